@@ -0,0 +1,128 @@
+/*
+ * adc.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef ADC_H_
+#define ADC_H_
+
+#include "stm32f4xx.h"
+#include "clock.h"
+#include "dma.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// Continuous sampling into blocks.
+//
+// The samples go to a pool of fixed size blocks owned by the caller. The
+// DMA runs in double buffer mode over two of them; when one is full the
+// stream goes on into the other, and the interrupt hands the full block
+// to the callback, without copying, and gives the stream a free block in
+// its place. The callback runs at a work queue level and owns the block
+// until it returns, so the processing of a block may take up to the time
+// of (blocks - 2) blocks without a sample being lost. Three blocks at the
+// least: the stream always holds two, so with two there would be none to
+// hand out. A block completed while no block is
+// free is dropped, never one that is handed out: it is counted by
+// adc_overruns(), and so are the conversions lost by the ADC itself when
+// the DMA did not keep up.
+//
+// ADC_MODE_SCAN converts a sequence of up to 16 channels on ADC1, once per
+// TIM8 update, 'rate_hz' times a second; a block holds whole scans, in
+// sequence order. ADC_MODE_TRIPLE interleaves ADC1, ADC2 and ADC3 on one
+// channel, back to back, for up to 3 * 1.4 MSPS at 21 MHz ADC clock; the
+// rate is the ADC clock over the delay between the ADCs, 5 to 20 cycles,
+// so 'rate_hz' only picks the closest delay.
+//
+// Uses TIM8 and DMA2 stream 4. Blocks must be DMA reachable, not in CCM
+// RAM (CARZOS_SRAM2).
+
+#define ADC_MODE_SCAN                   (0U)
+#define ADC_MODE_TRIPLE                 (1U)
+
+#define ADC_CHANNELS_MAX                (16U)
+#define ADC_BLOCKS_MAX                  (32U)
+
+// ADC clock limit
+#define ADC_CLOCK_MAX_HZ                (36000000U)
+
+typedef void (*adc_Callback)(void *arg, const uint16_t *block, uint32_t samples);
+
+typedef struct adc_config
+{
+	uint32_t mode;
+	// Channels 0 to 15 (on their pins), 16 temperature, 17 VREFINT; one
+	// of 0 to 3 or 10 to 13 in ADC_MODE_TRIPLE
+	const uint8_t *channels;
+	uint32_t nchannels;
+	uint32_t sample_time;           // ADC_SAMPLETIME_*
+	uint32_t rate_hz;
+
+	// 'blocks' (3 to ADC_BLOCKS_MAX) blocks of 'block_samples' samples,
+	// one after the other; whole scans, an even number in ADC_MODE_TRIPLE
+	uint16_t *buf;
+	uint32_t blocks;
+	uint32_t block_samples;
+
+	// NVIC priority of the ADC and DMA interrupts
+	uint32_t priority;
+	adc_Callback callback;
+	void *arg;
+	uint32_t level;
+} adc_Config;
+
+typedef struct adc_sampler
+{
+	uint32_t mode;
+	uint32_t nadcs;
+	// Rate asked for, and the closest one the clocks allow
+	uint32_t rate_hz;
+	uint32_t rate;
+	uint32_t sample_time;
+	dma_Stream dma;
+
+	uint16_t *buf;
+	uint32_t blocks;
+	uint32_t block_samples;
+
+	// Blocks neither in the DMA nor handed out, one bit each
+	volatile uint32_t free;
+	// The blocks behind M0AR and M1AR
+	uint32_t target[2];
+	// Full blocks, in order, for the work item
+	uint8_t ready[ADC_BLOCKS_MAX];
+	volatile uint32_t ready_in;
+	volatile uint32_t ready_out;
+
+	volatile uint32_t running;
+	volatile uint32_t overruns;
+
+	adc_Callback callback;
+	void *arg;
+	workq_Item work;
+	clock_Listener clock;
+} adc_Sampler;
+
+// ----------------------------------------------------------------------------
+
+// Sets the ADCs, the timer and the stream up; sampling starts with
+// adc_start().
+extern uint32_t adc_init(adc_Sampler *adc, const adc_Config *config);
+
+extern uint32_t adc_start(adc_Sampler *adc);
+
+// The blocks handed out stay with the callback; the one being filled is
+// discarded.
+extern void adc_stop(adc_Sampler *adc);
+
+// Samples per second as set, per channel in ADC_MODE_SCAN.
+extern uint32_t adc_rate(const adc_Sampler *adc);
+
+extern uint32_t adc_overruns(const adc_Sampler *adc);
+
+// ----------------------------------------------------------------------------
+
+#endif // ADC_H_
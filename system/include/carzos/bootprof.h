@@ -0,0 +1,76 @@
+/*
+ * bootprof.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef BOOTPROF_H_
+#define BOOTPROF_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Boot time trace.
+//
+// _start() and __hardware_init() stamp the DWT cycle counter at the end of
+// each startup stage into a .noinit buffer, which the data and bss
+// initialisation leave alone, so the trace is intact when main() runs.
+// The counter is zeroed by the first stamp, right after reset.
+//
+// The core clock changes during clock_init(), so every entry also
+// records the core frequency at the time of the stamp, taken from the RCC
+// registers (SystemCoreClock is not valid before the RAM is initialised).
+//
+// The .data and .bss stages also record how many words they moved, so
+// that bootprof_report() gives their cost in cycles per word. Building
+// with CARZOS_BOOT_WORD_LOOP puts back the plain word loops in _start()
+// in place of the LDM/STM bursts, to compare the two on the same board.
+
+typedef enum bootprof_stage
+{
+	BOOTPROF_RESET = 0,   // entry of _start()
+	BOOTPROF_EARLY,       // __hardware_init_early() done
+	BOOTPROF_DATA,        // .data regions copied
+	BOOTPROF_BSS,         // .bss regions cleared
+	BOOTPROF_HAL,         // HAL_Init() done
+	BOOTPROF_CLOCK,       // clock_init() done (HSE/PLL locked, tick on)
+	BOOTPROF_HARDWARE,    // __hardware_init() done
+	BOOTPROF_MAIN,        // about to call main()
+	BOOTPROF_STAGES
+} bootprof_Stage;
+
+typedef struct bootprof_entry
+{
+	uint32_t cycles;
+	uint32_t hz;
+	uint32_t words;       // moved by the stage (.data, .bss), else 0
+} bootprof_Entry;
+
+// ----------------------------------------------------------------------------
+
+// Zeroes and starts the cycle counter and records BOOTPROF_RESET.
+extern void bootprof_start(void);
+
+extern void bootprof_stamp(bootprof_Stage stage);
+
+// bootprof_stamp() for a stage that moved 'words' words.
+extern void bootprof_stamp_words(bootprof_Stage stage, uint32_t words);
+
+// Returns the trace, BOOTPROF_STAGES entries; stages not reached have
+// zero cycles.
+extern const bootprof_Entry *bootprof_get(void);
+
+// Time from reset to the stamp of 'stage', in microseconds; each interval
+// is converted with the clock at its start, since the long waits (HSE and
+// PLL lock) happen before the switch to the new clock.
+extern uint32_t bootprof_us(bootprof_Stage stage);
+
+// Prints the trace with trace_printf(): per stage its cycles, the time
+// since reset and, for .data and .bss, the cycles per word (in 1/100).
+extern void bootprof_report(void);
+
+// ----------------------------------------------------------------------------
+
+#endif // BOOTPROF_H_
@@ -0,0 +1,116 @@
+/*
+ * can.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef CAN_H_
+#define CAN_H_
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+
+// bxCAN driver.
+//
+// Receive: each FIFO interrupt takes every frame pending in its FIFO, not
+// one, into the caller's ring, and the ring is read with can_receive()
+// (single reader), lock-free. A callback at a work queue level, when
+// given, is told that frames are in. Frames lost because the ring or a
+// hardware FIFO was full are counted by can_overruns().
+//
+// Filters: can_filter_add() takes an ID and a mask and packs them into
+// the hardware filter banks itself, four exact standard IDs, two masked
+// standard IDs, two exact extended IDs or one masked extended ID to a
+// bank, so the hardware drops what is not asked for. Until the first
+// filter is added everything is accepted. Exact IDs (a full mask) take
+// data frames only; remote frames need a masked filter.
+//
+// Transmit: frames go to a queue kept in CAN priority order (the ID, then
+// standard before extended, then data before remote), from which all
+// three mailboxes are kept loaded; the hardware sends the highest
+// priority mailbox first. Equal IDs go out in mailbox number order, so a
+// frame waits in the queue while one of its ID is in a mailbox. A frame
+// that beats every loaded mailbox aborts the lowest one, which goes back
+// to the queue, so a burst of low priority frames cannot hold a high
+// priority one back.
+//
+// CAN_BUS_LOOPBACK loops the transmitter to the receiver inside the
+// controller and keeps off the bus. tools/can_loop.c implements this
+// interface on Linux, with the instances on one simulated bus, for
+// testing without a board. Only this header is shared with the host
+// stand-in, so it does not include the device headers.
+//
+// CAN2 works through the filters of CAN1: CAN1 owns banks 0 to 13, CAN2
+// banks 14 to 27, and CAN1 is clocked whenever CAN2 is used.
+
+#define CAN_INSTANCES                   (2U)
+
+#define CAN_BUS_NORMAL                  (0U)
+#define CAN_BUS_LOOPBACK                (1U)
+
+// Set in can_Frame.id for a 29 bit ID
+#define CAN_EXT_ID                      (0x80000000U)
+#define CAN_STD_ID_MAX                  (0x7FFU)
+#define CAN_EXT_ID_MAX                  (0x1FFFFFFFU)
+
+#define CAN_BANKS                       (14U)           // per instance
+
+// Frames waiting for a mailbox, per instance
+#if !defined(CAN_TX_QUEUE)
+#define CAN_TX_QUEUE                    (16U)
+#endif
+
+typedef struct can_frame
+{
+	uint32_t id;
+	uint8_t len;
+	uint8_t rtr;
+	uint8_t data[8];
+} can_Frame;
+
+typedef void (*can_Callback)(void *arg, uint32_t instance);
+
+typedef struct can_config
+{
+	uint32_t mode;
+	uint32_t bitrate;
+	uint32_t tx_pin;                // PIN()
+	uint32_t rx_pin;
+	// A power of two frames
+	can_Frame *ring;
+	uint32_t ring_len;
+	// NVIC priority of the CAN interrupts
+	uint32_t priority;
+	// Optional; run at the work queue level 'level'
+	can_Callback callback;
+	void *arg;
+	uint32_t level;
+} can_Config;
+
+// ----------------------------------------------------------------------------
+
+// 'instance' is the CAN number, 1 or 2. Fails when the bit rate cannot be
+// made exactly from the APB1 clock. When a later clock change leaves no
+// exact bit timing, the controller stays off the bus (in init mode) until
+// a change makes one again.
+extern uint32_t can_init(uint32_t instance, const can_Config *config);
+
+// Accepts the IDs 'id' matches on the bits set in 'mask' (CAN_EXT_ID in
+// 'id' for extended ones), into FIFO 'fifo', 0 or 1. Fails when the banks
+// are used up.
+extern uint32_t can_filter_add(uint32_t instance, uint32_t id, uint32_t mask, uint32_t fifo);
+
+// Queues a frame; fails when the queue is full, or while the controller
+// is off the bus for want of a bit timing.
+extern uint32_t can_send(uint32_t instance, const can_Frame *frame);
+
+// Takes the oldest received frame; fails when there is none.
+extern uint32_t can_receive(uint32_t instance, can_Frame *frame);
+
+extern uint32_t can_overruns(uint32_t instance);
+
+// ----------------------------------------------------------------------------
+
+#endif // CAN_H_
@@ -0,0 +1,118 @@
+/*
+ * clock.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// System clock bring-up.
+//
+// The board descriptor says which oscillator the board has and which core
+// frequency to run at; the PLL, bus prescalers, flash latency and
+// regulator scale are derived from it, so nothing here needs to be edited
+// per board. The PLL input is the oscillator divided exactly down to 1 to
+// 2 MHz; a crystal with no such divider (not a whole number of MHz) is
+// not used for the PLL, the HSI is. SystemCoreClock is computed with the
+// descriptor's HSE frequency, not HSE_VALUE.
+//
+// Bring-up is split in two so that it overlaps the RAM initialisation:
+// clock_start() runs from __hardware_init_early() and only turns the HSE
+// on; clock_init() runs from __hardware_init(), waits for it (falling back
+// to the HSI if it does not start), locks the PLL and switches to it, then
+// starts the system tick, once, at the final frequency. After a warm
+// restart (restart.h) it keeps the clock of the last run, whatever
+// clock_set() made of it, and only starts the tick.
+//
+// clock_set() changes the core frequency at run time. Above 12.5 MHz the
+// PLL makes it; below, the oscillator is used directly, divided on AHB,
+// and the PLL is turned off (no USB then). The APB prescalers, flash
+// latency and regulator scale follow. Drivers whose timings derive from a
+// bus clock register a listener: it is called with CLOCK_EVENT_PRE before
+// the change, interrupts enabled, to let transfers in flight finish, and
+// with CLOCK_EVENT_POST right after, interrupts masked, to set their
+// dividers again from clock_pclk1() and friends. The system tick is one
+// of them.
+
+#define CLOCK_MAX_HZ                    (168000000U)
+
+typedef struct clock_board
+{
+	// Frequency on OSC_IN, a multiple of 2 MHz; 0 when there is no HSE
+	uint32_t hse_hz;
+	// Non zero for an external clock signal instead of a crystal
+	uint32_t hse_bypass;
+	// Core (and AHB) frequency to run at, at most 168 MHz
+	uint32_t sysclk_hz;
+} clock_Board;
+
+typedef enum clock_source
+{
+	CLOCK_SOURCE_HSI = 0,
+	CLOCK_SOURCE_HSE
+} clock_Source;
+
+typedef enum clock_event
+{
+	CLOCK_EVENT_PRE = 0,
+	CLOCK_EVENT_POST
+} clock_Event;
+
+typedef void (*clock_Callback)(void *arg, clock_Event event);
+
+typedef struct clock_listener
+{
+	clock_Callback fn;
+	void *arg;
+	struct clock_listener *next;
+} clock_Listener;
+
+// The descriptor of this board. The default (weak) one takes HSE_VALUE
+// from the build settings and runs at 168 MHz; define it in the
+// application to override.
+extern const clock_Board clock_board;
+
+// ----------------------------------------------------------------------------
+
+extern void clock_start(void);
+
+extern void clock_init(void);
+
+// Sets the core (and AHB) frequency to the closest one not above
+// 'hclk_hz' that the oscillator allows and returns it; 0, the clock
+// unchanged, when out of range (below the oscillator over 16, 1 MHz on
+// the HSI). Thread mode only.
+extern uint32_t clock_set(uint32_t hclk_hz);
+
+// 'listener' is owned by the caller and must stay valid until removed.
+extern void clock_listen(clock_Listener *listener, clock_Callback fn, void *arg);
+
+extern void clock_unlisten(clock_Listener *listener);
+
+// The oscillator feeding the PLL (or the core, below 12.5 MHz).
+extern clock_Source clock_source(void);
+
+// Bus and timer kernel clocks, as set now.
+extern uint32_t clock_hclk(void);
+
+extern uint32_t clock_pclk1(void);
+
+extern uint32_t clock_pclk2(void);
+
+extern uint32_t clock_timclk1(void);
+
+extern uint32_t clock_timclk2(void);
+
+// The PLL's 48 MHz output (USB, SDIO, RNG), as set now; 0 with the PLL
+// off.
+extern uint32_t clock_pll48(void);
+
+// ----------------------------------------------------------------------------
+
+#endif // CLOCK_H_
@@ -0,0 +1,68 @@
+/*
+ * cpuload.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef CPULOAD_H_
+#define CPULOAD_H_
+
+#include "stm32f4xx.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// CPU load and per context runtime accounting.
+//
+// The execution contexts of carzos are the main program and the deferred
+// work levels; the work queue switches the accounted context when a level
+// starts and finishes draining, and the DWT cycle counter is sampled at
+// each switch. Interrupt handlers are charged to the context they
+// interrupted (see irqprof.h for per interrupt figures).
+//
+// Idle time is the time spent in cpuload_idle(). The cycle counter stops
+// while the core sleeps, so it is measured on the SysTick counter, which
+// runs on in Sleep mode, from a stamp at entry and one at exit; the
+// debug clock stays off. Once a second (counted by cpuload_tick() from
+// the 1 kHz system tick) the idle cycles of the last second are stored,
+// which gives the load over 1, 10 and 60 s windows.
+//
+// The cost is a few loads and stores per switch, per sleep and per tick,
+// so the accounting is always on.
+
+#define CPULOAD_CTX_MAIN                (0U)
+#define CPULOAD_CTX_WORKQ(_level)       (1U + (_level))
+#define CPULOAD_CONTEXTS                (1U + WORKQ_LEVELS)
+
+#define CPULOAD_HISTORY_S               (60U)
+
+// ----------------------------------------------------------------------------
+
+extern void cpuload_init(void);
+
+// Charges the cycles since the last switch to the current context and
+// makes 'ctx' current; returns the previous context.
+extern uint32_t cpuload_switch(uint32_t ctx);
+
+// Sleeps until the next interrupt and counts the time as idle.
+// Must be called with interrupts masked (PRIMASK set); returns with them
+// still masked, the caller unmasks to let the interrupt run.
+extern void cpuload_idle(void);
+
+// The context running now (CPULOAD_CTX_*).
+extern uint32_t cpuload_context(void);
+
+// Called from the system tick handler at TIMER_FREQUENCY_HZ.
+extern void cpuload_tick(void);
+
+// Accumulated cycles of a context, and of idle.
+extern uint64_t cpuload_runtime(uint32_t ctx);
+extern uint64_t cpuload_idle_cycles(void);
+
+// Load in permille averaged over the last 'seconds' (1..60) seconds.
+extern uint32_t cpuload_get(uint32_t seconds);
+
+// ----------------------------------------------------------------------------
+
+#endif // CPULOAD_H_
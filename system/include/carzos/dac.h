@@ -0,0 +1,103 @@
+/*
+ * dac.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef DAC_H_
+#define DAC_H_
+
+#include "stm32f4xx.h"
+#include "clock.h"
+#include "dma.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// Waveform streaming on the DAC.
+//
+// TIM6 triggers a conversion 'rate_hz' times a second and the DMA feeds
+// the DAC from a circular buffer of two halves, without the CPU. When the
+// DMA passes from one half to the other, the half it left is due: the
+// refill callback runs at a work queue level and writes the next
+// 'half_frames' frames into it while the other half plays. A half that
+// comes due again before its refill is done is played again as it was;
+// that is counted by dac_underruns(), and so is a DAC DMA underrun (a
+// trigger before the DMA served the last one), after which the stream
+// starts over at the first half.
+//
+// DAC_OUT_BOTH drives both channels from one stream through the dual
+// holding register, so they change on the same trigger; a frame is then
+// two samples, channel 1 first. Samples are 12 bits, right aligned.
+//
+// Channel 1 is on PA4, channel 2 on PA5. DAC_OUT_1 and DAC_OUT_BOTH use
+// DMA1 stream 5, DAC_OUT_2 stream 6: the USART2 RX and TX streams, do not
+// use both.
+// The buffer must be DMA reachable, not in CCM RAM (CARZOS_SRAM2).
+
+#define DAC_OUT_1                       (1U)
+#define DAC_OUT_2                       (2U)
+#define DAC_OUT_BOTH                    (3U)
+
+#define DAC_SAMPLE_MAX                  (0xFFFU)
+
+typedef void (*dac_Callback)(void *arg, uint16_t *half, uint32_t frames);
+
+typedef struct dac_config
+{
+	uint32_t out;
+	uint32_t rate_hz;
+	// Two halves of 'half_frames' frames, one after the other
+	uint16_t *buf;
+	uint32_t half_frames;
+	// NVIC priority of the DMA and DAC interrupts
+	uint32_t priority;
+	dac_Callback callback;
+	void *arg;
+	uint32_t level;
+} dac_Config;
+
+typedef struct dac_stream
+{
+	uint32_t out;
+	uint32_t channels;
+	uint32_t rate_hz;
+	uint32_t rate;
+	dma_Stream dma;
+
+	uint16_t *buf;
+	uint32_t half_frames;
+
+	// Halves due for refill, one bit each, and the one to refill next
+	volatile uint32_t due;
+	uint32_t next;
+
+	volatile uint32_t running;
+	volatile uint32_t underruns;
+
+	dac_Callback callback;
+	void *arg;
+	workq_Item work;
+	clock_Listener clock;
+} dac_Stream;
+
+// ----------------------------------------------------------------------------
+
+// Sets the DAC, TIM6 and the stream up; the output starts with dac_start().
+extern uint32_t dac_init(dac_Stream *dac, const dac_Config *config);
+
+// Has the callback fill both halves, in the calling context, then starts.
+extern uint32_t dac_start(dac_Stream *dac);
+
+// The outputs keep the last sample.
+extern void dac_stop(dac_Stream *dac);
+
+// Frames per second as set, the closest to rate_hz the timer allows.
+extern uint32_t dac_rate(const dac_Stream *dac);
+
+extern uint32_t dac_underruns(const dac_Stream *dac);
+
+// ----------------------------------------------------------------------------
+
+#endif // DAC_H_
@@ -0,0 +1,67 @@
+/*
+ * dma.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef DMA_H_
+#define DMA_H_
+
+#include "stm32f4xx.h"
+#include "irq.h"
+
+// ----------------------------------------------------------------------------
+
+// DMA stream helpers shared by the drivers.
+//
+// A driver owns its streams: it programs CR, PAR, M0AR and NDTR itself.
+// dma_stream_init() powers the controller, stops the stream and attaches
+// the stream interrupt; dma_take() reads and clears the stream flags, which
+// are spread over LISR/HISR in 6 bit groups, as one DMA_FLAG_* set.
+//
+// Memory on DMA1/DMA2 must be SRAM1, SRAM2 or flash: the CCM RAM is not
+// on the bus matrix (CARZOS_SRAM2 is the place for buffers).
+
+#define DMA_FLAG_FE                     (0x01U)
+#define DMA_FLAG_DME                    (0x04U)
+#define DMA_FLAG_TE                     (0x08U)
+#define DMA_FLAG_HT                     (0x10U)
+#define DMA_FLAG_TC                     (0x20U)
+#define DMA_FLAG_ALL                    (0x3DU)
+
+// CR fields (this CMSIS version has no _Pos definitions)
+#define DMA_CR_CHSEL_SHIFT              (25U)
+#define DMA_CR_PL_SHIFT                 (16U)
+#define DMA_CR_DIR_P2M                  (0U)
+#define DMA_CR_DIR_M2P                  (DMA_SxCR_DIR_0)
+#define DMA_CR_DIR_M2M                  (DMA_SxCR_DIR_1)
+
+typedef struct dma_stream
+{
+	DMA_Stream_TypeDef *regs;
+	volatile uint32_t *isr;
+	volatile uint32_t *ifcr;
+	uint32_t shift;
+	IRQn_Type irqn;
+} dma_Stream;
+
+// ----------------------------------------------------------------------------
+
+// 'controller' 1 or 2, 'stream' 0 to 7. The handler runs at 'priority'.
+extern uint32_t dma_stream_init(dma_Stream *stream, uint32_t controller,
+		uint32_t index, irq_Handler handler, void *ctx, uint32_t priority);
+
+// Disables the stream, waits until it has stopped, clears its flags.
+extern void dma_stop(const dma_Stream *stream);
+
+static inline __attribute__((always_inline)) uint32_t dma_take(const dma_Stream *stream)
+{
+	uint32_t flags = (*stream->isr >> stream->shift) & DMA_FLAG_ALL;
+	*stream->ifcr = flags << stream->shift;
+	return flags;
+}
+
+// ----------------------------------------------------------------------------
+
+#endif // DMA_H_
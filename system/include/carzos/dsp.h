@@ -0,0 +1,178 @@
+/*
+ * dsp.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+
+// Signal processing kernels: FIR, biquad cascade, radix-2 FFT, moving
+// average.
+//
+// The q15 kernels work on two samples per instruction with the Cortex-M4
+// SIMD instructions (SMLALD, SMUAD, SHADD16, QADD16...), the q31 ones
+// accumulate with SMLAL into 64 bits, and the f32 ones are plain float C
+// that the compiler turns into FPU instructions (the project builds with
+// -mfloat-abi=hard). Off target the SIMD instructions are replaced by C
+// with the same results, so the kernels also build on the host, where
+// tools/dsp_bench.c checks them against scalar references.
+//
+// Layouts follow CMSIS-DSP (arm_math.h): FIR coefficients are in time
+// reversed order (coeffs[taps - 1] multiplies the newest sample), biquad
+// stages are { b0, b1, b2, a1, a2 } with
+//   y = b0 x[n] + b1 x[n-1] + b2 x[n-2] + a1 y[n-1] + a2 y[n-2]
+// (a1 and a2 negated from the usual form), and q15 stages are padded to
+// { b0, 0, b1, b2, a1, a2 } for pair loads. Fixed point results are
+// truncated, then saturated; the instances and buffers belong to the
+// caller. Sample buffers may be at any 16-bit boundary.
+
+#define DSP_FFT_MIN                     (16U)
+#define DSP_FFT_MAX                     (4096U)
+
+typedef struct dsp_fir_q15
+{
+	const int16_t *coeffs;
+	// taps - 1 + block samples: the history, then the block being filtered
+	int16_t *state;
+	uint32_t taps;
+	uint32_t block;
+} dsp_FirQ15;
+
+typedef struct dsp_fir_q31
+{
+	const int32_t *coeffs;
+	int32_t *state;
+	uint32_t taps;
+	uint32_t block;
+} dsp_FirQ31;
+
+typedef struct dsp_fir_f32
+{
+	const float *coeffs;
+	float *state;
+	uint32_t taps;
+	uint32_t block;
+} dsp_FirF32;
+
+typedef struct dsp_biquad_q15
+{
+	// 6 per stage, Q15 scaled down by 2^shift
+	const int16_t *coeffs;
+	// 4 per stage: x[n-1], x[n-2], y[n-1], y[n-2]
+	int16_t *state;
+	uint32_t stages;
+	uint32_t shift;
+} dsp_BiquadQ15;
+
+typedef struct dsp_biquad_q31
+{
+	// 5 per stage, Q31 scaled down by 2^shift
+	const int32_t *coeffs;
+	int32_t *state;
+	uint32_t stages;
+	uint32_t shift;
+} dsp_BiquadQ31;
+
+typedef struct dsp_biquad_f32
+{
+	const float *coeffs;
+	// 2 per stage (transposed direct form II)
+	float *state;
+	uint32_t stages;
+} dsp_BiquadF32;
+
+typedef struct dsp_fft_q15
+{
+	uint32_t n;
+	// n / 2 words, cos in the low half, sin in the high half
+	uint32_t *twiddle;
+} dsp_FftQ15;
+
+typedef struct dsp_fft_f32
+{
+	uint32_t n;
+	// n / 2 cos, sin pairs
+	float *twiddle;
+} dsp_FftF32;
+
+typedef struct dsp_average_q15
+{
+	// 2^shift samples
+	int16_t *window;
+	uint32_t shift;
+	uint32_t pos;
+	int32_t sum;
+} dsp_AverageQ15;
+
+typedef struct dsp_average_f32
+{
+	float *window;
+	uint32_t len;
+	uint32_t pos;
+	float sum;
+	float scale;
+} dsp_AverageF32;
+
+// ----------------------------------------------------------------------------
+
+// FIR filters. A call filters up to 'block' samples; 'state' holds
+// taps - 1 + block samples. q15 accumulates 64 bits and gives
+// (sum >> 15); q31 gives (sum >> 31) and has no guard bit, so its input
+// should be scaled down by log2(taps) bits.
+extern uint32_t dsp_fir_q15_init(dsp_FirQ15 *fir, const int16_t *coeffs, uint32_t taps,
+		int16_t *state, uint32_t block);
+extern void dsp_fir_q15(dsp_FirQ15 *fir, const int16_t *in, int16_t *out, uint32_t n);
+
+extern uint32_t dsp_fir_q31_init(dsp_FirQ31 *fir, const int32_t *coeffs, uint32_t taps,
+		int32_t *state, uint32_t block);
+extern void dsp_fir_q31(dsp_FirQ31 *fir, const int32_t *in, int32_t *out, uint32_t n);
+
+extern uint32_t dsp_fir_f32_init(dsp_FirF32 *fir, const float *coeffs, uint32_t taps,
+		float *state, uint32_t block);
+extern void dsp_fir_f32(dsp_FirF32 *fir, const float *in, float *out, uint32_t n);
+
+// Biquad cascades; 'shift' (0 to 15, 0 to 31) is the headroom taken out
+// of the coefficients and put back on each stage output.
+extern uint32_t dsp_biquad_q15_init(dsp_BiquadQ15 *iir, const int16_t *coeffs,
+		uint32_t stages, int16_t *state, uint32_t shift);
+extern void dsp_biquad_q15(dsp_BiquadQ15 *iir, const int16_t *in, int16_t *out, uint32_t n);
+
+extern uint32_t dsp_biquad_q31_init(dsp_BiquadQ31 *iir, const int32_t *coeffs,
+		uint32_t stages, int32_t *state, uint32_t shift);
+extern void dsp_biquad_q31(dsp_BiquadQ31 *iir, const int32_t *in, int32_t *out, uint32_t n);
+
+extern uint32_t dsp_biquad_f32_init(dsp_BiquadF32 *iir, const float *coeffs,
+		uint32_t stages, float *state);
+extern void dsp_biquad_f32(dsp_BiquadF32 *iir, const float *in, float *out, uint32_t n);
+
+// Forward complex FFT in place, 'n' a power of two from DSP_FFT_MIN to
+// DSP_FFT_MAX, samples interleaved re, im, output in natural order. The
+// q15 one halves every stage, so its output is the transform over n.
+extern uint32_t dsp_fft_q15_init(dsp_FftQ15 *fft, uint32_t n, uint32_t *twiddle);
+extern void dsp_fft_q15(const dsp_FftQ15 *fft, int16_t *buf);
+
+extern uint32_t dsp_fft_f32_init(dsp_FftF32 *fft, uint32_t n, float *twiddle);
+extern void dsp_fft_f32(const dsp_FftF32 *fft, float *buf);
+
+// Moving averages over the last window samples, O(1) per sample; the
+// window starts out as zeros. q15 windows are a power of two long and
+// the result is rounded down; the f32 running sum is summed again from
+// the window once per window length, so rounding errors do not build up.
+extern uint32_t dsp_average_q15_init(dsp_AverageQ15 *avg, int16_t *window, uint32_t shift);
+extern void dsp_average_q15(dsp_AverageQ15 *avg, const int16_t *in, int16_t *out, uint32_t n);
+
+extern uint32_t dsp_average_f32_init(dsp_AverageF32 *avg, float *window, uint32_t len);
+extern void dsp_average_f32(dsp_AverageF32 *avg, const float *in, float *out, uint32_t n);
+
+// Saturating out = a + b, two samples per instruction.
+extern void dsp_add_q15(const int16_t *a, const int16_t *b, int16_t *out, uint32_t n);
+
+// ----------------------------------------------------------------------------
+
+#endif // DSP_H_
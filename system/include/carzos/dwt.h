@@ -0,0 +1,52 @@
+/*
+ * dwt.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef DWT_H_
+#define DWT_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// DWT cycle counter, the common time base of the profiling code.
+// It counts core clocks and wraps every 2^32 cycles (~25 s at 168 MHz),
+// so only differences are meaningful.
+
+typedef uint32_t dwt_cycles_t;
+
+// ----------------------------------------------------------------------------
+
+inline void
+dwt_init(void);
+
+inline dwt_cycles_t
+dwt_cycles(void);
+
+// ----------------------------------------------------------------------------
+
+inline void
+__attribute__((always_inline))
+dwt_init(void)
+{
+  if ((DWT->CTRL & DWT_CTRL_CYCCNTENA_Msk) == 0U)
+    {
+      CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+      DWT->CYCCNT = 0U;
+      DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    }
+}
+
+inline dwt_cycles_t
+__attribute__((always_inline))
+dwt_cycles(void)
+{
+  return DWT->CYCCNT;
+}
+
+// ----------------------------------------------------------------------------
+
+#endif // DWT_H_
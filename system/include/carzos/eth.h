@@ -0,0 +1,122 @@
+/*
+ * eth.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef ETH_H_
+#define ETH_H_
+
+#include <stdint.h>
+
+#include "pkt.h"
+
+// ----------------------------------------------------------------------------
+
+// Ethernet MAC driver, without copies.
+//
+// Receive: each RX descriptor points at a buffer of the caller's pool and
+// the DMA writes the frame straight into it. The buffer goes to the
+// callback as it is and a fresh one from the pool takes its place in the
+// ring. When the pool is empty the frame is dropped and its buffer stays
+// in the ring, so the ring never runs out of buffers. The callback owns
+// the frames it gets and gives them back with pkt_free().
+//
+// Transmit: eth_send() takes a chain and points one TX descriptor at each
+// buffer of it, so headers in a pool buffer and a payload in caller memory
+// (pkt_ref()) go out as one frame without being put together first. Once
+// sent, the chain goes to tx_done, or to pkt_free() without one.
+//
+// Interrupts are coalesced: the interrupt masks the receive and transmit
+// interrupts and posts the work item, which takes every frame received
+// and reclaims every frame sent since, then unmasks them. Under load that
+// is one interrupt per batch of frames rather than one per frame.
+//
+// Checksums are offloaded: the MAC inserts the IPv4 header checksum and
+// the TCP, UDP and ICMP checksums (pseudo header included) of the frames
+// sent, whatever the fields hold. It drops received frames with a bad one
+// and marks those it checked with PKT_CSUM_OK.
+//
+// eth_link() reads the PHY, standard registers only, and sets the MAC to
+// the negotiated speed and duplex; call it now and then (e.g. each 500
+// ms) to follow the link.
+//
+// RMII, on the pins of the DP83848 and LAN8720 boards: PA1 REF_CLK, PA2
+// MDIO, PA7 CRS_DV, PC1 MDC, PC4 RXD0, PC5 RXD1, PB11 TX_EN, PB12 TXD0,
+// PB13 TXD1. The descriptor rings are in SRAM2, ETH_RX_RING and
+// ETH_TX_RING descriptors long; a TX descriptor holds one buffer of a
+// chain. HCLK must stay at 25 MHz or more. Pool memory must be DMA
+// reachable, not in CCM RAM.
+//
+// tools/eth_tap.c is the same interface on Linux, for host builds.
+
+#if !defined(ETH_RX_RING)
+#define ETH_RX_RING                     (16U)
+#endif
+#if !defined(ETH_TX_RING)
+#define ETH_TX_RING                     (32U)
+#endif
+
+// Frame without the CRC, VLAN tagged
+#define ETH_FRAME_MAX                   (1518U)
+
+// Least pool buffer size for receiving
+#define ETH_POOL_BUF_MIN                (1536U)
+
+// Finds the PHY on the MDIO bus
+#define ETH_PHY_ANY                     (0xFFU)
+
+#define ETH_LINK_DOWN                   (0U)
+#define ETH_LINK_10_HALF                (1U)
+#define ETH_LINK_10_FULL                (2U)
+#define ETH_LINK_100_HALF               (3U)
+#define ETH_LINK_100_FULL               (4U)
+
+typedef void (*eth_Rx)(void *arg, pkt_Buf *frame);
+typedef void (*eth_TxDone)(void *arg, pkt_Buf *chain);
+
+typedef struct eth_config
+{
+	uint8_t mac[6];
+	uint32_t phy;                   // MDIO address 0 to 31, or ETH_PHY_ANY
+	// RX buffers, ETH_POOL_BUF_MIN bytes each at least
+	pkt_Pool *pool;
+	// NVIC priority of the Ethernet interrupt
+	uint32_t priority;
+	// Run at the work queue level 'level'; tx_done is optional
+	eth_Rx rx;
+	eth_TxDone tx_done;
+	void *arg;
+	uint32_t level;
+} eth_Config;
+
+typedef struct eth_stats
+{
+	uint32_t rx_frames;
+	uint32_t rx_errors;
+	uint32_t rx_dropped;            // pool empty
+	uint32_t rx_missed;             // ring full, counted by the MAC
+	uint32_t tx_frames;
+	uint32_t tx_errors;
+} eth_Stats;
+
+// ----------------------------------------------------------------------------
+
+// Sets the MAC, DMA and PHY up and fills the RX ring from the pool;
+// receiving and sending start at once, the link comes with negotiation.
+extern uint32_t eth_init(const eth_Config *config);
+
+// Queues the frame in 'chain', the Ethernet header in the first buffer,
+// without the CRC. Fails, and the chain stays with the caller, when the
+// TX ring has no room for it.
+extern uint32_t eth_send(pkt_Buf *chain);
+
+// ETH_LINK_*.
+extern uint32_t eth_link(void);
+
+extern void eth_stats(eth_Stats *stats);
+
+// ----------------------------------------------------------------------------
+
+#endif // ETH_H_
@@ -0,0 +1,84 @@
+/*
+ * fault.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef FAULT_H_
+#define FAULT_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Fault capture.
+//
+// The HardFault, MemManage, BusFault and UsageFault handlers switch to a
+// small stack of their own (the fault may be a main stack overflow), store
+// a fault_Record in .noinit and reset the system at once. The record
+// survives the reset and is read back with fault_last() on the next boot,
+// or pulled with the debugger and decoded against the ELF by
+// tools/crashdump.py.
+//
+// The stack walk is a scan: the words above the exception frame, up to the
+// top of the main stack, that are Thumb addresses in code right after a
+// BL or BLX. Stale return addresses left on the stack also pass, so read
+// it as "recently called from", innermost first.
+
+#define FAULT_MAGIC                     (0x46415554U)   // "FAUT"
+#define FAULT_WALK_DEPTH                (8U)
+#define FAULT_SCAN_WORDS                (256U)
+#define FAULT_STACK_WORDS               (128U)
+
+// The exception numbers
+typedef enum fault_type
+{
+	FAULT_HARD = 3,
+	FAULT_MEMMANAGE = 4,
+	FAULT_BUS = 5,
+	FAULT_USAGE = 6
+} fault_Type;
+
+// Layout known to tools/crashdump.py; append only.
+typedef struct fault_record
+{
+	uint32_t magic;
+	// Faults in a row, without a cold boot or fault_clear() in between
+	uint32_t count;
+	uint32_t type;
+	// Exception frame
+	uint32_t r0;
+	uint32_t r1;
+	uint32_t r2;
+	uint32_t r3;
+	uint32_t r12;
+	uint32_t lr;
+	uint32_t pc;
+	uint32_t psr;
+	uint32_t exc_return;
+	// Stack pointer before the exception
+	uint32_t sp;
+	uint32_t cfsr;
+	uint32_t hfsr;
+	uint32_t mmfar;
+	uint32_t bfar;
+	// CPULOAD_CTX_* running; psr has the interrupt number if any
+	uint32_t context;
+	uint32_t ticks;
+	uint32_t depth;
+	uint32_t walk[FAULT_WALK_DEPTH];
+	// Complement of the sum of the words above
+	uint32_t check;
+} fault_Record;
+
+// ----------------------------------------------------------------------------
+
+// The record left by the previous run, NULL if there is none.
+extern const fault_Record *fault_last(void);
+
+extern void fault_clear(void);
+
+// ----------------------------------------------------------------------------
+
+#endif // FAULT_H_
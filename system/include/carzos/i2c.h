@@ -0,0 +1,136 @@
+/*
+ * i2c.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef I2C_H_
+#define I2C_H_
+
+#include "stm32f4xx.h"
+#include "clock.h"
+#include "dma.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// I2C master on interrupts and DMA.
+//
+// A transaction is one unit on the bus: an optional write (the register
+// address, typically) followed by an optional read, with a repeated start
+// in between. Transactions are queued per bus and run from the event
+// interrupt; the bytes written go out on TXE interrupts, reads of two bytes
+// or more on the RX DMA stream, so a register read costs about six short
+// interrupts whatever its length. When another transaction is queued the
+// bus is not released: the next one follows with a repeated start.
+//
+// Each transaction may have a completion callback, run at the work queue
+// level of the bus, in submission order. Queue the reads of one sample
+// (several registers, several sensors) together and put the callback on
+// the last one only: the whole batch then costs a single wakeup.
+//
+// A bus found busy before a start (a slave holding SDA low after a reset
+// in the middle of a read) is recovered: up to nine clocks are bit banged
+// on SCL until SDA is released, then a stop, and the peripheral is reset.
+// Arbitration loss and bus errors are recovered the same way, and so is a
+// transaction that does not end in time; the F4 I2C has no timeout of its
+// own, i2c_watchdog() provides it. A recovered or refused (NACK)
+// transaction completes with ERR_GENERIC; the queue goes on.
+//
+// The bus timing follows clock_set(); APB1 must stay at 2 MHz or more.
+// The lines need external pull-ups. Read buffers must be DMA reachable
+// (not in CCM RAM).
+
+#define I2C_HZ_STANDARD                 (100000U)
+#define I2C_HZ_FAST                     (400000U)
+
+// Longest a transaction may take; 255 bytes at 100 kHz is about 25 ms
+#define I2C_TIMEOUT_MS                  (50U)
+
+struct i2c_transfer;
+typedef void (*i2c_Callback)(void *arg, struct i2c_transfer *transfer);
+
+typedef struct i2c_config
+{
+	uint32_t scl_pin;               // PIN()
+	uint32_t sda_pin;
+	uint32_t speed_hz;              // up to I2C_HZ_FAST
+	// NVIC priority of the I2C and DMA interrupts
+	uint32_t priority;
+	// Work queue level of the completion callbacks
+	uint32_t level;
+} i2c_Config;
+
+typedef struct i2c_bus
+{
+	I2C_TypeDef *regs;
+	dma_Stream rx_dma;
+	uint32_t scl_pin;
+	uint32_t sda_pin;
+	uint32_t af;
+	uint32_t speed_hz;
+
+	struct i2c_transfer *volatile head;
+	struct i2c_transfer *tail;
+	// Completed, newest first, until the work item runs
+	struct i2c_transfer *volatile done;
+
+	// The transaction on the bus: phase, bytes written, start time
+	uint32_t phase;
+	uint32_t index;
+	uint32_t stamp;
+	// Non zero when a repeated start was issued for the next one
+	uint32_t chained;
+	volatile uint32_t active;
+	volatile uint32_t hold;
+
+	volatile uint32_t errors;
+	volatile uint32_t recoveries;
+
+	workq_Item work;
+	clock_Listener clock;
+} i2c_Bus;
+
+typedef struct i2c_transfer
+{
+	i2c_Bus *bus;
+	uint32_t addr;                  // 7 bit address
+	const uint8_t *wr;
+	uint32_t wr_len;                // 0 for a plain read
+	uint8_t *rd;
+	uint32_t rd_len;                // 0 for a plain write
+	i2c_Callback callback;          // optional
+	void *arg;
+	struct i2c_transfer *next;
+	// Non zero from i2c_submit() until completed (until the callback,
+	// when there is one)
+	volatile uint32_t busy;
+	uint32_t status;
+} i2c_Transfer;
+
+// ----------------------------------------------------------------------------
+
+// 'instance' is the I2C number, 1 to 3.
+extern uint32_t i2c_init(i2c_Bus *bus, uint32_t instance, const i2c_Config *config);
+
+// Queues the transaction; it and its buffers stay untouched until busy
+// clears.
+extern uint32_t i2c_submit(i2c_Transfer *transfer);
+
+// Runs one transaction and waits for it; returns its status.
+extern uint32_t i2c_transfer(i2c_Bus *bus, uint32_t addr, const uint8_t *wr,
+		uint32_t wr_len, uint8_t *rd, uint32_t rd_len);
+
+// Recovers the bus and fails the transaction in progress if it started
+// 'timeout_ms' ago or more; returns non zero when it did. Call it now and
+// then when only i2c_submit() is used.
+extern uint32_t i2c_watchdog(i2c_Bus *bus, uint32_t timeout_ms);
+
+extern uint32_t i2c_errors(const i2c_Bus *bus);
+
+extern uint32_t i2c_recoveries(const i2c_Bus *bus);
+
+// ----------------------------------------------------------------------------
+
+#endif // I2C_H_
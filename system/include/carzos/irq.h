@@ -0,0 +1,45 @@
+/*
+ * irq.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef IRQ_H_
+#define IRQ_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Runtime interrupt registration.
+//
+// irq_init() copies the flash vector table into SRAM1 and points VTOR at
+// the copy, so the link time handlers (the weak aliases in
+// vectors_stm32f407xx.c) stay in effect until a driver attaches its own.
+//
+// An attached handler gets its context pointer in r0: the vector points to
+// a four word thunk in RAM that loads the context and jumps to the handler,
+// so no table lookup happens on interrupt entry.
+
+// Cortex-M system exceptions in front of the peripheral vectors
+#define IRQ_SYSTEM_VECTORS              (16U)
+#define IRQ_COUNT                       ((uint32_t) FPU_IRQn + 1U)
+#define IRQ_VECTORS                     (IRQ_SYSTEM_VECTORS + IRQ_COUNT)
+
+typedef void (*irq_Handler)(void *ctx);
+
+// ----------------------------------------------------------------------------
+
+// Relocates the vector table to RAM; call once before any irq_attach().
+extern void irq_init(void);
+
+// Routes the interrupt to handler(ctx). The NVIC enable state is kept.
+extern uint32_t irq_attach(IRQn_Type irqn, irq_Handler handler, void *ctx);
+
+// Restores the link time handler of the interrupt.
+extern uint32_t irq_detach(IRQn_Type irqn);
+
+// ----------------------------------------------------------------------------
+
+#endif // IRQ_H_
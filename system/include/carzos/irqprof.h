@@ -0,0 +1,79 @@
+/*
+ * irqprof.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef IRQPROF_H_
+#define IRQPROF_H_
+
+#include "stm32f4xx.h"
+#include "irq.h"
+
+// ----------------------------------------------------------------------------
+
+// Interrupt duration and latency profiler, enabled by CARZOS_IRQ_PROFILE.
+//
+// With the profiler enabled, irq_init() and irq_attach() route every
+// peripheral interrupt through irqprof_dispatch(), which time stamps the
+// handler with the DWT cycle counter. Without it none of this is compiled
+// and the thunks jump straight to the handlers.
+//
+// Durations are self time: cycles spent in nested (higher priority)
+// profiled interrupts are subtracted from the interrupted one.
+//
+// Cost per interrupt: one extra thunk-to-dispatch call, two CYCCNT reads
+// and a fixed sequence of loads and stores on the slot, with no loops and
+// no locks; around 40 cycles on a Cortex-M4, plus the latency probe if
+// one is set.
+//
+// irqprof_table is plain RAM, so a debugger or the trace channel can read
+// it as is.
+
+// Returns the cycles elapsed since the hardware event that raised the
+// interrupt, derived from a peripheral time stamp (capture register,
+// timer counter, ...).
+typedef uint32_t (*irqprof_Probe)(void *ctx);
+
+typedef struct irqprof_stats
+{
+	uint32_t count;
+	uint32_t min;
+	uint32_t max;
+	uint64_t total;
+	uint32_t latency_max;
+	uint64_t latency_total;
+	uint32_t latency_count;
+} irqprof_Stats;
+
+// ----------------------------------------------------------------------------
+
+#if defined(CARZOS_IRQ_PROFILE)
+
+extern irqprof_Stats irqprof_table[IRQ_COUNT];
+
+// Used by irq.c: records the real handler and returns the dispatch context.
+extern void *irqprof_bind(IRQn_Type irqn, irq_Handler handler, void *ctx);
+
+extern void irqprof_dispatch(void *ctx);
+
+// Sets (or clears, with NULL) the entry latency probe of an interrupt.
+extern uint32_t irqprof_set_probe(IRQn_Type irqn, irqprof_Probe probe,
+		void *ctx);
+
+// Copies the statistics of one interrupt.
+extern uint32_t irqprof_get(IRQn_Type irqn, irqprof_Stats *stats);
+
+extern void irqprof_reset(void);
+
+#else
+
+#define irqprof_set_probe(irqn, probe, ctx)     (0U)
+#define irqprof_reset()                         ((void) 0)
+
+#endif // defined(CARZOS_IRQ_PROFILE)
+
+// ----------------------------------------------------------------------------
+
+#endif // IRQPROF_H_
@@ -0,0 +1,71 @@
+/*
+ * itm.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef ITM_H_
+#define ITM_H_
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+
+// ITM stimulus ports over SWO.
+//
+// Each of the 32 stimulus ports is a channel; a write is one ITM packet of
+// 1, 2 or 4 bytes. Writes never wait: when the ITM FIFO is full the value
+// is dropped and counted against its port. The ITM adds local timestamp
+// packets (core clock cycles, the DWT cycle counter clock) after the
+// packets they time, and the DWT sends periodic sync packets, so a capture
+// can be joined at any point.
+//
+// tools/swodump.py turns a captured SWO byte stream into events.
+// tools/itm_file.c implements this interface on Linux, writing the same
+// packets to a file, to check the encoding and the decoder without a
+// probe.
+//
+// Only this header is shared with the host stand-in, so it does not
+// include the device headers.
+
+#define ITM_PORTS                       (32U)
+
+// The trace_printf() output, see trace.h
+#if !defined(ITM_PORT_TRACE)
+#define ITM_PORT_TRACE                  (0U)
+#endif
+
+#if !defined(ITM_SWO_HZ)
+#define ITM_SWO_HZ                      (2000000U)
+#endif
+
+// ----------------------------------------------------------------------------
+
+// Sets the SWO pin to 'swo_hz' (NRZ), enables the ITM with timestamps and
+// the ports in 'ports' (bit mask). The SWO divider follows clock_set().
+extern uint32_t itm_init(uint32_t swo_hz, uint32_t ports);
+
+// Return 1 when the value was sent, 0 when it was dropped (FIFO full, or
+// port or ITM off, as when no debugger is attached and init was skipped).
+extern uint32_t itm_write8(uint32_t port, uint8_t value);
+extern uint32_t itm_write16(uint32_t port, uint16_t value);
+extern uint32_t itm_write32(uint32_t port, uint32_t value);
+
+// Sends 'len' bytes, as words and then the tail; returns the bytes sent.
+extern uint32_t itm_write(uint32_t port, const void *buf, uint32_t len);
+
+// Sends the DWT cycle count, an absolute time mark for the port.
+extern uint32_t itm_stamp(uint32_t port);
+
+// The SWO bit rate in use: the core clock over a whole divider, so near
+// swo_hz rather than equal to it, and the core clock itself when that is
+// below swo_hz. 0 before itm_init().
+extern uint32_t itm_swo_rate(void);
+
+// Values dropped on a port since itm_init().
+extern uint32_t itm_dropped(uint32_t port);
+
+// ----------------------------------------------------------------------------
+
+#endif // ITM_H_
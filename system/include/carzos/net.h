@@ -0,0 +1,169 @@
+/*
+ * net.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef NET_H_
+#define NET_H_
+
+#include <stdint.h>
+
+#include "eth.h"
+#include "pkt.h"
+
+// ----------------------------------------------------------------------------
+
+// TCP/IP stack: ARP, IPv4, ICMP echo, UDP and TCP on the eth.h interface.
+//
+// The network thread: the stack runs at the work queue level of the
+// Ethernet driver, from its receive callback, and is not locked, so
+// everything that calls into it (net_timer(), the UDP and TCP calls) must
+// run at that level too, e.g. from a work item posted to it. Its callbacks
+// run there as well.
+//
+// No copies on the way: a received frame stays in the pool buffer the
+// DMA wrote it to, and UDP and TCP hand it to their callbacks with 'data'
+// moved on to the payload; the callback owns it and gives it back with
+// pkt_free(). A buffer from net_alloc() leaves room for the headers in
+// front of the payload, which are then written in place, so the payload
+// goes to the DMA where it is; an ICMP echo request is answered in its own
+// buffer. Checksums are left to the MAC both ways (checked in software
+// only for frames it did not check).
+//
+// net_timer() drives ARP retries and ageing, the TCP retransmissions,
+// delayed acknowledgements and TIME-WAIT; call it each NET_TIMER_MS or so
+// with the time in ms (timer_ticks on the target).
+//
+// UDP: a datagram goes out as one frame, no fragments; the chain given to
+// net_udp_send() is freed once sent. TCP: each buffer given to
+// net_tcp_send() is one segment, of up to net_tcp_mss() bytes, kept until
+// acknowledged; received data shrinks the window until the callback hands
+// it back with net_tcp_recved().
+//
+// tools/eth_tap.c runs the stack on Linux over a TAP device or pcap files.
+
+#define NET_TIMER_MS                    (100U)
+
+// 'a.b.c.d', in host byte order like all addresses and ports here
+#define NET_IP(a, b, c, d)              (((uint32_t) (a) << 24) | ((uint32_t) (b) << 16) \
+		| ((uint32_t) (c) << 8) | (uint32_t) (d))
+
+// Ethernet, IPv4 and TCP headers (no options) in front of the payload
+#define NET_HEADROOM                    (54U)
+
+#if !defined(NET_ARP_ENTRIES)
+#define NET_ARP_ENTRIES                 (8U)
+#endif
+#if !defined(NET_TCP_CONNS)
+#define NET_TCP_CONNS                   (8U)
+#endif
+// Receive window, bytes
+#if !defined(NET_TCP_WND)
+#define NET_TCP_WND                     (8U * 1460U)
+#endif
+// Segments queued for sending or unacknowledged, per connection
+#if !defined(NET_TCP_SND_SEGS)
+#define NET_TCP_SND_SEGS                (16U)
+#endif
+
+// net_TcpHandler.event
+#define NET_TCP_CONNECTED               (0U)    // also for accepted ones
+#define NET_TCP_SENT                    (1U)    // segments acknowledged, room to send
+#define NET_TCP_PEER_CLOSED             (2U)    // FIN received, no more data
+#define NET_TCP_CLOSED                  (3U)    // gone; the handle is no longer valid
+#define NET_TCP_ABORTED                 (4U)    // reset or timed out; likewise
+
+typedef struct net_tcp net_Tcp;
+
+typedef struct net_tcp_handler
+{
+	// 'data' is the payload of one segment
+	void (*recv)(void *arg, net_Tcp *tcp, pkt_Buf *data);
+	void (*event)(void *arg, net_Tcp *tcp, uint32_t event);
+} net_TcpHandler;
+
+typedef void (*net_UdpRecv)(void *arg, pkt_Buf *data, uint32_t ip, uint16_t port);
+
+typedef struct net_udp
+{
+	uint16_t port;
+	net_UdpRecv recv;
+	void *arg;
+	struct net_udp *next;
+} net_Udp;
+
+typedef struct net_config
+{
+	uint8_t mac[6];
+	uint32_t ip;
+	uint32_t netmask;
+	uint32_t gateway;               // 0 for none
+	// Shared by the driver (receive) and the stack (headers, replies)
+	pkt_Pool *pool;
+	// For eth_init()
+	uint32_t phy;
+	uint32_t priority;
+	uint32_t level;
+} net_Config;
+
+typedef struct net_stats
+{
+	uint32_t ip_in;
+	uint32_t ip_out;
+	uint32_t dropped;               // bad, not for us, or no buffer
+	uint32_t arp_misses;            // frames lost waiting for ARP
+	uint32_t tcp_retransmits;
+} net_Stats;
+
+// ----------------------------------------------------------------------------
+
+// Starts the Ethernet driver with the stack on top.
+extern uint32_t net_init(const net_Config *config);
+
+extern void net_timer(uint32_t now_ms);
+
+// A pool buffer with NET_HEADROOM bytes in front of 'data', or NULL.
+extern pkt_Buf *net_alloc(void);
+
+// Datagrams to 'port' go to 'recv' (a statically allocated 'udp').
+extern uint32_t net_udp_bind(net_Udp *udp, uint16_t port, net_UdpRecv recv, void *arg);
+
+extern void net_udp_unbind(net_Udp *udp);
+
+// Sends 'chain' from the port of 'udp'. Pool buffers in it are freed once
+// sent; pkt_ref() ones must stay as they are until then.
+extern uint32_t net_udp_send(net_Udp *udp, uint32_t ip, uint16_t port, pkt_Buf *chain);
+
+// Connections to 'port' are accepted, each reported by NET_TCP_CONNECTED
+// with the listener's handler and 'arg'. net_tcp_close() stops listening.
+extern net_Tcp *net_tcp_listen(uint16_t port, const net_TcpHandler *handler, void *arg);
+
+// NET_TCP_CONNECTED, or NET_TCP_ABORTED, follows.
+extern net_Tcp *net_tcp_connect(uint32_t ip, uint16_t port, const net_TcpHandler *handler,
+		void *arg);
+
+extern void net_tcp_set_arg(net_Tcp *tcp, void *arg);
+
+// Queues 'buf', from net_alloc(), as one segment; the stack owns it from
+// then on. Fails when the buffer is too long or the queue full.
+extern uint32_t net_tcp_send(net_Tcp *tcp, pkt_Buf *buf);
+
+// Payload bytes per segment.
+extern uint32_t net_tcp_mss(const net_Tcp *tcp);
+
+// Hands 'len' received bytes back to the window.
+extern void net_tcp_recved(net_Tcp *tcp, uint32_t len);
+
+// Sends FIN after the queued data; NET_TCP_CLOSED follows.
+extern void net_tcp_close(net_Tcp *tcp);
+
+// Sends RST and drops the connection at once, without an event.
+extern void net_tcp_abort(net_Tcp *tcp);
+
+extern void net_stats(net_Stats *stats);
+
+// ----------------------------------------------------------------------------
+
+#endif // NET_H_
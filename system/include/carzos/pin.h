@@ -0,0 +1,40 @@
+/*
+ * pin.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef PIN_H_
+#define PIN_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// GPIO pins of the drivers, as one number: PIN('B', 6) is PB6.
+
+#define PIN(_port, _n)                  ((uint32_t) ((((_port) - 'A') << 4) | (_n)))
+#define PIN_NONE                        (0xFFU)
+
+#define PIN_GPIO(_pin)                  ((GPIO_TypeDef *) (GPIOA_BASE + ((GPIOB_BASE - GPIOA_BASE) * ((_pin) >> 4))))
+#define PIN_MASK(_pin)                  ((uint16_t) (1U << ((_pin) & 0xFU)))
+
+#define PIN_PUSH_PULL                   (0U)
+#define PIN_OPEN_DRAIN                  (1U)
+
+// ----------------------------------------------------------------------------
+
+// Clocks the port and hands the pin to alternate function 'af', at the
+// highest slew rate. PIN_NONE is ignored.
+extern void pin_af(uint32_t pin, uint32_t af, uint32_t pull, uint32_t type);
+
+extern void pin_output(uint32_t pin, uint32_t type);
+
+extern void pin_input(uint32_t pin, uint32_t pull);
+
+extern void pin_analog(uint32_t pin);
+
+// ----------------------------------------------------------------------------
+
+#endif // PIN_H_
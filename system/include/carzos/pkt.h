@@ -0,0 +1,86 @@
+/*
+ * pkt.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef PKT_H_
+#define PKT_H_
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+
+// Packet buffers.
+//
+// A pool cuts a caller array into 'count' buffers of 'size' bytes, each
+// behind its pkt_Buf header. pkt_alloc() and pkt_free() may be called from
+// any context, interrupts included: the free list is a stack updated with
+// LDREX/STREX, and since taking an exception clears the exclusive monitor,
+// a buffer taken and given back by an interrupt between the two cannot
+// slip through (no ABA).
+//
+// A packet is a chain of buffers through 'next', 'len' bytes at 'data'
+// each. A buffer from a pool holds its own memory at 'mem', and 'data' may
+// start further in to leave room for headers. A pkt_Buf set with pkt_ref()
+// belongs to no pool and only points at caller memory: this is how data
+// goes into a packet without being copied. pkt_free() gives the pool
+// buffers of a chain back and leaves those alone.
+//
+// 'link' is free for the owner of a packet to queue it.
+//
+// The memory must be DMA reachable for packets the DMA touches, not in CCM
+// RAM (CARZOS_SRAM2). Only <stdint.h> is included, the host stand-ins use
+// this header too.
+
+// Bytes a pool of 'count' buffers of 'size' bytes needs
+#define PKT_POOL_BYTES(count, size)     ((count) * (PKT_HEADER_BYTES + (((size) + 3U) & ~3U)))
+#define PKT_HEADER_BYTES                ((sizeof(pkt_Buf) + 3U) & ~3U)
+
+// pkt_Buf.flags: received, and the hardware found the IPv4 header and
+// TCP/UDP/ICMP checksums good
+#define PKT_CSUM_OK                     (0x0001U)
+
+typedef struct pkt_pool pkt_Pool;
+
+typedef struct pkt_buf
+{
+	struct pkt_buf *next;
+	uint8_t *data;
+	uint16_t len;
+	uint16_t flags;
+	pkt_Pool *pool;                 // NULL for caller memory
+	uint8_t *mem;
+	struct pkt_buf *link;
+} pkt_Buf;
+
+struct pkt_pool
+{
+	pkt_Buf *volatile free;
+	uint32_t size;
+	uint32_t count;
+	// pkt_alloc() calls that found the pool empty
+	volatile uint32_t misses;
+};
+
+// ----------------------------------------------------------------------------
+
+// 'mem' holds PKT_POOL_BYTES(count, size) bytes, word aligned.
+extern uint32_t pkt_pool_init(pkt_Pool *pool, void *mem, uint32_t count, uint32_t size);
+
+// A buffer with 'data' at the start of its memory, or NULL.
+extern pkt_Buf *pkt_alloc(pkt_Pool *pool);
+
+// Gives back the pool buffers of a chain.
+extern void pkt_free(pkt_Buf *chain);
+
+// Sets 'buf' to point at 'len' caller bytes, for chaining.
+extern void pkt_ref(pkt_Buf *buf, const void *data, uint32_t len);
+
+// Bytes in a chain.
+extern uint32_t pkt_chain_len(const pkt_Buf *chain);
+
+// ----------------------------------------------------------------------------
+
+#endif // PKT_H_
@@ -0,0 +1,58 @@
+/*
+ * restart.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef RESTART_H_
+#define RESTART_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Warm restart.
+//
+// restart_warm() restarts the application without a system reset: it
+// stops the interrupts and the SysTick, resets the peripherals, then
+// reloads the main stack pointer and jumps to _start(), interrupts still
+// masked until restart_init() (from __hardware_init()). The clock tree is
+// left running, so __hardware_init_early() and the HSE/PLL bring-up are
+// skipped; .data and .bss are initialised again and main() runs as after
+// a reset.
+//
+// Objects marked CARZOS_RETAINED (a part of .noinit) are carried over.
+// restart_warm() seals them with a CRC, and restart_init() checks it; on a
+// cold boot, or when the CRC does not match, they are zeroed instead.
+//
+// Example:
+//   static calib_Table calib CARZOS_RETAINED;
+//   ...
+//   if (!restart_retained())
+//       calib_measure(&calib);
+
+#define CARZOS_RETAINED                 __attribute__((section(".noinit.retained")))
+
+// ----------------------------------------------------------------------------
+
+// Must be called from thread mode; from a handler it falls back to a
+// system reset.
+extern void restart_warm(void) __attribute__((noreturn));
+
+// Consumes the warm restart request; called by _start() before the RAM
+// is initialised. Returns non zero on a warm restart.
+extern uint32_t restart_take(void);
+
+// Validates or clears the retained objects; called by __hardware_init().
+extern void restart_init(void);
+
+// Non zero when the retained objects were carried over from the last run.
+extern uint32_t restart_retained(void);
+
+// Warm restarts since the last cold boot.
+extern uint32_t restart_count(void);
+
+// ----------------------------------------------------------------------------
+
+#endif // RESTART_H_
@@ -0,0 +1,145 @@
+/*
+ * sdcard.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef SDCARD_H_
+#define SDCARD_H_
+
+#include <stdint.h>
+
+// ----------------------------------------------------------------------------
+
+// SD card block device on SDIO, interrupts and DMA.
+//
+// sdcard_init() identifies the card and sets it up, blocking: 4 bit bus
+// when the card has it (SCR), high speed (CMD6) when it has it and
+// max_hz allows, the clock from the 48 MHz PLL output. SDSC, SDHC and
+// SDXC cards; no MMC, no SPI mode.
+//
+// Requests are queued and run from the interrupts, one multi-block
+// command (CMD18, CMD25) each, on DMA2 stream 6 straight to or from the
+// request buffer. With 'merge' set, requests next to each other in the
+// queue, same direction and with adjacent sectors, go in one command, the
+// DMA moving from one buffer to the next on its own interrupt. Writes
+// tell the card the block count first (ACMD23) so that it can erase
+// ahead; reads use CMD23 when the card has it and then need no
+// CMD12. The next command is issued from the interrupt that ends the
+// previous transfer, or from the one that ends the card's programming
+// busy (D0 low, watched on EXTI 8), not from a thread.
+//
+// Each request may have a completion callback, run at the work queue
+// level of the card, in submission order. A write completes once the card
+// has programmed it. A merged command that fails is retried one request
+// at a time, once; a request that fails again completes with ERR_GENERIC
+// and the queue goes on. sdcard_watchdog() fails a command the card never
+// ends.
+//
+// Merging is off by default because of that interrupt: the card's data
+// keeps coming while the stream is re-armed, and the 32 word SDIO FIFO is
+// all the slack there is, 5 us at 50 MHz on 4 bits, 10 us at 25 MHz. A
+// read whose DMA interrupt is held up longer than that overruns, a write
+// underruns; the command fails and is retried unmerged. Set 'merge' only
+// when nothing masks interrupts or runs above 'priority' for that long.
+//
+// The clock follows clock_set(); the PLL must be on (12.5 MHz and above).
+// A clock_set() that leaves it off fails the queued requests, and
+// sdcard_submit() fails, until one turns it on again.
+// Pins: PC8 to PC11 D0 to D3, PC12 CK, PD2 CMD, with pull-ups on the card
+// side or the internal ones. The driver takes the EXTI 9_5 interrupt.
+// Buffers must be 4 byte aligned and DMA reachable (not in CCM RAM).
+//
+// tools/sdcard_file.c is the same interface over an image file, for
+// host builds.
+
+#define SDCARD_SECTOR                   (512U)
+
+#define SDCARD_READ                     (0U)
+#define SDCARD_WRITE                    (1U)
+
+// Most sectors in one command, merged requests together (and in one
+// request)
+#if !defined(SDCARD_RUN_MAX)
+#define SDCARD_RUN_MAX                  (256U)
+#endif
+
+// Longest a command may take, card programming included
+#define SDCARD_TIMEOUT_MS               (500U)
+
+struct sdcard_request;
+typedef void (*sdcard_Callback)(void *arg, struct sdcard_request *request);
+
+typedef struct sdcard_config
+{
+	// Highest bus clock; 0 for as fast as the card goes
+	uint32_t max_hz;
+	// NVIC priority of the SDIO, DMA and EXTI interrupts
+	uint32_t priority;
+	// Work queue level of the completion callbacks
+	uint32_t level;
+	// Non zero to merge adjacent requests into one command
+	uint32_t merge;
+} sdcard_Config;
+
+typedef struct sdcard_request
+{
+	uint32_t sector;
+	uint32_t count;                 // 1 to SDCARD_RUN_MAX
+	uint8_t *buf;
+	uint32_t write;                 // SDCARD_READ or SDCARD_WRITE
+	sdcard_Callback callback;       // optional
+	void *arg;
+	struct sdcard_request *next;
+	// Non zero from sdcard_submit() until completed (until the callback,
+	// when there is one)
+	volatile uint32_t busy;
+	uint32_t status;
+	uint32_t tries;
+} sdcard_Request;
+
+typedef struct sdcard_info
+{
+	uint32_t sectors;
+	uint32_t hz;
+	uint32_t bus_width;             // 1 or 4
+	uint32_t high_capacity;         // SDHC or SDXC
+	uint32_t high_speed;
+	uint32_t cmd23;
+} sdcard_Info;
+
+typedef struct sdcard_stats
+{
+	uint32_t requests;
+	uint32_t commands;              // read and write commands issued
+	uint32_t merged;                // requests that went with another's command
+	uint32_t sectors_read;
+	uint32_t sectors_written;
+	uint32_t errors;
+	uint32_t retries;
+} sdcard_Stats;
+
+// ----------------------------------------------------------------------------
+
+extern uint32_t sdcard_init(const sdcard_Config *config);
+
+// Queues the request; it and its buffer stay untouched until busy
+// clears.
+extern uint32_t sdcard_submit(sdcard_Request *request);
+
+// Runs one request and waits for it; returns its status.
+extern uint32_t sdcard_transfer(uint32_t sector, uint32_t count, uint8_t *buf, uint32_t write);
+
+// Fails the command in progress if it started 'timeout_ms' ago or more;
+// returns non zero when it did. Call it now and then when only
+// sdcard_submit() is used.
+extern uint32_t sdcard_watchdog(uint32_t timeout_ms);
+
+extern void sdcard_info(sdcard_Info *info);
+
+extern void sdcard_stats(sdcard_Stats *stats);
+
+// ----------------------------------------------------------------------------
+
+#endif // SDCARD_H_
@@ -0,0 +1,50 @@
+/*
+ * sections.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef SECTIONS_H_
+#define SECTIONS_H_
+
+// ----------------------------------------------------------------------------
+
+// Placement of objects into the memories set up by sections.ld.
+//
+//   CARZOS_CCMRAM      CCM RAM, initialised from flash at startup
+//   CARZOS_CCMRAM_BSS  CCM RAM, zeroed at startup
+//   CARZOS_SRAM2       SRAM2, zeroed at startup
+//   CARZOS_NOINIT      SRAM1, left as is by the startup (survives resets)
+//   CARZOS_BKPSRAM     backup SRAM, left as is (survives power loss on VBAT)
+//   CARZOS_RAMFUNC     function run from SRAM1, copied from flash at startup
+//
+// CCM RAM is zero wait state and private to the core, the place for hot
+// state; it cannot be used for DMA buffers nor for code. SRAM2 has its own
+// bus matrix port, the place for DMA buffers.
+//
+// A RAM function avoids the flash wait states (5 at 168 MHz) on ART
+// accelerator misses, which is what branchy code suffers from. Straight
+// line code that hits the ART gains nothing, and RAM code shares the SRAM1
+// port with data, so only move measured hot spots. Calls between flash
+// and RAM are out of BL range; the linker adds long branch veneers.
+// CARZOS_RAMFUNC_FLASH leaves them all in flash, to compare the two with
+// tools/ramfunc_bench.c.
+//
+// Example:
+//   static uint32_t table[256] CARZOS_CCMRAM_BSS;
+
+#define CARZOS_CCMRAM                   __attribute__((section(".ccmram")))
+#define CARZOS_CCMRAM_BSS               __attribute__((section(".ccmram_bss")))
+#define CARZOS_SRAM2                    __attribute__((section(".sram2")))
+#define CARZOS_NOINIT                   __attribute__((section(".noinit")))
+#define CARZOS_BKPSRAM                  __attribute__((section(".bkpsram")))
+#if defined(CARZOS_RAMFUNC_FLASH)
+#define CARZOS_RAMFUNC                  __attribute__((noinline))
+#else
+#define CARZOS_RAMFUNC                  __attribute__((section(".ramfunc"), noinline))
+#endif
+
+// ----------------------------------------------------------------------------
+
+#endif // SECTIONS_H_
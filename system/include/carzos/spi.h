@@ -0,0 +1,126 @@
+/*
+ * spi.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef SPI_H_
+#define SPI_H_
+
+#include "stm32f4xx.h"
+#include "clock.h"
+#include "dma.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// SPI bus manager.
+//
+// Devices on a bus share one transfer queue. A transfer names its device;
+// when it reaches the head of the queue the device's mode and clock are
+// written to the bus only if they differ from the ones in use (the baud
+// divider is derived from the device's maximum frequency and worked out
+// again after a clock_set()), its chip select is driven low, and both DMA
+// streams run. The RX stream interrupt completes the transfer and starts
+// the next one on the spot, so queued transfers follow each other with
+// only the interrupt latency in between.
+//
+// Chip select goes high after each transfer, unless the transfer has
+// cs_hold set: then it stays low until a transfer of another device
+// starts or one without cs_hold ends, for command then data sequences.
+//
+// Completion callbacks run at the work queue level of the bus, in
+// submission order; spi_transfer() blocks the calling (main) context
+// instead. Buffers must be DMA reachable (not in CCM RAM).
+
+#define SPI_MODE_0                      (0U)                    // CPOL 0, CPHA 0
+#define SPI_MODE_1                      (SPI_CR1_CPHA)
+#define SPI_MODE_2                      (SPI_CR1_CPOL)
+#define SPI_MODE_3                      (SPI_CR1_CPOL | SPI_CR1_CPHA)
+#define SPI_LSB_FIRST                   (SPI_CR1_LSBFIRST)
+
+struct spi_transfer;
+typedef void (*spi_Callback)(void *arg, struct spi_transfer *transfer);
+
+typedef struct spi_bus_config
+{
+	uint32_t sck_pin;               // PIN()
+	uint32_t miso_pin;              // PIN() or PIN_NONE
+	uint32_t mosi_pin;
+	// NVIC priority of the DMA interrupts
+	uint32_t priority;
+	// Work queue level of the completion callbacks
+	uint32_t level;
+} spi_BusConfig;
+
+typedef struct spi_bus
+{
+	SPI_TypeDef *regs;
+	uint32_t apb2;
+	dma_Stream rx_dma;
+	dma_Stream tx_dma;
+
+	struct spi_transfer *volatile head;
+	struct spi_transfer *tail;
+	// Completed, newest first, until the work item runs
+	struct spi_transfer *volatile done;
+	volatile uint32_t hold;
+
+	// Settings on the bus now, and the clock generation they were made for
+	uint32_t cr1;
+	uint32_t epoch;
+	struct spi_device *cs_active;
+
+	workq_Item work;
+	clock_Listener clock;
+} spi_Bus;
+
+typedef struct spi_device
+{
+	spi_Bus *bus;
+	uint32_t cs_pin;
+	uint32_t max_hz;
+	uint32_t mode;
+	// CR1 worked out for bus->epoch
+	uint32_t cr1;
+	uint32_t epoch;
+} spi_Device;
+
+typedef struct spi_transfer
+{
+	spi_Device *device;
+	const uint8_t *tx;              // NULL sends 0xFF
+	uint8_t *rx;                    // NULL discards
+	uint32_t len;
+	uint32_t cs_hold;
+	spi_Callback callback;
+	void *arg;
+	struct spi_transfer *next;
+	// Non zero from spi_submit() until completed (until the callback,
+	// when there is one)
+	volatile uint32_t busy;
+	uint32_t status;
+} spi_Transfer;
+
+// ----------------------------------------------------------------------------
+
+// 'instance' is the SPI number, 1 to 3.
+extern uint32_t spi_bus_init(spi_Bus *bus, uint32_t instance, const spi_BusConfig *config);
+
+// SCK is the bus clock over 2 to 256, the fastest not above 'max_hz'; it
+// fails when even /256 is faster. A later clock_set() that raises the bus
+// clock that far leaves the device at /256.
+extern uint32_t spi_device_init(spi_Device *device, spi_Bus *bus, uint32_t cs_pin,
+		uint32_t max_hz, uint32_t mode);
+
+// Queues the transfer; it and its buffers stay untouched until busy clears.
+extern uint32_t spi_submit(spi_Transfer *transfer);
+
+// Queues a transfer and waits for it; returns its status.
+extern uint32_t spi_transfer(spi_Device *device, const uint8_t *tx, uint8_t *rx,
+		uint32_t len);
+
+// ----------------------------------------------------------------------------
+
+#endif // SPI_H_
@@ -0,0 +1,57 @@
+/*
+ * stack.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef STACK_H_
+#define STACK_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Stack high water tracking and overflow guard.
+//
+// A registered stack is painted with STACK_PAINT below the current stack
+// pointer. stack_scan() then looks for the lowest word that is no longer
+// painted, a few words per call, so it can run from the system tick: the
+// cursor walks up from the bottom of each stack and restarts whenever it
+// finds a new high water mark or reaches the current one.
+//
+// The bottom STACK_GUARD_SIZE bytes of a guarded stack are made
+// inaccessible with an MPU region, so an overflow raises a MemManage fault
+// right away instead of silently writing into whatever lies below (the
+// heap, for the main stack). The guard needs the stack bottom aligned to
+// STACK_GUARD_SIZE; the linker script checks this for the main stack.
+
+#define STACK_PAINT                     (0xA5A5A5A5U)
+#define STACK_GUARD_SIZE                (32U)
+
+#define STACK_MAX                       (4U)
+
+// Words checked per stack_scan() call
+#define STACK_SCAN_WORDS                (16U)
+
+// ----------------------------------------------------------------------------
+
+// Registers and paints the main stack and guards its bottom.
+extern void stack_init(void);
+
+// Registers a stack [begin, end). Paints it unless it is the stack in use
+// (then only below the stack pointer), and guards it if 'guard' is set.
+// Returns the stack index, or STACK_MAX when full or the guard cannot be
+// placed.
+extern uint32_t stack_register(uint32_t *begin, uint32_t *end, uint32_t guard);
+
+// Advances the incremental scan by up to 'words' words.
+extern void stack_scan(uint32_t words);
+
+// Deepest use seen so far, in bytes, and the stack size.
+extern uint32_t stack_used(uint32_t index);
+extern uint32_t stack_size(uint32_t index);
+
+// ----------------------------------------------------------------------------
+
+#endif // STACK_H_
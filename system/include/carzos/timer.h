@@ -11,6 +11,9 @@ typedef uint32_t timer_ticks_t;
 
 extern volatile timer_ticks_t timer_delayCount;
 
+// Milliseconds since clock_init(); HAL_GetTick() returns it too.
+extern volatile timer_ticks_t timer_ticks;
+
 extern void timer_start (void);
 
 extern void timer_sleep (timer_ticks_t ticks);
@@ -0,0 +1,98 @@
+/*
+ * trace.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include "stm32f4xx.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// Deferred binary trace.
+//
+// trace_printf() does not format. The format string literal is placed in
+// the .trace_fmt section and its address is the message ID; the call
+// stores the ID, a cycle count and the arguments as raw words into a ring
+// and returns, in a few tens of cycles, lock-free and from any context.
+// The ring is drained later at the work queue level given to trace_init():
+// each record is passed on as is, to be formatted on the host by
+// tools/tracedump.py, which reads the format strings from the ELF. With
+// TRACE_TEXT the drain formats it on the target instead, with a small
+// formatter of its own (%d %i %u %x %X %o %c %s %p, '-' and '0' flags,
+// width; no precision), not newlib's printf: it runs as an interrupt, on
+// the main stack. The drained bytes go to trace_sink(); itm.c sends them
+// out on ITM_PORT_TRACE, waiting for the stimulus FIFO.
+//
+// Arguments are stored as 32 bit words: integers, characters and
+// pointers; no floating point, no 64 bit integers. More than
+// TRACE_ARGS_MAX of them do not compile. A %s argument must
+// point to a string that is still there when the record is formatted,
+// a literal or a const table (in flash, for the host decoder).
+//
+// Without TRACE (Release) the calls compile to nothing.
+
+#define TRACE_RING_WORDS                (1024U)         // power of 2
+#define TRACE_ARGS_MAX                  (8U)
+
+// The drain level set up by __hardware_init(), at the lowest priority
+#if !defined(TRACE_WORKQ_LEVEL)
+#define TRACE_WORKQ_LEVEL               (WORKQ_LEVELS - 1U)
+#endif
+
+// Record layout, in words: header, format address, DWT cycles, arguments.
+// The header is written last; TRACE_HEADER_MAGIC marks it complete.
+#define TRACE_HEADER_MAGIC              (0x54520000U)   // "TR"
+#define TRACE_HEADER_WORDS(_header)     ((_header) & 0xFFU)
+#define TRACE_RECORD_WORDS(_nargs)      (3U + (_nargs))
+
+#if defined(TRACE)
+
+#define TRACE_FMT(_fmt) \
+	({ \
+		static const char _trace_fmt[] __attribute__((section(".trace_fmt"), used)) = _fmt; \
+		_trace_fmt; \
+	})
+
+// Counts up to 16 arguments, so that more than TRACE_ARGS_MAX is caught
+#define TRACE_NARGS(...) \
+	TRACE_NARGS_(0, ##__VA_ARGS__, 16, 15, 14, 13, 12, 11, 10, 9, \
+			8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define TRACE_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, \
+		_9, _10, _11, _12, _13, _14, _15, _16, _n, ...) _n
+
+#define trace_printf(_fmt, ...) \
+	({ \
+		_Static_assert(TRACE_NARGS(__VA_ARGS__) <= TRACE_ARGS_MAX, \
+				"trace_printf() takes at most TRACE_ARGS_MAX arguments"); \
+		trace_write(TRACE_FMT(_fmt), TRACE_NARGS(__VA_ARGS__), ##__VA_ARGS__); \
+	})
+
+#else
+
+#define trace_printf(_fmt, ...)         ((void) 0)
+
+#endif // defined(TRACE)
+
+// ----------------------------------------------------------------------------
+
+// Binds the drain to a work queue level (set up with workq_init()).
+extern uint32_t trace_init(uint32_t level);
+
+// Backend of trace_printf(); the arguments are 'nargs' 32 bit words.
+extern void trace_write(const char *fmt, uint32_t nargs, ...);
+
+// Records lost because the ring was full, or not all taken by the sink.
+extern uint32_t trace_dropped(void);
+
+// Output of the drain; returns the bytes it took, all of them unless the
+// output is off. The default one, without itm.c, discards them all.
+extern uint32_t trace_sink(const void *buf, uint32_t len);
+
+// ----------------------------------------------------------------------------
+
+#endif // TRACE_H_
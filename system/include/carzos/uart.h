@@ -0,0 +1,131 @@
+/*
+ * uart.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef UART_H_
+#define UART_H_
+
+#include "stm32f4xx.h"
+#include "clock.h"
+#include "dma.h"
+#include "workq.h"
+
+// ----------------------------------------------------------------------------
+
+// Serial ports on DMA.
+//
+// Receive runs continuously: the RX stream writes the caller's ring buffer
+// in circular mode, and the CPU only looks at it on the half and full
+// transfer interrupts and on the USART IDLE interrupt, which fires one
+// character time after the last byte of a frame. So a frame of any length
+// is delivered with one or two interrupts, and never more than two per
+// buffer lap. Data not read before the DMA comes round again is lost and
+// counted (uart_lost()).
+//
+// Transmit takes uart_Buffer descriptors, queued without copying; the TX
+// stream interrupt starts the next one right away, so queued buffers go
+// out back to back. The F4 DMA has no descriptor chaining, this is the
+// nearest to it.
+//
+// Events (data, end of frame, buffer sent, line error) are collected in
+// interrupt context and handed to the port callback from a work queue
+// level. uart_read() and uart_write() block the calling (main) context,
+// sleeping in between; uart_read_some() and uart_write_async() do not.
+//
+// Buffers must be DMA reachable, not in CCM RAM.
+
+#define UART_EVENT_RX                   (0x01U)     // new data in the ring
+#define UART_EVENT_FRAME                (0x02U)     // the line went idle
+#define UART_EVENT_TX                   (0x04U)     // a buffer was sent
+#define UART_EVENT_ERROR                (0x08U)     // overrun, framing, noise
+
+#define UART_FOREVER                    (0xFFFFFFFFU)
+
+typedef void (*uart_Callback)(void *arg, uint32_t events);
+
+typedef struct uart_buffer
+{
+	const uint8_t *data;
+	uint32_t len;
+	struct uart_buffer *next;
+	// Non zero from uart_write_async() until sent
+	volatile uint32_t busy;
+} uart_Buffer;
+
+typedef struct uart_config
+{
+	uint32_t baud;
+	uint32_t tx_pin;                // PIN() or PIN_NONE
+	uint32_t rx_pin;
+	uint8_t *rx_buf;
+	uint32_t rx_size;
+	// NVIC priority of the USART and DMA interrupts
+	uint32_t priority;
+	// Optional; runs at work queue 'level'
+	uart_Callback callback;
+	void *arg;
+	uint32_t level;
+} uart_Config;
+
+// State of a port; statically allocated by the application
+typedef struct uart_port
+{
+	USART_TypeDef *regs;
+	uint32_t baud;
+	uint32_t apb2;
+	dma_Stream rx_dma;
+	dma_Stream tx_dma;
+
+	uint8_t *rx_buf;
+	uint32_t rx_size;
+	uint32_t rx_pos;                // DMA position at the last update
+	volatile uint32_t rx_in;        // bytes received, free running
+	volatile uint32_t rx_out;       // bytes read, free running
+	// rx_in at the last idle line, where the last frame ended
+	volatile uint32_t rx_frame_end;
+	volatile uint32_t rx_lost;
+	volatile uint32_t errors;
+
+	uart_Buffer *volatile tx_head;
+	uart_Buffer *tx_tail;
+	volatile uint32_t tx_hold;
+
+	volatile uint32_t events;
+	uart_Callback callback;
+	void *arg;
+	workq_Item work;
+	clock_Listener clock;
+} uart_Port;
+
+// ----------------------------------------------------------------------------
+
+// 'instance' is the USART number, 1 to 6.
+extern uint32_t uart_init(uart_Port *port, uint32_t instance, const uart_Config *config);
+
+// Bytes waiting in the ring.
+extern uint32_t uart_available(uart_Port *port);
+
+// Copies out what is there, up to 'len'; never waits.
+extern uint32_t uart_read_some(uart_Port *port, uint8_t *buf, uint32_t len);
+
+// Waits until 'len' bytes came in, or a frame ended with some data read,
+// or 'timeout_ms' passed; returns the bytes read.
+extern uint32_t uart_read(uart_Port *port, uint8_t *buf, uint32_t len, uint32_t timeout_ms);
+
+// Queues the buffer; 'buffer' and its data stay untouched until busy
+// clears (and UART_EVENT_TX is sent).
+extern uint32_t uart_write_async(uart_Port *port, uart_Buffer *buffer);
+
+// Sends 'len' bytes and returns when they are out of the DMA.
+extern uint32_t uart_write(uart_Port *port, const uint8_t *data, uint32_t len);
+
+extern uint32_t uart_lost(const uart_Port *port);
+
+extern uint32_t uart_errors(const uart_Port *port);
+
+// ----------------------------------------------------------------------------
+
+#endif // UART_H_
@@ -0,0 +1,72 @@
+/*
+ * workq.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#ifndef WORKQ_H_
+#define WORKQ_H_
+
+#include "stm32f4xx.h"
+
+// ----------------------------------------------------------------------------
+
+// Deferred interrupt work (bottom halves).
+//
+// An ISR does the minimum in interrupt context and posts a work item; the
+// item runs later from the drain handler of its level. Each level is an
+// otherwise unused peripheral interrupt line that is only ever pended by
+// software, so the NVIC priority of that line is the priority of the level
+// and a level preempts lower ones exactly like a real interrupt would.
+// The drain handlers are attached with irq_attach(), so irq_init() must
+// have run before workq_init().
+//
+// Posting is O(1) and lock-free (LDREX/STREX), so it is safe from any
+// interrupt priority. Posting an item that is already pending is coalesced
+// into the pending run.
+
+#define WORKQ_LEVELS (3U)
+
+// The interrupt lines borrowed by the levels. Pick lines whose peripherals
+// are not used by the application; the defaults are free on the
+// STM32F4DISCOVERY board.
+#if !defined(WORKQ_LEVEL0_IRQn)
+#define WORKQ_LEVEL0_IRQn               DCMI_IRQn
+#endif
+
+#if !defined(WORKQ_LEVEL1_IRQn)
+#define WORKQ_LEVEL1_IRQn               OTG_HS_EP1_OUT_IRQn
+#endif
+
+#if !defined(WORKQ_LEVEL2_IRQn)
+#define WORKQ_LEVEL2_IRQn               OTG_HS_EP1_IN_IRQn
+#endif
+
+typedef void (*workq_Fn)(void *arg);
+
+typedef struct workq_item
+{
+	workq_Fn fn;
+	void *arg;
+	struct workq_item *next;
+	// Non zero from the post until the drain starts running the item
+	volatile uint32_t pending;
+	uint32_t level;
+} workq_Item;
+
+// ----------------------------------------------------------------------------
+
+// Sets the NVIC priority of a level and enables it.
+extern uint32_t workq_init(uint32_t level, uint32_t priority);
+
+// Binds a (statically allocated) item to its function and level.
+extern uint32_t workq_item_init(workq_Item *item, workq_Fn fn, void *arg,
+		uint32_t level);
+
+// Queues the item on its level; callable from interrupt context.
+extern uint32_t workq_post(workq_Item *item);
+
+// ----------------------------------------------------------------------------
+
+#endif // WORKQ_H_
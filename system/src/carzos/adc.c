@@ -0,0 +1,545 @@
+/*
+ * adc.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <adc.h>
+#include <pin.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define ADC_NONE                (0xFFFFFFFFU)
+#define ADC_DMA_STREAM          (4U)
+#define ADC_DMA_CHANNEL         (0U)
+#define ADC_DMA_PL_HIGH         (2U)
+#define ADC_NDTR_MAX            (0xFFFFU)
+
+// Conversion time on top of the sampling time, in ADC clocks (12 bits)
+#define ADC_CONVERSION_CYCLES   (12U)
+#define ADC_DELAY_MIN           (5U)
+#define ADC_DELAY_MAX           (20U)
+
+// CCR and CR2 fields (this CMSIS version has no _Pos definitions)
+#define ADC_CCR_MULTI_TRIPLE    (0x17U)         // triple mode, interleaved mode only
+#define ADC_CCR_DELAY_SHIFT     (8U)
+#define ADC_CCR_ADCPRE_SHIFT    (16U)
+#define ADC_CCR_DMA_MODE2       (ADC_CCR_DMA_1)
+#define ADC_CR2_EXTSEL_TIM8     (0xEU << 24)    // TIM8 TRGO
+#define ADC_SQR_BITS            (5U)
+#define ADC_SMPR_BITS           (3U)
+
+static ADC_TypeDef *const adc_regs[3] = { ADC1, ADC2, ADC3 };
+
+// Sampling time of the ADC_SAMPLETIME_* codes, in ADC clocks
+static const u16 adc_smp_cycles[8] = { 3U, 15U, 28U, 56U, 84U, 112U, 144U, 480U };
+
+
+// Pin of a channel on ADC1 (and on ADC2 and ADC3 for 0 to 3 and 10 to 13)
+static u32 adc_pin(u32 channel)
+{
+	if (channel < 8U)
+	{
+		return PIN('A', channel);
+	}
+	if (channel < 10U)
+	{
+		return PIN('B', channel - 8U);
+	}
+	if (channel < 16U)
+	{
+		return PIN('C', channel - 10U);
+	}
+	return PIN_NONE;
+}
+
+// Smallest delay between the ADCs in ADC_MODE_TRIPLE: each ADC must be
+// done before its turn comes again, and the sampling phases of the same
+// channel must not overlap
+static u32 adc_delay_min(u32 sample_time)
+{
+	u32 smp = adc_smp_cycles[sample_time];
+	u32 min = (smp + ADC_CONVERSION_CYCLES + 2U) / 3U;
+	if (min <= smp)
+	{
+		min = smp + 1U;
+	}
+	if (min < ADC_DELAY_MIN)
+	{
+		min = ADC_DELAY_MIN;
+	}
+	return min;
+}
+
+static inline u16 *adc_block(const adc_Sampler *adc, u32 block)
+{
+	return adc->buf + (block * adc->block_samples);
+}
+
+static u32 adc_take_block(adc_Sampler *adc)
+{
+	u32 free;
+	u32 block;
+	do
+	{
+		free = __LDREXW(&adc->free);
+		if (free == 0U)
+		{
+			__CLREX();
+			return ADC_NONE;
+		}
+		block = __CLZ(__RBIT(free));
+	} while (__STREXW(free & ~(1U << block), &adc->free) != 0U);
+
+	return block;
+}
+
+static void adc_give_block(adc_Sampler *adc, u32 block)
+{
+	do
+	{
+	} while (__STREXW(__LDREXW(&adc->free) | (1U << block), &adc->free) != 0U);
+}
+
+// ADC clock and trigger rate from the APB2 clock
+static void adc_timing(adc_Sampler *adc)
+{
+	u32 pclk = clock_pclk2();
+
+	// The smallest of /2, /4, /6, /8 within the limit
+	u32 div = 2U;
+	while (((pclk / div) > ADC_CLOCK_MAX_HZ) && (div < 8U))
+	{
+		div += 2U;
+	}
+	u32 adcclk = pclk / div;
+
+	u32 ccr = ADC->CCR & ~(ADC_CCR_ADCPRE | ADC_CCR_DELAY);
+	ccr |= ((div / 2U) - 1U) << ADC_CCR_ADCPRE_SHIFT;
+
+	if (adc->mode == ADC_MODE_TRIPLE)
+	{
+		u32 min = adc_delay_min(adc->sample_time);
+		u32 delay = (adcclk + (adc->rate_hz / 2U)) / adc->rate_hz;
+		if (delay < min)
+		{
+			delay = min;
+		}
+		else if (delay > ADC_DELAY_MAX)
+		{
+			delay = ADC_DELAY_MAX;
+		}
+
+		ccr |= (delay - ADC_DELAY_MIN) << ADC_CCR_DELAY_SHIFT;
+		adc->rate = adcclk / delay;
+	}
+	else
+	{
+		u32 period = clock_timclk2() / adc->rate_hz;
+		if (period == 0U)
+		{
+			period = 1U;
+		}
+		u32 psc = (period - 1U) >> 16;
+		u32 arr = (period / (psc + 1U)) - 1U;
+
+		TIM8->PSC = psc;
+		TIM8->ARR = arr;
+		TIM8->EGR = TIM_EGR_UG;
+		adc->rate = clock_timclk2() / ((psc + 1U) * (arr + 1U));
+	}
+
+	ADC->CCR = ccr;
+}
+
+// Starts the stream on the two target blocks, then the conversions
+static void adc_arm(adc_Sampler *adc)
+{
+	DMA_Stream_TypeDef *stream = adc->dma.regs;
+
+	stream->M0AR = (u32) adc_block(adc, adc->target[0]);
+	stream->M1AR = (u32) adc_block(adc, adc->target[1]);
+	stream->NDTR = (adc->mode == ADC_MODE_TRIPLE)
+			? (adc->block_samples / 2U) : adc->block_samples;
+	stream->CR &= ~DMA_SxCR_CT;
+	stream->CR |= DMA_SxCR_EN;
+
+	for (u32 i = 0U; i < adc->nadcs; i++)
+	{
+		adc_regs[i]->SR = 0U;
+	}
+
+	if (adc->mode == ADC_MODE_TRIPLE)
+	{
+		ADC->CCR |= ADC_CCR_DMA_MODE2;
+		for (u32 i = 0U; i < adc->nadcs; i++)
+		{
+			adc_regs[i]->CR2 |= ADC_CR2_CONT;
+		}
+		ADC1->CR2 |= ADC_CR2_SWSTART;
+	}
+	else
+	{
+		ADC1->CR2 |= ADC_CR2_DMA;
+		TIM8->CNT = 0U;
+		TIM8->CR1 |= TIM_CR1_CEN;
+	}
+}
+
+// Stops the conversions, then the stream; the DMA requests are dropped
+// first so that a conversion still running does not overrun.
+static void adc_halt(adc_Sampler *adc)
+{
+	if (adc->mode == ADC_MODE_TRIPLE)
+	{
+		ADC->CCR &= ~ADC_CCR_DMA;
+		for (u32 i = 0U; i < adc->nadcs; i++)
+		{
+			adc_regs[i]->CR2 &= ~ADC_CR2_CONT;
+		}
+	}
+	else
+	{
+		TIM8->CR1 &= ~TIM_CR1_CEN;
+		ADC1->CR2 &= ~ADC_CR2_DMA;
+	}
+
+	dma_stop(&adc->dma);
+}
+
+static void adc_dma_irq(void *ctx)
+{
+	adc_Sampler *adc = ctx;
+	DMA_Stream_TypeDef *stream = adc->dma.regs;
+
+	u32 flags = dma_take(&adc->dma);
+
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		// The stream stopped; start again on the same blocks
+		adc->overruns++;
+		adc_halt(adc);
+		adc_arm(adc);
+		return;
+	}
+
+	if ((flags & DMA_FLAG_TC) == 0U)
+	{
+		return;
+	}
+
+	// The stream went on into the other target; replace the full one
+	u32 done = ((stream->CR & DMA_SxCR_CT) != 0U) ? 0U : 1U;
+	u32 next = adc_take_block(adc);
+	if (next == ADC_NONE)
+	{
+		// Nothing free: it is filled again, and this one is lost
+		adc->overruns++;
+		return;
+	}
+
+	u32 full = adc->target[done];
+	if (done == 0U)
+	{
+		stream->M0AR = (u32) adc_block(adc, next);
+	}
+	else
+	{
+		stream->M1AR = (u32) adc_block(adc, next);
+	}
+	adc->target[done] = next;
+
+	adc->ready[adc->ready_in % ADC_BLOCKS_MAX] = (u8) full;
+	adc->ready_in++;
+	workq_post(&adc->work);
+}
+
+// Conversions lost because the DMA did not take them in time
+static void adc_irq(void *ctx)
+{
+	adc_Sampler *adc = ctx;
+	u32 overrun = 0U;
+
+	for (u32 i = 0U; i < adc->nadcs; i++)
+	{
+		if ((adc_regs[i]->SR & ADC_SR_OVR) != 0U)
+		{
+			adc_regs[i]->SR = ~ADC_SR_OVR;
+			overrun = 1U;
+		}
+	}
+
+	if (overrun != 0U)
+	{
+		// The ADC stops its DMA requests; both have to be started again
+		adc->overruns++;
+		adc_halt(adc);
+		adc_arm(adc);
+	}
+}
+
+static void adc_work(void *arg)
+{
+	adc_Sampler *adc = arg;
+
+	while (adc->ready_out != adc->ready_in)
+	{
+		u32 block = adc->ready[adc->ready_out % ADC_BLOCKS_MAX];
+
+		adc->callback(adc->arg, adc_block(adc, block), adc->block_samples);
+
+		adc->ready_out++;
+		adc_give_block(adc, block);
+	}
+}
+
+static void adc_clock_changed(void *arg, clock_Event event)
+{
+	adc_Sampler *adc = arg;
+
+	if (adc->running == 0U)
+	{
+		if (event == CLOCK_EVENT_POST)
+		{
+			adc_timing(adc);
+		}
+		return;
+	}
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		u32 primask = __get_PRIMASK();
+		__disable_irq();
+		adc_halt(adc);
+		__set_PRIMASK(primask);
+	}
+	else
+	{
+		// The blocks being filled start over
+		adc_timing(adc);
+		adc_arm(adc);
+	}
+}
+
+u32 adc_init(adc_Sampler *adc, const adc_Config *config)
+{
+	if ((adc == NULL) || (config == NULL) || (config->channels == NULL)
+			|| (config->buf == NULL) || (config->callback == NULL)
+			|| (config->rate_hz == 0U) || (config->sample_time > 7U)
+			|| (config->blocks < 3U) || (config->blocks > ADC_BLOCKS_MAX)
+			|| (config->block_samples == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	if (config->mode == ADC_MODE_TRIPLE)
+	{
+		u32 channel = config->channels[0];
+		if ((config->nchannels != 1U)
+				|| ((channel > 3U) && ((channel < 10U) || (channel > 13U)))
+				|| ((config->block_samples % 2U) != 0U)
+				|| ((config->block_samples / 2U) > ADC_NDTR_MAX)
+				|| (adc_delay_min(config->sample_time) > ADC_DELAY_MAX))
+		{
+			return ERR_GENERIC;
+		}
+	}
+	else if ((config->mode != ADC_MODE_SCAN)
+			|| (config->nchannels == 0U) || (config->nchannels > ADC_CHANNELS_MAX)
+			|| ((config->block_samples % config->nchannels) != 0U)
+			|| (config->block_samples > ADC_NDTR_MAX))
+	{
+		return ERR_GENERIC;
+	}
+
+	for (u32 i = 0U; i < config->nchannels; i++)
+	{
+		if (config->channels[i] > 17U)
+		{
+			return ERR_GENERIC;
+		}
+	}
+
+	adc->mode = config->mode;
+	adc->nadcs = (config->mode == ADC_MODE_TRIPLE) ? 3U : 1U;
+	adc->rate_hz = config->rate_hz;
+	adc->sample_time = config->sample_time;
+	adc->buf = config->buf;
+	adc->blocks = config->blocks;
+	adc->block_samples = config->block_samples;
+	adc->free = (config->blocks == 32U) ? 0xFFFFFFFFU : ((1U << config->blocks) - 1U);
+	adc->ready_in = 0U;
+	adc->ready_out = 0U;
+	adc->running = 0U;
+	adc->overruns = 0U;
+	adc->callback = config->callback;
+	adc->arg = config->arg;
+
+	if (workq_item_init(&adc->work, adc_work, adc, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	RCC->APB2ENR |= RCC_APB2ENR_ADC1EN | RCC_APB2ENR_TIM8EN
+			| ((adc->nadcs == 3U) ? (RCC_APB2ENR_ADC2EN | RCC_APB2ENR_ADC3EN) : 0U);
+	(void) RCC->APB2ENR;
+
+	u32 ccr = 0U;
+	u32 smpr1 = 0U;
+	u32 smpr2 = 0U;
+	u32 sqr[3] = { 0U, 0U, 0U };
+
+	for (u32 i = 0U; i < config->nchannels; i++)
+	{
+		u32 channel = config->channels[i];
+
+		pin_analog(adc_pin(channel));
+		if (channel >= 16U)
+		{
+			ccr |= ADC_CCR_TSVREFE;
+		}
+
+		if (channel >= 10U)
+		{
+			smpr1 |= config->sample_time << ((channel - 10U) * ADC_SMPR_BITS);
+		}
+		else
+		{
+			smpr2 |= config->sample_time << (channel * ADC_SMPR_BITS);
+		}
+
+		// SQR3 holds the first six, SQR2 the next six, SQR1 the rest
+		sqr[i / 6U] |= channel << ((i % 6U) * ADC_SQR_BITS);
+	}
+
+	if (adc->mode == ADC_MODE_TRIPLE)
+	{
+		ccr |= ADC_CCR_MULTI_TRIPLE | ADC_CCR_DDS;
+	}
+	ADC->CCR = ccr;
+
+	for (u32 i = 0U; i < adc->nadcs; i++)
+	{
+		ADC_TypeDef *regs = adc_regs[i];
+
+		regs->CR2 = 0U;
+		regs->CR1 = ADC_CR1_OVRIE | ((config->nchannels > 1U) ? ADC_CR1_SCAN : 0U);
+		regs->SMPR1 = smpr1;
+		regs->SMPR2 = smpr2;
+		regs->SQR1 = ((config->nchannels - 1U) << 20) | sqr[2];
+		regs->SQR2 = sqr[1];
+		regs->SQR3 = sqr[0];
+	}
+
+	if (adc->mode == ADC_MODE_SCAN)
+	{
+		// One scan per update event
+		TIM8->CR1 = 0U;
+		TIM8->CR2 = TIM_CR2_MMS_1;
+		ADC1->CR2 = ADC_CR2_DDS | ADC_CR2_EXTEN_0 | ADC_CR2_EXTSEL_TIM8;
+	}
+
+	adc_timing(adc);
+
+	for (u32 i = 0U; i < adc->nadcs; i++)
+	{
+		adc_regs[i]->CR2 |= ADC_CR2_ADON;
+	}
+
+	if (dma_stream_init(&adc->dma, 2U, ADC_DMA_STREAM, adc_dma_irq, adc,
+			config->priority) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_Stream_TypeDef *stream = adc->dma.regs;
+	if (adc->mode == ADC_MODE_TRIPLE)
+	{
+		// Two samples per request, in conversion order
+		stream->PAR = (u32) &ADC->CDR;
+		stream->CR = DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1;
+	}
+	else
+	{
+		stream->PAR = (u32) &ADC1->DR;
+		stream->CR = DMA_SxCR_PSIZE_0 | DMA_SxCR_MSIZE_0;
+	}
+	stream->CR |= (ADC_DMA_CHANNEL << DMA_CR_CHSEL_SHIFT)
+			| (ADC_DMA_PL_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_CR_DIR_P2M | DMA_SxCR_MINC | DMA_SxCR_DBM | DMA_SxCR_CIRC
+			| DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	if (irq_attach(ADC_IRQn, adc_irq, adc) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	NVIC_SetPriority(ADC_IRQn, config->priority);
+	NVIC_EnableIRQ(ADC_IRQn);
+
+	clock_listen(&adc->clock, adc_clock_changed, adc);
+
+	return ERR_NONE;
+}
+
+u32 adc_start(adc_Sampler *adc)
+{
+	if (adc->running != 0U)
+	{
+		return ERR_NONE;
+	}
+
+	u32 first = adc_take_block(adc);
+	u32 second = adc_take_block(adc);
+	if (second == ADC_NONE)
+	{
+		if (first != ADC_NONE)
+		{
+			adc_give_block(adc, first);
+		}
+		return ERR_GENERIC;
+	}
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	adc->target[0] = first;
+	adc->target[1] = second;
+	adc->running = 1U;
+	adc_arm(adc);
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+void adc_stop(adc_Sampler *adc)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (adc->running != 0U)
+	{
+		adc_halt(adc);
+		adc->running = 0U;
+		adc_give_block(adc, adc->target[0]);
+		adc_give_block(adc, adc->target[1]);
+	}
+
+	__set_PRIMASK(primask);
+}
+
+u32 adc_rate(const adc_Sampler *adc)
+{
+	return adc->rate;
+}
+
+u32 adc_overruns(const adc_Sampler *adc)
+{
+	return adc->overruns;
+}
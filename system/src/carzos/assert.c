@@ -2,6 +2,8 @@
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <trace.h>
+
 // ----------------------------------------------------------------------------
 
 void
@@ -9,11 +11,9 @@ __attribute__((noreturn))
 __assert_func (const char *file, int line, const char *func,
                const char *failedexpr)
 {
-	/*
   trace_printf ("assertion \"%s\" failed: file \"%s\", line %d%s%s\n",
                 failedexpr, file, line, func ? ", function: " : "",
                 func ? func : "");
-    */
   abort ();
   /* NOTREACHED */
 }
@@ -40,7 +40,7 @@ void
 __attribute__((noreturn, weak))
 assert_failed (uint8_t* file, uint32_t line)
 {
-  // TODO trace_printf ("assert_param() failed: file \"%s\", line %d\n", file, line);
+  trace_printf ("assert_param() failed: file \"%s\", line %d\n", file, line);
   abort ();
   /* NOTREACHED */
 }
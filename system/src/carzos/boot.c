@@ -32,6 +32,9 @@
 #include <limits.h>
 #include <signal.h>
 
+#include <bootprof.h>
+#include <restart.h>
+
 // ----------------------------------------------------------------------------
 
 #if !defined(DEBUG)
@@ -82,18 +85,13 @@ abort(void)
 
 // ----------------------------------------------------------------------------
 
-// Begin address for the initialisation values of the .data section.
-// defined in linker script
-extern unsigned int _data_begin_rom;
-// Begin address for the .data section; defined in linker script
-extern unsigned int _data_begin_ram;
-// End address for the .data section; defined in linker script
-extern unsigned int _data_end_ram;
-
-// Begin address for the .bss section; defined in linker script
-extern unsigned int _bss_begin_ram;
-// End address for the .bss section; defined in linker script
-extern unsigned int _bss_end_ram;
+// The region tables, generated by the linker script in the .inits section.
+// Each .data entry is three words: load address, begin and end in RAM.
+// Each .bss entry is two words: begin and end in RAM.
+extern unsigned int* __data_regions_array_start;
+extern unsigned int* __data_regions_array_end;
+extern unsigned int* __bss_regions_array_start;
+extern unsigned int* __bss_regions_array_end;
 
 void __initialize_args(int* p_argc, char*** p_argv);
 
@@ -153,13 +151,60 @@ void __hardware_init(void);
 
 // ----------------------------------------------------------------------------
 
+// Both routines move eight words per LDM/STM pair, which the Cortex-M4
+// issues as back to back bus transfers, and finish the tail word by word.
+// It is assumed that the pointers are word aligned.
+// r7 is left out of the register lists since it is the Thumb frame
+// pointer in the Debug configuration.
+//
+// CARZOS_BOOT_WORD_LOOP builds the plain word loops instead, to measure
+// the difference with bootprof_report().
+
+#if defined(CARZOS_BOOT_WORD_LOOP)
+
+inline void
+__attribute__((always_inline))
+__initialize_data(unsigned int* from, unsigned int* region_begin, unsigned int* region_end)
+{
+  unsigned int *p = region_begin;
+  while (p < region_end)
+    *p++ = *from++;
+}
+
+inline void
+__attribute__((always_inline))
+__initialize_bss(unsigned int* region_begin, unsigned int* region_end)
+{
+  unsigned int *p = region_begin;
+  while (p < region_end)
+    *p++ = 0;
+}
+
+#else
+
 inline void
 __attribute__((always_inline))
 __initialize_data(unsigned int* from, unsigned int* region_begin, unsigned int* region_end)
 {
-  // Iterate and copy word by word.
-  // It is assumed that the pointers are word aligned.
   unsigned int *p = region_begin;
+  unsigned int bursts = ((unsigned int) (region_end - p)) / 8u;
+
+  if (bursts != 0u)
+    {
+      asm volatile
+      (
+          "1:                                           \n"
+          " ldmia %[src]!, {r3, r4, r5, r6, r8, r9, r10, r12} \n"
+          " stmia %[dst]!, {r3, r4, r5, r6, r8, r9, r10, r12} \n"
+          " subs  %[n], %[n], #1                        \n"
+          " bne   1b                                    \n"
+
+          : [src] "+r" (from), [dst] "+r" (p), [n] "+r" (bursts)
+          :
+          : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory"
+      );
+    }
+
   while (p < region_end)
     *p++ = *from++;
 }
@@ -168,13 +213,38 @@ inline void
 __attribute__((always_inline))
 __initialize_bss(unsigned int* region_begin, unsigned int* region_end)
 {
-  // Iterate and clear word by word.
-  // It is assumed that the pointers are word aligned.
   unsigned int *p = region_begin;
+  unsigned int bursts = ((unsigned int) (region_end - p)) / 8u;
+
+  if (bursts != 0u)
+    {
+      asm volatile
+      (
+          " movs  r3, #0                                \n"
+          " movs  r4, #0                                \n"
+          " movs  r5, #0                                \n"
+          " movs  r6, #0                                \n"
+          " mov   r8, r3                                \n"
+          " mov   r9, r3                                \n"
+          " mov   r10, r3                               \n"
+          " mov   r12, r3                               \n"
+          "1:                                           \n"
+          " stmia %[dst]!, {r3, r4, r5, r6, r8, r9, r10, r12} \n"
+          " subs  %[n], %[n], #1                        \n"
+          " bne   1b                                    \n"
+
+          : [dst] "+r" (p), [n] "+r" (bursts)
+          :
+          : "r3", "r4", "r5", "r6", "r8", "r9", "r10", "r12", "cc", "memory"
+      );
+    }
+
   while (p < region_end)
     *p++ = 0;
 }
 
+#endif // defined(CARZOS_BOOT_WORD_LOOP)
+
 // This is the place where Cortex-M core will go immediately after reset,
 // via a call or jump from the Reset_Handler.
 //
@@ -194,16 +264,49 @@ _start(void)
   // Also useful on platform with external RAM, that need to be
   // initialised before filling the BSS section.
 
-	__hardware_init_early();
+  // Zero the cycle counter; every startup stage is stamped from here.
+  bootprof_start();
+
+  // After a warm restart the clock is still running at full speed; the
+  // early init would stop the PLL (SystemInit() resets the RCC).
+  if (restart_take () == 0u)
+    {
+      __hardware_init_early();
+    }
+
+  bootprof_stamp(BOOTPROF_EARLY);
+
+  // Use the region tables from the linker script, that will manage
+  // multiple DATA and BSS sections.
 
-  // Use Old Style DATA and BSS section initialisation,
-  // that will manage a single BSS sections.
+  // Copy the DATA segments from Flash to RAM (inlined).
+  unsigned int words = 0;
+  for (unsigned int** p = &__data_regions_array_start;
+      p < &__data_regions_array_end;)
+    {
+      unsigned int* from = (*p++);
+      unsigned int* region_begin = (*p++);
+      unsigned int* region_end = (*p++);
 
-  // Copy the DATA segment from Flash to RAM (inlined).
-  __initialize_data(&_data_begin_rom, &_data_begin_ram, &_data_end_ram);
+      __initialize_data (from, region_begin, region_end);
+      words += (unsigned int) (region_end - region_begin);
+    }
 
-  // Zero fill the BSS section (inlined).
-  __initialize_bss(&_bss_begin_ram, &_bss_end_ram);
+  bootprof_stamp_words(BOOTPROF_DATA, words);
+
+  // Zero fill the BSS sections (inlined).
+  words = 0;
+  for (unsigned int** p = &__bss_regions_array_start;
+      p < &__bss_regions_array_end;)
+    {
+      unsigned int* region_begin = (*p++);
+      unsigned int* region_end = (*p++);
+
+      __initialize_bss (region_begin, region_end);
+      words += (unsigned int) (region_end - region_begin);
+    }
+
+  bootprof_stamp_words(BOOTPROF_BSS, words);
 
   // Hook to continue the initialisations. Usually compute and store the
   // clock frequency in the global CMSIS variable, cleared above.
@@ -214,6 +317,8 @@ _start(void)
   char** argv;
   __initialize_args(&argc, &argv);
 
+  bootprof_stamp(BOOTPROF_MAIN);
+
   // Call the main entry point, and save the exit code.
   int code = main(argc, argv);
 
@@ -0,0 +1,142 @@
+/*
+ * bootprof.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <bootprof.h>
+#include <clock.h>
+#include <dwt.h>
+#include <sections.h>
+#include <trace.h>
+
+#include "ktype.h"
+
+// From system_stm32f4xx.c; const, so usable before RAM is initialised
+extern const u8 AHBPrescTable[16];
+
+static bootprof_Entry bootprof_trace[BOOTPROF_STAGES] CARZOS_NOINIT;
+
+
+// Same computation as SystemCoreClockUpdate(), without the RAM variable
+// and with the board's HSE (clock_board is const, in flash)
+static u32 bootprof_hz(void)
+{
+	u32 cfgr = RCC->CFGR;
+	u32 sysclk;
+
+	switch (cfgr & RCC_CFGR_SWS)
+	{
+	case RCC_CFGR_SWS_HSE:
+		sysclk = clock_board.hse_hz;
+		break;
+
+	case RCC_CFGR_SWS_PLL:
+	{
+		u32 pllcfgr = RCC->PLLCFGR;
+		u32 input = ((pllcfgr & RCC_PLLCFGR_PLLSRC) != 0U) ? clock_board.hse_hz : HSI_VALUE;
+		u32 pllm = pllcfgr & RCC_PLLCFGR_PLLM;
+		u32 plln = (pllcfgr & RCC_PLLCFGR_PLLN) >> 6;
+		u32 pllp = (((pllcfgr & RCC_PLLCFGR_PLLP) >> 16) + 1U) * 2U;
+		sysclk = (pllm != 0U) ? (((input / pllm) * plln) / pllp) : HSI_VALUE;
+		break;
+	}
+
+	default:
+		sysclk = HSI_VALUE;
+		break;
+	}
+
+	return sysclk >> AHBPrescTable[(cfgr & RCC_CFGR_HPRE) >> 4];
+}
+
+void bootprof_start(void)
+{
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CYCCNT = 0U;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	for (u32 i = 0U; i < BOOTPROF_STAGES; i++)
+	{
+		bootprof_trace[i].cycles = 0U;
+		bootprof_trace[i].hz = 0U;
+		bootprof_trace[i].words = 0U;
+	}
+
+	bootprof_stamp(BOOTPROF_RESET);
+}
+
+void bootprof_stamp(bootprof_Stage stage)
+{
+	u32 cycles = dwt_cycles();
+
+	bootprof_trace[stage].cycles = cycles;
+	bootprof_trace[stage].hz = bootprof_hz();
+}
+
+void bootprof_stamp_words(bootprof_Stage stage, u32 words)
+{
+	bootprof_stamp(stage);
+	bootprof_trace[stage].words = words;
+}
+
+const bootprof_Entry *bootprof_get(void)
+{
+	return bootprof_trace;
+}
+
+u32 bootprof_us(bootprof_Stage stage)
+{
+	u64 us = 0U;
+	u32 last = BOOTPROF_RESET;
+
+	for (u32 i = BOOTPROF_RESET + 1U; (i <= (u32) stage) && (i < BOOTPROF_STAGES); i++)
+	{
+		if (bootprof_trace[i].cycles == 0U)
+		{
+			// Not reached
+			continue;
+		}
+
+		u32 delta = bootprof_trace[i].cycles - bootprof_trace[last].cycles;
+		us += ((u64) delta * 1000000U) / bootprof_trace[last].hz;
+		last = i;
+	}
+
+	return (u32) us;
+}
+
+void bootprof_report(void)
+{
+#if defined(TRACE)
+	static const char *const names[BOOTPROF_STAGES] =
+	{
+		"reset", "early", "data", "bss", "hal", "clock", "hardware", "main",
+	};
+	u32 last = BOOTPROF_RESET;
+
+	for (u32 i = BOOTPROF_RESET + 1U; i < BOOTPROF_STAGES; i++)
+	{
+		const bootprof_Entry *entry = &bootprof_trace[i];
+		if (entry->cycles == 0U)
+		{
+			continue;
+		}
+
+		u32 cycles = entry->cycles - bootprof_trace[last].cycles;
+		u32 us = bootprof_us((bootprof_Stage) i);
+		if (entry->words != 0U)
+		{
+			u32 per_word = (u32) (((u64) cycles * 100U) / entry->words);
+			trace_printf("boot %s: %u cycles, %u us, %u words, %u.%02u cycles/word\n",
+					names[i], cycles, us, entry->words, per_word / 100U, per_word % 100U);
+		}
+		else
+		{
+			trace_printf("boot %s: %u cycles, %u us\n", names[i], cycles, us);
+		}
+		last = i;
+	}
+#endif
+}
@@ -0,0 +1,705 @@
+/*
+ * can.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <can.h>
+#include <clock.h>
+#include <irq.h>
+#include <pin.h>
+#include <workq.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define CAN_MAILBOXES           (3U)
+#define CAN_BTR_NONE            (0xFFFFFFFFU)
+#define CAN_INAK_SPINS          (1000000U)
+#define CAN_TXQ_NONE            (0xFFFFFFFFU)
+#define CAN_TSR_TME_SHIFT       (26U)           // TME0, one bit per mailbox
+
+// Bit timing: 8 to 25 time quanta, sampled at 87.5 %
+#define CAN_TQ_MIN              (8U)
+#define CAN_TQ_MAX              (25U)
+#define CAN_TS1_MAX             (16U)
+#define CAN_TS2_MAX             (8U)
+#define CAN_BRP_MAX             (1024U)
+
+// TIR / RIR layout: standard ID at 21, extended at 3
+#define CAN_IR_STD_SHIFT        (21U)
+#define CAN_IR_EXT_SHIFT        (3U)
+#define CAN_IR_IDE              (CAN_TI0R_IDE)
+#define CAN_IR_RTR              (CAN_TI0R_RTR)
+
+// 16-bit filter layout: STID at 5, RTR 4, IDE 3
+#define CAN_F16_STD_SHIFT       (5U)
+#define CAN_F16_IDE             (0x08U)
+
+#define CAN_FMR_CAN2SB_SHIFT    (8U)
+
+// Bank kinds, by scale and mode
+#define CAN_KIND_STD_LIST       (0U)            // 16-bit list
+#define CAN_KIND_STD_MASK       (1U)            // 16-bit ID / mask
+#define CAN_KIND_EXT_LIST       (2U)            // 32-bit list
+#define CAN_KIND_EXT_MASK       (3U)            // 32-bit ID / mask
+
+typedef struct can_bank
+{
+	u8 kind;
+	u8 fifo;
+	u8 used;
+	u32 entry[4];
+} can_Bank;
+
+typedef struct can_port
+{
+	CAN_TypeDef *regs;
+	u32 ready;
+	u32 instance;
+	u32 bitrate;
+	u32 loopback;
+	u32 bank_first;
+	// No bit timing for the clock: kept in init mode
+	volatile u32 offbus;
+
+	can_Frame *ring;
+	u32 ring_mask;
+	volatile u32 head;
+	volatile u32 tail;
+	volatile u32 overruns;
+
+	// Sorted by falling key; the next to send is the last. One spare
+	// entry for a frame coming back from an aborted mailbox.
+	can_Frame txq[CAN_TX_QUEUE + 1U];
+	u32 txq_key[CAN_TX_QUEUE + 1U];
+	u32 txq_len;
+	// The frames loaded in the mailboxes, and the one being aborted
+	can_Frame mailbox[CAN_MAILBOXES];
+	u32 mailbox_key[CAN_MAILBOXES];
+	u32 aborting;
+
+	can_Bank banks[CAN_BANKS];
+	u32 nbanks;
+
+	can_Callback callback;
+	void *arg;
+	workq_Item work;
+	clock_Listener clock;
+} can_Port;
+
+static can_Port can_ports[CAN_INSTANCES];
+
+// Entries per bank of each kind
+static const u8 can_slots[4] = { 4U, 2U, 2U, 1U };
+
+
+static can_Port *can_port(u32 instance)
+{
+	if ((instance < 1U) || (instance > CAN_INSTANCES) || (can_ports[instance - 1U].ready == 0U))
+	{
+		return NULL;
+	}
+	return &can_ports[instance - 1U];
+}
+
+// The TIR value of a frame. Compared as numbers, a lower one wins the
+// arbitration: the 11 base bits come first, then IDE (standard first),
+// then RTR (data first).
+static u32 can_key(const can_Frame *frame)
+{
+	u32 rtr = (frame->rtr != 0U) ? CAN_IR_RTR : 0U;
+
+	if ((frame->id & CAN_EXT_ID) != 0U)
+	{
+		return ((frame->id & CAN_EXT_ID_MAX) << CAN_IR_EXT_SHIFT) | CAN_IR_IDE | rtr;
+	}
+	return (frame->id << CAN_IR_STD_SHIFT) | rtr;
+}
+
+static u32 can_btr(u32 pclk, u32 bitrate)
+{
+	for (u32 tq = CAN_TQ_MAX; tq >= CAN_TQ_MIN; tq--)
+	{
+		if ((pclk % (bitrate * tq)) != 0U)
+		{
+			continue;
+		}
+
+		u32 brp = pclk / (bitrate * tq);
+		u32 ts1 = ((tq * 7U) / 8U) - 1U;        // after the 1 tq sync segment
+		u32 ts2 = tq - 1U - ts1;
+		if ((brp <= CAN_BRP_MAX) && (ts1 <= CAN_TS1_MAX) && (ts2 <= CAN_TS2_MAX))
+		{
+			// SJW 1
+			return ((ts2 - 1U) << 20) | ((ts1 - 1U) << 16) | (brp - 1U);
+		}
+	}
+	return CAN_BTR_NONE;
+}
+
+static u32 can_wait_inak(CAN_TypeDef *regs, u32 set)
+{
+	for (u32 i = 0U; i < CAN_INAK_SPINS; i++)
+	{
+		if (((regs->MSR & CAN_MSR_INAK) != 0U) == (set != 0U))
+		{
+			return ERR_NONE;
+		}
+	}
+	return ERR_GENERIC;
+}
+
+// ----------------------------------------------------------------------------
+
+// Writes one bank; the filters of both instances stop for the time it
+// takes, so this is for set up, not for the hot path.
+static void can_bank_write(u32 n, u32 list, u32 scale32, u32 fifo, u32 fr1, u32 fr2)
+{
+	u32 bit = 1U << n;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	CAN1->FMR |= CAN_FMR_FINIT;
+	CAN1->FA1R &= ~bit;
+
+	CAN1->FM1R = (list != 0U) ? (CAN1->FM1R | bit) : (CAN1->FM1R & ~bit);
+	CAN1->FS1R = (scale32 != 0U) ? (CAN1->FS1R | bit) : (CAN1->FS1R & ~bit);
+	CAN1->FFA1R = (fifo != 0U) ? (CAN1->FFA1R | bit) : (CAN1->FFA1R & ~bit);
+	CAN1->sFilterRegister[n].FR1 = fr1;
+	CAN1->sFilterRegister[n].FR2 = fr2;
+
+	CAN1->FA1R |= bit;
+	CAN1->FMR &= ~CAN_FMR_FINIT;
+
+	__set_PRIMASK(primask);
+}
+
+// Unused slots repeat the first entry, so they accept nothing more
+static void can_bank_apply(const can_Port *port, u32 index)
+{
+	const can_Bank *bank = &port->banks[index];
+	u32 e[4];
+
+	for (u32 i = 0U; i < 4U; i++)
+	{
+		e[i] = (i < bank->used) ? bank->entry[i] : bank->entry[0];
+	}
+
+	u32 fr1;
+	u32 fr2;
+	switch (bank->kind)
+	{
+	case CAN_KIND_STD_LIST:
+		fr1 = e[0] | (e[1] << 16);
+		fr2 = e[2] | (e[3] << 16);
+		break;
+	case CAN_KIND_EXT_MASK:
+		// ID and mask of the single entry
+		fr1 = bank->entry[0];
+		fr2 = bank->entry[1];
+		break;
+	default:
+		fr1 = e[0];
+		fr2 = e[1];
+		break;
+	}
+
+	can_bank_write(port->bank_first + index,
+			((bank->kind == CAN_KIND_STD_LIST) || (bank->kind == CAN_KIND_EXT_LIST)) ? 1U : 0U,
+			(bank->kind >= CAN_KIND_EXT_LIST) ? 1U : 0U,
+			bank->fifo, fr1, fr2);
+}
+
+u32 can_filter_add(u32 instance, u32 id, u32 mask, u32 fifo)
+{
+	can_Port *port = can_port(instance);
+	u32 ext = id & CAN_EXT_ID;
+	u32 max = (ext != 0U) ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX;
+	u32 raw = id & ~CAN_EXT_ID;
+
+	if ((port == NULL) || (raw > max) || (fifo > 1U))
+	{
+		return ERR_GENERIC;
+	}
+	mask &= max;
+
+	u32 kind;
+	u32 entry[2] = { 0U, 0U };
+	if (ext == 0U)
+	{
+		if (mask == max)
+		{
+			kind = CAN_KIND_STD_LIST;
+			entry[0] = raw << CAN_F16_STD_SHIFT;
+		}
+		else
+		{
+			// IDE must match, RTR does not matter
+			kind = CAN_KIND_STD_MASK;
+			entry[0] = (raw << CAN_F16_STD_SHIFT)
+					| (((mask << CAN_F16_STD_SHIFT) | CAN_F16_IDE) << 16);
+		}
+	}
+	else if (mask == max)
+	{
+		kind = CAN_KIND_EXT_LIST;
+		entry[0] = (raw << CAN_IR_EXT_SHIFT) | CAN_IR_IDE;
+	}
+	else
+	{
+		kind = CAN_KIND_EXT_MASK;
+		entry[0] = (raw << CAN_IR_EXT_SHIFT) | CAN_IR_IDE;
+		entry[1] = (mask << CAN_IR_EXT_SHIFT) | CAN_IR_IDE;
+	}
+
+	// A bank of the same kind and FIFO with room, or a new one; the first
+	// one replaces the accept-all bank
+	u32 index = 0U;
+	while ((index < port->nbanks)
+			&& ((port->banks[index].kind != kind) || (port->banks[index].fifo != fifo)
+					|| (port->banks[index].used >= can_slots[kind])))
+	{
+		index++;
+	}
+
+	can_Bank *bank = &port->banks[index];
+	if (index == port->nbanks)
+	{
+		if (port->nbanks == CAN_BANKS)
+		{
+			return ERR_GENERIC;
+		}
+		port->nbanks++;
+		bank->kind = (u8) kind;
+		bank->fifo = (u8) fifo;
+		bank->used = 0U;
+	}
+
+	if (kind == CAN_KIND_EXT_MASK)
+	{
+		bank->entry[0] = entry[0];
+		bank->entry[1] = entry[1];
+	}
+	else
+	{
+		bank->entry[bank->used] = entry[0];
+	}
+	bank->used++;
+
+	can_bank_apply(port, index);
+
+	return ERR_NONE;
+}
+
+// ----------------------------------------------------------------------------
+
+static void can_load(can_Port *port, u32 m, const can_Frame *frame, u32 key)
+{
+	CAN_TxMailBox_TypeDef *mb = &port->regs->sTxMailBox[m];
+	u32 lo;
+	u32 hi;
+
+	memcpy(&lo, &frame->data[0], sizeof(lo));
+	memcpy(&hi, &frame->data[4], sizeof(hi));
+	mb->TDTR = frame->len;
+	mb->TDLR = lo;
+	mb->TDHR = hi;
+
+	port->mailbox[m] = *frame;
+	port->mailbox_key[m] = key;
+	mb->TIR = key | CAN_TI0R_TXRQ;
+}
+
+// Frames of equal keys keep their order. A frame back from an aborted
+// mailbox goes ahead of its equal keys: it was queued before them.
+static void can_txq_insert(can_Port *port, const can_Frame *frame, u32 key, u32 back)
+{
+	u32 i = port->txq_len;
+	while ((i > 0U) && ((port->txq_key[i - 1U] < key)
+			|| ((back == 0U) && (port->txq_key[i - 1U] == key))))
+	{
+		port->txq[i] = port->txq[i - 1U];
+		port->txq_key[i] = port->txq_key[i - 1U];
+		i--;
+	}
+	port->txq[i] = *frame;
+	port->txq_key[i] = key;
+	port->txq_len++;
+}
+
+// The best queued frame whose key is not in a mailbox, CAN_TXQ_NONE when
+// there is none. The hardware sends equal keys in mailbox number order,
+// not in load order, so a key gets one mailbox at a time.
+static u32 can_txq_next(const can_Port *port, u32 tsr)
+{
+	for (u32 i = port->txq_len; i > 0U; i--)
+	{
+		u32 busy = 0U;
+		for (u32 m = 0U; m < CAN_MAILBOXES; m++)
+		{
+			if (((tsr & (CAN_TSR_TME0 << m)) == 0U)
+					&& (port->mailbox_key[m] == port->txq_key[i - 1U]))
+			{
+				busy = 1U;
+			}
+		}
+		if (busy == 0U)
+		{
+			return i - 1U;
+		}
+	}
+	return CAN_TXQ_NONE;
+}
+
+static void can_txq_remove(can_Port *port, u32 i)
+{
+	port->txq_len--;
+	for (; i < port->txq_len; i++)
+	{
+		port->txq[i] = port->txq[i + 1U];
+		port->txq_key[i] = port->txq_key[i + 1U];
+	}
+}
+
+// Keeps the mailboxes loaded from the queue; with all three loaded, the
+// lowest priority one is aborted when the queue holds a better frame.
+// Called with the TX interrupt masked.
+static void can_tx_fill(can_Port *port)
+{
+	CAN_TypeDef *regs = port->regs;
+
+	for (;;)
+	{
+		u32 tsr = regs->TSR;
+
+		// An abort that is over waits for the interrupt to take the frame
+		// back before its mailbox is loaded again
+		if ((tsr & (port->aborting << CAN_TSR_TME_SHIFT)) != 0U)
+		{
+			return;
+		}
+
+		u32 next = can_txq_next(port, tsr);
+		if (next == CAN_TXQ_NONE)
+		{
+			return;
+		}
+
+		if ((tsr & CAN_TSR_TME) != 0U)
+		{
+			can_load(port, (tsr & CAN_TSR_CODE) >> 24, &port->txq[next], port->txq_key[next]);
+			can_txq_remove(port, next);
+			continue;
+		}
+
+		if (port->aborting == 0U)
+		{
+			u32 worst = 0U;
+			for (u32 m = 1U; m < CAN_MAILBOXES; m++)
+			{
+				if (port->mailbox_key[m] > port->mailbox_key[worst])
+				{
+					worst = m;
+				}
+			}
+			if (port->txq_key[next] < port->mailbox_key[worst])
+			{
+				port->aborting = 1U << worst;
+				regs->TSR = CAN_TSR_ABRQ0 << (8U * worst);
+			}
+		}
+		return;
+	}
+}
+
+static void can_tx_irq(void *ctx)
+{
+	can_Port *port = ctx;
+	CAN_TypeDef *regs = port->regs;
+	u32 tsr = regs->TSR;
+
+	for (u32 m = 0U; m < CAN_MAILBOXES; m++)
+	{
+		u32 status = tsr >> (8U * m);
+		if ((status & CAN_TSR_RQCP0) == 0U)
+		{
+			continue;
+		}
+
+		// Clears RQCP, TXOK, ALST and TERR
+		regs->TSR = CAN_TSR_RQCP0 << (8U * m);
+
+		if ((port->aborting & (1U << m)) != 0U)
+		{
+			// Sent anyway when the abort came too late
+			if ((status & CAN_TSR_TXOK0) == 0U)
+			{
+				can_txq_insert(port, &port->mailbox[m], port->mailbox_key[m], 1U);
+			}
+			port->aborting = 0U;
+		}
+	}
+
+	can_tx_fill(port);
+}
+
+u32 can_send(u32 instance, const can_Frame *frame)
+{
+	can_Port *port = can_port(instance);
+
+	if ((port == NULL) || (port->offbus != 0U) || (frame == NULL) || (frame->len > 8U)
+			|| ((frame->id & ~CAN_EXT_ID)
+					> (((frame->id & CAN_EXT_ID) != 0U) ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX)))
+	{
+		return ERR_GENERIC;
+	}
+
+	u32 status = ERR_GENERIC;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (port->txq_len < CAN_TX_QUEUE)
+	{
+		can_txq_insert(port, frame, can_key(frame), 0U);
+		can_tx_fill(port);
+		status = ERR_NONE;
+	}
+
+	__set_PRIMASK(primask);
+
+	return status;
+}
+
+// ----------------------------------------------------------------------------
+
+// Takes every frame in the FIFO. Both FIFO interrupts run at the same
+// priority, so they never write the ring at the same time.
+static void can_rx_drain(can_Port *port, u32 fifo)
+{
+	CAN_TypeDef *regs = port->regs;
+	volatile u32 *rfr = (fifo == 0U) ? &regs->RF0R : &regs->RF1R;
+	CAN_FIFOMailBox_TypeDef *mb = &regs->sFIFOMailBox[fifo];
+	u32 head = port->head;
+	u32 received = 0U;
+
+	if ((*rfr & CAN_RF0R_FOVR0) != 0U)
+	{
+		*rfr = CAN_RF0R_FOVR0;
+		port->overruns++;
+	}
+
+	while ((*rfr & CAN_RF0R_FMP0) != 0U)
+	{
+		if ((head - port->tail) > port->ring_mask)
+		{
+			port->overruns++;
+		}
+		else
+		{
+			can_Frame *frame = &port->ring[head & port->ring_mask];
+			u32 rir = mb->RIR;
+			u32 len = mb->RDTR & CAN_RDT0R_DLC;
+			u32 lo = mb->RDLR;
+			u32 hi = mb->RDHR;
+
+			frame->id = ((rir & CAN_IR_IDE) != 0U)
+					? ((rir >> CAN_IR_EXT_SHIFT) | CAN_EXT_ID) : (rir >> CAN_IR_STD_SHIFT);
+			frame->rtr = ((rir & CAN_IR_RTR) != 0U) ? 1U : 0U;
+			frame->len = (u8) ((len > 8U) ? 8U : len);
+			memcpy(&frame->data[0], &lo, sizeof(lo));
+			memcpy(&frame->data[4], &hi, sizeof(hi));
+			head++;
+			received = 1U;
+		}
+
+		*rfr = CAN_RF0R_RFOM0;
+		while ((*rfr & CAN_RF0R_RFOM0) != 0U)
+		{
+		}
+	}
+
+	if (received != 0U)
+	{
+		__DMB();
+		port->head = head;
+		if (port->callback != NULL)
+		{
+			workq_post(&port->work);
+		}
+	}
+}
+
+static void can_rx0_irq(void *ctx)
+{
+	can_rx_drain(ctx, 0U);
+}
+
+static void can_rx1_irq(void *ctx)
+{
+	can_rx_drain(ctx, 1U);
+}
+
+u32 can_receive(u32 instance, can_Frame *frame)
+{
+	can_Port *port = can_port(instance);
+	if ((port == NULL) || (frame == NULL))
+	{
+		return ERR_GENERIC;
+	}
+
+	u32 tail = port->tail;
+	if (tail == port->head)
+	{
+		return ERR_GENERIC;
+	}
+
+	__DMB();
+	*frame = port->ring[tail & port->ring_mask];
+	__DMB();
+	port->tail = tail + 1U;
+
+	return ERR_NONE;
+}
+
+u32 can_overruns(u32 instance)
+{
+	can_Port *port = can_port(instance);
+	return (port != NULL) ? port->overruns : 0U;
+}
+
+static void can_work(void *arg)
+{
+	can_Port *port = arg;
+	port->callback(port->arg, port->instance);
+}
+
+// ----------------------------------------------------------------------------
+
+// The controller sits in init mode while the clock changes; queued frames
+// stay in the mailboxes. When the bit rate cannot be made from the new
+// clock it stays there, off the bus, until a later change allows it. POST
+// runs with interrupts masked, so it does not wait for the 11 recessive
+// bits that leaving init mode takes.
+static void can_clock_changed(void *arg, clock_Event event)
+{
+	can_Port *port = arg;
+	CAN_TypeDef *regs = port->regs;
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		regs->MCR |= CAN_MCR_INRQ;
+		(void) can_wait_inak(regs, 1U);
+	}
+	else
+	{
+		u32 btr = can_btr(clock_pclk1(), port->bitrate);
+		if (btr == CAN_BTR_NONE)
+		{
+			port->offbus = 1U;
+			return;
+		}
+		regs->BTR = (regs->BTR & (CAN_BTR_LBKM | CAN_BTR_SILM)) | btr;
+		regs->MCR &= ~CAN_MCR_INRQ;
+		port->offbus = 0U;
+	}
+}
+
+u32 can_init(u32 instance, const can_Config *config)
+{
+	if ((instance < 1U) || (instance > CAN_INSTANCES) || (config == NULL)
+			|| (config->ring == NULL) || (config->ring_len == 0U)
+			|| ((config->ring_len & (config->ring_len - 1U)) != 0U)
+			|| (config->bitrate == 0U) || (config->mode > CAN_BUS_LOOPBACK))
+	{
+		return ERR_GENERIC;
+	}
+
+	u32 btr = can_btr(clock_pclk1(), config->bitrate);
+	if (btr == CAN_BTR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	can_Port *port = &can_ports[instance - 1U];
+	memset(port, 0, sizeof(*port));
+	port->regs = (instance == 1U) ? CAN1 : CAN2;
+	port->instance = instance;
+	port->bitrate = config->bitrate;
+	port->loopback = (config->mode == CAN_BUS_LOOPBACK) ? 1U : 0U;
+	port->bank_first = (instance - 1U) * CAN_BANKS;
+	port->ring = config->ring;
+	port->ring_mask = config->ring_len - 1U;
+	port->callback = config->callback;
+	port->arg = config->arg;
+
+	if ((config->callback != NULL)
+			&& (workq_item_init(&port->work, can_work, port, config->level) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	// CAN2 needs the CAN1 clock for the filters
+	RCC->APB1ENR |= RCC_APB1ENR_CAN1EN | ((instance == 2U) ? RCC_APB1ENR_CAN2EN : 0U);
+	(void) RCC->APB1ENR;
+
+	pin_af(config->tx_pin, GPIO_AF9_CAN1, GPIO_NOPULL, PIN_PUSH_PULL);
+	pin_af(config->rx_pin, GPIO_AF9_CAN1, GPIO_PULLUP, PIN_PUSH_PULL);
+
+	CAN_TypeDef *regs = port->regs;
+	regs->MCR = CAN_MCR_INRQ;
+	if (can_wait_inak(regs, 1U) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	// Bus-off recovery by the hardware; mailboxes in ID order (TXFP 0)
+	regs->MCR = CAN_MCR_INRQ | CAN_MCR_ABOM;
+	regs->BTR = btr | ((port->loopback != 0U) ? (CAN_BTR_LBKM | CAN_BTR_SILM) : 0U);
+
+	// The bank split, and a bank that takes everything until filters come
+	CAN1->FMR = (CAN1->FMR & ~CAN_FMR_CAN2SB) | (CAN_BANKS << CAN_FMR_CAN2SB_SHIFT);
+	can_bank_write(port->bank_first, 0U, 1U, 0U, 0U, 0U);
+
+	if ((irq_attach((instance == 1U) ? CAN1_TX_IRQn : CAN2_TX_IRQn, can_tx_irq, port) != ERR_NONE)
+			|| (irq_attach((instance == 1U) ? CAN1_RX0_IRQn : CAN2_RX0_IRQn, can_rx0_irq, port)
+					!= ERR_NONE)
+			|| (irq_attach((instance == 1U) ? CAN1_RX1_IRQn : CAN2_RX1_IRQn, can_rx1_irq, port)
+					!= ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	static const IRQn_Type irqs[CAN_INSTANCES][3] =
+	{
+		{ CAN1_TX_IRQn, CAN1_RX0_IRQn, CAN1_RX1_IRQn },
+		{ CAN2_TX_IRQn, CAN2_RX0_IRQn, CAN2_RX1_IRQn },
+	};
+	for (u32 i = 0U; i < 3U; i++)
+	{
+		NVIC_SetPriority(irqs[instance - 1U][i], config->priority);
+		NVIC_EnableIRQ(irqs[instance - 1U][i]);
+	}
+
+	regs->IER = CAN_IER_TMEIE | CAN_IER_FMPIE0 | CAN_IER_FOVIE0 | CAN_IER_FMPIE1 | CAN_IER_FOVIE1;
+
+	// Leaving init mode waits for 11 recessive bits on the bus
+	regs->MCR &= ~CAN_MCR_INRQ;
+	if (can_wait_inak(regs, 0U) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	port->ready = 1U;
+	clock_listen(&port->clock, can_clock_changed, port);
+
+	return ERR_NONE;
+}
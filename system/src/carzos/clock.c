@@ -0,0 +1,482 @@
+/*
+ * clock.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <clock.h>
+#include <dwt.h>
+#include <timer.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+// Limits of the F405/407 at 2.7 V and above
+#define CLOCK_PLL_INPUT_MIN_HZ  (1000000U)
+#define CLOCK_PLL_INPUT_MAX_HZ  (2000000U)
+#define CLOCK_PLL_M_MAX         (63U)
+#define CLOCK_PLL_N_MIN         (50U)
+#define CLOCK_PLL_N_MAX         (432U)
+#define CLOCK_VCO_MIN_HZ        (100000000U)
+#define CLOCK_VCO_MAX_HZ        (432000000U)
+#define CLOCK_USB_HZ            (48000000U)
+#define CLOCK_APB1_MAX_HZ       (42000000U)
+#define CLOCK_APB2_MAX_HZ       (84000000U)
+#define CLOCK_FLASH_WS_HZ       (30000000U)
+#define CLOCK_SCALE2_MAX_HZ     (144000000U)
+
+// Register fields (this CMSIS version has no _Pos definitions)
+#define CLOCK_PLLCFGR_N_SHIFT   (6U)
+#define CLOCK_PLLCFGR_P_SHIFT   (16U)
+#define CLOCK_PLLCFGR_Q_SHIFT   (24U)
+#define CLOCK_CFGR_PPRE1_SHIFT  (10U)
+#define CLOCK_CFGR_PPRE2_SHIFT  (13U)
+#define CLOCK_CFGR_HPRE_SHIFT   (4U)
+
+// Slowest core clock the PLL can make: VCO minimum over the largest P
+#define CLOCK_PLL_MIN_HZ        (CLOCK_VCO_MIN_HZ / 8U)
+// Largest AHB divider used below that (the next one, /64, skips /32)
+#define CLOCK_AHB_DIV_MAX       (16U)
+
+typedef struct clock_tree
+{
+	// PLL dividers; m is 0 when SYSCLK comes straight from the oscillator
+	u32 m;
+	u32 n;
+	u32 p;
+	u32 q;
+	// CFGR prescaler codes
+	u32 hpre;
+	u32 ppre1;
+	u32 ppre2;
+	u32 latency;
+	u32 scale1;
+	u32 hclk;
+} clock_Tree;
+
+const clock_Board clock_board __attribute__((weak)) =
+{
+#if defined(HSE_VALUE)
+	.hse_hz = HSE_VALUE,
+#else
+	.hse_hz = 0U,
+#endif
+	.hse_bypass = 0U,
+	.sysclk_hz = 168000000U,
+};
+
+// From system_stm32f4xx.c
+extern const u8 AHBPrescTable[16];
+
+static clock_Source clock_src;
+
+static clock_Listener *clock_listeners;
+static clock_Listener clock_tick;
+
+
+void clock_start(void)
+{
+	if (clock_board.hse_hz == 0U)
+	{
+		return;
+	}
+
+	// The crystal needs a few ms to stabilise; clock_init() collects it
+	if (clock_board.hse_bypass != 0U)
+	{
+		RCC->CR |= RCC_CR_HSEBYP;
+	}
+	RCC->CR |= RCC_CR_HSEON;
+}
+
+// Waits for the HSE, using the cycle counter since there is no tick yet
+static u32 clock_hse_ready(void)
+{
+	// Not turned on: a warm restart skips clock_start()
+	if ((clock_board.hse_hz == 0U) || ((RCC->CR & RCC_CR_HSEON) == 0U))
+	{
+		return 0U;
+	}
+
+	dwt_init();
+	u32 start = dwt_cycles();
+	u32 timeout = (HSE_STARTUP_TIMEOUT * (HSI_VALUE / 1000U));
+
+	while ((RCC->CR & RCC_CR_HSERDY) == 0U)
+	{
+		if ((dwt_cycles() - start) > timeout)
+		{
+			RCC->CR &= ~(RCC_CR_HSEON | RCC_CR_HSEBYP);
+			return 0U;
+		}
+	}
+
+	return 1U;
+}
+
+// APB prescaler encoding: 0 for /1, 4 + log2(div) - 1 otherwise
+static u32 clock_apb_prescaler(u32 hclk, u32 max)
+{
+	u32 code = 0U;
+	for (u32 div = 1U; (hclk / div) > max; div <<= 1)
+	{
+		code = (code == 0U) ? 4U : (code + 1U);
+	}
+	return code;
+}
+
+// The PLL input divider: the first that divides the oscillator exactly
+// into the PLL input range (the higher the input, the lower the jitter);
+// 0 when none does
+static u32 clock_pll_m(u32 input_hz)
+{
+	for (u32 m = 2U; m <= CLOCK_PLL_M_MAX; m++)
+	{
+		u32 pll_in = input_hz / m;
+		if (((input_hz % m) == 0U) && (pll_in >= CLOCK_PLL_INPUT_MIN_HZ)
+				&& (pll_in <= CLOCK_PLL_INPUT_MAX_HZ))
+		{
+			return m;
+		}
+	}
+	return 0U;
+}
+
+static u32 clock_plan(u32 input_hz, u32 hclk_hz, clock_Tree *tree)
+{
+	if (hclk_hz >= CLOCK_PLL_MIN_HZ)
+	{
+		tree->m = clock_pll_m(input_hz);
+		if (tree->m == 0U)
+		{
+			return ERR_GENERIC;
+		}
+		u32 pll_in = input_hz / tree->m;
+
+		// Lowest P that keeps the VCO in range
+		tree->p = 2U;
+		while (((hclk_hz * tree->p) < CLOCK_VCO_MIN_HZ) && (tree->p < 8U))
+		{
+			tree->p += 2U;
+		}
+
+		tree->n = (hclk_hz * tree->p) / pll_in;
+		u32 vco = tree->n * pll_in;
+		if ((tree->n < CLOCK_PLL_N_MIN) || (tree->n > CLOCK_PLL_N_MAX)
+				|| (vco < CLOCK_VCO_MIN_HZ) || (vco > CLOCK_VCO_MAX_HZ))
+		{
+			return ERR_GENERIC;
+		}
+		// USB needs 48 MHz exactly; this is the closest not above it
+		tree->q = (vco + CLOCK_USB_HZ - 1U) / CLOCK_USB_HZ;
+		if (tree->q < 2U)
+		{
+			tree->q = 2U;
+		}
+
+		tree->hpre = 0U;
+		tree->hclk = vco / tree->p;
+	}
+	else
+	{
+		// Too slow for the PLL: the oscillator itself, divided on AHB
+		tree->m = 0U;
+		tree->hpre = 0U;
+		u32 div = 1U;
+		while (((input_hz / div) > hclk_hz) && (div < CLOCK_AHB_DIV_MAX))
+		{
+			div <<= 1;
+			tree->hpre = (tree->hpre == 0U) ? 8U : (tree->hpre + 1U);
+		}
+		tree->hclk = input_hz / div;
+		// Still above the request at the largest divider
+		if (tree->hclk > hclk_hz)
+		{
+			return ERR_GENERIC;
+		}
+	}
+
+	tree->ppre1 = clock_apb_prescaler(tree->hclk, CLOCK_APB1_MAX_HZ);
+	tree->ppre2 = clock_apb_prescaler(tree->hclk, CLOCK_APB2_MAX_HZ);
+	tree->latency = (tree->hclk - 1U) / CLOCK_FLASH_WS_HZ;
+	tree->scale1 = (tree->hclk > CLOCK_SCALE2_MAX_HZ) ? 1U : 0U;
+
+	return ERR_NONE;
+}
+
+// SystemCoreClock from the registers, as SystemCoreClockUpdate() does
+// but with the board's HSE rather than HSE_VALUE
+static void clock_update(void)
+{
+	u32 cfgr = RCC->CFGR;
+	u32 sysclk;
+
+	switch (cfgr & RCC_CFGR_SWS)
+	{
+	case RCC_CFGR_SWS_HSE:
+		sysclk = clock_board.hse_hz;
+		break;
+
+	case RCC_CFGR_SWS_PLL:
+	{
+		u32 pllcfgr = RCC->PLLCFGR;
+		u32 input = ((pllcfgr & RCC_PLLCFGR_PLLSRC) != 0U) ? clock_board.hse_hz : HSI_VALUE;
+		u32 m = pllcfgr & RCC_PLLCFGR_PLLM;
+		u32 n = (pllcfgr >> CLOCK_PLLCFGR_N_SHIFT) & 0x1FFU;
+		u32 p = (((pllcfgr >> CLOCK_PLLCFGR_P_SHIFT) & 0x3U) + 1U) * 2U;
+		sysclk = (m != 0U) ? (((input / m) * n) / p) : HSI_VALUE;
+		break;
+	}
+
+	default:
+		sysclk = HSI_VALUE;
+		break;
+	}
+
+	SystemCoreClock = sysclk >> AHBPrescTable[(cfgr & RCC_CFGR_HPRE) >> CLOCK_CFGR_HPRE_SHIFT];
+}
+
+// Safe from any state: the core runs from the HSI (no wait state needed,
+// and the flash latency only ever is too high for it) while the PLL,
+// the regulator scale, the prescalers and the latency change.
+static void clock_apply(const clock_Tree *tree)
+{
+	RCC->CR |= RCC_CR_HSION;
+	while ((RCC->CR & RCC_CR_HSIRDY) == 0U)
+	{
+	}
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | RCC_CFGR_SW_HSI;
+	while ((RCC->CFGR & RCC_CFGR_SWS) != RCC_CFGR_SWS_HSI)
+	{
+	}
+
+	RCC->CR &= ~RCC_CR_PLLON;
+	while ((RCC->CR & RCC_CR_PLLRDY) != 0U)
+	{
+	}
+
+	__HAL_RCC_PWR_CLK_ENABLE();
+	if (tree->scale1 != 0U)
+	{
+		PWR->CR |= PWR_CR_VOS;
+	}
+	else
+	{
+		PWR->CR &= ~PWR_CR_VOS;
+	}
+
+	u32 sw = (clock_src == CLOCK_SOURCE_HSE) ? RCC_CFGR_SW_HSE : RCC_CFGR_SW_HSI;
+	if (tree->m != 0U)
+	{
+		RCC->PLLCFGR = tree->m
+				| (tree->n << CLOCK_PLLCFGR_N_SHIFT)
+				| (((tree->p / 2U) - 1U) << CLOCK_PLLCFGR_P_SHIFT)
+				| (tree->q << CLOCK_PLLCFGR_Q_SHIFT)
+				| ((clock_src == CLOCK_SOURCE_HSE) ? RCC_PLLCFGR_PLLSRC_HSE : 0U);
+
+		RCC->CR |= RCC_CR_PLLON;
+		while ((RCC->CR & RCC_CR_PLLRDY) == 0U)
+		{
+		}
+		sw = RCC_CFGR_SW_PLL;
+	}
+
+	// Slow the buses and the flash down before speeding the core up
+	RCC->CFGR = (RCC->CFGR & ~(RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2))
+			| (tree->hpre << CLOCK_CFGR_HPRE_SHIFT)
+			| (tree->ppre1 << CLOCK_CFGR_PPRE1_SHIFT)
+			| (tree->ppre2 << CLOCK_CFGR_PPRE2_SHIFT);
+	__HAL_FLASH_SET_LATENCY(tree->latency);
+	while (__HAL_FLASH_GET_LATENCY() != tree->latency)
+	{
+	}
+
+	RCC->CFGR = (RCC->CFGR & ~RCC_CFGR_SW) | sw;
+	while ((RCC->CFGR & RCC_CFGR_SWS) != (sw << 2))
+	{
+	}
+
+	clock_update();
+}
+
+static void clock_notify(clock_Event event)
+{
+	for (clock_Listener *l = clock_listeners; l != NULL; l = l->next)
+	{
+		l->fn(l->arg, event);
+	}
+}
+
+// The one and only place the system tick is programmed
+static void clock_tick_changed(void *arg, clock_Event event)
+{
+	(void) arg;
+
+	if (event == CLOCK_EVENT_POST)
+	{
+		timer_start();
+	}
+}
+
+void clock_init(void)
+{
+	clock_listen(&clock_tick, clock_tick_changed, NULL);
+
+	// SystemInit() leaves CFGR at its reset value; anything else is the
+	// clock of the run before a warm restart, which is kept as it is. Every
+	// rate clock_set() makes has a source or a divider off the reset ones.
+	u32 cfgr = RCC->CFGR;
+	if ((cfgr & (RCC_CFGR_SWS | RCC_CFGR_HPRE | RCC_CFGR_PPRE1 | RCC_CFGR_PPRE2)) != 0U)
+	{
+		u32 sws = cfgr & RCC_CFGR_SWS;
+		u32 hse = (sws == RCC_CFGR_SWS_HSE)
+				|| ((sws == RCC_CFGR_SWS_PLL) && ((RCC->PLLCFGR & RCC_PLLCFGR_PLLSRC) != 0U));
+		clock_src = (hse != 0U) ? CLOCK_SOURCE_HSE : CLOCK_SOURCE_HSI;
+		clock_update();
+		clock_notify(CLOCK_EVENT_POST);
+		return;
+	}
+
+	clock_src = (clock_hse_ready() != 0U) ? CLOCK_SOURCE_HSE : CLOCK_SOURCE_HSI;
+
+	if (clock_set(clock_board.sysclk_hz) != 0U)
+	{
+		return;
+	}
+	// No PLL setting from this crystal: the HSI has one for any rate
+	// clock_set() takes
+	if (clock_src == CLOCK_SOURCE_HSE)
+	{
+		clock_src = CLOCK_SOURCE_HSI;
+		if (clock_set(clock_board.sysclk_hz) != 0U)
+		{
+			return;
+		}
+	}
+	// A board rate out of range: stay on the HSI, with the tick running
+	clock_update();
+	clock_notify(CLOCK_EVENT_POST);
+}
+
+u32 clock_set(u32 hclk_hz)
+{
+	if ((hclk_hz == 0U) || (hclk_hz > CLOCK_MAX_HZ))
+	{
+		return 0U;
+	}
+
+	u32 input_hz = (clock_src == CLOCK_SOURCE_HSE) ? clock_board.hse_hz : HSI_VALUE;
+
+	clock_Tree tree;
+	if (clock_plan(input_hz, hclk_hz, &tree) != ERR_NONE)
+	{
+		return 0U;
+	}
+
+	// Drivers finish what is in flight, with the interrupts on
+	clock_notify(CLOCK_EVENT_PRE);
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	clock_apply(&tree);
+	// and set their dividers again before anything runs on the new clock
+	clock_notify(CLOCK_EVENT_POST);
+
+	__set_PRIMASK(primask);
+
+	return SystemCoreClock;
+}
+
+void clock_listen(clock_Listener *listener, clock_Callback fn, void *arg)
+{
+	listener->fn = fn;
+	listener->arg = arg;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	listener->next = clock_listeners;
+	clock_listeners = listener;
+	__set_PRIMASK(primask);
+}
+
+void clock_unlisten(clock_Listener *listener)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	for (clock_Listener **l = &clock_listeners; *l != NULL; l = &(*l)->next)
+	{
+		if (*l == listener)
+		{
+			*l = listener->next;
+			break;
+		}
+	}
+	__set_PRIMASK(primask);
+}
+
+clock_Source clock_source(void)
+{
+	return clock_src;
+}
+
+u32 clock_hclk(void)
+{
+	return SystemCoreClock;
+}
+
+// APB clock from its CFGR prescaler code (3 bits at 'shift')
+static u32 clock_pclk(u32 shift)
+{
+	u32 code = (RCC->CFGR >> shift) & 0x7U;
+	return ((code & 0x4U) != 0U) ? (SystemCoreClock >> ((code & 0x3U) + 1U)) : SystemCoreClock;
+}
+
+u32 clock_pclk1(void)
+{
+	return clock_pclk(CLOCK_CFGR_PPRE1_SHIFT);
+}
+
+u32 clock_pclk2(void)
+{
+	return clock_pclk(CLOCK_CFGR_PPRE2_SHIFT);
+}
+
+// The timers run at twice the APB clock when it is divided
+static u32 clock_timclk(u32 shift)
+{
+	u32 pclk = clock_pclk(shift);
+	return (((RCC->CFGR >> shift) & 0x4U) != 0U) ? (pclk * 2U) : pclk;
+}
+
+u32 clock_timclk1(void)
+{
+	return clock_timclk(CLOCK_CFGR_PPRE1_SHIFT);
+}
+
+u32 clock_timclk2(void)
+{
+	return clock_timclk(CLOCK_CFGR_PPRE2_SHIFT);
+}
+
+u32 clock_pll48(void)
+{
+	if ((RCC->CR & RCC_CR_PLLON) == 0U)
+	{
+		return 0U;
+	}
+
+	u32 cfg = RCC->PLLCFGR;
+	u32 input_hz = ((cfg & RCC_PLLCFGR_PLLSRC) != 0U) ? clock_board.hse_hz : HSI_VALUE;
+	u32 m = cfg & RCC_PLLCFGR_PLLM;
+	u32 n = (cfg >> CLOCK_PLLCFGR_N_SHIFT) & 0x1FFU;
+	u32 q = (cfg >> CLOCK_PLLCFGR_Q_SHIFT) & 0xFU;
+	if ((m == 0U) || (q < 2U))
+	{
+		return 0U;
+	}
+	return ((input_hz / m) * n) / q;
+}
@@ -0,0 +1,190 @@
+/*
+ * cpuload.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <cpuload.h>
+#include <dwt.h>
+#include <sections.h>
+#include <timer.h>
+
+#include "ktype.h"
+
+static u64 cpuload_runtimes[CPULOAD_CONTEXTS];
+static u32 cpuload_current;
+// Cycle stamp of the last switch
+static u32 cpuload_last;
+
+static u64 cpuload_idle_total;
+
+// The second in progress
+static u32 cpuload_ms;
+static u32 cpuload_second_start;
+static u32 cpuload_second_idle;
+
+// Per second history, a ring written at cpuload_head
+static u32 cpuload_hist_total[CPULOAD_HISTORY_S];
+static u32 cpuload_hist_idle[CPULOAD_HISTORY_S];
+static u32 cpuload_head;
+static u32 cpuload_filled;
+
+
+void cpuload_init(void)
+{
+	dwt_init();
+
+	cpuload_current = CPULOAD_CTX_MAIN;
+	cpuload_last = dwt_cycles();
+	cpuload_second_start = cpuload_last;
+}
+
+CARZOS_RAMFUNC u32 cpuload_switch(u32 ctx)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	u32 now = dwt_cycles();
+	u32 previous = cpuload_current;
+
+	cpuload_runtimes[previous] += now - cpuload_last;
+	cpuload_last = now;
+	cpuload_current = ctx;
+
+	__set_PRIMASK(primask);
+
+	return previous;
+}
+
+// The SysTick counter, and whether it has wrapped since its interrupt was
+// last taken; read so that the two agree
+static inline u32 cpuload_systick(u32 *wrapped)
+{
+	u32 val = SysTick->VAL;
+	u32 pending = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+	u32 again = SysTick->VAL;
+
+	// It counts down: higher the second time, it reloaded in between
+	if (again > val)
+	{
+		*wrapped = 1U;
+		return again;
+	}
+	*wrapped = (pending != 0U) ? 1U : 0U;
+	return val;
+}
+
+void cpuload_idle(void)
+{
+	u32 start = dwt_cycles();
+	cpuload_runtimes[cpuload_current] += start - cpuload_last;
+
+	// CYCCNT stops with the core clock in Sleep mode; the SysTick, on
+	// the processor clock too, does not, and its counter gives the time
+	// asleep in the same cycles. The interrupts are masked, so the tick
+	// cannot be taken in between: the counter has wrapped once at most,
+	// since the wrap itself wakes the core.
+	u32 wrapped_before;
+	u32 wrapped_after;
+	u32 before = cpuload_systick(&wrapped_before);
+
+	// Wakes on a pending interrupt even though it is masked
+	__DSB();
+	__WFI();
+
+	u32 after = cpuload_systick(&wrapped_after);
+	u32 slept = before - after;
+	if (wrapped_after != wrapped_before)
+	{
+		slept += SysTick->LOAD + 1U;
+	}
+
+	cpuload_idle_total += slept;
+	cpuload_second_idle += slept;
+	cpuload_last = dwt_cycles();
+}
+
+u32 cpuload_context(void)
+{
+	return cpuload_current;
+}
+
+CARZOS_RAMFUNC void cpuload_tick(void)
+{
+	if (++cpuload_ms < TIMER_FREQUENCY_HZ)
+	{
+		return;
+	}
+	cpuload_ms = 0U;
+
+	u32 now = dwt_cycles();
+
+	// CYCCNT counted the time awake only
+	cpuload_hist_total[cpuload_head] = (now - cpuload_second_start) + cpuload_second_idle;
+	cpuload_hist_idle[cpuload_head] = cpuload_second_idle;
+	cpuload_second_start = now;
+	cpuload_second_idle = 0U;
+
+	cpuload_head = (cpuload_head + 1U) % CPULOAD_HISTORY_S;
+	if (cpuload_filled < CPULOAD_HISTORY_S)
+	{
+		cpuload_filled++;
+	}
+}
+
+u64 cpuload_runtime(u32 ctx)
+{
+	if (ctx >= CPULOAD_CONTEXTS)
+	{
+		return 0U;
+	}
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	u64 cycles = cpuload_runtimes[ctx];
+	__set_PRIMASK(primask);
+
+	return cycles;
+}
+
+u64 cpuload_idle_cycles(void)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	u64 cycles = cpuload_idle_total;
+	__set_PRIMASK(primask);
+
+	return cycles;
+}
+
+u32 cpuload_get(u32 seconds)
+{
+	u64 total = 0U;
+	u64 idle = 0U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (seconds > cpuload_filled)
+	{
+		seconds = cpuload_filled;
+	}
+
+	u32 i = cpuload_head;
+	for (u32 n = 0U; n < seconds; n++)
+	{
+		i = (i + CPULOAD_HISTORY_S - 1U) % CPULOAD_HISTORY_S;
+		total += cpuload_hist_total[i];
+		idle += cpuload_hist_idle[i];
+	}
+
+	__set_PRIMASK(primask);
+
+	if (total == 0U)
+	{
+		return 0U;
+	}
+
+	return (u32) (1000U - ((idle * 1000U) / total));
+}
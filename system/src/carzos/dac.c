@@ -0,0 +1,322 @@
+/*
+ * dac.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <dac.h>
+#include <pin.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define DAC_DMA_CHANNEL         (7U)
+#define DAC_DMA_PL_HIGH         (2U)
+#define DAC_NDTR_MAX            (0xFFFFU)
+
+// Channel 2 fields are the channel 1 ones 16 bits up
+#define DAC_CR_CH2_SHIFT        (16U)
+
+
+static inline u16 *dac_half(const dac_Stream *dac, u32 half)
+{
+	return dac->buf + (half * dac->half_frames * dac->channels);
+}
+
+// Sets and clears 'due' bits; the interrupt and the work item both do
+static void dac_due_update(dac_Stream *dac, u32 set, u32 clear)
+{
+	u32 due;
+	do
+	{
+		due = __LDREXW(&dac->due);
+	} while (__STREXW((due & ~clear) | set, &dac->due) != 0U);
+}
+
+// DAC CR bits of the channels in use: channel 1 for DAC_OUT_BOTH, which
+// feeds both through DHR12RD on one request
+static u32 dac_cr(const dac_Stream *dac, u32 bits)
+{
+	switch (dac->out)
+	{
+	case DAC_OUT_1:
+		return bits;
+	case DAC_OUT_2:
+		return bits << DAC_CR_CH2_SHIFT;
+	default:
+		return bits | ((bits & (DAC_CR_EN1 | DAC_CR_TEN1)) << DAC_CR_CH2_SHIFT);
+	}
+}
+
+static void dac_timing(dac_Stream *dac)
+{
+	u32 timclk = clock_timclk1();
+	u32 period = timclk / dac->rate_hz;
+	if (period == 0U)
+	{
+		period = 1U;
+	}
+	u32 psc = (period - 1U) >> 16;
+	u32 arr = (period / (psc + 1U)) - 1U;
+
+	TIM6->PSC = psc;
+	TIM6->ARR = arr;
+	TIM6->EGR = TIM_EGR_UG;
+	dac->rate = timclk / ((psc + 1U) * (arr + 1U));
+}
+
+// Starts the stream from the first half, then the trigger
+static void dac_arm(dac_Stream *dac)
+{
+	DMA_Stream_TypeDef *stream = dac->dma.regs;
+
+	stream->M0AR = (u32) dac->buf;
+	stream->NDTR = 2U * dac->half_frames;
+	stream->CR |= DMA_SxCR_EN;
+
+	DAC->SR = DAC_SR_DMAUDR1 | DAC_SR_DMAUDR2;
+	DAC->CR |= dac_cr(dac, DAC_CR_DMAEN1);
+
+	TIM6->CNT = 0U;
+	TIM6->CR1 |= TIM_CR1_CEN;
+}
+
+static void dac_halt(dac_Stream *dac)
+{
+	TIM6->CR1 &= ~TIM_CR1_CEN;
+	DAC->CR &= ~dac_cr(dac, DAC_CR_DMAEN1);
+	dma_stop(&dac->dma);
+}
+
+static void dac_set_due(dac_Stream *dac, u32 half)
+{
+	if ((dac->due & (1U << half)) != 0U)
+	{
+		// Not refilled yet: it plays again as it is
+		dac->underruns++;
+	}
+	dac_due_update(dac, 1U << half, 0U);
+	workq_post(&dac->work);
+}
+
+static void dac_dma_irq(void *ctx)
+{
+	dac_Stream *dac = ctx;
+
+	u32 flags = dma_take(&dac->dma);
+
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		dac->underruns++;
+		dac_halt(dac);
+		dac_arm(dac);
+		return;
+	}
+
+	// Both at once when the interrupt was held off for a whole half
+	if ((flags & DMA_FLAG_HT) != 0U)
+	{
+		dac_set_due(dac, 0U);
+	}
+	if ((flags & DMA_FLAG_TC) != 0U)
+	{
+		dac_set_due(dac, 1U);
+	}
+}
+
+// The DMA missed a trigger; the DAC stops its requests until restarted
+static void dac_irq(void *ctx)
+{
+	dac_Stream *dac = ctx;
+	u32 udr = DAC->SR & (DAC_SR_DMAUDR1 | DAC_SR_DMAUDR2);
+
+	if (udr != 0U)
+	{
+		DAC->SR = udr;
+		dac->underruns++;
+		dac_halt(dac);
+		dac_arm(dac);
+	}
+}
+
+static void dac_work(void *arg)
+{
+	dac_Stream *dac = arg;
+
+	// In playing order; after a restart the first half can come due
+	// while the second one was expected
+	u32 due;
+	while ((due = dac->due) != 0U)
+	{
+		u32 half = ((due & (1U << dac->next)) != 0U) ? dac->next : (dac->next ^ 1U);
+
+		dac->callback(dac->arg, dac_half(dac, half), dac->half_frames);
+
+		dac_due_update(dac, 0U, 1U << half);
+		dac->next = half ^ 1U;
+	}
+}
+
+static void dac_clock_changed(void *arg, clock_Event event)
+{
+	dac_Stream *dac = arg;
+
+	if (dac->running == 0U)
+	{
+		if (event == CLOCK_EVENT_POST)
+		{
+			dac_timing(dac);
+		}
+		return;
+	}
+
+	// The trigger is held across the change; the stream goes on where it was
+	if (event == CLOCK_EVENT_PRE)
+	{
+		TIM6->CR1 &= ~TIM_CR1_CEN;
+	}
+	else
+	{
+		dac_timing(dac);
+		TIM6->CR1 |= TIM_CR1_CEN;
+	}
+}
+
+u32 dac_init(dac_Stream *dac, const dac_Config *config)
+{
+	if ((dac == NULL) || (config == NULL) || (config->buf == NULL)
+			|| (config->callback == NULL) || (config->rate_hz == 0U)
+			|| (config->out < DAC_OUT_1) || (config->out > DAC_OUT_BOTH)
+			|| (config->half_frames == 0U)
+			|| ((2U * config->half_frames) > DAC_NDTR_MAX))
+	{
+		return ERR_GENERIC;
+	}
+
+	dac->out = config->out;
+	dac->channels = (config->out == DAC_OUT_BOTH) ? 2U : 1U;
+	dac->rate_hz = config->rate_hz;
+	dac->buf = config->buf;
+	dac->half_frames = config->half_frames;
+	dac->due = 0U;
+	dac->next = 0U;
+	dac->running = 0U;
+	dac->underruns = 0U;
+	dac->callback = config->callback;
+	dac->arg = config->arg;
+
+	if (workq_item_init(&dac->work, dac_work, dac, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	RCC->APB1ENR |= RCC_APB1ENR_DACEN | RCC_APB1ENR_TIM6EN;
+	(void) RCC->APB1ENR;
+
+	if (dac->out != DAC_OUT_2)
+	{
+		pin_analog(PIN('A', 4U));
+	}
+	if (dac->out != DAC_OUT_1)
+	{
+		pin_analog(PIN('A', 5U));
+	}
+
+	// An update event per frame; TSEL 0 is the TIM6 TRGO
+	TIM6->CR1 = 0U;
+	TIM6->CR2 = TIM_CR2_MMS_1;
+	dac_timing(dac);
+
+	DAC->CR = dac_cr(dac, DAC_CR_EN1 | DAC_CR_TEN1 | DAC_CR_DMAUDRIE1);
+
+	u32 index = (dac->out == DAC_OUT_2) ? 6U : 5U;
+	if (dma_stream_init(&dac->dma, 1U, index, dac_dma_irq, dac, config->priority) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_Stream_TypeDef *stream = dac->dma.regs;
+	switch (dac->out)
+	{
+	case DAC_OUT_1:
+		stream->PAR = (u32) &DAC->DHR12R1;
+		stream->CR = DMA_SxCR_PSIZE_0 | DMA_SxCR_MSIZE_0;
+		break;
+	case DAC_OUT_2:
+		stream->PAR = (u32) &DAC->DHR12R2;
+		stream->CR = DMA_SxCR_PSIZE_0 | DMA_SxCR_MSIZE_0;
+		break;
+	default:
+		// One word per frame, channel 1 in the low half
+		stream->PAR = (u32) &DAC->DHR12RD;
+		stream->CR = DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1;
+		break;
+	}
+	stream->CR |= (DAC_DMA_CHANNEL << DMA_CR_CHSEL_SHIFT)
+			| (DAC_DMA_PL_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_CR_DIR_M2P | DMA_SxCR_MINC | DMA_SxCR_CIRC
+			| DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	if (irq_attach(TIM6_DAC_IRQn, dac_irq, dac) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	NVIC_SetPriority(TIM6_DAC_IRQn, config->priority);
+	NVIC_EnableIRQ(TIM6_DAC_IRQn);
+
+	clock_listen(&dac->clock, dac_clock_changed, dac);
+
+	return ERR_NONE;
+}
+
+u32 dac_start(dac_Stream *dac)
+{
+	if (dac->running != 0U)
+	{
+		return ERR_NONE;
+	}
+
+	dac->callback(dac->arg, dac_half(dac, 0U), dac->half_frames);
+	dac->callback(dac->arg, dac_half(dac, 1U), dac->half_frames);
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	dac->due = 0U;
+	dac->next = 0U;
+	dac->running = 1U;
+	dac_arm(dac);
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+void dac_stop(dac_Stream *dac)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (dac->running != 0U)
+	{
+		dac_halt(dac);
+		dac->running = 0U;
+	}
+
+	__set_PRIMASK(primask);
+}
+
+u32 dac_rate(const dac_Stream *dac)
+{
+	return dac->rate;
+}
+
+u32 dac_underruns(const dac_Stream *dac)
+{
+	return dac->underruns;
+}
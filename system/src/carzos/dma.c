@@ -0,0 +1,79 @@
+/*
+ * dma.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <dma.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+// Flag group of streams 0 to 3 (4 to 7 alike, in the high registers)
+static const u8 dma_shifts[4] = { 0U, 6U, 16U, 22U };
+
+static const IRQn_Type dma_irqs[2][8] =
+{
+	{
+		DMA1_Stream0_IRQn, DMA1_Stream1_IRQn, DMA1_Stream2_IRQn, DMA1_Stream3_IRQn,
+		DMA1_Stream4_IRQn, DMA1_Stream5_IRQn, DMA1_Stream6_IRQn, DMA1_Stream7_IRQn
+	},
+	{
+		DMA2_Stream0_IRQn, DMA2_Stream1_IRQn, DMA2_Stream2_IRQn, DMA2_Stream3_IRQn,
+		DMA2_Stream4_IRQn, DMA2_Stream5_IRQn, DMA2_Stream6_IRQn, DMA2_Stream7_IRQn
+	},
+};
+
+
+u32 dma_stream_init(dma_Stream *stream, u32 controller, u32 index,
+		irq_Handler handler, void *ctx, u32 priority)
+{
+	if ((controller < 1U) || (controller > 2U) || (index > 7U))
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_TypeDef *dma;
+	if (controller == 1U)
+	{
+		RCC->AHB1ENR |= RCC_AHB1ENR_DMA1EN;
+		dma = DMA1;
+	}
+	else
+	{
+		RCC->AHB1ENR |= RCC_AHB1ENR_DMA2EN;
+		dma = DMA2;
+	}
+	(void) RCC->AHB1ENR;
+
+	// The stream registers follow the controller registers, 0x18 apart
+	stream->regs = (DMA_Stream_TypeDef *) ((u32) dma + 0x10U + (0x18U * index));
+	stream->isr = (index < 4U) ? &dma->LISR : &dma->HISR;
+	stream->ifcr = (index < 4U) ? &dma->LIFCR : &dma->HIFCR;
+	stream->shift = dma_shifts[index & 3U];
+	stream->irqn = dma_irqs[controller - 1U][index];
+
+	dma_stop(stream);
+
+	if (handler != NULL)
+	{
+		if (irq_attach(stream->irqn, handler, ctx) != ERR_NONE)
+		{
+			return ERR_GENERIC;
+		}
+		NVIC_SetPriority(stream->irqn, priority);
+		NVIC_EnableIRQ(stream->irqn);
+	}
+
+	return ERR_NONE;
+}
+
+void dma_stop(const dma_Stream *stream)
+{
+	stream->regs->CR &= ~DMA_SxCR_EN;
+	while ((stream->regs->CR & DMA_SxCR_EN) != 0U)
+	{
+	}
+	*stream->ifcr = DMA_FLAG_ALL << stream->shift;
+}
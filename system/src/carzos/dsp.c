@@ -0,0 +1,774 @@
+/*
+ * dsp.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <dsp.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+#if defined(__ARM_FEATURE_DSP)
+
+#include "stm32f4xx.h"
+
+#else
+
+// Host stand-ins for the cmsis_gcc.h intrinsics, with the same results
+
+static inline u64 __SMLALD(u32 x, u32 y, u64 acc)
+{
+	return acc + (u64) ((s64) ((s32) (s16) x * (s16) y)
+			+ (s64) ((s32) (s16) (x >> 16) * (s16) (y >> 16)));
+}
+
+static inline u32 __SMUAD(u32 x, u32 y)
+{
+	return (u32) ((s32) (s16) x * (s16) y) + (u32) ((s32) (s16) (x >> 16) * (s16) (y >> 16));
+}
+
+static inline u32 __SMUSDX(u32 x, u32 y)
+{
+	return (u32) ((s32) (s16) x * (s16) (y >> 16)) - (u32) ((s32) (s16) (x >> 16) * (s16) y);
+}
+
+static inline u32 __SHADD16(u32 x, u32 y)
+{
+	u32 lo = (u32) (((s32) (s16) x + (s16) y) >> 1);
+	u32 hi = (u32) (((s32) (s16) (x >> 16) + (s16) (y >> 16)) >> 1);
+	return (lo & 0xFFFFU) | (hi << 16);
+}
+
+static inline u32 __SHSUB16(u32 x, u32 y)
+{
+	u32 lo = (u32) (((s32) (s16) x - (s16) y) >> 1);
+	u32 hi = (u32) (((s32) (s16) (x >> 16) - (s16) (y >> 16)) >> 1);
+	return (lo & 0xFFFFU) | (hi << 16);
+}
+
+static inline s32 __SSAT(s32 value, u32 bits)
+{
+	s32 max = (s32) ((1U << (bits - 1U)) - 1U);
+	if (value > max)
+	{
+		return max;
+	}
+	if (value < (-max - 1))
+	{
+		return -max - 1;
+	}
+	return value;
+}
+
+static inline u32 __QADD16(u32 x, u32 y)
+{
+	u32 lo = (u32) __SSAT((s32) (s16) x + (s16) y, 16U);
+	u32 hi = (u32) __SSAT((s32) (s16) (x >> 16) + (s16) (y >> 16), 16U);
+	return (lo & 0xFFFFU) | (hi << 16);
+}
+
+#define __PKHBT(x, y, shift)    ((((u32) (x)) & 0xFFFFU) | ((((u32) (y)) << (shift)) & 0xFFFF0000U))
+
+static inline u32 __RBIT(u32 x)
+{
+	u32 r = 0U;
+	for (u32 i = 0U; i < 32U; i++)
+	{
+		r = (r << 1) | ((x >> i) & 1U);
+	}
+	return r;
+}
+
+#endif // __ARM_FEATURE_DSP
+
+#define DSP_Q15_ONE             (32767.0)
+
+
+// Two q15 samples as one word, the first in the low half; a single LDR
+// on the M4, which allows unaligned word loads
+static inline __attribute__((always_inline)) u32 dsp_pair(const s16 *p)
+{
+	u32 pair;
+	memcpy(&pair, p, sizeof(pair));
+	return pair;
+}
+
+static inline __attribute__((always_inline)) void dsp_put_pair(s16 *p, u32 pair)
+{
+	memcpy(p, &pair, sizeof(pair));
+}
+
+static inline __attribute__((always_inline)) s16 dsp_sat_q15(s32 value)
+{
+	return (s16) __SSAT(value, 16);
+}
+
+static inline __attribute__((always_inline)) s32 dsp_sat_q31(s64 value)
+{
+	if (value > INT32_MAX)
+	{
+		return INT32_MAX;
+	}
+	if (value < INT32_MIN)
+	{
+		return INT32_MIN;
+	}
+	return (s32) value;
+}
+
+static u32 dsp_log2(u32 n)
+{
+	return 31U - (u32) __builtin_clz(n);
+}
+
+// The first n / 2 powers of e^(2 pi i / n), without libm: the step from
+// its Taylor series (the angle is pi / 8 at most), the others by rotating
+// in double, which keeps the error far below a Q15 LSB.
+static void dsp_twiddle_step(u32 n, double *c, double *s)
+{
+	double a = 6.283185307179586 / (double) n;
+	double a2 = a * a;
+
+	*c = 1.0 - ((a2 / 2.0) * (1.0 - ((a2 / 12.0) * (1.0 - ((a2 / 30.0) * (1.0 - (a2 / 56.0)))))));
+	*s = a * (1.0 - ((a2 / 6.0) * (1.0 - ((a2 / 20.0) * (1.0 - ((a2 / 42.0) * (1.0 - (a2 / 72.0))))))));
+}
+
+static inline u32 dsp_is_fft_size(u32 n)
+{
+	return ((n >= DSP_FFT_MIN) && (n <= DSP_FFT_MAX) && ((n & (n - 1U)) == 0U)) ? 1U : 0U;
+}
+
+// ----------------------------------------------------------------------------
+
+u32 dsp_fir_q15_init(dsp_FirQ15 *fir, const s16 *coeffs, u32 taps, s16 *state, u32 block)
+{
+	if ((fir == NULL) || (coeffs == NULL) || (state == NULL) || (taps == 0U) || (block == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	fir->coeffs = coeffs;
+	fir->state = state;
+	fir->taps = taps;
+	fir->block = block;
+	memset(state, 0, (taps - 1U + block) * sizeof(s16));
+
+	return ERR_NONE;
+}
+
+void dsp_fir_q15(dsp_FirQ15 *fir, const s16 *in, s16 *out, u32 n)
+{
+	const s16 *coeffs = fir->coeffs;
+	s16 *state = fir->state;
+	u32 taps = fir->taps;
+
+	memcpy(&state[taps - 1U], in, n * sizeof(s16));
+
+	// Two outputs at a time share the coefficient loads; each SMLALD does
+	// two taps
+	u32 i = 0U;
+	for (; (i + 1U) < n; i += 2U)
+	{
+		const s16 *x = &state[i];
+		u64 acc0 = 0U;
+		u64 acc1 = 0U;
+
+		u32 k = 0U;
+		for (; (k + 1U) < taps; k += 2U)
+		{
+			u32 c = dsp_pair(&coeffs[k]);
+			acc0 = __SMLALD(c, dsp_pair(&x[k]), acc0);
+			acc1 = __SMLALD(c, dsp_pair(&x[k + 1U]), acc1);
+		}
+		if (k < taps)
+		{
+			acc0 += (u64) (s64) ((s32) coeffs[k] * x[k]);
+			acc1 += (u64) (s64) ((s32) coeffs[k] * x[k + 1U]);
+		}
+
+		out[i] = dsp_sat_q15((s32) ((s64) acc0 >> 15));
+		out[i + 1U] = dsp_sat_q15((s32) ((s64) acc1 >> 15));
+	}
+
+	if (i < n)
+	{
+		const s16 *x = &state[i];
+		u64 acc = 0U;
+
+		u32 k = 0U;
+		for (; (k + 1U) < taps; k += 2U)
+		{
+			acc = __SMLALD(dsp_pair(&coeffs[k]), dsp_pair(&x[k]), acc);
+		}
+		if (k < taps)
+		{
+			acc += (u64) (s64) ((s32) coeffs[k] * x[k]);
+		}
+
+		out[i] = dsp_sat_q15((s32) ((s64) acc >> 15));
+	}
+
+	memmove(state, &state[n], (taps - 1U) * sizeof(s16));
+}
+
+u32 dsp_fir_q31_init(dsp_FirQ31 *fir, const s32 *coeffs, u32 taps, s32 *state, u32 block)
+{
+	if ((fir == NULL) || (coeffs == NULL) || (state == NULL) || (taps == 0U) || (block == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	fir->coeffs = coeffs;
+	fir->state = state;
+	fir->taps = taps;
+	fir->block = block;
+	memset(state, 0, (taps - 1U + block) * sizeof(s32));
+
+	return ERR_NONE;
+}
+
+void dsp_fir_q31(dsp_FirQ31 *fir, const s32 *in, s32 *out, u32 n)
+{
+	const s32 *coeffs = fir->coeffs;
+	s32 *state = fir->state;
+	u32 taps = fir->taps;
+
+	memcpy(&state[taps - 1U], in, n * sizeof(s32));
+
+	// Two outputs at a time; the products are SMLALs
+	u32 i = 0U;
+	for (; (i + 1U) < n; i += 2U)
+	{
+		const s32 *x = &state[i];
+		s64 acc0 = 0;
+		s64 acc1 = 0;
+		s32 next = x[0];
+
+		for (u32 k = 0U; k < taps; k++)
+		{
+			s64 c = coeffs[k];
+			s32 cur = next;
+			next = x[k + 1U];
+			acc0 += c * cur;
+			acc1 += c * next;
+		}
+
+		out[i] = dsp_sat_q31(acc0 >> 31);
+		out[i + 1U] = dsp_sat_q31(acc1 >> 31);
+	}
+
+	if (i < n)
+	{
+		const s32 *x = &state[i];
+		s64 acc = 0;
+
+		for (u32 k = 0U; k < taps; k++)
+		{
+			acc += (s64) coeffs[k] * x[k];
+		}
+
+		out[i] = dsp_sat_q31(acc >> 31);
+	}
+
+	memmove(state, &state[n], (taps - 1U) * sizeof(s32));
+}
+
+u32 dsp_fir_f32_init(dsp_FirF32 *fir, const float *coeffs, u32 taps, float *state, u32 block)
+{
+	if ((fir == NULL) || (coeffs == NULL) || (state == NULL) || (taps == 0U) || (block == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	fir->coeffs = coeffs;
+	fir->state = state;
+	fir->taps = taps;
+	fir->block = block;
+	memset(state, 0, (taps - 1U + block) * sizeof(float));
+
+	return ERR_NONE;
+}
+
+void dsp_fir_f32(dsp_FirF32 *fir, const float *in, float *out, u32 n)
+{
+	const float *coeffs = fir->coeffs;
+	float *state = fir->state;
+	u32 taps = fir->taps;
+
+	memcpy(&state[taps - 1U], in, n * sizeof(float));
+
+	// Four outputs at a time, each summed in tap order; the samples slide
+	// through registers so each is loaded once per tap
+	u32 i = 0U;
+	for (; (i + 3U) < n; i += 4U)
+	{
+		const float *x = &state[i];
+		float acc0 = 0.0f;
+		float acc1 = 0.0f;
+		float acc2 = 0.0f;
+		float acc3 = 0.0f;
+		float x0 = x[0];
+		float x1 = x[1];
+		float x2 = x[2];
+
+		for (u32 k = 0U; k < taps; k++)
+		{
+			float c = coeffs[k];
+			float x3 = x[k + 3U];
+			acc0 += c * x0;
+			acc1 += c * x1;
+			acc2 += c * x2;
+			acc3 += c * x3;
+			x0 = x1;
+			x1 = x2;
+			x2 = x3;
+		}
+
+		out[i] = acc0;
+		out[i + 1U] = acc1;
+		out[i + 2U] = acc2;
+		out[i + 3U] = acc3;
+	}
+
+	for (; i < n; i++)
+	{
+		const float *x = &state[i];
+		float acc = 0.0f;
+
+		for (u32 k = 0U; k < taps; k++)
+		{
+			acc += coeffs[k] * x[k];
+		}
+
+		out[i] = acc;
+	}
+
+	memmove(state, &state[n], (taps - 1U) * sizeof(float));
+}
+
+// ----------------------------------------------------------------------------
+
+u32 dsp_biquad_q15_init(dsp_BiquadQ15 *iir, const s16 *coeffs, u32 stages, s16 *state,
+		u32 shift)
+{
+	if ((iir == NULL) || (coeffs == NULL) || (state == NULL) || (stages == 0U) || (shift > 15U))
+	{
+		return ERR_GENERIC;
+	}
+
+	iir->coeffs = coeffs;
+	iir->state = state;
+	iir->stages = stages;
+	iir->shift = shift;
+	memset(state, 0, stages * 4U * sizeof(s16));
+
+	return ERR_NONE;
+}
+
+void dsp_biquad_q15(dsp_BiquadQ15 *iir, const s16 *in, s16 *out, u32 n)
+{
+	const s16 *coeffs = iir->coeffs;
+	s16 *state = iir->state;
+	u32 shift = 15U - iir->shift;
+	const s16 *src = in;
+
+	for (u32 stage = 0U; stage < iir->stages; stage++)
+	{
+		s32 b0 = coeffs[0];
+		u32 b12 = dsp_pair(&coeffs[2]);
+		u32 a12 = dsp_pair(&coeffs[4]);
+		// x[n-1], x[n-2] and y[n-1], y[n-2] as pairs
+		u32 xs = dsp_pair(&state[0]);
+		u32 ys = dsp_pair(&state[2]);
+
+		for (u32 i = 0U; i < n; i++)
+		{
+			s32 x = src[i];
+			u64 acc = (u64) (s64) (b0 * x);
+			acc = __SMLALD(b12, xs, acc);
+			acc = __SMLALD(a12, ys, acc);
+			s32 y = dsp_sat_q15((s32) ((s64) acc >> shift));
+
+			xs = __PKHBT(x, xs, 16);
+			ys = __PKHBT(y, ys, 16);
+			out[i] = (s16) y;
+		}
+
+		memcpy(&state[0], &xs, sizeof(xs));
+		memcpy(&state[2], &ys, sizeof(ys));
+
+		// Later stages run in place on the output
+		src = out;
+		coeffs += 6U;
+		state += 4U;
+	}
+}
+
+u32 dsp_biquad_q31_init(dsp_BiquadQ31 *iir, const s32 *coeffs, u32 stages, s32 *state,
+		u32 shift)
+{
+	if ((iir == NULL) || (coeffs == NULL) || (state == NULL) || (stages == 0U) || (shift > 31U))
+	{
+		return ERR_GENERIC;
+	}
+
+	iir->coeffs = coeffs;
+	iir->state = state;
+	iir->stages = stages;
+	iir->shift = shift;
+	memset(state, 0, stages * 4U * sizeof(s32));
+
+	return ERR_NONE;
+}
+
+void dsp_biquad_q31(dsp_BiquadQ31 *iir, const s32 *in, s32 *out, u32 n)
+{
+	const s32 *coeffs = iir->coeffs;
+	s32 *state = iir->state;
+	u32 shift = 31U - iir->shift;
+	const s32 *src = in;
+
+	for (u32 stage = 0U; stage < iir->stages; stage++)
+	{
+		s64 b0 = coeffs[0];
+		s64 b1 = coeffs[1];
+		s64 b2 = coeffs[2];
+		s64 a1 = coeffs[3];
+		s64 a2 = coeffs[4];
+		s32 x1 = state[0];
+		s32 x2 = state[1];
+		s32 y1 = state[2];
+		s32 y2 = state[3];
+
+		for (u32 i = 0U; i < n; i++)
+		{
+			s32 x = src[i];
+			s64 acc = (b0 * x) + (b1 * x1) + (b2 * x2) + (a1 * y1) + (a2 * y2);
+			s32 y = dsp_sat_q31(acc >> shift);
+
+			x2 = x1;
+			x1 = x;
+			y2 = y1;
+			y1 = y;
+			out[i] = y;
+		}
+
+		state[0] = x1;
+		state[1] = x2;
+		state[2] = y1;
+		state[3] = y2;
+
+		src = out;
+		coeffs += 5U;
+		state += 4U;
+	}
+}
+
+u32 dsp_biquad_f32_init(dsp_BiquadF32 *iir, const float *coeffs, u32 stages, float *state)
+{
+	if ((iir == NULL) || (coeffs == NULL) || (state == NULL) || (stages == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	iir->coeffs = coeffs;
+	iir->state = state;
+	iir->stages = stages;
+	memset(state, 0, stages * 2U * sizeof(float));
+
+	return ERR_NONE;
+}
+
+void dsp_biquad_f32(dsp_BiquadF32 *iir, const float *in, float *out, u32 n)
+{
+	const float *coeffs = iir->coeffs;
+	float *state = iir->state;
+	const float *src = in;
+
+	for (u32 stage = 0U; stage < iir->stages; stage++)
+	{
+		float b0 = coeffs[0];
+		float b1 = coeffs[1];
+		float b2 = coeffs[2];
+		float a1 = coeffs[3];
+		float a2 = coeffs[4];
+		float d1 = state[0];
+		float d2 = state[1];
+
+		for (u32 i = 0U; i < n; i++)
+		{
+			float x = src[i];
+			float y = (b0 * x) + d1;
+			d1 = (b1 * x) + (a1 * y) + d2;
+			d2 = (b2 * x) + (a2 * y);
+			out[i] = y;
+		}
+
+		state[0] = d1;
+		state[1] = d2;
+
+		src = out;
+		coeffs += 5U;
+		state += 2U;
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+u32 dsp_fft_q15_init(dsp_FftQ15 *fft, u32 n, u32 *twiddle)
+{
+	if ((fft == NULL) || (twiddle == NULL) || (dsp_is_fft_size(n) == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	double c;
+	double s;
+	dsp_twiddle_step(n, &c, &s);
+
+	double wr = 1.0;
+	double wi = 0.0;
+	for (u32 k = 0U; k < (n / 2U); k++)
+	{
+		double qr = wr * DSP_Q15_ONE;
+		double qi = wi * DSP_Q15_ONE;
+		s32 re = (s32) (qr + ((qr < 0.0) ? -0.5 : 0.5));
+		s32 im = (s32) (qi + ((qi < 0.0) ? -0.5 : 0.5));
+		twiddle[k] = ((u32) re & 0xFFFFU) | ((u32) im << 16);
+
+		double t = (wr * c) - (wi * s);
+		wi = (wr * s) + (wi * c);
+		wr = t;
+	}
+
+	fft->n = n;
+	fft->twiddle = twiddle;
+
+	return ERR_NONE;
+}
+
+// Radix-2 decimation in frequency, then the bit reversal. A complex sample
+// is one word; each butterfly is two halving adds and a complex multiply
+// by the conjugated twiddle in two dual multiplies. The samples are moved
+// with dsp_pair(), as the buffer need only be 16-bit aligned.
+void dsp_fft_q15(const dsp_FftQ15 *fft, s16 *buf)
+{
+	u32 n = fft->n;
+	const u32 *twiddle = fft->twiddle;
+
+	for (u32 span = n / 2U, step = 1U; span > 0U; span >>= 1, step <<= 1)
+	{
+		for (u32 j = 0U; j < span; j++)
+		{
+			u32 w = twiddle[j * step];
+
+			for (u32 i = j; i < n; i += 2U * span)
+			{
+				u32 a = dsp_pair(&buf[2U * i]);
+				u32 b = dsp_pair(&buf[2U * (i + span)]);
+				u32 d = __SHSUB16(a, b);
+
+				// (dr + i di)(c - i s) = (dr c + di s) + i (di c - dr s)
+				s32 re = (s32) __SMUAD(d, w) >> 15;
+				s32 im = (s32) __SMUSDX(w, d) >> 15;
+
+				dsp_put_pair(&buf[2U * i], __SHADD16(a, b));
+				dsp_put_pair(&buf[2U * (i + span)], __PKHBT(__SSAT(re, 16), __SSAT(im, 16), 16));
+			}
+		}
+	}
+
+	u32 bits = 32U - dsp_log2(n);
+	for (u32 i = 1U; i < (n - 1U); i++)
+	{
+		u32 r = __RBIT(i) >> bits;
+		if (i < r)
+		{
+			u32 t = dsp_pair(&buf[2U * i]);
+			dsp_put_pair(&buf[2U * i], dsp_pair(&buf[2U * r]));
+			dsp_put_pair(&buf[2U * r], t);
+		}
+	}
+}
+
+u32 dsp_fft_f32_init(dsp_FftF32 *fft, u32 n, float *twiddle)
+{
+	if ((fft == NULL) || (twiddle == NULL) || (dsp_is_fft_size(n) == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	double c;
+	double s;
+	dsp_twiddle_step(n, &c, &s);
+
+	double wr = 1.0;
+	double wi = 0.0;
+	for (u32 k = 0U; k < (n / 2U); k++)
+	{
+		twiddle[2U * k] = (float) wr;
+		twiddle[(2U * k) + 1U] = (float) wi;
+
+		double t = (wr * c) - (wi * s);
+		wi = (wr * s) + (wi * c);
+		wr = t;
+	}
+
+	fft->n = n;
+	fft->twiddle = twiddle;
+
+	return ERR_NONE;
+}
+
+void dsp_fft_f32(const dsp_FftF32 *fft, float *buf)
+{
+	u32 n = fft->n;
+	const float *twiddle = fft->twiddle;
+
+	for (u32 span = n / 2U, step = 1U; span > 0U; span >>= 1, step <<= 1)
+	{
+		for (u32 j = 0U; j < span; j++)
+		{
+			float c = twiddle[2U * j * step];
+			float s = twiddle[(2U * j * step) + 1U];
+
+			for (u32 i = j; i < n; i += 2U * span)
+			{
+				float *a = &buf[2U * i];
+				float *b = &buf[2U * (i + span)];
+				float dr = a[0] - b[0];
+				float di = a[1] - b[1];
+
+				a[0] = a[0] + b[0];
+				a[1] = a[1] + b[1];
+				b[0] = (dr * c) + (di * s);
+				b[1] = (di * c) - (dr * s);
+			}
+		}
+	}
+
+	u32 bits = 32U - dsp_log2(n);
+	for (u32 i = 1U; i < (n - 1U); i++)
+	{
+		u32 r = __RBIT(i) >> bits;
+		if (i < r)
+		{
+			float tr = buf[2U * i];
+			float ti = buf[(2U * i) + 1U];
+			buf[2U * i] = buf[2U * r];
+			buf[(2U * i) + 1U] = buf[(2U * r) + 1U];
+			buf[2U * r] = tr;
+			buf[(2U * r) + 1U] = ti;
+		}
+	}
+}
+
+// ----------------------------------------------------------------------------
+
+u32 dsp_average_q15_init(dsp_AverageQ15 *avg, s16 *window, u32 shift)
+{
+	// A longer window could overflow the sum
+	if ((avg == NULL) || (window == NULL) || (shift > 16U))
+	{
+		return ERR_GENERIC;
+	}
+
+	avg->window = window;
+	avg->shift = shift;
+	avg->pos = 0U;
+	avg->sum = 0;
+	memset(window, 0, (1U << shift) * sizeof(s16));
+
+	return ERR_NONE;
+}
+
+void dsp_average_q15(dsp_AverageQ15 *avg, const s16 *in, s16 *out, u32 n)
+{
+	s16 *window = avg->window;
+	u32 mask = (1U << avg->shift) - 1U;
+	u32 shift = avg->shift;
+	u32 pos = avg->pos;
+	s32 sum = avg->sum;
+
+	for (u32 i = 0U; i < n; i++)
+	{
+		s16 x = in[i];
+		sum += x - window[pos];
+		window[pos] = x;
+		pos = (pos + 1U) & mask;
+		out[i] = (s16) (sum >> shift);
+	}
+
+	avg->pos = pos;
+	avg->sum = sum;
+}
+
+u32 dsp_average_f32_init(dsp_AverageF32 *avg, float *window, u32 len)
+{
+	if ((avg == NULL) || (window == NULL) || (len == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	avg->window = window;
+	avg->len = len;
+	avg->pos = 0U;
+	avg->sum = 0.0f;
+	avg->scale = 1.0f / (float) len;
+	memset(window, 0, len * sizeof(float));
+
+	return ERR_NONE;
+}
+
+void dsp_average_f32(dsp_AverageF32 *avg, const float *in, float *out, u32 n)
+{
+	float *window = avg->window;
+	u32 len = avg->len;
+	u32 pos = avg->pos;
+	float sum = avg->sum;
+	float scale = avg->scale;
+
+	for (u32 i = 0U; i < n; i++)
+	{
+		float x = in[i];
+		sum += x - window[pos];
+		window[pos] = x;
+
+		if (++pos == len)
+		{
+			pos = 0U;
+			sum = 0.0f;
+			for (u32 k = 0U; k < len; k++)
+			{
+				sum += window[k];
+			}
+		}
+
+		out[i] = sum * scale;
+	}
+
+	avg->pos = pos;
+	avg->sum = sum;
+}
+
+// ----------------------------------------------------------------------------
+
+void dsp_add_q15(const s16 *a, const s16 *b, s16 *out, u32 n)
+{
+	u32 i = 0U;
+	for (; (i + 1U) < n; i += 2U)
+	{
+		u32 sum = __QADD16(dsp_pair(&a[i]), dsp_pair(&b[i]));
+		dsp_put_pair(&out[i], sum);
+	}
+
+	if (i < n)
+	{
+		out[i] = dsp_sat_q15((s32) a[i] + b[i]);
+	}
+}
@@ -0,0 +1,617 @@
+/*
+ * eth.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <eth.h>
+#include <clock.h>
+#include <irq.h>
+#include <pin.h>
+#include <sections.h>
+#include <workq.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define ETH_CRC_LEN             (4U)
+// Puts the IP header of received frames on a word boundary
+#define ETH_RX_OFFSET           (2U)
+#define ETH_SPINS               (1000000U)
+
+#define ETH_IER_BATCH           (ETH_DMAIER_RIE | ETH_DMAIER_TIE | ETH_DMAIER_RBUIE)
+// DMASR status bits, write one to clear
+#define ETH_DMASR_CLEAR         (0x0001FFFFU)
+
+// PHY registers and bits, from IEEE 802.3 clause 22
+#define ETH_PHY_BMCR            (0U)
+#define ETH_PHY_BMSR            (1U)
+#define ETH_PHY_ID1             (2U)
+#define ETH_PHY_ANAR            (4U)
+#define ETH_PHY_ANLPAR          (5U)
+#define ETH_BMCR_RESET          (0x8000U)
+#define ETH_BMCR_ANEN           (0x1000U)
+#define ETH_BMCR_ANRESTART      (0x0200U)
+#define ETH_BMSR_ANDONE         (0x0020U)
+#define ETH_BMSR_LINK           (0x0004U)
+#define ETH_AN_100_FULL         (0x0100U)
+#define ETH_AN_100_HALF         (0x0080U)
+#define ETH_AN_10_FULL          (0x0040U)
+#define ETH_PHY_ADDRS           (32U)
+#define ETH_MDIO_NONE           (0xFFFFFFFFU)
+
+// Normal (not enhanced) DMA descriptor, in ring mode
+typedef struct eth_desc
+{
+	volatile u32 status;
+	volatile u32 ctrl;
+	volatile u32 buf1;
+	volatile u32 buf2;
+} eth_Desc;
+
+typedef struct eth_port
+{
+	u32 ready;
+	u32 phy;
+	u32 link;
+	pkt_Pool *pool;
+	u32 rx_size;
+
+	// The buffer behind each RX descriptor, and the next one to look at
+	pkt_Buf *rx_buf[ETH_RX_RING];
+	u32 rx_next;
+	// The RX DMA ran out of descriptors; latched by the interrupt, whose
+	// clearing of DMASR hides it from the poll
+	volatile u32 rx_suspended;
+
+	// The chain of a frame, at its last descriptor
+	pkt_Buf *tx_chain[ETH_TX_RING];
+	u32 tx_head;                    // next free descriptor
+	u32 tx_tail;                    // oldest one in flight
+	u32 tx_used;
+
+	eth_Stats stats;
+
+	eth_Rx rx;
+	eth_TxDone tx_done;
+	void *arg;
+	workq_Item work;
+} eth_Port;
+
+static eth_Desc eth_rx_desc[ETH_RX_RING] CARZOS_SRAM2;
+static eth_Desc eth_tx_desc[ETH_TX_RING] CARZOS_SRAM2;
+
+static eth_Port eth_port;
+
+static const u32 eth_pins[] =
+{
+	PIN('A', 1U), PIN('A', 2U), PIN('A', 7U),
+	PIN('C', 1U), PIN('C', 4U), PIN('C', 5U),
+	PIN('B', 11U), PIN('B', 12U), PIN('B', 13U),
+};
+
+
+static inline u32 eth_ring_next(u32 i, u32 len)
+{
+	return ((i + 1U) == len) ? 0U : (i + 1U);
+}
+
+// Writes a MAC register twice, the MAC clock domain apart: a single write
+// can be lost when it follows another one too closely (erratum)
+static void eth_mac_write(volatile u32 *reg, u32 value)
+{
+	*reg = value;
+	(void) *reg;
+	for (volatile u32 i = 0U; i < 100U; i++)
+	{
+	}
+	*reg = value;
+}
+
+// MDC at most 2.5 MHz
+static u32 eth_mdc_range(void)
+{
+	u32 hclk = clock_hclk();
+
+	if (hclk < 35000000U)
+	{
+		return ETH_MACMIIAR_CR_Div16;
+	}
+	if (hclk < 60000000U)
+	{
+		return ETH_MACMIIAR_CR_Div26;
+	}
+	if (hclk < 100000000U)
+	{
+		return ETH_MACMIIAR_CR_Div42;
+	}
+	if (hclk < 150000000U)
+	{
+		return ETH_MACMIIAR_CR_Div62;
+	}
+	return ETH_MACMIIAR_CR_Div102;
+}
+
+static u32 eth_mdio(u32 phy, u32 reg, u32 write, u32 value)
+{
+	if (write != 0U)
+	{
+		ETH->MACMIIDR = value;
+	}
+	ETH->MACMIIAR = (phy << 11) | (reg << 6) | eth_mdc_range()
+			| ((write != 0U) ? ETH_MACMIIAR_MW : 0U) | ETH_MACMIIAR_MB;
+
+	for (u32 i = 0U; i < ETH_SPINS; i++)
+	{
+		if ((ETH->MACMIIAR & ETH_MACMIIAR_MB) == 0U)
+		{
+			return ETH->MACMIIDR & 0xFFFFU;
+		}
+	}
+	return ETH_MDIO_NONE;
+}
+
+static u32 eth_phy_find(u32 phy)
+{
+	if (phy != ETH_PHY_ANY)
+	{
+		return phy;
+	}
+	for (phy = 0U; phy < ETH_PHY_ADDRS; phy++)
+	{
+		u32 id = eth_mdio(phy, ETH_PHY_ID1, 0U, 0U);
+		if ((id != ETH_MDIO_NONE) && (id != 0xFFFFU) && (id != 0U))
+		{
+			return phy;
+		}
+	}
+	return ETH_PHY_ANY;
+}
+
+static u32 eth_phy_init(u32 phy)
+{
+	if (eth_mdio(phy, ETH_PHY_BMCR, 1U, ETH_BMCR_RESET) == ETH_MDIO_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	for (u32 i = 0U; i < ETH_SPINS; i++)
+	{
+		u32 bmcr = eth_mdio(phy, ETH_PHY_BMCR, 0U, 0U);
+		if (bmcr == ETH_MDIO_NONE)
+		{
+			return ERR_GENERIC;
+		}
+		if ((bmcr & ETH_BMCR_RESET) == 0U)
+		{
+			// The PHY advertises all it can by default
+			eth_mdio(phy, ETH_PHY_BMCR, 1U, ETH_BMCR_ANEN | ETH_BMCR_ANRESTART);
+			return ERR_NONE;
+		}
+	}
+	return ERR_GENERIC;
+}
+
+// ----------------------------------------------------------------------------
+
+static void eth_rx_poll(eth_Port *eth)
+{
+	for (;;)
+	{
+		u32 i = eth->rx_next;
+		eth_Desc *desc = &eth_rx_desc[i];
+		u32 status = desc->status;
+		if ((status & ETH_DMARXDESC_OWN) != 0U)
+		{
+			break;
+		}
+
+		pkt_Buf *frame = eth->rx_buf[i];
+		pkt_Buf *fresh = NULL;
+		if ((status & (ETH_DMARXDESC_FS | ETH_DMARXDESC_LS | ETH_DMARXDESC_ES))
+				!= (ETH_DMARXDESC_FS | ETH_DMARXDESC_LS))
+		{
+			// Errors, or a frame longer than a buffer, in pieces
+			if ((status & ETH_DMARXDESC_LS) != 0U)
+			{
+				eth->stats.rx_errors++;
+			}
+		}
+		else if ((fresh = pkt_alloc(eth->pool)) == NULL)
+		{
+			eth->stats.rx_dropped++;
+		}
+		else
+		{
+			fresh->data = fresh->mem + ETH_RX_OFFSET;
+			eth->rx_buf[i] = fresh;
+			desc->buf1 = (u32) fresh->data;
+
+			frame->len = (u16) (((status & ETH_DMARXDESC_FL) >> 16) - ETH_CRC_LEN);
+			// An IPv4 or IPv6 type frame with neither checksum error
+			frame->flags = ((status & (ETH_DMARXDESC_FT | ETH_DMARXDESC_IPV4HCE
+					| ETH_DMARXDESC_MAMPCE)) == ETH_DMARXDESC_FT) ? PKT_CSUM_OK : 0U;
+		}
+
+		__DMB();
+		desc->status = ETH_DMARXDESC_OWN;
+		eth->rx_next = eth_ring_next(i, ETH_RX_RING);
+
+		if (fresh != NULL)
+		{
+			eth->stats.rx_frames++;
+			eth->rx(eth->arg, frame);
+		}
+	}
+
+	// The DMA suspends when it finds no descriptor of its own; the ones
+	// given back above get it going again
+	if (eth->rx_suspended != 0U)
+	{
+		eth->rx_suspended = 0U;
+		ETH->DMARPDR = 0U;
+	}
+}
+
+static void eth_tx_reclaim(eth_Port *eth)
+{
+	pkt_Buf *done = NULL;
+	pkt_Buf **last = &done;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	while (eth->tx_used != 0U)
+	{
+		u32 i = eth->tx_tail;
+		u32 status = eth_tx_desc[i].status;
+		if ((status & ETH_DMATXDESC_OWN) != 0U)
+		{
+			break;
+		}
+
+		if ((status & ETH_DMATXDESC_LS) != 0U)
+		{
+			if ((status & ETH_DMATXDESC_ES) != 0U)
+			{
+				eth->stats.tx_errors++;
+			}
+			else
+			{
+				eth->stats.tx_frames++;
+			}
+			pkt_Buf *chain = eth->tx_chain[i];
+			chain->link = NULL;
+			*last = chain;
+			last = &chain->link;
+		}
+
+		eth->tx_tail = eth_ring_next(i, ETH_TX_RING);
+		eth->tx_used--;
+	}
+
+	__set_PRIMASK(primask);
+
+	while (done != NULL)
+	{
+		pkt_Buf *next = done->link;
+		if (eth->tx_done != NULL)
+		{
+			eth->tx_done(eth->arg, done);
+		}
+		else
+		{
+			pkt_free(done);
+		}
+		done = next;
+	}
+}
+
+u32 eth_send(pkt_Buf *chain)
+{
+	eth_Port *eth = &eth_port;
+	u32 segs = 0U;
+	u32 len = 0U;
+
+	for (const pkt_Buf *buf = chain; buf != NULL; buf = buf->next)
+	{
+		if ((buf->len == 0U) || (buf->len > ETH_DMATXDESC_TBS1))
+		{
+			return ERR_GENERIC;
+		}
+		segs++;
+		len += buf->len;
+	}
+	if ((eth->ready == 0U) || (segs == 0U) || (len > ETH_FRAME_MAX))
+	{
+		return ERR_GENERIC;
+	}
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((ETH_TX_RING - eth->tx_used) < segs)
+	{
+		__set_PRIMASK(primask);
+		return ERR_GENERIC;
+	}
+
+	// The first descriptor is given to the DMA last, so that it never
+	// starts on a frame still being set
+	u32 first = eth->tx_head;
+	u32 i = first;
+	for (pkt_Buf *buf = chain; buf != NULL; buf = buf->next)
+	{
+		eth_Desc *desc = &eth_tx_desc[i];
+		u32 status = ((i + 1U) == ETH_TX_RING) ? ETH_DMATXDESC_TER : 0U;
+
+		if (buf == chain)
+		{
+			status |= ETH_DMATXDESC_FS | ETH_DMATXDESC_CIC_TCPUDPICMP_FULL;
+		}
+		else
+		{
+			status |= ETH_DMATXDESC_OWN;
+		}
+		if (buf->next == NULL)
+		{
+			status |= ETH_DMATXDESC_LS | ETH_DMATXDESC_IC;
+			eth->tx_chain[i] = chain;
+		}
+
+		desc->buf1 = (u32) buf->data;
+		desc->ctrl = buf->len;
+		desc->status = status;
+		i = eth_ring_next(i, ETH_TX_RING);
+	}
+
+	__DMB();
+	eth_tx_desc[first].status |= ETH_DMATXDESC_OWN;
+	eth->tx_head = i;
+	eth->tx_used += segs;
+
+	__set_PRIMASK(primask);
+
+	// Wakes the DMA if it suspended on an empty ring
+	ETH->DMATPDR = 0U;
+
+	return ERR_NONE;
+}
+
+// ----------------------------------------------------------------------------
+
+static void eth_irq(void *ctx)
+{
+	eth_Port *eth = ctx;
+	u32 sr = ETH->DMASR;
+
+	ETH->DMASR = sr & ETH_DMASR_CLEAR;
+
+	if ((sr & ETH_DMASR_RBUS) != 0U)
+	{
+		eth->rx_suspended = 1U;
+	}
+	if ((sr & (ETH_DMASR_RS | ETH_DMASR_TS | ETH_DMASR_RBUS)) != 0U)
+	{
+		ETH->DMAIER &= ~ETH_IER_BATCH;
+		workq_post(&eth->work);
+	}
+}
+
+static void eth_work(void *arg)
+{
+	eth_Port *eth = arg;
+
+	eth_tx_reclaim(eth);
+	eth_rx_poll(eth);
+
+	// A frame in since the poll has set its status bit again, which
+	// raises the interrupt as soon as it is unmasked
+	ETH->DMAIER |= ETH_IER_BATCH;
+}
+
+u32 eth_link(void)
+{
+	eth_Port *eth = &eth_port;
+
+	if (eth->ready == 0U)
+	{
+		return ETH_LINK_DOWN;
+	}
+
+	// The link bit latches low; the second read is the state now
+	(void) eth_mdio(eth->phy, ETH_PHY_BMSR, 0U, 0U);
+	u32 bmsr = eth_mdio(eth->phy, ETH_PHY_BMSR, 0U, 0U);
+
+	u32 link = ETH_LINK_DOWN;
+	if ((bmsr != ETH_MDIO_NONE) && ((bmsr & (ETH_BMSR_LINK | ETH_BMSR_ANDONE))
+			== (ETH_BMSR_LINK | ETH_BMSR_ANDONE)))
+	{
+		u32 common = eth_mdio(eth->phy, ETH_PHY_ANAR, 0U, 0U)
+				& eth_mdio(eth->phy, ETH_PHY_ANLPAR, 0U, 0U);
+
+		if ((common & ETH_AN_100_FULL) != 0U)
+		{
+			link = ETH_LINK_100_FULL;
+		}
+		else if ((common & ETH_AN_100_HALF) != 0U)
+		{
+			link = ETH_LINK_100_HALF;
+		}
+		else if ((common & ETH_AN_10_FULL) != 0U)
+		{
+			link = ETH_LINK_10_FULL;
+		}
+		else
+		{
+			link = ETH_LINK_10_HALF;
+		}
+	}
+
+	if ((link != ETH_LINK_DOWN) && (link != eth->link))
+	{
+		u32 maccr = ETH->MACCR & ~(ETH_MACCR_FES | ETH_MACCR_DM | ETH_MACCR_ROD);
+		if (link >= ETH_LINK_100_HALF)
+		{
+			maccr |= ETH_MACCR_FES;
+		}
+		if ((link == ETH_LINK_100_FULL) || (link == ETH_LINK_10_FULL))
+		{
+			maccr |= ETH_MACCR_DM;
+		}
+		else
+		{
+			// Half duplex hears its own frames
+			maccr |= ETH_MACCR_ROD;
+		}
+		eth_mac_write(&ETH->MACCR, maccr);
+	}
+	eth->link = link;
+
+	return link;
+}
+
+void eth_stats(eth_Stats *stats)
+{
+	*stats = eth_port.stats;
+	// Frames missed for want of a descriptor, and on a FIFO overflow; the
+	// counters clear when read
+	u32 missed = ETH->DMAMFBOCR;
+	eth_port.stats.rx_missed += (missed & 0xFFFFU) + ((missed >> 17) & 0x7FFU);
+	stats->rx_missed = eth_port.stats.rx_missed;
+}
+
+u32 eth_init(const eth_Config *config)
+{
+	eth_Port *eth = &eth_port;
+
+	if ((config == NULL) || (config->pool == NULL) || (config->rx == NULL)
+			|| (config->pool->size < ETH_POOL_BUF_MIN)
+			|| ((config->phy >= ETH_PHY_ADDRS) && (config->phy != ETH_PHY_ANY)))
+	{
+		return ERR_GENERIC;
+	}
+
+	eth->ready = 0U;
+	eth->link = ETH_LINK_DOWN;
+	eth->pool = config->pool;
+	eth->rx_size = (config->pool->size - ETH_RX_OFFSET) & ~3U;
+	if (eth->rx_size > ETH_DMARXDESC_RBS1)
+	{
+		eth->rx_size = ETH_DMARXDESC_RBS1 & ~3U;
+	}
+	eth->rx_next = 0U;
+	eth->rx_suspended = 0U;
+	eth->tx_head = 0U;
+	eth->tx_tail = 0U;
+	eth->tx_used = 0U;
+	eth->stats = (eth_Stats) { 0U };
+	eth->rx = config->rx;
+	eth->tx_done = config->tx_done;
+	eth->arg = config->arg;
+
+	if (workq_item_init(&eth->work, eth_work, eth, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	// RMII is picked with the MAC in reset, before its clocks run
+	RCC->APB2ENR |= RCC_APB2ENR_SYSCFGEN;
+	(void) RCC->APB2ENR;
+	RCC->AHB1RSTR |= RCC_AHB1RSTR_ETHMACRST;
+	SYSCFG->PMC |= SYSCFG_PMC_MII_RMII_SEL;
+	RCC->AHB1ENR |= RCC_AHB1ENR_ETHMACEN | RCC_AHB1ENR_ETHMACTXEN | RCC_AHB1ENR_ETHMACRXEN;
+	(void) RCC->AHB1ENR;
+	RCC->AHB1RSTR &= ~RCC_AHB1RSTR_ETHMACRST;
+
+	for (u32 i = 0U; i < (sizeof(eth_pins) / sizeof(eth_pins[0])); i++)
+	{
+		pin_af(eth_pins[i], GPIO_AF11_ETH, GPIO_NOPULL, PIN_PUSH_PULL);
+	}
+
+	// The reset needs REF_CLK, so it hangs without a PHY
+	ETH->DMABMR |= ETH_DMABMR_SR;
+	u32 spins = 0U;
+	while ((ETH->DMABMR & ETH_DMABMR_SR) != 0U)
+	{
+		if (++spins == ETH_SPINS)
+		{
+			return ERR_GENERIC;
+		}
+	}
+
+	eth->phy = eth_phy_find(config->phy);
+	if ((eth->phy == ETH_PHY_ANY) || (eth_phy_init(eth->phy) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	// 100 Mbit full duplex until eth_link() says otherwise; checksums
+	// checked on receive
+	eth_mac_write(&ETH->MACCR, ETH_MACCR_FES | ETH_MACCR_DM | ETH_MACCR_IPCO);
+	// Own unicast address, broadcast, multicast by perfect filter
+	eth_mac_write(&ETH->MACFFR, 0U);
+	eth_mac_write(&ETH->MACFCR, 0U);
+	ETH->MACA0HR = ((u32) config->mac[5] << 8) | config->mac[4];
+	ETH->MACA0LR = ((u32) config->mac[3] << 24) | ((u32) config->mac[2] << 16)
+			| ((u32) config->mac[1] << 8) | config->mac[0];
+
+	for (u32 i = 0U; i < ETH_RX_RING; i++)
+	{
+		pkt_Buf *buf = pkt_alloc(eth->pool);
+		if (buf == NULL)
+		{
+			return ERR_GENERIC;
+		}
+		buf->data = buf->mem + ETH_RX_OFFSET;
+		eth->rx_buf[i] = buf;
+
+		eth_rx_desc[i].buf1 = (u32) buf->data;
+		eth_rx_desc[i].buf2 = 0U;
+		eth_rx_desc[i].ctrl = eth->rx_size | (((i + 1U) == ETH_RX_RING) ? ETH_DMARXDESC_RER : 0U);
+		eth_rx_desc[i].status = ETH_DMARXDESC_OWN;
+	}
+	for (u32 i = 0U; i < ETH_TX_RING; i++)
+	{
+		eth_tx_desc[i].buf2 = 0U;
+		eth_tx_desc[i].ctrl = 0U;
+		eth_tx_desc[i].status = ((i + 1U) == ETH_TX_RING) ? ETH_DMATXDESC_TER : 0U;
+		eth->tx_chain[i] = NULL;
+	}
+
+	// 32 beat bursts, address aligned, 16 byte descriptors
+	ETH->DMABMR = ETH_DMABMR_AAB | ETH_DMABMR_FB | ETH_DMABMR_USP
+			| ETH_DMABMR_RDP_32Beat | ETH_DMABMR_PBL_32Beat;
+	ETH->DMARDLAR = (u32) eth_rx_desc;
+	ETH->DMATDLAR = (u32) eth_tx_desc;
+
+	// Store and forward both ways: checksum insertion needs whole frames,
+	// and frames with bad checksums are then dropped
+	eth_mac_write(&ETH->DMAOMR, ETH_DMAOMR_RSF | ETH_DMAOMR_TSF | ETH_DMAOMR_OSF);
+
+	if (irq_attach(ETH_IRQn, eth_irq, eth) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	NVIC_SetPriority(ETH_IRQn, config->priority);
+	NVIC_EnableIRQ(ETH_IRQn);
+
+	ETH->DMASR = ETH_DMASR_CLEAR;
+	ETH->DMAIER = ETH_DMAIER_NISE | ETH_DMAIER_AISE | ETH_IER_BATCH;
+
+	(void) ETH->DMAMFBOCR;
+	eth->ready = 1U;
+
+	eth_mac_write(&ETH->MACCR, ETH->MACCR | ETH_MACCR_TE | ETH_MACCR_RE);
+	ETH->DMAOMR |= ETH_DMAOMR_FTF;
+	for (spins = 0U; ((ETH->DMAOMR & ETH_DMAOMR_FTF) != 0U) && (spins < ETH_SPINS); spins++)
+	{
+	}
+	eth_mac_write(&ETH->DMAOMR, ETH->DMAOMR | ETH_DMAOMR_ST | ETH_DMAOMR_SR);
+
+	return ERR_NONE;
+}
@@ -0,0 +1,188 @@
+/*
+ * fault.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <cortexm/exception_handlers.h>
+#include <fault.h>
+#include <cpuload.h>
+#include <sections.h>
+#include <timer.h>
+
+#include "ktype.h"
+
+// Defined in linker script
+extern u32 __carzos_main_stack_limit[];
+extern u32 __carzos_stack_end[];
+extern u16 __vectors_start[];
+extern u16 __text_end[];
+extern u16 __ramfunc_start[];
+extern u16 __ramfunc_end[];
+
+void fault_capture(ExceptionStackFrame *frame, u32 exc_return, u32 type) __attribute__((noreturn, used));
+
+static fault_Record fault_record CARZOS_NOINIT;
+
+// The stack the handlers switch to; fault_stack_end is its top
+static u32 fault_stack[FAULT_STACK_WORDS] CARZOS_CCMRAM_BSS __attribute__((used));
+u32 * const fault_stack_end = &fault_stack[FAULT_STACK_WORDS];
+
+
+// The handler wrappers: r0 the frame, r1 EXC_RETURN, r2 the type
+#define FAULT_HANDLER(_name, _type) \
+	void __attribute__((naked)) _name(void) \
+	{ \
+		asm volatile \
+		( \
+			" tst   lr, #4          \n" \
+			" ite   eq              \n" \
+			" mrseq r0, msp         \n" \
+			" mrsne r0, psp         \n" \
+			" mov   r1, lr          \n" \
+			" movs  r2, %[type]     \n" \
+			" ldr   r3, =fault_stack_end \n" \
+			" ldr   r3, [r3]        \n" \
+			" msr   msp, r3         \n" \
+			" ldr   r3, =fault_capture \n" \
+			" bx    r3              \n" \
+			: \
+			: [type] "i" (_type) \
+			: \
+		); \
+	}
+
+FAULT_HANDLER(HardFault_Handler, FAULT_HARD)
+FAULT_HANDLER(MemManage_Handler, FAULT_MEMMANAGE)
+FAULT_HANDLER(BusFault_Handler, FAULT_BUS)
+FAULT_HANDLER(UsageFault_Handler, FAULT_USAGE)
+
+static u32 fault_sum(const fault_Record *record)
+{
+	const u32 *p = (const u32 *) record;
+	u32 sum = 0U;
+	for (u32 i = 0U; i < (offsetof(fault_Record, check) / sizeof(u32)); i++)
+	{
+		sum += p[i];
+	}
+	return ~sum;
+}
+
+static u32 fault_valid(const fault_Record *record)
+{
+	return (record->magic == FAULT_MAGIC) && (record->check == fault_sum(record));
+}
+
+// A Thumb address in code, right after a BL or a BLX register
+static u32 fault_is_return(u32 addr)
+{
+	if ((addr & 1U) == 0U)
+	{
+		return 0U;
+	}
+
+	const u16 *insn = (const u16 *) (addr & ~1U);
+	u32 in_text = (insn >= (__vectors_start + 2)) && (insn <= __text_end);
+	u32 in_ram = (insn >= (__ramfunc_start + 2)) && (insn <= __ramfunc_end);
+	if ((in_text == 0U) && (in_ram == 0U))
+	{
+		return 0U;
+	}
+
+	u32 bl = ((insn[-2] & 0xF800U) == 0xF000U) && ((insn[-1] & 0xD000U) == 0xD000U);
+	u32 blx = (insn[-1] & 0xFF87U) == 0x4780U;
+	return bl || blx;
+}
+
+static void fault_walk(fault_Record *record)
+{
+	record->depth = 0U;
+
+	u32 *p = (u32 *) record->sp;
+	if ((p < __carzos_main_stack_limit) || (p >= __carzos_stack_end))
+	{
+		return;
+	}
+
+	for (u32 n = 0U; (n < FAULT_SCAN_WORDS) && (p < __carzos_stack_end); n++, p++)
+	{
+		if (fault_is_return(*p))
+		{
+			record->walk[record->depth++] = *p;
+			if (record->depth == FAULT_WALK_DEPTH)
+			{
+				break;
+			}
+		}
+	}
+}
+
+void fault_capture(ExceptionStackFrame *frame, u32 exc_return, u32 type)
+{
+	// The guard under the main stack may be where the frame is
+	MPU->CTRL = 0U;
+	__DSB();
+	__ISB();
+
+	fault_Record *record = &fault_record;
+
+	record->count = fault_valid(record) ? (record->count + 1U) : 1U;
+	record->magic = FAULT_MAGIC;
+	record->type = type;
+
+	record->r0 = frame->r0;
+	record->r1 = frame->r1;
+	record->r2 = frame->r2;
+	record->r3 = frame->r3;
+	record->r12 = frame->r12;
+	record->lr = frame->lr;
+	record->pc = frame->pc;
+	record->psr = frame->psr;
+	record->exc_return = exc_return;
+
+	// 8 words, 26 with the FP context (EXC_RETURN bit 4 clear), plus the
+	// alignment word flagged in the stacked xPSR bit 9
+	u32 sp = (u32) frame + (8U * 4U);
+	if ((exc_return & (1U << 4)) == 0U)
+	{
+		sp += 18U * 4U;
+	}
+	if ((frame->psr & (1U << 9)) != 0U)
+	{
+		sp += 4U;
+	}
+	record->sp = sp;
+
+	// BFAR and MMFAR first, then CFSR, see dumpExceptionStack()
+	record->mmfar = SCB->MMFAR;
+	record->bfar = SCB->BFAR;
+	record->cfsr = SCB->CFSR;
+	record->hfsr = SCB->HFSR;
+
+	record->context = cpuload_context();
+	record->ticks = timer_ticks;
+
+	fault_walk(record);
+
+	record->check = fault_sum(record);
+	__DSB();
+
+#if defined(DEBUG)
+	__DEBUG_BKPT();
+#endif
+
+	NVIC_SystemReset();
+}
+
+const fault_Record *fault_last(void)
+{
+	return fault_valid(&fault_record) ? &fault_record : NULL;
+}
+
+void fault_clear(void)
+{
+	fault_record.magic = 0U;
+}
@@ -0,0 +1,623 @@
+/*
+ * i2c.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <cpuload.h>
+#include <dwt.h>
+#include <i2c.h>
+#include <pin.h>
+#include <timer.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define I2C_INSTANCES           (3U)
+#define I2C_DMA_PL_MEDIUM       (1U)
+#define I2C_FREQ_MIN_MHZ        (2U)
+#define I2C_FREQ_MAX_MHZ        (42U)
+#define I2C_RECOVERY_HZ         (100000U)
+#define I2C_RECOVERY_CLOCKS     (9U)
+
+#define I2C_SR1_ERRORS          (I2C_SR1_BERR | I2C_SR1_ARLO | I2C_SR1_AF \
+		| I2C_SR1_OVR | I2C_SR1_TIMEOUT)
+
+// Phase of the transaction on the bus
+#define I2C_PHASE_WRITE         (0U)
+#define I2C_PHASE_DRAIN         (1U)    // last byte written, waiting for BTF
+#define I2C_PHASE_READ          (2U)
+
+typedef struct i2c_hw
+{
+	I2C_TypeDef *regs;
+	IRQn_Type ev_irqn;
+	IRQn_Type er_irqn;
+	u32 enable;
+	u8 af;
+	u8 rx_stream;
+	u8 channel;
+} i2c_Hw;
+
+// All on DMA1. I2C1 shares stream 0 with the UART5 and SPI3 RX, I2C2
+// stream 3 with the SPI2 RX and USART3 TX, I2C3 stream 2 with the UART4
+// RX: do not use both of a pair.
+static const i2c_Hw i2c_hw[I2C_INSTANCES] =
+{
+	{ I2C1, I2C1_EV_IRQn, I2C1_ER_IRQn, RCC_APB1ENR_I2C1EN, GPIO_AF4_I2C1, 0U, 1U },
+	{ I2C2, I2C2_EV_IRQn, I2C2_ER_IRQn, RCC_APB1ENR_I2C2EN, GPIO_AF4_I2C2, 3U, 7U },
+	{ I2C3, I2C3_EV_IRQn, I2C3_ER_IRQn, RCC_APB1ENR_I2C3EN, GPIO_AF4_I2C3, 2U, 3U },
+};
+
+
+static inline u32 i2c_first_phase(const i2c_Transfer *transfer)
+{
+	return ((transfer->wr_len != 0U) || (transfer->rd_len == 0U))
+			? I2C_PHASE_WRITE : I2C_PHASE_READ;
+}
+
+// Timing from the APB1 clock; leaves the peripheral enabled
+static void i2c_setup(i2c_Bus *bus)
+{
+	I2C_TypeDef *regs = bus->regs;
+	u32 pclk = clock_pclk1();
+
+	u32 mhz = pclk / 1000000U;
+	if (mhz < I2C_FREQ_MIN_MHZ)
+	{
+		mhz = I2C_FREQ_MIN_MHZ;
+	}
+	else if (mhz > I2C_FREQ_MAX_MHZ)
+	{
+		mhz = I2C_FREQ_MAX_MHZ;
+	}
+
+	regs->CR1 = 0U;
+	regs->CR2 = mhz | I2C_CR2_ITEVTEN | I2C_CR2_ITERREN;
+
+	u32 ccr;
+	if (bus->speed_hz > I2C_HZ_STANDARD)
+	{
+		// Fast mode, low:high 2:1; 300 ns rise time
+		ccr = (pclk + (3U * bus->speed_hz) - 1U) / (3U * bus->speed_hz);
+		regs->CCR = I2C_CCR_FS | ((ccr < 1U) ? 1U : ccr);
+		regs->TRISE = ((mhz * 300U) / 1000U) + 1U;
+	}
+	else
+	{
+		// 1000 ns rise time
+		ccr = (pclk + (2U * bus->speed_hz) - 1U) / (2U * bus->speed_hz);
+		regs->CCR = (ccr < 4U) ? 4U : ccr;
+		regs->TRISE = mhz + 1U;
+	}
+
+	regs->CR1 = I2C_CR1_PE;
+}
+
+static void i2c_delay(u32 cycles)
+{
+	u32 start = dwt_cycles();
+	while ((dwt_cycles() - start) < cycles)
+	{
+	}
+}
+
+// Frees a bus held by a slave, then resets the peripheral
+static void i2c_recover(i2c_Bus *bus)
+{
+	GPIO_TypeDef *scl = PIN_GPIO(bus->scl_pin);
+	GPIO_TypeDef *sda = PIN_GPIO(bus->sda_pin);
+	u32 scl_mask = PIN_MASK(bus->scl_pin);
+	u32 sda_mask = PIN_MASK(bus->sda_pin);
+	u32 half = clock_hclk() / (2U * I2C_RECOVERY_HZ);
+
+	bus->regs->CR1 = 0U;
+
+	scl->BSRR = scl_mask;
+	sda->BSRR = sda_mask;
+	pin_output(bus->scl_pin, PIN_OPEN_DRAIN);
+	pin_output(bus->sda_pin, PIN_OPEN_DRAIN);
+	i2c_delay(half);
+
+	// Clock out whatever the slave is in the middle of sending
+	for (u32 i = 0U; (i < I2C_RECOVERY_CLOCKS) && ((sda->IDR & sda_mask) == 0U); i++)
+	{
+		scl->BSRR = scl_mask << 16;
+		i2c_delay(half);
+		scl->BSRR = scl_mask;
+		i2c_delay(half);
+	}
+
+	// Stop: SDA rises while SCL is high
+	scl->BSRR = scl_mask << 16;
+	i2c_delay(half);
+	sda->BSRR = sda_mask << 16;
+	i2c_delay(half);
+	scl->BSRR = scl_mask;
+	i2c_delay(half);
+	sda->BSRR = sda_mask;
+	i2c_delay(half);
+
+	pin_af(bus->scl_pin, bus->af, GPIO_NOPULL, PIN_OPEN_DRAIN);
+	pin_af(bus->sda_pin, bus->af, GPIO_NOPULL, PIN_OPEN_DRAIN);
+
+	bus->regs->CR1 = I2C_CR1_SWRST;
+	bus->regs->CR1 = 0U;
+	i2c_setup(bus);
+
+	bus->recoveries++;
+}
+
+// Starts the transaction at the head of the queue from an idle bus;
+// interrupts masked or in a bus interrupt.
+static void i2c_start(i2c_Bus *bus)
+{
+	i2c_Transfer *transfer = bus->head;
+	if ((transfer == NULL) || (bus->hold != 0U))
+	{
+		bus->active = 0U;
+		return;
+	}
+
+	I2C_TypeDef *regs = bus->regs;
+
+	bus->active = 1U;
+	bus->phase = i2c_first_phase(transfer);
+	bus->index = 0U;
+	bus->stamp = timer_ticks;
+
+	// The stop of the previous transaction may still be going out; it
+	// takes at most a bit time
+	while ((regs->CR1 & I2C_CR1_STOP) != 0U)
+	{
+	}
+
+	if ((regs->SR2 & I2C_SR2_BUSY) != 0U)
+	{
+		i2c_recover(bus);
+	}
+
+	regs->CR1 |= I2C_CR1_START;
+}
+
+// Ends the transaction on the wire: a repeated start when the next one is
+// already queued, a stop otherwise.
+static void i2c_end(i2c_Bus *bus)
+{
+	if ((bus->head->next != NULL) && (bus->hold == 0U))
+	{
+		bus->regs->CR1 |= I2C_CR1_START;
+		bus->chained = 1U;
+	}
+	else
+	{
+		bus->regs->CR1 |= I2C_CR1_STOP;
+		bus->chained = 0U;
+	}
+}
+
+static void i2c_complete(i2c_Bus *bus, u32 status)
+{
+	i2c_Transfer *transfer = bus->head;
+	transfer->status = status;
+
+	bus->head = transfer->next;
+	if (bus->head == NULL)
+	{
+		bus->tail = NULL;
+	}
+
+	if ((bus->head != NULL) && (bus->chained != 0U))
+	{
+		// Its start is on the way
+		bus->phase = i2c_first_phase(bus->head);
+		bus->index = 0U;
+		bus->stamp = timer_ticks;
+	}
+	else
+	{
+		i2c_start(bus);
+	}
+	bus->chained = 0U;
+
+	if (transfer->callback != NULL)
+	{
+		// Still busy until its callback has run
+		transfer->next = bus->done;
+		bus->done = transfer;
+		workq_post(&bus->work);
+	}
+	else
+	{
+		transfer->busy = 0U;
+	}
+}
+
+// Fails the transaction on the bus; a stop ends it, or a recovery when
+// the bus state is unknown.
+static void i2c_abort(i2c_Bus *bus, u32 recover)
+{
+	I2C_TypeDef *regs = bus->regs;
+
+	dma_stop(&bus->rx_dma);
+	regs->CR2 &= ~(I2C_CR2_ITBUFEN | I2C_CR2_DMAEN | I2C_CR2_LAST);
+
+	if (recover != 0U)
+	{
+		i2c_recover(bus);
+	}
+	else
+	{
+		regs->CR1 = (regs->CR1 & ~(I2C_CR1_START | I2C_CR1_ACK)) | I2C_CR1_STOP;
+	}
+
+	bus->chained = 0U;
+	i2c_complete(bus, ERR_GENERIC);
+}
+
+static void i2c_ev_irq(void *ctx)
+{
+	i2c_Bus *bus = ctx;
+	I2C_TypeDef *regs = bus->regs;
+	i2c_Transfer *transfer = bus->head;
+
+	u32 sr1 = regs->SR1;
+
+	if (transfer == NULL)
+	{
+		regs->CR2 &= ~I2C_CR2_ITBUFEN;
+		return;
+	}
+
+	if ((sr1 & I2C_SR1_SB) != 0U)
+	{
+		regs->DR = (transfer->addr << 1) | ((bus->phase == I2C_PHASE_READ) ? 1U : 0U);
+		return;
+	}
+
+	if ((sr1 & I2C_SR1_ADDR) != 0U)
+	{
+		if (bus->phase == I2C_PHASE_READ)
+		{
+			if (transfer->rd_len == 1U)
+			{
+				// NACK and stop (or restart) must be set up before ADDR
+				// is cleared; the byte comes on RXNE
+				regs->CR1 &= ~I2C_CR1_ACK;
+				(void) regs->SR2;
+				i2c_end(bus);
+				regs->CR2 |= I2C_CR2_ITBUFEN;
+			}
+			else
+			{
+				// The DMA takes it all; LAST has the last byte NACKed
+				DMA_Stream_TypeDef *rx = bus->rx_dma.regs;
+				rx->M0AR = (u32) transfer->rd;
+				rx->NDTR = transfer->rd_len;
+				rx->CR |= DMA_SxCR_EN;
+				regs->CR1 |= I2C_CR1_ACK;
+				regs->CR2 |= I2C_CR2_DMAEN | I2C_CR2_LAST;
+				(void) regs->SR2;
+			}
+		}
+		else
+		{
+			(void) regs->SR2;
+			if (transfer->wr_len == 0U)
+			{
+				// Address only, a probe
+				i2c_end(bus);
+				i2c_complete(bus, ERR_NONE);
+			}
+			else
+			{
+				regs->DR = transfer->wr[0];
+				bus->index = 1U;
+				regs->CR2 |= I2C_CR2_ITBUFEN;
+			}
+		}
+		return;
+	}
+
+	if (bus->phase == I2C_PHASE_WRITE)
+	{
+		if (((sr1 & I2C_SR1_TXE) != 0U) && ((regs->CR2 & I2C_CR2_ITBUFEN) != 0U))
+		{
+			if (bus->index < transfer->wr_len)
+			{
+				regs->DR = transfer->wr[bus->index++];
+			}
+			else
+			{
+				// The last byte is in the shift register
+				regs->CR2 &= ~I2C_CR2_ITBUFEN;
+				if (transfer->rd_len != 0U)
+				{
+					// Repeated start once it is out
+					bus->phase = I2C_PHASE_READ;
+					regs->CR1 |= I2C_CR1_START;
+				}
+				else
+				{
+					// Completes once it is acknowledged
+					bus->phase = I2C_PHASE_DRAIN;
+				}
+			}
+		}
+	}
+	else if (bus->phase == I2C_PHASE_DRAIN)
+	{
+		if ((sr1 & I2C_SR1_BTF) != 0U)
+		{
+			i2c_end(bus);
+			i2c_complete(bus, ERR_NONE);
+		}
+	}
+	else if (((sr1 & I2C_SR1_RXNE) != 0U) && (transfer->rd_len == 1U))
+	{
+		transfer->rd[0] = (u8) regs->DR;
+		regs->CR2 &= ~I2C_CR2_ITBUFEN;
+		i2c_complete(bus, ERR_NONE);
+	}
+}
+
+static void i2c_er_irq(void *ctx)
+{
+	i2c_Bus *bus = ctx;
+	I2C_TypeDef *regs = bus->regs;
+
+	u32 errors = regs->SR1 & I2C_SR1_ERRORS;
+	// The error flags clear on writing 0
+	regs->SR1 = ~errors & 0xFFFFU;
+	bus->errors++;
+
+	if (bus->head == NULL)
+	{
+		return;
+	}
+
+	// A NACK leaves the bus to us; the rest leave it in an unknown state
+	i2c_abort(bus, ((errors & (I2C_SR1_BERR | I2C_SR1_ARLO)) != 0U) ? 1U : 0U);
+}
+
+static void i2c_dma_irq(void *ctx)
+{
+	i2c_Bus *bus = ctx;
+
+	u32 flags = dma_take(&bus->rx_dma);
+	if (bus->head == NULL)
+	{
+		return;
+	}
+
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		i2c_abort(bus, 1U);
+	}
+	else if ((flags & DMA_FLAG_TC) != 0U)
+	{
+		bus->regs->CR2 &= ~(I2C_CR2_DMAEN | I2C_CR2_LAST);
+		i2c_end(bus);
+		i2c_complete(bus, ERR_NONE);
+	}
+}
+
+static void i2c_work(void *arg)
+{
+	i2c_Bus *bus = arg;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	i2c_Transfer *done = bus->done;
+	bus->done = NULL;
+	__set_PRIMASK(primask);
+
+	// Back to submission order
+	i2c_Transfer *list = NULL;
+	while (done != NULL)
+	{
+		i2c_Transfer *next = done->next;
+		done->next = list;
+		list = done;
+		done = next;
+	}
+
+	while (list != NULL)
+	{
+		i2c_Transfer *next = list->next;
+		list->busy = 0U;
+		list->callback(list->arg, list);
+		list = next;
+	}
+}
+
+static void i2c_clock_changed(void *arg, clock_Event event)
+{
+	i2c_Bus *bus = arg;
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		// Let the transaction on the bus finish; no new one starts
+		bus->hold = 1U;
+		while (bus->active != 0U)
+		{
+			if (i2c_watchdog(bus, I2C_TIMEOUT_MS) != 0U)
+			{
+				break;
+			}
+		}
+	}
+	else
+	{
+		i2c_setup(bus);
+		bus->hold = 0U;
+		i2c_start(bus);
+	}
+}
+
+u32 i2c_init(i2c_Bus *bus, u32 instance, const i2c_Config *config)
+{
+	if ((bus == NULL) || (config == NULL) || (instance < 1U) || (instance > I2C_INSTANCES)
+			|| (config->speed_hz == 0U) || (config->speed_hz > I2C_HZ_FAST))
+	{
+		return ERR_GENERIC;
+	}
+
+	const i2c_Hw *hw = &i2c_hw[instance - 1U];
+
+	bus->regs = hw->regs;
+	bus->scl_pin = config->scl_pin;
+	bus->sda_pin = config->sda_pin;
+	bus->af = hw->af;
+	bus->speed_hz = config->speed_hz;
+	bus->head = NULL;
+	bus->tail = NULL;
+	bus->done = NULL;
+	bus->chained = 0U;
+	bus->active = 0U;
+	bus->hold = 0U;
+	bus->errors = 0U;
+	bus->recoveries = 0U;
+
+	if (workq_item_init(&bus->work, i2c_work, bus, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	RCC->APB1ENR |= hw->enable;
+	(void) RCC->APB1ENR;
+
+	// Frees the bus if a slave was left in the middle of a read, and sets
+	// the pins and the timing
+	i2c_recover(bus);
+	bus->recoveries = 0U;
+
+	if (dma_stream_init(&bus->rx_dma, 1U, hw->rx_stream, i2c_dma_irq, bus,
+			config->priority) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_Stream_TypeDef *rx = bus->rx_dma.regs;
+	rx->PAR = (u32) &bus->regs->DR;
+	rx->CR = ((u32) hw->channel << DMA_CR_CHSEL_SHIFT)
+			| (I2C_DMA_PL_MEDIUM << DMA_CR_PL_SHIFT)
+			| DMA_CR_DIR_P2M | DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	if ((irq_attach(hw->ev_irqn, i2c_ev_irq, bus) != ERR_NONE)
+			|| (irq_attach(hw->er_irqn, i2c_er_irq, bus) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+	NVIC_SetPriority(hw->ev_irqn, config->priority);
+	NVIC_SetPriority(hw->er_irqn, config->priority);
+	NVIC_EnableIRQ(hw->ev_irqn);
+	NVIC_EnableIRQ(hw->er_irqn);
+
+	clock_listen(&bus->clock, i2c_clock_changed, bus);
+
+	return ERR_NONE;
+}
+
+u32 i2c_submit(i2c_Transfer *transfer)
+{
+	if ((transfer == NULL) || (transfer->bus == NULL) || (transfer->addr > 0x7FU)
+			|| ((transfer->wr_len != 0U) && (transfer->wr == NULL))
+			|| ((transfer->rd_len != 0U) && (transfer->rd == NULL))
+			|| (transfer->rd_len > 0xFFFFU))
+	{
+		return ERR_GENERIC;
+	}
+
+	i2c_Bus *bus = transfer->bus;
+
+	transfer->next = NULL;
+	transfer->busy = 1U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (bus->tail != NULL)
+	{
+		bus->tail->next = transfer;
+		bus->tail = transfer;
+	}
+	else
+	{
+		bus->head = transfer;
+		bus->tail = transfer;
+		i2c_start(bus);
+	}
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+u32 i2c_transfer(i2c_Bus *bus, u32 addr, const u8 *wr, u32 wr_len, u8 *rd, u32 rd_len)
+{
+	i2c_Transfer transfer;
+	transfer.bus = bus;
+	transfer.addr = addr;
+	transfer.wr = wr;
+	transfer.wr_len = wr_len;
+	transfer.rd = rd;
+	transfer.rd_len = rd_len;
+	transfer.callback = NULL;
+	transfer.arg = NULL;
+
+	if (i2c_submit(&transfer) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	// The system tick wakes us at least every millisecond
+	__disable_irq();
+	while (transfer.busy != 0U)
+	{
+		cpuload_idle();
+
+		__enable_irq();
+		__ISB();
+		__disable_irq();
+
+		(void) i2c_watchdog(bus, I2C_TIMEOUT_MS);
+	}
+	__enable_irq();
+
+	return transfer.status;
+}
+
+u32 i2c_watchdog(i2c_Bus *bus, u32 timeout_ms)
+{
+	u32 expired = 0U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((bus->active != 0U) && (bus->head != NULL)
+			&& ((timer_ticks - bus->stamp) >= timeout_ms))
+	{
+		i2c_abort(bus, 1U);
+		expired = 1U;
+	}
+
+	__set_PRIMASK(primask);
+
+	return expired;
+}
+
+u32 i2c_errors(const i2c_Bus *bus)
+{
+	return bus->errors;
+}
+
+u32 i2c_recoveries(const i2c_Bus *bus)
+{
+	return bus->recoveries;
+}
@@ -0,0 +1,128 @@
+/*
+ * irq.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <irq.h>
+#include <irqprof.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+typedef void (*irq_Vector)(void);
+
+// Thumb code, 4 byte aligned:
+//   ldr   r0, [pc, #4]     ; r0 = ctx
+//   ldr.w pc, [pc, #8]     ; jump to handler, lr still holds EXC_RETURN
+//   nop
+typedef struct irq_thunk
+{
+	u16 code[4];
+	void *ctx;
+	irq_Handler handler;
+} irq_Thunk;
+
+#define IRQ_THUNK_LDR_R0        (0x4801U)
+#define IRQ_THUNK_LDR_PC_HI     (0xF8DFU)
+#define IRQ_THUNK_LDR_PC_LO     (0xF008U)
+#define IRQ_THUNK_NOP           (0xBF00U)
+
+// Flash vector table; defined in linker script
+extern irq_Vector __vectors_start[];
+
+// VTOR needs the table aligned to its size rounded up to a power of two.
+// Both live in the .ram_vectors section, which the linker script keeps at
+// the start of SRAM1: CCM RAM is not on the instruction bus of the F407.
+static irq_Vector irq_vectors[IRQ_VECTORS]
+	__attribute__((section(".ram_vectors"), aligned(512)));
+
+static irq_Thunk irq_thunks[IRQ_COUNT]
+	__attribute__((section(".ram_vectors"), aligned(4)));
+
+
+void irq_init(void)
+{
+	for (u32 i = 0U; i < IRQ_VECTORS; i++)
+	{
+		irq_vectors[i] = __vectors_start[i];
+	}
+
+	__DSB();
+	SCB->VTOR = (u32) irq_vectors;
+	__DSB();
+	__ISB();
+
+#if defined(CARZOS_IRQ_PROFILE)
+	// Profile the link time handlers too; they ignore the context
+	for (u32 i = 0U; i < IRQ_COUNT; i++)
+	{
+		irq_attach((IRQn_Type) i,
+				(irq_Handler) __vectors_start[IRQ_SYSTEM_VECTORS + i], NULL);
+	}
+#endif
+}
+
+u32 irq_attach(IRQn_Type irqn, irq_Handler handler, void *ctx)
+{
+	if (((s32) irqn < 0) || ((u32) irqn >= IRQ_COUNT) || (handler == NULL))
+	{
+		return ERR_GENERIC;
+	}
+
+	// Keep the line quiet while its thunk is half written
+	u32 enabled = NVIC->ISER[(u32) irqn >> 5] & (1UL << ((u32) irqn & 0x1FU));
+	NVIC_DisableIRQ(irqn);
+	__DSB();
+	__ISB();
+
+#if defined(CARZOS_IRQ_PROFILE)
+	ctx = irqprof_bind(irqn, handler, ctx);
+	handler = irqprof_dispatch;
+#endif
+
+	irq_Thunk *thunk = &irq_thunks[irqn];
+	thunk->code[0] = IRQ_THUNK_LDR_R0;
+	thunk->code[1] = IRQ_THUNK_LDR_PC_HI;
+	thunk->code[2] = IRQ_THUNK_LDR_PC_LO;
+	thunk->code[3] = IRQ_THUNK_NOP;
+	thunk->ctx = ctx;
+	// Bit 0 set, the load into pc must stay in Thumb state
+	thunk->handler = (irq_Handler) ((u32) handler | 1U);
+
+	irq_vectors[IRQ_SYSTEM_VECTORS + (u32) irqn] = (irq_Vector) ((u32) thunk | 1U);
+
+	// Make the new code and vector visible to the instruction side
+	__DSB();
+	__ISB();
+
+	if (enabled != 0U)
+	{
+		NVIC_EnableIRQ(irqn);
+	}
+
+	return ERR_NONE;
+}
+
+u32 irq_detach(IRQn_Type irqn)
+{
+	if (((s32) irqn < 0) || ((u32) irqn >= IRQ_COUNT))
+	{
+		return ERR_GENERIC;
+	}
+
+	u32 i = IRQ_SYSTEM_VECTORS + (u32) irqn;
+
+#if defined(CARZOS_IRQ_PROFILE)
+	return irq_attach(irqn, (irq_Handler) __vectors_start[i], NULL);
+#else
+	irq_vectors[i] = __vectors_start[i];
+	__DSB();
+	__ISB();
+
+	return ERR_NONE;
+#endif
+}
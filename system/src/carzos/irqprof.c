@@ -0,0 +1,142 @@
+/*
+ * irqprof.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <irqprof.h>
+
+#if defined(CARZOS_IRQ_PROFILE)
+
+#include <stddef.h>
+
+#include <dwt.h>
+#include <sections.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+typedef struct irqprof_slot
+{
+	irq_Handler handler;
+	void *ctx;
+	irqprof_Probe probe;
+	void *probe_ctx;
+	irqprof_Stats *stats;
+} irqprof_Slot;
+
+// Touched on every interrupt, so kept in CCM RAM
+irqprof_Stats irqprof_table[IRQ_COUNT] CARZOS_CCMRAM_BSS;
+
+static irqprof_Slot irqprof_slots[IRQ_COUNT] CARZOS_CCMRAM_BSS;
+
+// Cycles spent in profiled handlers, used to take nested time out
+static volatile u32 irqprof_inner;
+
+
+void *irqprof_bind(IRQn_Type irqn, irq_Handler handler, void *ctx)
+{
+	irqprof_Slot *slot = &irqprof_slots[irqn];
+
+	dwt_init();
+
+	slot->handler = handler;
+	slot->ctx = ctx;
+	slot->stats = &irqprof_table[irqn];
+
+	return slot;
+}
+
+void irqprof_dispatch(void *ctx)
+{
+	irqprof_Slot *slot = (irqprof_Slot *) ctx;
+	irqprof_Stats *stats = slot->stats;
+
+	// The stamp and the nested total are taken together, and the total
+	// updated together with the end stamp, so that no higher priority
+	// handler can slip in between and have its time lost
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	u32 start = dwt_cycles();
+	u32 inner = irqprof_inner;
+	__set_PRIMASK(primask);
+
+	if (slot->probe != NULL)
+	{
+		u32 latency = slot->probe(slot->probe_ctx);
+		if (latency > stats->latency_max)
+		{
+			stats->latency_max = latency;
+		}
+		stats->latency_total += latency;
+		stats->latency_count++;
+	}
+
+	slot->handler(slot->ctx);
+
+	__disable_irq();
+	u32 elapsed = dwt_cycles() - start;
+	u32 self = elapsed - (irqprof_inner - inner);
+	irqprof_inner = inner + elapsed;
+	__set_PRIMASK(primask);
+
+	if ((stats->count == 0U) || (self < stats->min))
+	{
+		stats->min = self;
+	}
+	if (self > stats->max)
+	{
+		stats->max = self;
+	}
+	stats->total += self;
+	stats->count++;
+}
+
+u32 irqprof_set_probe(IRQn_Type irqn, irqprof_Probe probe, void *ctx)
+{
+	if (((s32) irqn < 0) || ((u32) irqn >= IRQ_COUNT))
+	{
+		return ERR_GENERIC;
+	}
+
+	irqprof_Slot *slot = &irqprof_slots[irqn];
+
+	// The dispatch must never see a probe with the wrong context
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	slot->probe = probe;
+	slot->probe_ctx = ctx;
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+u32 irqprof_get(IRQn_Type irqn, irqprof_Stats *stats)
+{
+	if (((s32) irqn < 0) || ((u32) irqn >= IRQ_COUNT) || (stats == NULL))
+	{
+		return ERR_GENERIC;
+	}
+
+	// The handler may update the entry while it is copied
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = irqprof_table[irqn];
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+void irqprof_reset(void)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	for (u32 i = 0U; i < IRQ_COUNT; i++)
+	{
+		irqprof_table[i] = (irqprof_Stats) { 0U };
+	}
+	__set_PRIMASK(primask);
+}
+
+#endif // defined(CARZOS_IRQ_PROFILE)
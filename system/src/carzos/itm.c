@@ -0,0 +1,233 @@
+/*
+ * itm.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <clock.h>
+#include <dwt.h>
+#include <itm.h>
+#include <sections.h>
+#include <trace.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+// Lock Access Register key of the CoreSight components
+#define ITM_LAR_KEY             (0xC5ACCE55U)
+// TPIU pin protocol: asynchronous NRZ (UART like)
+#define ITM_SPPR_NRZ            (2U)
+// Sync packet every 2^24 cycles (DWT SYNCTAP = 1)
+#define ITM_SYNCTAP             (1U)
+// ACPR is 13 bits wide
+#define ITM_ACPR_DIV_MAX        (0x2000U)
+
+static u32 itm_drops[ITM_PORTS] CARZOS_CCMRAM_BSS;
+static u32 itm_swo_hz;
+static clock_Listener itm_clock;
+
+
+static void itm_prescaler(void)
+{
+	// The trace clock is HCLK on the F4. Below swo_hz (clock_set() may go
+	// that low) the divider stays at 1 and the pin runs slower than asked;
+	// itm_swo_rate() tells.
+	u32 div = clock_hclk() / itm_swo_hz;
+	div = (div == 0U) ? 1U : ((div > ITM_ACPR_DIV_MAX) ? ITM_ACPR_DIV_MAX : div);
+	TPI->ACPR = div - 1U;
+}
+
+static void itm_clock_changed(void *arg, clock_Event event)
+{
+	(void) arg;
+
+	if (event == CLOCK_EVENT_POST)
+	{
+		itm_prescaler();
+	}
+}
+
+u32 itm_init(u32 swo_hz, u32 ports)
+{
+	if ((swo_hz == 0U) || (swo_hz > clock_hclk()))
+	{
+		return ERR_GENERIC;
+	}
+	itm_swo_hz = swo_hz;
+
+	// Trace pin out (PB3 is TRACESWO after reset), asynchronous mode
+	DBGMCU->CR = (DBGMCU->CR & ~DBGMCU_CR_TRACE_MODE) | DBGMCU_CR_TRACE_IOEN;
+
+	dwt_init();
+	DWT->CTRL = (DWT->CTRL & ~DWT_CTRL_SYNCTAP_Msk) | (ITM_SYNCTAP << DWT_CTRL_SYNCTAP_Pos);
+
+	TPI->SPPR = ITM_SPPR_NRZ;
+	itm_prescaler();
+	// Formatter off: the ITM is the only source
+	TPI->FFCR = TPI_FFCR_TrigIn_Msk;
+
+	ITM->LAR = ITM_LAR_KEY;
+	ITM->TCR = 0U;
+	ITM->TER = 0U;
+	ITM->TPR = 0U;
+	ITM->TCR = (1U << ITM_TCR_TraceBusID_Pos)
+			| ITM_TCR_DWTENA_Msk
+			| ITM_TCR_SYNCENA_Msk
+			| ITM_TCR_TSENA_Msk
+			| ITM_TCR_ITMENA_Msk;
+	ITM->TER = ports;
+
+	for (u32 i = 0U; i < ITM_PORTS; i++)
+	{
+		itm_drops[i] = 0U;
+	}
+
+	clock_unlisten(&itm_clock);
+	clock_listen(&itm_clock, itm_clock_changed, NULL);
+
+	return ERR_NONE;
+}
+
+static inline __attribute__((always_inline)) u32 itm_on(u32 port)
+{
+	return (port < ITM_PORTS)
+			&& ((ITM->TCR & ITM_TCR_ITMENA_Msk) != 0U)
+			&& ((ITM->TER & (1U << port)) != 0U);
+}
+
+// Non zero when the port is on and its FIFO slot is free. The check and
+// the write are done with interrupts masked, so that a write from an
+// interrupt cannot fill the slot in between and the value is not lost
+// uncounted.
+static inline __attribute__((always_inline)) u32 itm_ready(u32 port)
+{
+	if (itm_on(port) == 0U)
+	{
+		return 0U;
+	}
+
+	if (ITM->PORT[port].u32 == 0U)
+	{
+		itm_drops[port]++;
+		return 0U;
+	}
+
+	return 1U;
+}
+
+u32 itm_write8(u32 port, u8 value)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	u32 sent = itm_ready(port);
+	if (sent != 0U)
+	{
+		ITM->PORT[port].u8 = value;
+	}
+
+	__set_PRIMASK(primask);
+	return sent;
+}
+
+u32 itm_write16(u32 port, u16 value)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	u32 sent = itm_ready(port);
+	if (sent != 0U)
+	{
+		ITM->PORT[port].u16 = value;
+	}
+
+	__set_PRIMASK(primask);
+	return sent;
+}
+
+u32 itm_write32(u32 port, u32 value)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	u32 sent = itm_ready(port);
+	if (sent != 0U)
+	{
+		ITM->PORT[port].u32 = value;
+	}
+
+	__set_PRIMASK(primask);
+	return sent;
+}
+
+u32 itm_write(u32 port, const void *buf, u32 len)
+{
+	const u8 *p = buf;
+	u32 sent = 0U;
+
+	for (; (len - sent) >= 4U; sent += 4U)
+	{
+		u32 word = (u32) p[sent]
+				| ((u32) p[sent + 1U] << 8)
+				| ((u32) p[sent + 2U] << 16)
+				| ((u32) p[sent + 3U] << 24);
+		if (itm_write32(port, word) == 0U)
+		{
+			return sent;
+		}
+	}
+
+	for (; sent < len; sent++)
+	{
+		if (itm_write8(port, p[sent]) == 0U)
+		{
+			return sent;
+		}
+	}
+
+	return sent;
+}
+
+u32 itm_stamp(u32 port)
+{
+	return itm_write32(port, dwt_cycles());
+}
+
+u32 itm_swo_rate(void)
+{
+	if (itm_swo_hz == 0U)
+	{
+		return 0U;
+	}
+	return clock_hclk() / ((TPI->ACPR & (ITM_ACPR_DIV_MAX - 1U)) + 1U);
+}
+
+u32 itm_dropped(u32 port)
+{
+	return (port < ITM_PORTS) ? itm_drops[port] : 0U;
+}
+
+#if defined(TRACE)
+
+// The trace goes out on its ITM port, all of each record: a part of one
+// would put the decoder out of step. The drain runs at the lowest work
+// queue level, so it can wait for the FIFO; only a port that is off
+// stops it short.
+u32 trace_sink(const void *buf, u32 len)
+{
+	const u8 *p = buf;
+	u32 sent = 0U;
+
+	while ((sent < len) && (itm_on(ITM_PORT_TRACE) != 0U))
+	{
+		while (ITM->PORT[ITM_PORT_TRACE].u32 == 0U)
+		{
+		}
+		sent += itm_write(ITM_PORT_TRACE, p + sent, len - sent);
+	}
+
+	return sent;
+}
+
+#endif
@@ -6,6 +6,8 @@
 #include "ktype.h"
 #include "kmem.h"
 
+#include <sections.h>
+
 typedef struct kmem_block
 {
 	u32 length;
@@ -45,7 +47,7 @@ u32 kmem_init(void *heap, u32 heap_size)
 	return ERR_NONE;
 }
 
-void *kmem_alloc(u32 size)
+CARZOS_RAMFUNC void *kmem_alloc(u32 size)
 {
 	if (size == 0U)
 	{
@@ -101,7 +103,7 @@ void *kmem_alloc(u32 size)
 	return (p);
 }
 
-u32 kmem_free(void *p)
+CARZOS_RAMFUNC u32 kmem_free(void *p)
 {
 	if ((p == NULL))
 	{
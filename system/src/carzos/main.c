@@ -1,6 +1,7 @@
 // ----------------------------------------------------------------------------
 
 #include <blink_led.h>
+#include "bootprof.h"
 #include "timer.h"
 
 // ----------------------------------------------------------------------------
@@ -33,7 +34,8 @@
 int
 main(int argc, char* argv[])
 {
-  timer_start();
+  // Where the boot time went, on the trace (DEBUG builds).
+  bootprof_report();
 
   blink_led_init();
   
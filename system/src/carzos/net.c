@@ -0,0 +1,1702 @@
+/*
+ * net.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+#include <string.h>
+
+#include <net.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+// Device free: tools/eth_tap.c builds this file on the host as it is.
+
+#define NET_ETH_HLEN            (14U)
+#define NET_IP_HLEN             (20U)
+#define NET_UDP_HLEN            (8U)
+#define NET_TCP_HLEN            (20U)
+#define NET_ARP_LEN             (28U)
+#define NET_MTU                 (1500U)
+// Where net_alloc() puts 'data': the driver's 2 bytes that align the IP
+// header, then the headers
+#define NET_BUF_OFFSET          (2U + NET_HEADROOM)
+
+#define NET_TYPE_IP             (0x0800U)
+#define NET_TYPE_ARP            (0x0806U)
+#define NET_PROTO_ICMP          (1U)
+#define NET_PROTO_TCP           (6U)
+#define NET_PROTO_UDP           (17U)
+#define NET_IP_TTL              (64U)
+#define NET_IP_DF               (0x4000U)
+#define NET_IP_FRAG             (0x3FFFU)       // MF and offset
+#define NET_ICMP_ECHO_REPLY     (0U)
+#define NET_ICMP_ECHO           (8U)
+#define NET_ARP_REQUEST         (1U)
+#define NET_ARP_REPLY           (2U)
+
+#define NET_ARP_FREE            (0U)
+#define NET_ARP_PENDING         (1U)
+#define NET_ARP_VALID           (2U)
+#define NET_ARP_RETRY_MS        (1000U)
+#define NET_ARP_TRIES           (3U)
+#define NET_ARP_AGE_MS          (300000U)
+
+// TCP header flags
+#define NET_FIN                 (0x01U)
+#define NET_SYN                 (0x02U)
+#define NET_RST                 (0x04U)
+#define NET_PSH                 (0x08U)
+#define NET_ACK                 (0x10U)
+
+#define NET_TCP_FREE            (0U)
+#define NET_TCP_LISTEN          (1U)
+#define NET_TCP_SYN_SENT        (2U)
+#define NET_TCP_SYN_RCVD        (3U)
+#define NET_TCP_ESTABLISHED     (4U)
+#define NET_TCP_FIN_WAIT_1      (5U)
+#define NET_TCP_FIN_WAIT_2      (6U)
+#define NET_TCP_CLOSE_WAIT      (7U)
+#define NET_TCP_CLOSING         (8U)
+#define NET_TCP_LAST_ACK        (9U)
+#define NET_TCP_TIME_WAIT       (10U)
+
+// net_Tcp.flags
+#define NET_TCPF_ACK_NOW        (0x01U)
+#define NET_TCPF_ACK_DELAYED    (0x02U)
+#define NET_TCPF_FIN_QUEUED     (0x04U)         // net_tcp_close() called
+#define NET_TCPF_FIN_SENT       (0x08U)
+#define NET_TCPF_RTT            (0x10U)         // a segment is being timed
+#define NET_TCPF_RTX            (0x20U)         // retransmission timer on
+
+#define NET_TCP_MSS_DEFAULT     (536U)
+#define NET_TCP_MSS_MAX         (NET_MTU - NET_IP_HLEN - NET_TCP_HLEN)
+#define NET_TCP_RTO_INIT        (1000U)
+#define NET_TCP_RTO_MIN         (200U)
+#define NET_TCP_RTO_MAX         (16000U)
+#define NET_TCP_RETRIES         (8U)
+#define NET_TCP_TIME_WAIT_MS    (2000U)
+#define NET_TCP_PORT_FIRST      (49152U)
+
+// Stack flags in the high byte of pkt_Buf.flags: a TCP segment buffer,
+// in the TX ring (or waiting for ARP), acknowledged
+#define NET_PKT_SEG             (0x0100U)
+#define NET_PKT_INTX            (0x0200U)
+#define NET_PKT_ACKED           (0x0400U)
+
+#define NET_SEQ_LT(a, b)        ((s32) ((a) - (b)) < 0)
+#define NET_SEQ_GT(a, b)        ((s32) ((a) - (b)) > 0)
+
+typedef struct net_arp
+{
+	u32 ip;
+	u8 mac[6];
+	u8 state;
+	u8 tries;
+	u32 stamp;
+	// One frame waiting for the address, IP header first
+	pkt_Buf *waiting;
+} net_Arp;
+
+struct net_tcp
+{
+	u8 state;
+	u8 flags;
+	u16 mss;
+	u16 lport;
+	u16 rport;
+	u32 rip;
+
+	u32 iss;
+	u32 snd_una;
+	u32 snd_nxt;
+	u32 snd_wnd;
+	u32 snd_wl1;                    // seq and ack of the segment that
+	u32 snd_wl2;                    // last set snd_wnd
+	u32 fin_seq;
+	u32 rcv_nxt;
+	u32 rcv_held;                   // bytes with the application
+
+	// Unacknowledged segments then unsent ones, through 'link'; the
+	// first may be acknowledged in part, up to 'una_off'
+	pkt_Buf *sndq;
+	pkt_Buf *sndq_tail;
+	pkt_Buf *unsent;
+	u32 sndq_segs;
+	u32 una_off;
+
+	u32 cwnd;
+	u32 ssthresh;
+	u32 dupacks;
+	u32 rto;
+	u32 srtt;                       // ms * 8
+	u32 rttvar;                     // ms * 4
+	u32 rtt_seq;
+	u32 rtt_stamp;
+	u32 deadline;
+	u32 retries;
+
+	const net_TcpHandler *handler;
+	void *arg;
+};
+
+typedef struct net_stack
+{
+	u8 mac[6];
+	u32 ip;
+	u32 netmask;
+	u32 gateway;
+	pkt_Pool *pool;
+	u32 now;
+	u16 ident;
+	u16 port;
+	u32 iss;
+	// Some TCP segment could not go for want of TX descriptors
+	u32 blocked;
+
+	net_Arp arp[NET_ARP_ENTRIES];
+	net_Tcp tcp[NET_TCP_CONNS];
+	net_Udp *udp;
+
+	net_Stats stats;
+} net_Stack;
+
+static net_Stack net_stack;
+
+static const u8 net_broadcast[6] = { 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU, 0xFFU };
+static const u8 net_unknown[6] = { 0U, 0U, 0U, 0U, 0U, 0U };
+
+
+static inline u32 net_get16(const u8 *p)
+{
+	return ((u32) p[0] << 8) | p[1];
+}
+
+static inline u32 net_get32(const u8 *p)
+{
+	return ((u32) p[0] << 24) | ((u32) p[1] << 16) | ((u32) p[2] << 8) | p[3];
+}
+
+static inline void net_put16(u8 *p, u32 value)
+{
+	p[0] = (u8) (value >> 8);
+	p[1] = (u8) value;
+}
+
+static inline void net_put32(u8 *p, u32 value)
+{
+	p[0] = (u8) (value >> 24);
+	p[1] = (u8) (value >> 16);
+	p[2] = (u8) (value >> 8);
+	p[3] = (u8) value;
+}
+
+static u32 net_sum(const u8 *p, u32 len, u32 sum)
+{
+	for (; len > 1U; len -= 2U, p += 2)
+	{
+		sum += net_get16(p);
+	}
+	if (len != 0U)
+	{
+		sum += (u32) p[0] << 8;
+	}
+	return sum;
+}
+
+// Zero over data that holds its checksum, when it is right
+static u32 net_fold(u32 sum)
+{
+	while ((sum >> 16) != 0U)
+	{
+		sum = (sum & 0xFFFFU) + (sum >> 16);
+	}
+	return (~sum) & 0xFFFFU;
+}
+
+static u32 net_pseudo(u32 src, u32 dst, u32 proto, u32 len)
+{
+	return (src >> 16) + (src & 0xFFFFU) + (dst >> 16) + (dst & 0xFFFFU) + proto + len;
+}
+
+static inline u32 net_is_broadcast(u32 ip)
+{
+	return (ip == 0xFFFFFFFFU) || (ip == (net_stack.ip | ~net_stack.netmask));
+}
+
+// Payload bytes of a TCP segment buffer: from where net_alloc() put
+// 'data' to the end, which headers put in front never move
+static inline u32 net_seg_len(const pkt_Buf *seg)
+{
+	return (u32) ((seg->data + seg->len) - (seg->mem + NET_BUF_OFFSET));
+}
+
+// ----------------------------------------------------------------------------
+
+// Takes back a frame that was sent, or dropped on the way
+static void net_release(pkt_Buf *chain)
+{
+	if ((chain->flags & NET_PKT_SEG) != 0U)
+	{
+		// Stays queued for retransmission until acknowledged
+		chain->flags &= (u16) ~NET_PKT_INTX;
+		if ((chain->flags & NET_PKT_ACKED) != 0U)
+		{
+			pkt_free(chain);
+		}
+		return;
+	}
+	pkt_free(chain);
+}
+
+pkt_Buf *net_alloc(void)
+{
+	pkt_Buf *buf = pkt_alloc(net_stack.pool);
+	if (buf != NULL)
+	{
+		buf->data = buf->mem + NET_BUF_OFFSET;
+	}
+	return buf;
+}
+
+// Puts 'n' bytes in front of the chain, in place when its first buffer
+// has the room, or else in a new buffer
+static pkt_Buf *net_push(pkt_Buf *chain, u32 n)
+{
+	if ((chain != NULL) && (chain->pool != NULL) && ((u32) (chain->data - chain->mem) >= n))
+	{
+		chain->data -= n;
+		chain->len = (u16) (chain->len + n);
+		return chain;
+	}
+
+	pkt_Buf *head = net_alloc();
+	if (head == NULL)
+	{
+		return NULL;
+	}
+	head->data -= n;
+	head->len = (u16) n;
+	head->next = chain;
+	return head;
+}
+
+static u32 net_eth_send(pkt_Buf *frame, const u8 *mac, u32 type)
+{
+	pkt_Buf *head = net_push(frame, NET_ETH_HLEN);
+	if (head == NULL)
+	{
+		net_release(frame);
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+
+	memcpy(head->data, mac, 6U);
+	memcpy(head->data + 6, net_stack.mac, 6U);
+	net_put16(head->data + 12, type);
+
+	if (eth_send(head) != ERR_NONE)
+	{
+		net_release(head);
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+	if (type == NET_TYPE_IP)
+	{
+		net_stack.stats.ip_out++;
+	}
+	return ERR_NONE;
+}
+
+static void net_arp_send(u32 op, const u8 *mac, u32 ip)
+{
+	pkt_Buf *buf = net_alloc();
+	if (buf == NULL)
+	{
+		net_stack.stats.dropped++;
+		return;
+	}
+
+	u8 *a = buf->data;
+	net_put16(a, 1U);                       // Ethernet
+	net_put16(a + 2, NET_TYPE_IP);
+	a[4] = 6U;
+	a[5] = 4U;
+	net_put16(a + 6, op);
+	memcpy(a + 8, net_stack.mac, 6U);
+	net_put32(a + 14, net_stack.ip);
+	memcpy(a + 18, (op == NET_ARP_REQUEST) ? net_unknown : mac, 6U);
+	net_put32(a + 24, ip);
+	buf->len = NET_ARP_LEN;
+
+	(void) net_eth_send(buf, (op == NET_ARP_REQUEST) ? net_broadcast : mac, NET_TYPE_ARP);
+}
+
+static net_Arp *net_arp_find(u32 ip)
+{
+	for (u32 i = 0U; i < NET_ARP_ENTRIES; i++)
+	{
+		if ((net_stack.arp[i].state != NET_ARP_FREE) && (net_stack.arp[i].ip == ip))
+		{
+			return &net_stack.arp[i];
+		}
+	}
+	return NULL;
+}
+
+static void net_arp_clear(net_Arp *entry)
+{
+	if (entry->waiting != NULL)
+	{
+		net_release(entry->waiting);
+		entry->waiting = NULL;
+		net_stack.stats.arp_misses++;
+	}
+	entry->state = NET_ARP_FREE;
+}
+
+// A free entry, or the oldest one
+static net_Arp *net_arp_new(u32 ip)
+{
+	net_Arp *entry = &net_stack.arp[0];
+	for (u32 i = 0U; i < NET_ARP_ENTRIES; i++)
+	{
+		net_Arp *e = &net_stack.arp[i];
+		if (e->state == NET_ARP_FREE)
+		{
+			entry = e;
+			break;
+		}
+		if ((net_stack.now - e->stamp) > (net_stack.now - entry->stamp))
+		{
+			entry = e;
+		}
+	}
+
+	net_arp_clear(entry);
+	entry->ip = ip;
+	entry->tries = 0U;
+	entry->stamp = net_stack.now;
+	return entry;
+}
+
+static void net_arp_learn(u32 ip, const u8 *mac, u32 create)
+{
+	net_Arp *entry = net_arp_find(ip);
+	if (entry == NULL)
+	{
+		if (create == 0U)
+		{
+			return;
+		}
+		entry = net_arp_new(ip);
+	}
+
+	memcpy(entry->mac, mac, 6U);
+	entry->state = NET_ARP_VALID;
+	entry->stamp = net_stack.now;
+
+	if (entry->waiting != NULL)
+	{
+		pkt_Buf *frame = entry->waiting;
+		entry->waiting = NULL;
+		(void) net_eth_send(frame, entry->mac, NET_TYPE_IP);
+	}
+}
+
+static void net_arp_input(pkt_Buf *frame)
+{
+	u8 *a = frame->data + NET_ETH_HLEN;
+
+	if ((frame->len < (NET_ETH_HLEN + NET_ARP_LEN)) || (net_get16(a) != 1U)
+			|| (net_get16(a + 2) != NET_TYPE_IP) || (a[4] != 6U) || (a[5] != 4U))
+	{
+		net_stack.stats.dropped++;
+		pkt_free(frame);
+		return;
+	}
+
+	u32 op = net_get16(a + 6);
+	u32 spa = net_get32(a + 14);
+	u32 tpa = net_get32(a + 24);
+	u32 ours = (tpa == net_stack.ip) ? 1U : 0U;
+
+	if (spa != 0U)
+	{
+		net_arp_learn(spa, a + 8, ours);
+	}
+
+	if ((op != NET_ARP_REQUEST) || (ours == 0U))
+	{
+		pkt_free(frame);
+		return;
+	}
+
+	// The reply, in the request's own buffer
+	net_put16(a + 6, NET_ARP_REPLY);
+	memcpy(a + 18, a + 8, 6U);
+	net_put32(a + 24, spa);
+	memcpy(a + 8, net_stack.mac, 6U);
+	net_put32(a + 14, net_stack.ip);
+	frame->data = a;
+	frame->len = NET_ARP_LEN;
+	(void) net_eth_send(frame, a + 18, NET_TYPE_ARP);
+}
+
+// 'frame' starts at the IP header
+static u32 net_route(pkt_Buf *frame, u32 dst)
+{
+	if (net_is_broadcast(dst))
+	{
+		return net_eth_send(frame, net_broadcast, NET_TYPE_IP);
+	}
+
+	u32 hop = (((dst ^ net_stack.ip) & net_stack.netmask) == 0U) ? dst : net_stack.gateway;
+	if (hop == 0U)
+	{
+		net_release(frame);
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+
+	net_Arp *entry = net_arp_find(hop);
+	if ((entry != NULL) && (entry->state == NET_ARP_VALID))
+	{
+		return net_eth_send(frame, entry->mac, NET_TYPE_IP);
+	}
+
+	if (entry == NULL)
+	{
+		entry = net_arp_new(hop);
+		entry->state = NET_ARP_PENDING;
+		net_arp_send(NET_ARP_REQUEST, NULL, hop);
+	}
+	else if (entry->waiting != NULL)
+	{
+		net_release(entry->waiting);
+		net_stack.stats.arp_misses++;
+	}
+	entry->waiting = frame;
+	return ERR_NONE;
+}
+
+// 'chain' starts at the IP payload. The checksums are the MAC's.
+static u32 net_ip_output(pkt_Buf *chain, u32 dst, u32 proto)
+{
+	u32 len = pkt_chain_len(chain) + NET_IP_HLEN;
+	pkt_Buf *head = (len <= NET_MTU) ? net_push(chain, NET_IP_HLEN) : NULL;
+	if (head == NULL)
+	{
+		net_release(chain);
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+
+	u8 *ip = head->data;
+	ip[0] = 0x45U;
+	ip[1] = 0U;
+	net_put16(ip + 2, len);
+	net_put16(ip + 4, net_stack.ident++);
+	net_put16(ip + 6, NET_IP_DF);
+	ip[8] = NET_IP_TTL;
+	ip[9] = (u8) proto;
+	net_put16(ip + 10, 0U);
+	net_put32(ip + 12, net_stack.ip);
+	net_put32(ip + 16, dst);
+
+	return net_route(head, dst);
+}
+
+// ----------------------------------------------------------------------------
+
+static void net_icmp_input(pkt_Buf *frame, u8 *ip, u32 ihl, u32 src, u32 dst)
+{
+	u8 *icmp = frame->data;
+
+	if ((frame->len < 8U) || (icmp[0] != NET_ICMP_ECHO) || net_is_broadcast(dst))
+	{
+		pkt_free(frame);
+		return;
+	}
+
+	// The reply is the request turned around, in its own buffer, back to
+	// the MAC it came from
+	icmp[0] = NET_ICMP_ECHO_REPLY;
+	net_put16(icmp + 2, 0U);
+	ip[8] = NET_IP_TTL;
+	net_put16(ip + 10, 0U);
+	net_put32(ip + 12, net_stack.ip);
+	net_put32(ip + 16, src);
+
+	u8 *eth = ip - NET_ETH_HLEN;
+	u8 mac[6];
+	memcpy(mac, eth + 6, 6U);
+	frame->data = ip;
+	frame->len = (u16) (ihl + frame->len);
+	(void) net_eth_send(frame, mac, NET_TYPE_IP);
+}
+
+// ----------------------------------------------------------------------------
+
+uint32_t net_udp_bind(net_Udp *udp, uint16_t port, net_UdpRecv recv, void *arg)
+{
+	if ((udp == NULL) || (recv == NULL) || (port == 0U))
+	{
+		return ERR_GENERIC;
+	}
+	for (net_Udp *u = net_stack.udp; u != NULL; u = u->next)
+	{
+		if ((u == udp) || (u->port == port))
+		{
+			return ERR_GENERIC;
+		}
+	}
+
+	udp->port = port;
+	udp->recv = recv;
+	udp->arg = arg;
+	udp->next = net_stack.udp;
+	net_stack.udp = udp;
+	return ERR_NONE;
+}
+
+void net_udp_unbind(net_Udp *udp)
+{
+	for (net_Udp **p = &net_stack.udp; *p != NULL; p = &(*p)->next)
+	{
+		if (*p == udp)
+		{
+			*p = udp->next;
+			return;
+		}
+	}
+}
+
+uint32_t net_udp_send(net_Udp *udp, uint32_t ip, uint16_t port, pkt_Buf *chain)
+{
+	pkt_Buf *head = net_push(chain, NET_UDP_HLEN);
+	if (head == NULL)
+	{
+		if (chain != NULL)
+		{
+			pkt_free(chain);
+		}
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+
+	u8 *uh = head->data;
+	net_put16(uh, udp->port);
+	net_put16(uh + 2, port);
+	net_put16(uh + 4, pkt_chain_len(head));
+	net_put16(uh + 6, 0U);
+
+	return net_ip_output(head, ip, NET_PROTO_UDP);
+}
+
+static void net_udp_input(pkt_Buf *frame, u32 src, u32 dst, u32 checked)
+{
+	u8 *uh = frame->data;
+	u32 len = (frame->len >= NET_UDP_HLEN) ? net_get16(uh + 4) : 0U;
+
+	if ((len < NET_UDP_HLEN) || (len > frame->len)
+			|| ((checked == 0U) && (net_get16(uh + 6) != 0U)
+					&& (net_fold(net_sum(uh, len, net_pseudo(src, dst, NET_PROTO_UDP, len))) != 0U)))
+	{
+		net_stack.stats.dropped++;
+		pkt_free(frame);
+		return;
+	}
+
+	u32 port = net_get16(uh + 2);
+	for (net_Udp *udp = net_stack.udp; udp != NULL; udp = udp->next)
+	{
+		if (udp->port == port)
+		{
+			frame->data += NET_UDP_HLEN;
+			frame->len = (u16) (len - NET_UDP_HLEN);
+			udp->recv(udp->arg, frame, src, (u16) net_get16(uh));
+			return;
+		}
+	}
+
+	net_stack.stats.dropped++;
+	pkt_free(frame);
+}
+
+// ----------------------------------------------------------------------------
+
+static void net_tcp_event(net_Tcp *tcp, u32 event)
+{
+	if ((tcp->handler != NULL) && (tcp->handler->event != NULL))
+	{
+		tcp->handler->event(tcp->arg, tcp, event);
+	}
+}
+
+static void net_tcp_free(net_Tcp *tcp)
+{
+	pkt_Buf *seg = tcp->sndq;
+	while (seg != NULL)
+	{
+		pkt_Buf *next = seg->link;
+		seg->flags |= NET_PKT_ACKED;
+		if ((seg->flags & NET_PKT_INTX) == 0U)
+		{
+			pkt_free(seg);
+		}
+		seg = next;
+	}
+	memset(tcp, 0, sizeof(*tcp));
+}
+
+static u32 net_tcp_window(const net_Tcp *tcp)
+{
+	u32 wnd = (tcp->rcv_held < NET_TCP_WND) ? (NET_TCP_WND - tcp->rcv_held) : 0U;
+	return (wnd > 0xFFFFU) ? 0xFFFFU : wnd;
+}
+
+static u32 net_tcp_our_mss(void)
+{
+	u32 mss = net_stack.pool->size - NET_BUF_OFFSET;
+	return (mss > NET_TCP_MSS_MAX) ? NET_TCP_MSS_MAX : mss;
+}
+
+// Sends a segment: the payload of 'seg' from 'off' on, or none
+static u32 net_tcp_xmit(net_Tcp *tcp, pkt_Buf *seg, u32 off, u32 seq, u32 flags)
+{
+	u32 optlen = ((flags & NET_SYN) != 0U) ? 4U : 0U;
+	pkt_Buf *buf;
+
+	if (seg != NULL)
+	{
+		u32 len = net_seg_len(seg) - off;
+		seg->data = seg->mem + NET_BUF_OFFSET + off;
+		seg->len = (u16) len;
+		seg->flags |= NET_PKT_INTX;
+		buf = seg;
+	}
+	else if ((buf = net_alloc()) == NULL)
+	{
+		net_stack.stats.dropped++;
+		return ERR_GENERIC;
+	}
+
+	buf = net_push(buf, NET_TCP_HLEN + optlen);
+	u8 *th = buf->data;
+	net_put16(th, tcp->lport);
+	net_put16(th + 2, tcp->rport);
+	net_put32(th + 4, seq);
+	net_put32(th + 8, ((flags & NET_ACK) != 0U) ? tcp->rcv_nxt : 0U);
+	th[12] = (u8) (((NET_TCP_HLEN + optlen) / 4U) << 4);
+	th[13] = (u8) flags;
+	net_put16(th + 14, net_tcp_window(tcp));
+	net_put16(th + 16, 0U);
+	net_put16(th + 18, 0U);
+	if (optlen != 0U)
+	{
+		th[20] = 2U;
+		th[21] = 4U;
+		net_put16(th + 22, net_tcp_our_mss());
+	}
+
+	if ((flags & NET_ACK) != 0U)
+	{
+		tcp->flags &= (u8) ~(NET_TCPF_ACK_NOW | NET_TCPF_ACK_DELAYED);
+	}
+	return net_ip_output(buf, tcp->rip, NET_PROTO_TCP);
+}
+
+static void net_tcp_arm(net_Tcp *tcp)
+{
+	tcp->flags |= NET_TCPF_RTX;
+	tcp->deadline = net_stack.now + tcp->rto;
+}
+
+// Sends what the windows allow, then the FIN when asked for
+static void net_tcp_push(net_Tcp *tcp)
+{
+	if ((tcp->state != NET_TCP_ESTABLISHED) && (tcp->state != NET_TCP_CLOSE_WAIT)
+			&& (tcp->state != NET_TCP_FIN_WAIT_1) && (tcp->state != NET_TCP_CLOSING)
+			&& (tcp->state != NET_TCP_LAST_ACK))
+	{
+		return;
+	}
+
+	while (tcp->unsent != NULL)
+	{
+		pkt_Buf *seg = tcp->unsent;
+		u32 off = (seg == tcp->sndq) ? tcp->una_off : 0U;
+		u32 len = net_seg_len(seg) - off;
+		u32 flight = tcp->snd_nxt - tcp->snd_una;
+		u32 wnd = (tcp->cwnd < tcp->snd_wnd) ? tcp->cwnd : tcp->snd_wnd;
+
+		if ((flight + len) > wnd)
+		{
+			if (flight == 0U)
+			{
+				// The persist timer probes the closed window
+				net_tcp_arm(tcp);
+			}
+			break;
+		}
+		if ((seg->flags & NET_PKT_INTX) != 0U)
+		{
+			// Still in the ring from before a retransmission timeout
+			net_stack.blocked = 1U;
+			break;
+		}
+		if (net_tcp_xmit(tcp, seg, off, tcp->snd_nxt, NET_ACK | NET_PSH) != ERR_NONE)
+		{
+			net_stack.blocked = 1U;
+			break;
+		}
+
+		if ((tcp->flags & NET_TCPF_RTT) == 0U)
+		{
+			tcp->flags |= NET_TCPF_RTT;
+			tcp->rtt_seq = tcp->snd_nxt;
+			tcp->rtt_stamp = net_stack.now;
+		}
+		tcp->snd_nxt += len;
+		tcp->unsent = seg->link;
+		if ((tcp->flags & NET_TCPF_RTX) == 0U)
+		{
+			net_tcp_arm(tcp);
+		}
+	}
+
+	if ((tcp->unsent == NULL) && ((tcp->flags & NET_TCPF_FIN_QUEUED) != 0U)
+			&& ((tcp->flags & NET_TCPF_FIN_SENT) == 0U))
+	{
+		tcp->fin_seq = tcp->snd_nxt;
+		if (net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_FIN | NET_ACK) == ERR_NONE)
+		{
+			tcp->flags |= NET_TCPF_FIN_SENT;
+			tcp->snd_nxt++;
+			if (tcp->state == NET_TCP_ESTABLISHED)
+			{
+				tcp->state = NET_TCP_FIN_WAIT_1;
+			}
+			else if (tcp->state == NET_TCP_CLOSE_WAIT)
+			{
+				tcp->state = NET_TCP_LAST_ACK;
+			}
+			if ((tcp->flags & NET_TCPF_RTX) == 0U)
+			{
+				net_tcp_arm(tcp);
+			}
+		}
+	}
+}
+
+static void net_tcp_reset(u32 rip, u32 lport, u32 rport, u32 seq, u32 ack, u32 flags)
+{
+	net_Tcp tmp;
+	memset(&tmp, 0, sizeof(tmp));
+	tmp.rip = rip;
+	tmp.lport = (u16) lport;
+	tmp.rport = (u16) rport;
+	tmp.rcv_nxt = ack;
+	(void) net_tcp_xmit(&tmp, NULL, 0U, seq, NET_RST | flags);
+}
+
+static net_Tcp *net_tcp_new(void)
+{
+	for (u32 i = 0U; i < NET_TCP_CONNS; i++)
+	{
+		if (net_stack.tcp[i].state == NET_TCP_FREE)
+		{
+			net_Tcp *tcp = &net_stack.tcp[i];
+			memset(tcp, 0, sizeof(*tcp));
+			net_stack.iss = (net_stack.iss * 1664525U) + 1013904223U + net_stack.now;
+			tcp->iss = net_stack.iss;
+			tcp->snd_una = tcp->iss;
+			tcp->snd_nxt = tcp->iss + 1U;
+			tcp->mss = NET_TCP_MSS_DEFAULT;
+			tcp->rto = NET_TCP_RTO_INIT;
+			tcp->ssthresh = 0xFFFFU;
+			return tcp;
+		}
+	}
+	return NULL;
+}
+
+static void net_tcp_options(net_Tcp *tcp, const u8 *th, u32 doff)
+{
+	u32 mss = NET_TCP_MSS_DEFAULT;
+
+	for (u32 i = NET_TCP_HLEN; i < doff;)
+	{
+		u32 kind = th[i];
+		if (kind == 0U)
+		{
+			break;
+		}
+		if (kind == 1U)
+		{
+			i++;
+			continue;
+		}
+		if (((i + 1U) >= doff) || (th[i + 1U] < 2U))
+		{
+			break;
+		}
+		if ((kind == 2U) && (th[i + 1U] == 4U) && ((i + 4U) <= doff))
+		{
+			mss = net_get16(th + i + 2U);
+		}
+		i += th[i + 1U];
+	}
+
+	u32 ours = net_tcp_our_mss();
+	tcp->mss = (u16) (((mss == 0U) || (mss > ours)) ? ours : mss);
+	tcp->cwnd = 10U * tcp->mss;
+}
+
+static void net_tcp_rtt(net_Tcp *tcp, u32 sample)
+{
+	// RFC 6298, in ms, srtt scaled by 8 and rttvar by 4
+	if (tcp->srtt == 0U)
+	{
+		tcp->srtt = sample << 3;
+		tcp->rttvar = sample << 1;
+	}
+	else
+	{
+		s32 delta = (s32) sample - (s32) (tcp->srtt >> 3);
+		tcp->srtt = (u32) ((s32) tcp->srtt + delta);
+		if (delta < 0)
+		{
+			delta = -delta;
+		}
+		tcp->rttvar = (u32) ((s32) tcp->rttvar + (delta - (s32) (tcp->rttvar >> 2)));
+	}
+
+	u32 rto = (tcp->srtt >> 3) + tcp->rttvar;
+	tcp->rto = (rto < NET_TCP_RTO_MIN) ? NET_TCP_RTO_MIN
+			: ((rto > NET_TCP_RTO_MAX) ? NET_TCP_RTO_MAX : rto);
+}
+
+// New data acknowledged up to 'ack'
+static void net_tcp_acked(net_Tcp *tcp, u32 ack)
+{
+	u32 acked = ack - tcp->snd_una;
+
+	if (((tcp->flags & NET_TCPF_RTT) != 0U) && NET_SEQ_GT(ack, tcp->rtt_seq))
+	{
+		tcp->flags &= (u8) ~NET_TCPF_RTT;
+		net_tcp_rtt(tcp, net_stack.now - tcp->rtt_stamp);
+	}
+
+	// Congestion window: slow start, then a segment per window
+	if (tcp->cwnd < tcp->ssthresh)
+	{
+		tcp->cwnd += (acked < tcp->mss) ? acked : tcp->mss;
+	}
+	else
+	{
+		tcp->cwnd += ((u32) tcp->mss * tcp->mss) / tcp->cwnd;
+	}
+
+	tcp->snd_una = ack;
+	if (((tcp->flags & NET_TCPF_FIN_SENT) != 0U) && (ack == (tcp->fin_seq + 1U)))
+	{
+		acked--;
+	}
+
+	while ((acked != 0U) && (tcp->sndq != NULL) && (tcp->sndq != tcp->unsent))
+	{
+		pkt_Buf *seg = tcp->sndq;
+		u32 left = net_seg_len(seg) - tcp->una_off;
+		if (acked < left)
+		{
+			tcp->una_off += acked;
+			break;
+		}
+
+		acked -= left;
+		tcp->una_off = 0U;
+		tcp->sndq = seg->link;
+		if (tcp->sndq == NULL)
+		{
+			tcp->sndq_tail = NULL;
+		}
+		tcp->sndq_segs--;
+		seg->flags |= NET_PKT_ACKED;
+		if ((seg->flags & NET_PKT_INTX) == 0U)
+		{
+			pkt_free(seg);
+		}
+	}
+
+	tcp->dupacks = 0U;
+	tcp->retries = 0U;
+	if (tcp->snd_una == tcp->snd_nxt)
+	{
+		tcp->flags &= (u8) ~NET_TCPF_RTX;
+	}
+	else
+	{
+		net_tcp_arm(tcp);
+	}
+}
+
+static void net_tcp_retransmit(net_Tcp *tcp)
+{
+	u32 flight = tcp->snd_nxt - tcp->snd_una;
+	u32 half = flight / 2U;
+
+	tcp->ssthresh = (half > (2U * tcp->mss)) ? half : (2U * tcp->mss);
+	tcp->flags &= (u8) ~NET_TCPF_RTT;
+	net_stack.stats.tcp_retransmits++;
+
+	switch (tcp->state)
+	{
+	case NET_TCP_SYN_SENT:
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->iss, NET_SYN);
+		break;
+	case NET_TCP_SYN_RCVD:
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->iss, NET_SYN | NET_ACK);
+		break;
+	default:
+		// Go back to the first unacknowledged byte
+		tcp->unsent = tcp->sndq;
+		tcp->snd_nxt = tcp->snd_una;
+		tcp->flags &= (u8) ~NET_TCPF_FIN_SENT;
+		net_tcp_push(tcp);
+		break;
+	}
+}
+
+static void net_tcp_timeout(net_Tcp *tcp)
+{
+	tcp->flags &= (u8) ~NET_TCPF_RTX;
+
+	if (tcp->snd_una == tcp->snd_nxt)
+	{
+		// Persist: a segment into the closed window
+		if (tcp->unsent != NULL)
+		{
+			u32 wnd = tcp->snd_wnd;
+			tcp->snd_wnd = net_seg_len(tcp->unsent);
+			net_tcp_push(tcp);
+			tcp->snd_wnd = wnd;
+		}
+		return;
+	}
+
+	if (++tcp->retries > NET_TCP_RETRIES)
+	{
+		net_tcp_reset(tcp->rip, tcp->lport, tcp->rport, tcp->snd_nxt, tcp->rcv_nxt, NET_ACK);
+		net_tcp_event(tcp, NET_TCP_ABORTED);
+		net_tcp_free(tcp);
+		return;
+	}
+
+	tcp->cwnd = tcp->mss;
+	tcp->rto = (tcp->rto < (NET_TCP_RTO_MAX / 2U)) ? (2U * tcp->rto) : NET_TCP_RTO_MAX;
+	net_tcp_retransmit(tcp);
+	net_tcp_arm(tcp);
+}
+
+static void net_tcp_time_wait(net_Tcp *tcp)
+{
+	tcp->state = NET_TCP_TIME_WAIT;
+	tcp->deadline = net_stack.now + NET_TCP_TIME_WAIT_MS;
+	net_tcp_event(tcp, NET_TCP_CLOSED);
+	tcp->handler = NULL;
+}
+
+static void net_tcp_set_wnd(net_Tcp *tcp, u32 seq, u32 ack, u32 wnd)
+{
+	tcp->snd_wnd = wnd;
+	tcp->snd_wl1 = seq;
+	tcp->snd_wl2 = ack;
+}
+
+// The window of a segment older than the one that last set it is stale:
+// a reordered ACK must not shrink it again
+static void net_tcp_update_wnd(net_Tcp *tcp, u32 seq, u32 ack, u32 wnd)
+{
+	if (NET_SEQ_LT(tcp->snd_wl1, seq)
+			|| ((tcp->snd_wl1 == seq) && !NET_SEQ_LT(ack, tcp->snd_wl2)))
+	{
+		net_tcp_set_wnd(tcp, seq, ack, wnd);
+	}
+}
+
+static void net_tcp_input(pkt_Buf *frame, u32 src)
+{
+	u8 *th = frame->data;
+	u32 doff = (frame->len >= NET_TCP_HLEN) ? ((u32) (th[12] >> 4) * 4U) : 0U;
+
+	if ((doff < NET_TCP_HLEN) || (doff > frame->len))
+	{
+		net_stack.stats.dropped++;
+		pkt_free(frame);
+		return;
+	}
+
+	u32 sport = net_get16(th);
+	u32 dport = net_get16(th + 2);
+	u32 seq = net_get32(th + 4);
+	u32 ack = net_get32(th + 8);
+	u32 flags = th[13];
+	u32 wnd = net_get16(th + 14);
+	u32 len = frame->len - doff;
+
+	net_Tcp *tcp = NULL;
+	net_Tcp *listener = NULL;
+	for (u32 i = 0U; i < NET_TCP_CONNS; i++)
+	{
+		net_Tcp *t = &net_stack.tcp[i];
+		if ((t->state == NET_TCP_FREE) || (t->lport != dport))
+		{
+			continue;
+		}
+		if (t->state == NET_TCP_LISTEN)
+		{
+			listener = t;
+		}
+		else if ((t->rport == sport) && (t->rip == src))
+		{
+			tcp = t;
+			break;
+		}
+	}
+
+	if ((tcp == NULL) && ((listener == NULL) || ((flags & (NET_SYN | NET_ACK | NET_RST)) != NET_SYN)))
+	{
+		if ((flags & NET_RST) == 0U)
+		{
+			if ((flags & NET_ACK) != 0U)
+			{
+				net_tcp_reset(src, dport, sport, ack, 0U, 0U);
+			}
+			else
+			{
+				net_tcp_reset(src, dport, sport, 0U,
+						seq + len + (((flags & NET_SYN) != 0U) ? 1U : 0U)
+						+ (((flags & NET_FIN) != 0U) ? 1U : 0U), NET_ACK);
+			}
+		}
+		pkt_free(frame);
+		return;
+	}
+
+	if (tcp == NULL)
+	{
+		// A SYN to a listener
+		tcp = net_tcp_new();
+		if (tcp != NULL)
+		{
+			tcp->state = NET_TCP_SYN_RCVD;
+			tcp->lport = (u16) dport;
+			tcp->rport = (u16) sport;
+			tcp->rip = src;
+			tcp->rcv_nxt = seq + 1U;
+			net_tcp_set_wnd(tcp, seq, 0U, wnd);
+			tcp->handler = listener->handler;
+			tcp->arg = listener->arg;
+			net_tcp_options(tcp, th, doff);
+			(void) net_tcp_xmit(tcp, NULL, 0U, tcp->iss, NET_SYN | NET_ACK);
+			net_tcp_arm(tcp);
+		}
+		pkt_free(frame);
+		return;
+	}
+
+	if (tcp->state == NET_TCP_SYN_SENT)
+	{
+		if (((flags & NET_ACK) != 0U) && (ack != tcp->snd_nxt))
+		{
+			if ((flags & NET_RST) == 0U)
+			{
+				net_tcp_reset(src, dport, sport, ack, 0U, 0U);
+			}
+		}
+		else if ((flags & NET_RST) != 0U)
+		{
+			if ((flags & NET_ACK) != 0U)
+			{
+				net_tcp_event(tcp, NET_TCP_ABORTED);
+				net_tcp_free(tcp);
+			}
+		}
+		else if ((flags & NET_SYN) != 0U)
+		{
+			tcp->rcv_nxt = seq + 1U;
+			net_tcp_set_wnd(tcp, seq, ack, wnd);
+			net_tcp_options(tcp, th, doff);
+			if ((flags & NET_ACK) != 0U)
+			{
+				tcp->snd_una = ack;
+				tcp->state = NET_TCP_ESTABLISHED;
+				tcp->flags &= (u8) ~NET_TCPF_RTX;
+				tcp->retries = 0U;
+				(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+				net_tcp_event(tcp, NET_TCP_CONNECTED);
+				if (tcp->state == NET_TCP_ESTABLISHED)
+				{
+					net_tcp_push(tcp);
+				}
+			}
+			else
+			{
+				// Both opened at once
+				tcp->state = NET_TCP_SYN_RCVD;
+				(void) net_tcp_xmit(tcp, NULL, 0U, tcp->iss, NET_SYN | NET_ACK);
+			}
+		}
+		pkt_free(frame);
+		return;
+	}
+
+	// Synchronised states. Old bytes are cut off the front; a segment
+	// after a gap is not kept, the duplicate ACK asks for what is missing
+	frame->data += doff;
+	frame->len = (u16) len;
+
+	// A reset counts only at exactly the next sequence number (RFC 5961);
+	// one elsewhere in the window gets an ACK, which the real peer answers
+	// with a reset that does count. A blind attacker would have to guess
+	// rcv_nxt itself.
+	if ((flags & NET_RST) != 0U)
+	{
+		if (seq == tcp->rcv_nxt)
+		{
+			if (tcp->state != NET_TCP_TIME_WAIT)
+			{
+				net_tcp_event(tcp, NET_TCP_ABORTED);
+			}
+			net_tcp_free(tcp);
+		}
+		else if ((seq - tcp->rcv_nxt) < net_tcp_window(tcp))
+		{
+			(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+		}
+		pkt_free(frame);
+		return;
+	}
+
+	if (NET_SEQ_LT(seq, tcp->rcv_nxt))
+	{
+		u32 old = tcp->rcv_nxt - seq;
+		if ((flags & NET_SYN) != 0U)
+		{
+			flags &= ~NET_SYN;
+			old--;
+		}
+		if (old >= len)
+		{
+			if ((len != 0U) || ((flags & NET_FIN) != 0U))
+			{
+				// A retransmission of what we have
+				tcp->flags |= NET_TCPF_ACK_NOW;
+			}
+			flags &= ~NET_FIN;
+			len = 0U;
+		}
+		else
+		{
+			frame->data += old;
+			len -= old;
+		}
+		frame->len = (u16) len;
+	}
+	else if (NET_SEQ_GT(seq, tcp->rcv_nxt))
+	{
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+		pkt_free(frame);
+		return;
+	}
+
+	if (((flags & NET_SYN) != 0U) || ((flags & NET_ACK) == 0U))
+	{
+		if ((flags & NET_SYN) != 0U)
+		{
+			(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+		}
+		pkt_free(frame);
+		return;
+	}
+
+	if (tcp->state == NET_TCP_SYN_RCVD)
+	{
+		if (ack != tcp->snd_nxt)
+		{
+			net_tcp_reset(src, dport, sport, ack, 0U, 0U);
+			pkt_free(frame);
+			return;
+		}
+		tcp->snd_una = ack;
+		net_tcp_set_wnd(tcp, seq, ack, wnd);
+		tcp->state = NET_TCP_ESTABLISHED;
+		tcp->flags &= (u8) ~NET_TCPF_RTX;
+		tcp->retries = 0U;
+		net_tcp_event(tcp, NET_TCP_CONNECTED);
+		if (tcp->state != NET_TCP_ESTABLISHED)
+		{
+			pkt_free(frame);
+			return;
+		}
+	}
+
+	if (NET_SEQ_GT(ack, tcp->snd_nxt))
+	{
+		// Acknowledges what was never sent
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+		pkt_free(frame);
+		return;
+	}
+
+	if (NET_SEQ_GT(ack, tcp->snd_una))
+	{
+		u32 fin_acked = (((tcp->flags & NET_TCPF_FIN_SENT) != 0U) && (ack == tcp->snd_nxt)) ? 1U : 0U;
+
+		net_tcp_update_wnd(tcp, seq, ack, wnd);
+		net_tcp_acked(tcp, ack);
+
+		if (fin_acked != 0U)
+		{
+			switch (tcp->state)
+			{
+			case NET_TCP_FIN_WAIT_1:
+				tcp->state = NET_TCP_FIN_WAIT_2;
+				break;
+			case NET_TCP_CLOSING:
+				net_tcp_time_wait(tcp);
+				break;
+			case NET_TCP_LAST_ACK:
+				net_tcp_event(tcp, NET_TCP_CLOSED);
+				net_tcp_free(tcp);
+				pkt_free(frame);
+				return;
+			default:
+				break;
+			}
+		}
+		else if (tcp->sndq_segs < NET_TCP_SND_SEGS)
+		{
+			net_tcp_event(tcp, NET_TCP_SENT);
+			if (tcp->state == NET_TCP_FREE)
+			{
+				pkt_free(frame);
+				return;
+			}
+		}
+	}
+	else if ((ack == tcp->snd_una) && (len == 0U) && ((flags & NET_FIN) == 0U)
+			&& (tcp->snd_nxt != tcp->snd_una) && (wnd == tcp->snd_wnd))
+	{
+		if (++tcp->dupacks == 3U)
+		{
+			// Fast retransmit of the first segment
+			tcp->cwnd = tcp->mss;
+			net_tcp_retransmit(tcp);
+			tcp->cwnd = tcp->ssthresh;
+			net_tcp_arm(tcp);
+		}
+	}
+	else
+	{
+		net_tcp_update_wnd(tcp, seq, ack, wnd);
+	}
+
+	if ((len != 0U) && ((tcp->state == NET_TCP_ESTABLISHED) || (tcp->state == NET_TCP_FIN_WAIT_1)
+			|| (tcp->state == NET_TCP_FIN_WAIT_2)))
+	{
+		u32 room = net_tcp_window(tcp);
+		if (len > room)
+		{
+			// Past the window; FIN with it too
+			len = room;
+			frame->len = (u16) len;
+			flags &= ~NET_FIN;
+			tcp->flags |= NET_TCPF_ACK_NOW;
+		}
+		if (len != 0U)
+		{
+			tcp->rcv_nxt += len;
+			tcp->rcv_held += len;
+			// Every second segment is acknowledged at once
+			tcp->flags |= ((tcp->flags & NET_TCPF_ACK_DELAYED) != 0U)
+					? NET_TCPF_ACK_NOW : NET_TCPF_ACK_DELAYED;
+			if ((tcp->handler != NULL) && (tcp->handler->recv != NULL))
+			{
+				tcp->handler->recv(tcp->arg, tcp, frame);
+				frame = NULL;
+				if (tcp->state == NET_TCP_FREE)
+				{
+					return;
+				}
+			}
+		}
+	}
+
+	if ((flags & NET_FIN) != 0U)
+	{
+		tcp->rcv_nxt++;
+		tcp->flags |= NET_TCPF_ACK_NOW;
+		switch (tcp->state)
+		{
+		case NET_TCP_ESTABLISHED:
+			tcp->state = NET_TCP_CLOSE_WAIT;
+			net_tcp_event(tcp, NET_TCP_PEER_CLOSED);
+			break;
+		case NET_TCP_FIN_WAIT_1:
+			tcp->state = NET_TCP_CLOSING;
+			break;
+		case NET_TCP_FIN_WAIT_2:
+			net_tcp_time_wait(tcp);
+			break;
+		case NET_TCP_TIME_WAIT:
+			tcp->deadline = net_stack.now + NET_TCP_TIME_WAIT_MS;
+			break;
+		default:
+			break;
+		}
+	}
+
+	if (frame != NULL)
+	{
+		pkt_free(frame);
+	}
+	if (tcp->state == NET_TCP_FREE)
+	{
+		return;
+	}
+
+	net_tcp_push(tcp);
+	if ((tcp->flags & NET_TCPF_ACK_NOW) != 0U)
+	{
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+	}
+}
+
+net_Tcp *net_tcp_listen(uint16_t port, const net_TcpHandler *handler, void *arg)
+{
+	for (u32 i = 0U; i < NET_TCP_CONNS; i++)
+	{
+		if ((net_stack.tcp[i].state == NET_TCP_LISTEN) && (net_stack.tcp[i].lport == port))
+		{
+			return NULL;
+		}
+	}
+
+	net_Tcp *tcp = (port != 0U) ? net_tcp_new() : NULL;
+	if (tcp != NULL)
+	{
+		tcp->state = NET_TCP_LISTEN;
+		tcp->lport = port;
+		tcp->handler = handler;
+		tcp->arg = arg;
+	}
+	return tcp;
+}
+
+net_Tcp *net_tcp_connect(uint32_t ip, uint16_t port, const net_TcpHandler *handler, void *arg)
+{
+	net_Tcp *tcp = ((ip != 0U) && (port != 0U)) ? net_tcp_new() : NULL;
+	if (tcp == NULL)
+	{
+		return NULL;
+	}
+
+	tcp->state = NET_TCP_SYN_SENT;
+	tcp->lport = (u16) (NET_TCP_PORT_FIRST + (net_stack.port++ % (0x10000U - NET_TCP_PORT_FIRST)));
+	tcp->rport = port;
+	tcp->rip = ip;
+	tcp->handler = handler;
+	tcp->arg = arg;
+	tcp->cwnd = 10U * tcp->mss;
+
+	(void) net_tcp_xmit(tcp, NULL, 0U, tcp->iss, NET_SYN);
+	net_tcp_arm(tcp);
+	return tcp;
+}
+
+void net_tcp_set_arg(net_Tcp *tcp, void *arg)
+{
+	tcp->arg = arg;
+}
+
+uint32_t net_tcp_mss(const net_Tcp *tcp)
+{
+	return tcp->mss;
+}
+
+uint32_t net_tcp_send(net_Tcp *tcp, pkt_Buf *buf)
+{
+	if ((buf == NULL) || (buf->pool != net_stack.pool) || (buf->next != NULL)
+			|| (buf->data != (buf->mem + NET_BUF_OFFSET)) || (buf->len == 0U)
+			|| (buf->len > tcp->mss) || (tcp->sndq_segs >= NET_TCP_SND_SEGS)
+			|| ((tcp->flags & NET_TCPF_FIN_QUEUED) != 0U)
+			|| ((tcp->state != NET_TCP_ESTABLISHED) && (tcp->state != NET_TCP_CLOSE_WAIT)
+					&& (tcp->state != NET_TCP_SYN_SENT) && (tcp->state != NET_TCP_SYN_RCVD)))
+	{
+		return ERR_GENERIC;
+	}
+
+	buf->flags = NET_PKT_SEG;
+	buf->link = NULL;
+	if (tcp->sndq_tail != NULL)
+	{
+		tcp->sndq_tail->link = buf;
+	}
+	else
+	{
+		tcp->sndq = buf;
+	}
+	tcp->sndq_tail = buf;
+	if (tcp->unsent == NULL)
+	{
+		tcp->unsent = buf;
+	}
+	tcp->sndq_segs++;
+
+	net_tcp_push(tcp);
+	return ERR_NONE;
+}
+
+void net_tcp_recved(net_Tcp *tcp, uint32_t len)
+{
+	u32 before = net_tcp_window(tcp);
+
+	tcp->rcv_held = (len < tcp->rcv_held) ? (tcp->rcv_held - len) : 0U;
+
+	// A window update once it opened by a segment, or from closed
+	if ((tcp->state >= NET_TCP_ESTABLISHED) && (tcp->state != NET_TCP_TIME_WAIT)
+			&& ((before < tcp->mss) || ((net_tcp_window(tcp) - before) >= tcp->mss)))
+	{
+		(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+	}
+}
+
+void net_tcp_close(net_Tcp *tcp)
+{
+	switch (tcp->state)
+	{
+	case NET_TCP_LISTEN:
+	case NET_TCP_SYN_SENT:
+		net_tcp_event(tcp, NET_TCP_CLOSED);
+		net_tcp_free(tcp);
+		break;
+	case NET_TCP_SYN_RCVD:
+	case NET_TCP_ESTABLISHED:
+	case NET_TCP_CLOSE_WAIT:
+		tcp->flags |= NET_TCPF_FIN_QUEUED;
+		net_tcp_push(tcp);
+		break;
+	default:
+		break;
+	}
+}
+
+void net_tcp_abort(net_Tcp *tcp)
+{
+	if ((tcp->state != NET_TCP_LISTEN) && (tcp->state != NET_TCP_SYN_SENT)
+			&& (tcp->state != NET_TCP_TIME_WAIT) && (tcp->state != NET_TCP_FREE))
+	{
+		net_tcp_reset(tcp->rip, tcp->lport, tcp->rport, tcp->snd_nxt, tcp->rcv_nxt, NET_ACK);
+	}
+	net_tcp_free(tcp);
+}
+
+// ----------------------------------------------------------------------------
+
+static void net_ip_input(pkt_Buf *frame)
+{
+	u8 *ip = frame->data + NET_ETH_HLEN;
+	u32 len = frame->len - NET_ETH_HLEN;
+	u32 ihl = (len >= NET_IP_HLEN) ? ((u32) (ip[0] & 0x0FU) * 4U) : 0U;
+	u32 total = (ihl != 0U) ? net_get16(ip + 2) : 0U;
+
+	// IPv4 only, whole (no fragments), and for this host
+	if ((ihl < NET_IP_HLEN) || ((ip[0] >> 4) != 4U) || (total < ihl) || (total > len)
+			|| ((net_get16(ip + 6) & NET_IP_FRAG) != 0U))
+	{
+		net_stack.stats.dropped++;
+		pkt_free(frame);
+		return;
+	}
+
+	u32 src = net_get32(ip + 12);
+	u32 dst = net_get32(ip + 16);
+	u32 proto = ip[9];
+	u32 checked = frame->flags & PKT_CSUM_OK;
+
+	if (((dst != net_stack.ip) && !net_is_broadcast(dst))
+			|| ((checked == 0U) && (net_fold(net_sum(ip, ihl, 0U)) != 0U)))
+	{
+		net_stack.stats.dropped++;
+		pkt_free(frame);
+		return;
+	}
+	net_stack.stats.ip_in++;
+
+	// On to the payload, without the Ethernet padding
+	frame->data = ip + ihl;
+	frame->len = (u16) (total - ihl);
+
+	switch (proto)
+	{
+	case NET_PROTO_ICMP:
+		if ((checked == 0U) && (net_fold(net_sum(frame->data, frame->len, 0U)) != 0U))
+		{
+			break;
+		}
+		net_icmp_input(frame, ip, ihl, src, dst);
+		return;
+	case NET_PROTO_UDP:
+		net_udp_input(frame, src, dst, checked);
+		return;
+	case NET_PROTO_TCP:
+		if (net_is_broadcast(dst) || ((checked == 0U) && (net_fold(net_sum(frame->data, frame->len,
+				net_pseudo(src, dst, NET_PROTO_TCP, frame->len))) != 0U)))
+		{
+			break;
+		}
+		net_tcp_input(frame, src);
+		return;
+	default:
+		break;
+	}
+
+	net_stack.stats.dropped++;
+	pkt_free(frame);
+}
+
+static void net_rx(void *arg, pkt_Buf *frame)
+{
+	(void) arg;
+
+	u32 type = (frame->len >= NET_ETH_HLEN) ? net_get16(frame->data + 12) : 0U;
+	if (type == NET_TYPE_IP)
+	{
+		net_ip_input(frame);
+	}
+	else if (type == NET_TYPE_ARP)
+	{
+		net_arp_input(frame);
+	}
+	else
+	{
+		pkt_free(frame);
+	}
+}
+
+// Frames sent; the ring has room again for segments that found it full
+static void net_tx_done(void *arg, pkt_Buf *chain)
+{
+	(void) arg;
+
+	net_release(chain);
+
+	if (net_stack.blocked != 0U)
+	{
+		net_stack.blocked = 0U;
+		for (u32 i = 0U; i < NET_TCP_CONNS; i++)
+		{
+			if (net_stack.tcp[i].unsent != NULL)
+			{
+				net_tcp_push(&net_stack.tcp[i]);
+			}
+		}
+	}
+}
+
+void net_timer(uint32_t now_ms)
+{
+	net_stack.now = now_ms;
+
+	for (u32 i = 0U; i < NET_ARP_ENTRIES; i++)
+	{
+		net_Arp *entry = &net_stack.arp[i];
+		u32 age = now_ms - entry->stamp;
+
+		if (entry->state == NET_ARP_PENDING)
+		{
+			if (age >= NET_ARP_RETRY_MS)
+			{
+				if (++entry->tries >= NET_ARP_TRIES)
+				{
+					net_arp_clear(entry);
+				}
+				else
+				{
+					entry->stamp = now_ms;
+					net_arp_send(NET_ARP_REQUEST, NULL, entry->ip);
+				}
+			}
+		}
+		else if ((entry->state == NET_ARP_VALID) && (age >= NET_ARP_AGE_MS))
+		{
+			net_arp_clear(entry);
+		}
+	}
+
+	for (u32 i = 0U; i < NET_TCP_CONNS; i++)
+	{
+		net_Tcp *tcp = &net_stack.tcp[i];
+
+		if (tcp->state == NET_TCP_TIME_WAIT)
+		{
+			if ((s32) (now_ms - tcp->deadline) >= 0)
+			{
+				net_tcp_free(tcp);
+			}
+			continue;
+		}
+		if ((tcp->flags & NET_TCPF_ACK_DELAYED) != 0U)
+		{
+			(void) net_tcp_xmit(tcp, NULL, 0U, tcp->snd_nxt, NET_ACK);
+		}
+		if (((tcp->flags & NET_TCPF_RTX) != 0U) && ((s32) (now_ms - tcp->deadline) >= 0))
+		{
+			net_tcp_timeout(tcp);
+		}
+	}
+}
+
+void net_stats(net_Stats *stats)
+{
+	*stats = net_stack.stats;
+}
+
+uint32_t net_init(const net_Config *config)
+{
+	if ((config == NULL) || (config->pool == NULL) || (config->ip == 0U)
+			|| (config->pool->size < (NET_BUF_OFFSET + NET_TCP_MSS_DEFAULT)))
+	{
+		return ERR_GENERIC;
+	}
+
+	memset(&net_stack, 0, sizeof(net_stack));
+	memcpy(net_stack.mac, config->mac, 6U);
+	net_stack.ip = config->ip;
+	net_stack.netmask = config->netmask;
+	net_stack.gateway = config->gateway;
+	net_stack.pool = config->pool;
+	net_stack.iss = config->ip;
+
+	eth_Config eth;
+	memcpy(eth.mac, config->mac, 6U);
+	eth.phy = config->phy;
+	eth.pool = config->pool;
+	eth.priority = config->priority;
+	eth.rx = net_rx;
+	eth.tx_done = net_tx_done;
+	eth.arg = NULL;
+	eth.level = config->level;
+	if (eth_init(&eth) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	return ERR_NONE;
+}
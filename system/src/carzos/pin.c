@@ -0,0 +1,53 @@
+/*
+ * pin.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <pin.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+
+
+static void pin_setup(u32 pin, u32 mode, u32 pull, u32 af)
+{
+	if (pin == PIN_NONE)
+	{
+		return;
+	}
+
+	RCC->AHB1ENR |= RCC_AHB1ENR_GPIOAEN << (pin >> 4);
+	(void) RCC->AHB1ENR;
+
+	GPIO_InitTypeDef init;
+	init.Pin = PIN_MASK(pin);
+	init.Mode = mode;
+	init.Pull = pull;
+	init.Speed = GPIO_SPEED_FREQ_VERY_HIGH;
+	init.Alternate = af;
+	HAL_GPIO_Init(PIN_GPIO(pin), &init);
+}
+
+void pin_af(u32 pin, u32 af, u32 pull, u32 type)
+{
+	pin_setup(pin, (type == PIN_OPEN_DRAIN) ? GPIO_MODE_AF_OD : GPIO_MODE_AF_PP, pull, af);
+}
+
+void pin_output(u32 pin, u32 type)
+{
+	pin_setup(pin, (type == PIN_OPEN_DRAIN) ? GPIO_MODE_OUTPUT_OD : GPIO_MODE_OUTPUT_PP,
+			GPIO_NOPULL, 0U);
+}
+
+void pin_input(u32 pin, u32 pull)
+{
+	pin_setup(pin, GPIO_MODE_INPUT, pull, 0U);
+}
+
+void pin_analog(u32 pin)
+{
+	pin_setup(pin, GPIO_MODE_ANALOG, GPIO_NOPULL, 0U);
+}
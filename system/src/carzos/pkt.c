@@ -0,0 +1,143 @@
+/*
+ * pkt.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <pkt.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+#if defined(__arm__)
+
+#include "stm32f4xx.h"
+
+static inline pkt_Buf *pkt_ldrex(pkt_Buf *volatile *head)
+{
+	return (pkt_Buf *) __LDREXW((volatile u32 *) head);
+}
+
+static inline u32 pkt_strex(pkt_Buf *value, pkt_Buf *volatile *head)
+{
+	return __STREXW((u32) value, (volatile u32 *) head);
+}
+
+#else
+
+// Host stand-ins: the host ports run the network from one thread
+
+static inline pkt_Buf *pkt_ldrex(pkt_Buf *volatile *head)
+{
+	return *head;
+}
+
+static inline u32 pkt_strex(pkt_Buf *value, pkt_Buf *volatile *head)
+{
+	*head = value;
+	return 0U;
+}
+
+#endif // __arm__
+
+
+static void pkt_push(pkt_Pool *pool, pkt_Buf *buf)
+{
+	pkt_Buf *head;
+	do
+	{
+		head = pkt_ldrex(&pool->free);
+		buf->link = head;
+	} while (pkt_strex(buf, &pool->free) != 0U);
+}
+
+u32 pkt_pool_init(pkt_Pool *pool, void *mem, u32 count, u32 size)
+{
+	if ((pool == NULL) || (mem == NULL) || (count == 0U) || (size == 0U)
+			|| (size > 0xFFFFU) || (((uintptr_t) mem & 3U) != 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	pool->free = NULL;
+	pool->size = size;
+	pool->count = count;
+	pool->misses = 0U;
+
+	u8 *p = mem;
+	u32 stride = PKT_HEADER_BYTES + ALIGN(size, 4U);
+	for (u32 i = 0U; i < count; i++)
+	{
+		pkt_Buf *buf = (pkt_Buf *) p;
+		buf->pool = pool;
+		buf->mem = p + PKT_HEADER_BYTES;
+		pkt_push(pool, buf);
+		p += stride;
+	}
+
+	return ERR_NONE;
+}
+
+pkt_Buf *pkt_alloc(pkt_Pool *pool)
+{
+	pkt_Buf *buf;
+	do
+	{
+		// An exception between the two clears the monitor, so 'link' is
+		// still the one of the head when the store succeeds
+		buf = pkt_ldrex(&pool->free);
+		if (buf == NULL)
+		{
+#if defined(__arm__)
+			__CLREX();
+#endif
+			pool->misses++;
+			return NULL;
+		}
+	} while (pkt_strex(buf->link, &pool->free) != 0U);
+
+	buf->next = NULL;
+	buf->link = NULL;
+	buf->data = buf->mem;
+	buf->len = 0U;
+	buf->flags = 0U;
+
+	return buf;
+}
+
+void pkt_free(pkt_Buf *chain)
+{
+	while (chain != NULL)
+	{
+		pkt_Buf *next = chain->next;
+		if (chain->pool != NULL)
+		{
+			pkt_push(chain->pool, chain);
+		}
+		chain = next;
+	}
+}
+
+void pkt_ref(pkt_Buf *buf, const void *data, u32 len)
+{
+	buf->next = NULL;
+	buf->link = NULL;
+	buf->data = (u8 *) data;
+	buf->len = (u16) len;
+	buf->flags = 0U;
+	buf->pool = NULL;
+	buf->mem = NULL;
+}
+
+u32 pkt_chain_len(const pkt_Buf *chain)
+{
+	u32 len = 0U;
+	for (; chain != NULL; chain = chain->next)
+	{
+		len += chain->len;
+	}
+	return len;
+}
@@ -0,0 +1,198 @@
+/*
+ * restart.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <restart.h>
+#include <sections.h>
+
+#include "ktype.h"
+
+#define RESTART_MAGIC           (0x5741524DU)   // "WARM"
+
+// Every peripheral reset bit of the F405/407; the other bits are reserved.
+// PWR is left out, it holds the regulator scale the clock runs with.
+#define RESTART_AHB1_RESETS     (RCC_AHB1RSTR_GPIOARST | RCC_AHB1RSTR_GPIOBRST \
+		| RCC_AHB1RSTR_GPIOCRST | RCC_AHB1RSTR_GPIODRST | RCC_AHB1RSTR_GPIOERST \
+		| RCC_AHB1RSTR_GPIOFRST | RCC_AHB1RSTR_GPIOGRST | RCC_AHB1RSTR_GPIOHRST \
+		| RCC_AHB1RSTR_GPIOIRST | RCC_AHB1RSTR_CRCRST | RCC_AHB1RSTR_DMA1RST \
+		| RCC_AHB1RSTR_DMA2RST | RCC_AHB1RSTR_ETHMACRST | RCC_AHB1RSTR_OTGHRST)
+#define RESTART_AHB2_RESETS     (RCC_AHB2RSTR_DCMIRST | RCC_AHB2RSTR_RNGRST \
+		| RCC_AHB2RSTR_OTGFSRST)
+#define RESTART_AHB3_RESETS     (RCC_AHB3RSTR_FSMCRST)
+#define RESTART_APB1_RESETS     (RCC_APB1RSTR_TIM2RST | RCC_APB1RSTR_TIM3RST \
+		| RCC_APB1RSTR_TIM4RST | RCC_APB1RSTR_TIM5RST | RCC_APB1RSTR_TIM6RST \
+		| RCC_APB1RSTR_TIM7RST | RCC_APB1RSTR_TIM12RST | RCC_APB1RSTR_TIM13RST \
+		| RCC_APB1RSTR_TIM14RST | RCC_APB1RSTR_WWDGRST | RCC_APB1RSTR_SPI2RST \
+		| RCC_APB1RSTR_SPI3RST | RCC_APB1RSTR_USART2RST | RCC_APB1RSTR_USART3RST \
+		| RCC_APB1RSTR_UART4RST | RCC_APB1RSTR_UART5RST | RCC_APB1RSTR_I2C1RST \
+		| RCC_APB1RSTR_I2C2RST | RCC_APB1RSTR_I2C3RST | RCC_APB1RSTR_CAN1RST \
+		| RCC_APB1RSTR_CAN2RST | RCC_APB1RSTR_DACRST)
+#define RESTART_APB2_RESETS     (RCC_APB2RSTR_TIM1RST | RCC_APB2RSTR_TIM8RST \
+		| RCC_APB2RSTR_USART1RST | RCC_APB2RSTR_USART6RST | RCC_APB2RSTR_ADCRST \
+		| RCC_APB2RSTR_SDIORST | RCC_APB2RSTR_SPI1RST | RCC_APB2RSTR_SYSCFGRST \
+		| RCC_APB2RSTR_TIM9RST | RCC_APB2RSTR_TIM10RST | RCC_APB2RSTR_TIM11RST)
+
+typedef enum restart_boot
+{
+	RESTART_BOOT_COLD = 0,
+	RESTART_BOOT_WARM,
+	RESTART_BOOT_RETAINED
+} restart_Boot;
+
+typedef struct restart_state
+{
+	// RESTART_MAGIC and its complement while a warm restart is pending
+	u32 magic;
+	u32 magic_inv;
+	u32 crc;
+	u32 count;
+	u32 boot;
+} restart_State;
+
+// Defined in linker script; the retained part of .noinit
+extern u32 __retained_start[];
+extern u32 __retained_end[];
+extern u32 __vectors_start[];
+
+extern void _start(void);
+
+static restart_State restart_state CARZOS_NOINIT;
+
+
+// CRC-32 of the retained objects, with the CRC unit
+static u32 restart_crc(void)
+{
+	RCC->AHB1ENR |= RCC_AHB1ENR_CRCEN;
+	(void) RCC->AHB1ENR;
+
+	CRC->CR = CRC_CR_RESET;
+	for (u32 *p = __retained_start; p < __retained_end; p++)
+	{
+		CRC->DR = *p;
+	}
+	u32 crc = CRC->DR;
+
+	RCC->AHB1ENR &= ~RCC_AHB1ENR_CRCEN;
+
+	return crc;
+}
+
+static void restart_quiesce(void)
+{
+	SysTick->CTRL = 0U;
+	SCB->ICSR = SCB_ICSR_PENDSTCLR_Msk | SCB_ICSR_PENDSVCLR_Msk;
+
+	for (u32 i = 0U; i < (sizeof(NVIC->ICER) / sizeof(NVIC->ICER[0])); i++)
+	{
+		NVIC->ICER[i] = 0xFFFFFFFFU;
+		NVIC->ICPR[i] = 0xFFFFFFFFU;
+	}
+
+	// Stop the DMA streams and everything else the application started
+	RCC->AHB1RSTR = RESTART_AHB1_RESETS;
+	RCC->AHB2RSTR = RESTART_AHB2_RESETS;
+	RCC->AHB3RSTR = RESTART_AHB3_RESETS;
+	RCC->APB1RSTR = RESTART_APB1_RESETS;
+	RCC->APB2RSTR = RESTART_APB2_RESETS;
+	RCC->AHB1RSTR = 0U;
+	RCC->AHB2RSTR = 0U;
+	RCC->AHB3RSTR = 0U;
+	RCC->APB1RSTR = 0U;
+	RCC->APB2RSTR = 0U;
+
+	// Clock gates back to their reset values
+	RCC->AHB1ENR = RCC_AHB1ENR_CCMDATARAMEN;
+	RCC->AHB2ENR = 0U;
+	RCC->AHB3ENR = 0U;
+	RCC->APB1ENR = 0U;
+	RCC->APB2ENR = 0U;
+
+	// stack_init() sets the guard again
+	MPU->CTRL = 0U;
+	__DSB();
+	__ISB();
+}
+
+void restart_warm(void)
+{
+	__disable_irq();
+
+	if (__get_IPSR() != 0U)
+	{
+		NVIC_SystemReset();
+	}
+
+	restart_quiesce();
+
+	restart_state.crc = restart_crc();
+	restart_state.count++;
+	restart_state.magic = RESTART_MAGIC;
+	restart_state.magic_inv = ~RESTART_MAGIC;
+
+	// Main stack, privileged, no FP context; the same state as after reset
+	__set_CONTROL(0U);
+	__ISB();
+
+	// PRIMASK stays set through the RAM initialisation; restart_init()
+	// clears it, where it is clear after a reset too
+	asm volatile
+	(
+		" msr   msp, %[sp]  \n"
+		" bx    %[entry]    \n"
+
+		:
+		: [sp] "r" (__vectors_start[0]), [entry] "r" (_start)
+		: "memory"
+	);
+
+	__builtin_unreachable();
+}
+
+u32 restart_take(void)
+{
+	u32 warm = (restart_state.magic == RESTART_MAGIC)
+			&& (restart_state.magic_inv == ~RESTART_MAGIC);
+
+	// A reset from here on is a cold one
+	restart_state.magic = 0U;
+	restart_state.boot = (warm != 0U) ? RESTART_BOOT_WARM : RESTART_BOOT_COLD;
+
+	return warm;
+}
+
+void restart_init(void)
+{
+	// Masked since restart_warm(); a no-op after a reset
+	__enable_irq();
+
+	if ((restart_state.boot == RESTART_BOOT_WARM)
+			&& (restart_crc() == restart_state.crc))
+	{
+		restart_state.boot = RESTART_BOOT_RETAINED;
+		return;
+	}
+
+	if (restart_state.boot == RESTART_BOOT_COLD)
+	{
+		restart_state.count = 0U;
+	}
+	restart_state.boot = RESTART_BOOT_COLD;
+
+	for (u32 *p = __retained_start; p < __retained_end; p++)
+	{
+		*p = 0U;
+	}
+}
+
+u32 restart_retained(void)
+{
+	return restart_state.boot == RESTART_BOOT_RETAINED;
+}
+
+u32 restart_count(void)
+{
+	return restart_state.count;
+}
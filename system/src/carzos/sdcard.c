@@ -0,0 +1,1011 @@
+/*
+ * sdcard.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <clock.h>
+#include <cpuload.h>
+#include <dma.h>
+#include <irq.h>
+#include <pin.h>
+#include <sdcard.h>
+#include <timer.h>
+#include <workq.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define SDCARD_INIT_HZ          (400000U)
+#define SDCARD_DEFAULT_HZ       (25000000U)
+#define SDCARD_HIGH_SPEED_HZ    (50000000U)
+#define SDCARD_WORDS            (SDCARD_SECTOR / 4U)
+
+// DMA2 channel 4; stream 3, the other one, is the SPI1 TX
+#define SDCARD_DMA_STREAM       (6U)
+#define SDCARD_DMA_CHANNEL      (4U)
+#define SDCARD_DMA_PL_VERY_HIGH (3U)
+
+#define SDCARD_PIN_D0           PIN('C', 8)
+#define SDCARD_PIN_D1           PIN('C', 9)
+#define SDCARD_PIN_D2           PIN('C', 10)
+#define SDCARD_PIN_D3           PIN('C', 11)
+#define SDCARD_PIN_CK           PIN('C', 12)
+#define SDCARD_PIN_CMD          PIN('D', 2)
+// D0 busy end, on EXTI line 8 (port C)
+#define SDCARD_EXTI_LINE        (1U << 8)
+#define SDCARD_EXTICR_PORT_C    (2U)
+
+// Commands; ACMD are preceded by SDCARD_APP_CMD
+#define SDCARD_GO_IDLE          (0U)
+#define SDCARD_ALL_SEND_CID     (2U)
+#define SDCARD_SEND_RCA         (3U)
+#define SDCARD_SWITCH           (6U)
+#define SDCARD_SELECT           (7U)
+#define SDCARD_SEND_IF_COND     (8U)
+#define SDCARD_SEND_CSD         (9U)
+#define SDCARD_STOP             (12U)
+#define SDCARD_SEND_STATUS      (13U)
+#define SDCARD_SET_BLOCKLEN     (16U)
+#define SDCARD_READ_MULTI       (18U)
+#define SDCARD_SET_BLOCK_COUNT  (23U)
+#define SDCARD_WRITE_MULTI      (25U)
+#define SDCARD_APP_CMD          (55U)
+#define SDCARD_ACMD_BUS_WIDTH   (6U)
+#define SDCARD_ACMD_ERASE_COUNT (23U)
+#define SDCARD_ACMD_OP_COND     (41U)
+#define SDCARD_ACMD_SEND_SCR    (51U)
+
+// Responses; R3 has no CRC (a bit above the CMD register fields)
+#define SDCARD_RESP_NONE        (0U)
+#define SDCARD_RESP_R1          (SDIO_CMD_WAITRESP_0)
+#define SDCARD_RESP_R2          (SDIO_CMD_WAITRESP)
+#define SDCARD_NO_CRC           (0x10000U)
+#define SDCARD_RESP_R3          (SDIO_CMD_WAITRESP_0 | SDCARD_NO_CRC)
+
+#define SDCARD_IF_COND          (0x1AAU)        // 2.7 to 3.6 V, check pattern
+#define SDCARD_OCR_VOLTAGES     (0x00FF8000U)
+#define SDCARD_OCR_CCS          (0x40000000U)   // HCS in the argument
+#define SDCARD_OCR_READY        (0x80000000U)
+#define SDCARD_R1_ERRORS        (0xFDF98008U)
+#define SDCARD_R1_STATE(r1)     (((r1) >> 9) & 0xFU)
+#define SDCARD_STATE_TRAN       (4U)
+#define SDCARD_SWITCH_CHECK     (0x00FFFFF1U)   // group 1 to high speed
+#define SDCARD_SWITCH_SET       (0x80FFFFF1U)
+#define SDCARD_OP_COND_MS       (1000U)
+#define SDCARD_CMD_MS           (10U)
+
+#define SDCARD_DCTRL_BLOCK(log2) ((u32) (log2) << 4)
+#define SDCARD_STA_CMD_ERRORS   (SDIO_STA_CCRCFAIL | SDIO_STA_CTIMEOUT)
+#define SDCARD_STA_DATA_ERRORS  (SDIO_STA_DCRCFAIL | SDIO_STA_DTIMEOUT | SDIO_STA_TXUNDERR \
+		| SDIO_STA_RXOVERR | SDIO_STA_STBITERR)
+#define SDCARD_ICR_ALL          (0x00C007FFU)
+#define SDCARD_MASK             (SDCARD_STA_CMD_ERRORS | SDIO_STA_CMDREND | SDIO_STA_DATAEND \
+		| SDCARD_STA_DATA_ERRORS)
+
+// Phase of the command on the bus
+#define SDCARD_PHASE_IDLE       (0U)
+#define SDCARD_PHASE_APP        (1U)    // CMD55, for ACMD23
+#define SDCARD_PHASE_ERASE      (2U)    // ACMD23
+#define SDCARD_PHASE_COUNT      (3U)    // CMD23
+#define SDCARD_PHASE_XFER       (4U)    // CMD18 or CMD25
+#define SDCARD_PHASE_DATA       (5U)
+#define SDCARD_PHASE_STOP       (6U)    // CMD12
+#define SDCARD_PHASE_BUSY       (7U)    // card programming
+#define SDCARD_PHASE_ABORT      (8U)    // CMD12 after an error
+
+typedef struct sdcard_card
+{
+	dma_Stream dma;
+	u32 ready;
+	u32 rca;                        // in the upper half, as the argument
+	u32 sectors;
+	u32 high_capacity;
+	u32 cmd23;
+	u32 wide;
+	u32 high_speed;
+	u32 max_hz;
+	u32 hz;
+	u32 merge;
+
+	sdcard_Request *volatile head;
+	sdcard_Request *tail;
+	// Completed, newest first, until the work item runs
+	sdcard_Request *volatile done;
+
+	// The command on the bus: its first request, the requests and sectors
+	// merged in it, the request the DMA is on
+	u32 phase;
+	u32 write;
+	u32 addr;
+	u32 run_count;
+	u32 run_sectors;
+	sdcard_Request *seg;
+	u32 seg_index;
+	u32 status;
+	u32 stamp;
+	// Commands left to go without merging, after a failed one
+	u32 solo;
+	volatile u32 hold;
+	// No PLL48 since the last clock change: requests fail
+	volatile u32 stopped;
+
+	sdcard_Stats stats;
+
+	workq_Item work;
+	clock_Listener clock;
+} sdcard_Card;
+
+static sdcard_Card sdcard;
+
+static void sdcard_start(void);
+
+
+// Fails, the clock untouched, when the PLL is off
+static u32 sdcard_set_clock(u32 hz)
+{
+	u32 sdioclk = clock_pll48();
+	if (sdioclk == 0U)
+	{
+		return ERR_GENERIC;
+	}
+
+	// The APB2 clock must stay above 3/8 of the card's
+	u32 apb_max = (clock_pclk2() / 3U) * 8U;
+	if (hz > apb_max)
+	{
+		hz = apb_max;
+	}
+
+	u32 clkcr = SDIO->CLKCR & ~(SDIO_CLKCR_CLKDIV | SDIO_CLKCR_BYPASS);
+	if (hz >= sdioclk)
+	{
+		clkcr |= SDIO_CLKCR_BYPASS;
+		sdcard.hz = sdioclk;
+	}
+	else
+	{
+		u32 div = (sdioclk + hz - 1U) / hz;
+		div = (div < 2U) ? 2U : ((div > 257U) ? 257U : div);
+		clkcr |= div - 2U;
+		sdcard.hz = sdioclk / div;
+	}
+	SDIO->CLKCR = clkcr;
+
+	return ERR_NONE;
+}
+
+// The bus clock for transfers
+static u32 sdcard_run_hz(void)
+{
+	u32 hz = (sdcard.high_speed != 0U) ? SDCARD_HIGH_SPEED_HZ : SDCARD_DEFAULT_HZ;
+	return ((sdcard.max_hz != 0U) && (sdcard.max_hz < hz)) ? sdcard.max_hz : hz;
+}
+
+// ----------------------------------------------------------------------------
+
+// Identification, polled
+
+static u32 sdcard_command(u32 index, u32 arg, u32 resp)
+{
+	u32 end = (resp == SDCARD_RESP_NONE) ? SDIO_STA_CMDSENT
+			: (SDIO_STA_CMDREND | SDCARD_STA_CMD_ERRORS);
+	u32 start = timer_ticks;
+	u32 sta;
+
+	SDIO->ICR = SDCARD_ICR_ALL;
+	SDIO->ARG = arg;
+	SDIO->CMD = index | (resp & ~SDCARD_NO_CRC) | SDIO_CMD_CPSMEN;
+
+	while (((sta = SDIO->STA) & end) == 0U)
+	{
+		if ((timer_ticks - start) > SDCARD_CMD_MS)
+		{
+			return ERR_GENERIC;
+		}
+	}
+	SDIO->ICR = SDCARD_ICR_ALL;
+
+	if (((sta & SDIO_STA_CTIMEOUT) != 0U)
+			|| (((sta & SDIO_STA_CCRCFAIL) != 0U) && ((resp & SDCARD_NO_CRC) == 0U)))
+	{
+		return ERR_GENERIC;
+	}
+	return ERR_NONE;
+}
+
+static u32 sdcard_r1(u32 index, u32 arg)
+{
+	if ((sdcard_command(index, arg, SDCARD_RESP_R1) != ERR_NONE)
+			|| ((SDIO->RESP1 & SDCARD_R1_ERRORS) != 0U))
+	{
+		return ERR_GENERIC;
+	}
+	return ERR_NONE;
+}
+
+static u32 sdcard_app(u32 index, u32 arg, u32 resp)
+{
+	if (sdcard_r1(SDCARD_APP_CMD, sdcard.rca) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	return sdcard_command(index, arg, resp);
+}
+
+// Until the card is back in the transfer state, busy over
+static u32 sdcard_wait_tran(void)
+{
+	u32 start = timer_ticks;
+	while ((timer_ticks - start) < SDCARD_TIMEOUT_MS)
+	{
+		if ((sdcard_r1(SDCARD_SEND_STATUS, sdcard.rca) == ERR_NONE)
+				&& (SDCARD_R1_STATE(SDIO->RESP1) == SDCARD_STATE_TRAN))
+		{
+			return ERR_NONE;
+		}
+	}
+	return ERR_GENERIC;
+}
+
+// A short data read through the FIFO: SCR, switch status
+static u32 sdcard_read_reg(u32 app, u32 index, u32 arg, u32 *buf, u32 log2)
+{
+	u32 words = (1U << log2) / 4U;
+	u32 n = 0U;
+
+	SDIO->DTIMER = sdcard.hz / 10U;
+	SDIO->DLEN = 1U << log2;
+	SDIO->DCTRL = SDIO_DCTRL_DTEN | SDIO_DCTRL_DTDIR | SDCARD_DCTRL_BLOCK(log2);
+
+	u32 status = (app != 0U) ? sdcard_app(index, arg, SDCARD_RESP_R1)
+			: sdcard_command(index, arg, SDCARD_RESP_R1);
+
+	u32 start = timer_ticks;
+	u32 sta = 0U;
+	while ((status == ERR_NONE)
+			&& (((sta = SDIO->STA) & (SDIO_STA_DATAEND | SDCARD_STA_DATA_ERRORS)) == 0U))
+	{
+		if (((sta & SDIO_STA_RXDAVL) != 0U) && (n < words))
+		{
+			buf[n++] = SDIO->FIFO;
+		}
+		else if ((timer_ticks - start) > SDCARD_CMD_MS)
+		{
+			status = ERR_GENERIC;
+		}
+	}
+	while (((SDIO->STA & SDIO_STA_RXDAVL) != 0U) && (n < words))
+	{
+		buf[n++] = SDIO->FIFO;
+	}
+
+	SDIO->DCTRL = 0U;
+	SDIO->ICR = SDCARD_ICR_ALL;
+	return ((status != ERR_NONE) || ((sta & SDCARD_STA_DATA_ERRORS) != 0U) || (n != words))
+			? ERR_GENERIC : ERR_NONE;
+}
+
+static u32 sdcard_identify(void)
+{
+	u32 r[16];
+
+	(void) sdcard_command(SDCARD_GO_IDLE, 0U, SDCARD_RESP_NONE);
+
+	// Version 2 cards answer CMD8 and may be high capacity
+	u32 v2 = ((sdcard_command(SDCARD_SEND_IF_COND, SDCARD_IF_COND, SDCARD_RESP_R1) == ERR_NONE)
+			&& ((SDIO->RESP1 & 0xFFFU) == SDCARD_IF_COND)) ? 1U : 0U;
+
+	u32 ocr = 0U;
+	u32 start = timer_ticks;
+	sdcard.rca = 0U;
+	while ((ocr & SDCARD_OCR_READY) == 0U)
+	{
+		if (((timer_ticks - start) > SDCARD_OP_COND_MS)
+				|| (sdcard_app(SDCARD_ACMD_OP_COND,
+						SDCARD_OCR_VOLTAGES | ((v2 != 0U) ? SDCARD_OCR_CCS : 0U),
+						SDCARD_RESP_R3) != ERR_NONE))
+		{
+			return ERR_GENERIC;
+		}
+		ocr = SDIO->RESP1;
+	}
+	sdcard.high_capacity = ((ocr & SDCARD_OCR_CCS) != 0U) ? 1U : 0U;
+
+	if ((sdcard_command(SDCARD_ALL_SEND_CID, 0U, SDCARD_RESP_R2) != ERR_NONE)
+			|| (sdcard_command(SDCARD_SEND_RCA, 0U, SDCARD_RESP_R1) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+	sdcard.rca = SDIO->RESP1 & 0xFFFF0000U;
+
+	if (sdcard_command(SDCARD_SEND_CSD, sdcard.rca, SDCARD_RESP_R2) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	u32 csd1 = SDIO->RESP1;
+	u32 csd2 = SDIO->RESP2;
+	u32 csd3 = SDIO->RESP3;
+	if ((csd1 >> 30) == 1U)
+	{
+		// CSD 2.0: C_SIZE [69:48], in 512 KiB units
+		u32 c_size = ((csd2 & 0x3FU) << 16) | (csd3 >> 16);
+		sdcard.sectors = (c_size + 1U) * 1024U;
+	}
+	else
+	{
+		// CSD 1.0: READ_BL_LEN [83:80], C_SIZE [73:62], C_SIZE_MULT [49:47]
+		u32 bl_len = (csd2 >> 16) & 0xFU;
+		u32 c_size = ((csd2 & 0x3FFU) << 2) | (csd3 >> 30);
+		u32 mult = (csd3 >> 15) & 0x7U;
+		sdcard.sectors = (c_size + 1U) << (mult + 2U + bl_len - 9U);
+	}
+
+	if ((sdcard_command(SDCARD_SELECT, sdcard.rca, SDCARD_RESP_R1) != ERR_NONE)
+			|| (sdcard_wait_tran() != ERR_NONE)
+			|| (sdcard_r1(SDCARD_SET_BLOCKLEN, SDCARD_SECTOR) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	// Default speed, then what the SCR says: SD_SPEC [59:56], 4 bit bus
+	// in SD_BUS_WIDTHS [51:48], CMD23 in CMD_SUPPORT [33:32]
+	(void) sdcard_set_clock(SDCARD_DEFAULT_HZ);
+	if (sdcard_read_reg(1U, SDCARD_ACMD_SEND_SCR, 0U, r, 3U) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	u32 scr = __REV(r[0]);
+	sdcard.cmd23 = (scr >> 1) & 1U;
+
+	if (((scr >> 16) & 0x4U) != 0U)
+	{
+		if (sdcard_app(SDCARD_ACMD_BUS_WIDTH, 2U, SDCARD_RESP_R1) != ERR_NONE)
+		{
+			return ERR_GENERIC;
+		}
+		SDIO->CLKCR = (SDIO->CLKCR & ~SDIO_CLKCR_WIDBUS) | SDIO_CLKCR_WIDBUS_0;
+		sdcard.wide = 1U;
+	}
+
+	// High speed in the switch status: supported in bits [415:400] (byte
+	// 13), selected in [379:376] (byte 16)
+	if ((((scr >> 24) & 0xFU) >= 1U)
+			&& ((sdcard.max_hz == 0U) || (sdcard.max_hz > SDCARD_DEFAULT_HZ))
+			&& (sdcard_read_reg(0U, SDCARD_SWITCH, SDCARD_SWITCH_CHECK, r, 6U) == ERR_NONE)
+			&& ((((const u8 *) r)[13] & 0x02U) != 0U)
+			&& (sdcard_read_reg(0U, SDCARD_SWITCH, SDCARD_SWITCH_SET, r, 6U) == ERR_NONE)
+			&& ((((const u8 *) r)[16] & 0x0FU) == 1U))
+	{
+		sdcard.high_speed = 1U;
+	}
+
+	(void) sdcard_set_clock(sdcard_run_hz());
+	return ERR_NONE;
+}
+
+// ----------------------------------------------------------------------------
+
+static inline void sdcard_cmd(u32 phase, u32 index, u32 arg)
+{
+	sdcard.phase = phase;
+	SDIO->ARG = arg;
+	SDIO->CMD = index | SDCARD_RESP_R1 | SDIO_CMD_CPSMEN;
+}
+
+static void sdcard_dma_arm(const sdcard_Request *request)
+{
+	DMA_Stream_TypeDef *stream = sdcard.dma.regs;
+
+	(void) dma_take(&sdcard.dma);
+	stream->M0AR = (u32) request->buf;
+	stream->NDTR = request->count * SDCARD_WORDS;
+	stream->CR = (stream->CR & ~DMA_SxCR_DIR)
+			| ((sdcard.write != 0U) ? DMA_CR_DIR_M2P : DMA_CR_DIR_P2M) | DMA_SxCR_EN;
+}
+
+static void sdcard_complete(sdcard_Request *request, u32 status)
+{
+	request->status = status;
+
+	if (request->callback != NULL)
+	{
+		// Still busy until its callback has run
+		request->next = sdcard.done;
+		sdcard.done = request;
+		workq_post(&sdcard.work);
+	}
+	else
+	{
+		request->busy = 0U;
+	}
+}
+
+// The requests of the command are done, with its status
+static void sdcard_finish(void)
+{
+	if (sdcard.status == ERR_NONE)
+	{
+		if (sdcard.write != 0U)
+		{
+			sdcard.stats.sectors_written += sdcard.run_sectors;
+		}
+		else
+		{
+			sdcard.stats.sectors_read += sdcard.run_sectors;
+		}
+	}
+
+	for (u32 i = 0U; i < sdcard.run_count; i++)
+	{
+		sdcard_Request *request = sdcard.head;
+		sdcard.head = request->next;
+		sdcard_complete(request, sdcard.status);
+	}
+	if (sdcard.head == NULL)
+	{
+		sdcard.tail = NULL;
+	}
+
+	sdcard.phase = SDCARD_PHASE_IDLE;
+	sdcard_start();
+}
+
+// After a failed command: the first try of its requests goes again, one
+// at a time
+static void sdcard_retry(void)
+{
+	sdcard_Request *request = sdcard.head;
+
+	if ((sdcard.run_count == 1U) && (request->tries != 0U))
+	{
+		sdcard_finish();
+		return;
+	}
+
+	for (u32 i = 0U; i < sdcard.run_count; i++)
+	{
+		request->tries++;
+		request = request->next;
+	}
+	sdcard.solo = sdcard.run_count;
+	sdcard.stats.retries++;
+	sdcard.phase = SDCARD_PHASE_IDLE;
+	sdcard_start();
+}
+
+static void sdcard_ready(void)
+{
+	if (sdcard.status != ERR_NONE)
+	{
+		sdcard_retry();
+	}
+	else
+	{
+		sdcard_finish();
+	}
+}
+
+// Until D0 goes high again; the EXTI interrupt catches the edge
+static void sdcard_wait_busy(void)
+{
+	sdcard.phase = SDCARD_PHASE_BUSY;
+
+	EXTI->PR = SDCARD_EXTI_LINE;
+	EXTI->IMR |= SDCARD_EXTI_LINE;
+	if ((PIN_GPIO(SDCARD_PIN_D0)->IDR & PIN_MASK(SDCARD_PIN_D0)) != 0U)
+	{
+		EXTI->IMR &= ~SDCARD_EXTI_LINE;
+		sdcard_ready();
+	}
+}
+
+static void sdcard_fail(void)
+{
+	sdcard.stats.errors++;
+	sdcard.status = ERR_GENERIC;
+
+	dma_stop(&sdcard.dma);
+	SDIO->DCTRL = 0U;
+	sdcard_cmd(SDCARD_PHASE_ABORT, SDCARD_STOP, 0U);
+}
+
+static void sdcard_data_end(void)
+{
+	SDIO->DCTRL = 0U;
+
+	if (sdcard.write == 0U)
+	{
+		// The last words may still be on their way to memory
+		while ((sdcard.dma.regs->CR & DMA_SxCR_EN) != 0U)
+		{
+		}
+		if (sdcard.cmd23 != 0U)
+		{
+			// The card stopped on its own: straight on with the next one
+			sdcard_finish();
+			return;
+		}
+	}
+	sdcard_cmd(SDCARD_PHASE_STOP, SDCARD_STOP, 0U);
+}
+
+static void sdcard_start(void)
+{
+	sdcard_Request *request = sdcard.head;
+
+	if ((sdcard.phase != SDCARD_PHASE_IDLE) || (request == NULL) || (sdcard.hold != 0U))
+	{
+		return;
+	}
+
+	// Merge what follows in the queue: same way, next sectors
+	u32 count = 1U;
+	u32 sectors = request->count;
+	if (sdcard.solo != 0U)
+	{
+		sdcard.solo--;
+	}
+	else if (sdcard.merge != 0U)
+	{
+		for (sdcard_Request *r = request->next; r != NULL; r = r->next)
+		{
+			if ((r->write != request->write) || (r->sector != (request->sector + sectors))
+					|| ((sectors + r->count) > SDCARD_RUN_MAX))
+			{
+				break;
+			}
+			sectors += r->count;
+			count++;
+		}
+	}
+
+	sdcard.write = request->write;
+	sdcard.addr = (sdcard.high_capacity != 0U) ? request->sector : (request->sector * SDCARD_SECTOR);
+	sdcard.run_count = count;
+	sdcard.run_sectors = sectors;
+	sdcard.seg = request;
+	sdcard.seg_index = 0U;
+	sdcard.status = ERR_NONE;
+	sdcard.stamp = timer_ticks;
+	sdcard.stats.commands++;
+	sdcard.stats.merged += count - 1U;
+
+	// Data timeout a quarter of a second, for reads and writes alike
+	SDIO->DTIMER = sdcard.hz / 4U;
+	SDIO->DLEN = sectors * SDCARD_SECTOR;
+	sdcard_dma_arm(request);
+
+	if (sdcard.write != 0U)
+	{
+		// ACMD23, CMD25; the data path starts on the response
+		sdcard_cmd(SDCARD_PHASE_APP, SDCARD_APP_CMD, sdcard.rca);
+	}
+	else
+	{
+		SDIO->DCTRL = SDIO_DCTRL_DTEN | SDIO_DCTRL_DTDIR | SDIO_DCTRL_DMAEN | SDCARD_DCTRL_BLOCK(9U);
+		if (sdcard.cmd23 != 0U)
+		{
+			sdcard_cmd(SDCARD_PHASE_COUNT, SDCARD_SET_BLOCK_COUNT, sectors);
+		}
+		else
+		{
+			sdcard_cmd(SDCARD_PHASE_XFER, SDCARD_READ_MULTI, sdcard.addr);
+		}
+	}
+}
+
+static void sdcard_irq(void *ctx)
+{
+	(void) ctx;
+
+	u32 sta = SDIO->STA;
+	SDIO->ICR = sta & SDCARD_ICR_ALL;
+
+	u32 phase = sdcard.phase;
+	if ((phase == SDCARD_PHASE_IDLE) || (phase == SDCARD_PHASE_BUSY))
+	{
+		return;
+	}
+
+	if (phase == SDCARD_PHASE_ABORT)
+	{
+		// Whatever the answer, once the card is no longer busy
+		if ((sta & (SDIO_STA_CMDREND | SDCARD_STA_CMD_ERRORS)) != 0U)
+		{
+			sdcard_wait_busy();
+		}
+		return;
+	}
+
+	if ((sta & SDCARD_STA_DATA_ERRORS) != 0U)
+	{
+		sdcard_fail();
+		return;
+	}
+
+	if (phase != SDCARD_PHASE_DATA)
+	{
+		if ((sta & SDCARD_STA_CMD_ERRORS) != 0U)
+		{
+			sdcard_fail();
+			return;
+		}
+		if ((sta & SDIO_STA_CMDREND) == 0U)
+		{
+			return;
+		}
+		// CMD12 may report an out of range after reading the last sectors
+		if ((phase != SDCARD_PHASE_STOP) && ((SDIO->RESP1 & SDCARD_R1_ERRORS) != 0U))
+		{
+			sdcard_fail();
+			return;
+		}
+
+		switch (phase)
+		{
+		case SDCARD_PHASE_APP:
+			sdcard_cmd(SDCARD_PHASE_ERASE, SDCARD_ACMD_ERASE_COUNT, sdcard.run_sectors);
+			return;
+		case SDCARD_PHASE_ERASE:
+			sdcard_cmd(SDCARD_PHASE_XFER, SDCARD_WRITE_MULTI, sdcard.addr);
+			return;
+		case SDCARD_PHASE_COUNT:
+			sdcard_cmd(SDCARD_PHASE_XFER, SDCARD_READ_MULTI, sdcard.addr);
+			return;
+		case SDCARD_PHASE_XFER:
+			sdcard.phase = SDCARD_PHASE_DATA;
+			if (sdcard.write != 0U)
+			{
+				SDIO->DCTRL = SDIO_DCTRL_DTEN | SDIO_DCTRL_DMAEN | SDCARD_DCTRL_BLOCK(9U);
+			}
+			// A short read may be over already
+			break;
+		case SDCARD_PHASE_STOP:
+			if (sdcard.write != 0U)
+			{
+				sdcard_wait_busy();
+			}
+			else
+			{
+				sdcard_finish();
+			}
+			return;
+		default:
+			return;
+		}
+	}
+
+	if ((sta & SDIO_STA_DATAEND) != 0U)
+	{
+		sdcard_data_end();
+	}
+}
+
+static void sdcard_dma_irq(void *ctx)
+{
+	(void) ctx;
+
+	u32 flags = dma_take(&sdcard.dma);
+	if ((sdcard.phase == SDCARD_PHASE_IDLE) || (sdcard.phase >= SDCARD_PHASE_STOP))
+	{
+		return;
+	}
+
+	if ((flags & (DMA_FLAG_TE | DMA_FLAG_DME)) != 0U)
+	{
+		sdcard_fail();
+	}
+	else if (((flags & DMA_FLAG_TC) != 0U) && ((sdcard.seg_index + 1U) < sdcard.run_count))
+	{
+		// On to the buffer of the next merged request. The card does not
+		// wait: the SDIO FIFO gives this 5 us at 50 MHz (sdcard.h), after
+		// which the command fails on an overrun or an underrun
+		sdcard.seg = sdcard.seg->next;
+		sdcard.seg_index++;
+		sdcard_dma_arm(sdcard.seg);
+	}
+}
+
+static void sdcard_exti_irq(void *ctx)
+{
+	(void) ctx;
+
+	if ((EXTI->PR & SDCARD_EXTI_LINE) == 0U)
+	{
+		return;
+	}
+	EXTI->PR = SDCARD_EXTI_LINE;
+
+	if (sdcard.phase == SDCARD_PHASE_BUSY)
+	{
+		EXTI->IMR &= ~SDCARD_EXTI_LINE;
+		sdcard_ready();
+	}
+}
+
+static void sdcard_work(void *arg)
+{
+	(void) arg;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	sdcard_Request *done = sdcard.done;
+	sdcard.done = NULL;
+	__set_PRIMASK(primask);
+
+	// Back to submission order
+	sdcard_Request *list = NULL;
+	while (done != NULL)
+	{
+		sdcard_Request *next = done->next;
+		done->next = list;
+		list = done;
+		done = next;
+	}
+
+	while (list != NULL)
+	{
+		sdcard_Request *next = list->next;
+		list->busy = 0U;
+		list->callback(list->arg, list);
+		list = next;
+	}
+}
+
+static void sdcard_clock_changed(void *arg, clock_Event event)
+{
+	(void) arg;
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		// Let the command on the bus finish; no new one starts
+		sdcard.hold = 1U;
+		while (sdcard.phase != SDCARD_PHASE_IDLE)
+		{
+			if (sdcard_watchdog(SDCARD_TIMEOUT_MS) != 0U)
+			{
+				break;
+			}
+		}
+	}
+	else if (sdcard_set_clock(sdcard_run_hz()) != ERR_NONE)
+	{
+		// No SDIO clock: the queue fails, and new requests with it, until
+		// a clock change brings the PLL back. The card keeps its state.
+		u32 primask = __get_PRIMASK();
+		__disable_irq();
+		sdcard.stopped = 1U;
+		sdcard_Request *request = sdcard.head;
+		sdcard.head = NULL;
+		sdcard.tail = NULL;
+		while (request != NULL)
+		{
+			sdcard_Request *next = request->next;
+			sdcard_complete(request, ERR_GENERIC);
+			request = next;
+		}
+		__set_PRIMASK(primask);
+	}
+	else
+	{
+		sdcard.stopped = 0U;
+		sdcard.hold = 0U;
+		sdcard_start();
+	}
+}
+
+u32 sdcard_init(const sdcard_Config *config)
+{
+	if ((config == NULL) || (clock_pll48() == 0U))
+	{
+		return ERR_GENERIC;
+	}
+
+	sdcard.ready = 0U;
+	sdcard.max_hz = config->max_hz;
+	sdcard.merge = config->merge;
+	sdcard.cmd23 = 0U;
+	sdcard.wide = 0U;
+	sdcard.high_speed = 0U;
+	sdcard.head = NULL;
+	sdcard.tail = NULL;
+	sdcard.done = NULL;
+	sdcard.phase = SDCARD_PHASE_IDLE;
+	sdcard.solo = 0U;
+	sdcard.hold = 0U;
+	sdcard.stopped = 0U;
+
+	if (workq_item_init(&sdcard.work, sdcard_work, NULL, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	RCC->APB2ENR |= RCC_APB2ENR_SDIOEN | RCC_APB2ENR_SYSCFGEN;
+	(void) RCC->APB2ENR;
+
+	pin_af(SDCARD_PIN_D0, GPIO_AF12_SDIO, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(SDCARD_PIN_D1, GPIO_AF12_SDIO, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(SDCARD_PIN_D2, GPIO_AF12_SDIO, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(SDCARD_PIN_D3, GPIO_AF12_SDIO, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(SDCARD_PIN_CK, GPIO_AF12_SDIO, GPIO_NOPULL, PIN_PUSH_PULL);
+	pin_af(SDCARD_PIN_CMD, GPIO_AF12_SDIO, GPIO_PULLUP, PIN_PUSH_PULL);
+
+	// Power up, then the 74 clocks at 400 kHz the card wants first
+	SDIO->POWER = 0U;
+	SDIO->CLKCR = 0U;
+	SDIO->DCTRL = 0U;
+	SDIO->MASK = 0U;
+	(void) sdcard_set_clock(SDCARD_INIT_HZ);
+	SDIO->POWER = SDIO_POWER_PWRCTRL;
+	SDIO->CLKCR |= SDIO_CLKCR_CLKEN;
+	timer_sleep(2U);
+
+	if (sdcard_identify() != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	if (dma_stream_init(&sdcard.dma, 2U, SDCARD_DMA_STREAM, sdcard_dma_irq, NULL,
+			config->priority) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	// Word transfers, bursts of 4 on the SDIO side as it requires; the
+	// DMA counts, so that a merged command can move from buffer to buffer
+	DMA_Stream_TypeDef *stream = sdcard.dma.regs;
+	stream->PAR = (u32) &SDIO->FIFO;
+	stream->CR = ((u32) SDCARD_DMA_CHANNEL << DMA_CR_CHSEL_SHIFT)
+			| (SDCARD_DMA_PL_VERY_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_SxCR_PBURST_0 | DMA_SxCR_MSIZE_1 | DMA_SxCR_PSIZE_1
+			| DMA_SxCR_MINC | DMA_SxCR_TCIE | DMA_SxCR_TEIE | DMA_SxCR_DMEIE;
+	stream->FCR = DMA_SxFCR_DMDIS | DMA_SxFCR_FTH;
+
+	// D0 rising edge ends the programming busy
+	SYSCFG->EXTICR[2] = (SYSCFG->EXTICR[2] & ~0xFU) | SDCARD_EXTICR_PORT_C;
+	EXTI->IMR &= ~SDCARD_EXTI_LINE;
+	EXTI->RTSR |= SDCARD_EXTI_LINE;
+	EXTI->FTSR &= ~SDCARD_EXTI_LINE;
+	EXTI->PR = SDCARD_EXTI_LINE;
+
+	if ((irq_attach(SDIO_IRQn, sdcard_irq, NULL) != ERR_NONE)
+			|| (irq_attach(EXTI9_5_IRQn, sdcard_exti_irq, NULL) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+	SDIO->ICR = SDCARD_ICR_ALL;
+	SDIO->MASK = SDCARD_MASK;
+	NVIC_SetPriority(SDIO_IRQn, config->priority);
+	NVIC_SetPriority(EXTI9_5_IRQn, config->priority);
+	NVIC_EnableIRQ(SDIO_IRQn);
+	NVIC_EnableIRQ(EXTI9_5_IRQn);
+
+	clock_listen(&sdcard.clock, sdcard_clock_changed, NULL);
+
+	sdcard.ready = 1U;
+	return ERR_NONE;
+}
+
+u32 sdcard_submit(sdcard_Request *request)
+{
+	if ((request == NULL) || (sdcard.ready == 0U) || (request->buf == NULL)
+			|| (((uintptr_t) request->buf & 3U) != 0U)
+			|| (request->count == 0U) || (request->count > SDCARD_RUN_MAX)
+			|| (request->sector >= sdcard.sectors)
+			|| (request->count > (sdcard.sectors - request->sector))
+			|| (request->write > SDCARD_WRITE))
+	{
+		return ERR_GENERIC;
+	}
+
+	request->next = NULL;
+	request->busy = 1U;
+	request->tries = 0U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (sdcard.stopped != 0U)
+	{
+		__set_PRIMASK(primask);
+		request->busy = 0U;
+		return ERR_GENERIC;
+	}
+
+	sdcard.stats.requests++;
+	if (sdcard.tail != NULL)
+	{
+		sdcard.tail->next = request;
+		sdcard.tail = request;
+	}
+	else
+	{
+		sdcard.head = request;
+		sdcard.tail = request;
+	}
+	sdcard_start();
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+u32 sdcard_transfer(u32 sector, u32 count, u8 *buf, u32 write)
+{
+	sdcard_Request request;
+	request.sector = sector;
+	request.count = count;
+	request.buf = buf;
+	request.write = write;
+	request.callback = NULL;
+	request.arg = NULL;
+
+	if (sdcard_submit(&request) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	// The system tick wakes us at least every millisecond
+	__disable_irq();
+	while (request.busy != 0U)
+	{
+		cpuload_idle();
+
+		__enable_irq();
+		__ISB();
+		__disable_irq();
+
+		(void) sdcard_watchdog(SDCARD_TIMEOUT_MS);
+	}
+	__enable_irq();
+
+	return request.status;
+}
+
+u32 sdcard_watchdog(u32 timeout_ms)
+{
+	u32 expired = 0U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if ((sdcard.phase != SDCARD_PHASE_IDLE) && ((timer_ticks - sdcard.stamp) >= timeout_ms))
+	{
+		// No retry: the card is not answering
+		dma_stop(&sdcard.dma);
+		SDIO->DCTRL = 0U;
+		EXTI->IMR &= ~SDCARD_EXTI_LINE;
+		sdcard.stats.errors++;
+		sdcard.status = ERR_GENERIC;
+		sdcard_finish();
+		expired = 1U;
+	}
+
+	__set_PRIMASK(primask);
+
+	return expired;
+}
+
+void sdcard_info(sdcard_Info *info)
+{
+	info->sectors = sdcard.sectors;
+	info->hz = sdcard.hz;
+	info->bus_width = (sdcard.wide != 0U) ? 4U : 1U;
+	info->high_capacity = sdcard.high_capacity;
+	info->high_speed = sdcard.high_speed;
+	info->cmd23 = sdcard.cmd23;
+}
+
+void sdcard_stats(sdcard_Stats *stats)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	*stats = sdcard.stats;
+	__set_PRIMASK(primask);
+}
@@ -0,0 +1,422 @@
+/*
+ * spi.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <cpuload.h>
+#include <pin.h>
+#include <spi.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define SPI_INSTANCES           (3U)
+#define SPI_DMA_PL_HIGH         (2U)
+#define SPI_CR1_BR_SHIFT        (3U)
+#define SPI_BR_MAX              (7U)
+
+typedef struct spi_hw
+{
+	SPI_TypeDef *regs;
+	u32 apb2;
+	u32 enable;
+	u8 af;
+	u8 dma;
+	u8 rx_stream;
+	u8 tx_stream;
+	u8 channel;
+} spi_Hw;
+
+// SPI2 shares DMA1 streams 3 and 4 with the USART3 and UART4 TX, and SPI3
+// streams 0 and 7 with UART5: do not use both of a pair.
+static const spi_Hw spi_hw[SPI_INSTANCES] =
+{
+	{ SPI1, 1U, RCC_APB2ENR_SPI1EN, GPIO_AF5_SPI1, 2U, 0U, 3U, 3U },
+	{ SPI2, 0U, RCC_APB1ENR_SPI2EN, GPIO_AF5_SPI2, 1U, 3U, 4U, 0U },
+	{ SPI3, 0U, RCC_APB1ENR_SPI3EN, GPIO_AF6_SPI3, 1U, 0U, 7U, 0U },
+};
+
+// Source and sink of the one sided transfers
+static const u8 spi_fill = 0xFFU;
+static u8 spi_sink;
+
+
+static inline void spi_cs(u32 pin, u32 high)
+{
+	if (pin != PIN_NONE)
+	{
+		PIN_GPIO(pin)->BSRR = (high != 0U) ? PIN_MASK(pin) : ((u32) PIN_MASK(pin) << 16);
+	}
+}
+
+static u32 spi_pclk(const spi_Bus *bus)
+{
+	return (bus->apb2 != 0U) ? clock_pclk2() : clock_pclk1();
+}
+
+// Master, software chip select, the smallest divider (fastest SCK) that
+// does not exceed the device's maximum; /256 when none does
+static u32 spi_cr1(const spi_Device *device)
+{
+	u32 pclk = spi_pclk(device->bus);
+
+	u32 br = 0U;
+	while (((pclk >> (br + 1U)) > device->max_hz) && (br < SPI_BR_MAX))
+	{
+		br++;
+	}
+
+	return SPI_CR1_MSTR | SPI_CR1_SSM | SPI_CR1_SSI
+			| (br << SPI_CR1_BR_SHIFT) | device->mode;
+}
+
+// Starts the transfer at the head of the queue; streams stopped, bus
+// interrupts masked.
+static void spi_start(spi_Bus *bus)
+{
+	spi_Transfer *transfer = bus->head;
+	if ((transfer == NULL) || (bus->hold != 0U))
+	{
+		return;
+	}
+
+	spi_Device *device = transfer->device;
+
+	if (bus->cs_active != device)
+	{
+		if (bus->cs_active != NULL)
+		{
+			spi_cs(bus->cs_active->cs_pin, 1U);
+		}
+
+		// Settings only written when they change
+		if (device->epoch != bus->epoch)
+		{
+			device->cr1 = spi_cr1(device);
+			device->epoch = bus->epoch;
+		}
+		if (device->cr1 != bus->cr1)
+		{
+			bus->regs->CR1 = device->cr1;
+			bus->regs->CR1 = device->cr1 | SPI_CR1_SPE;
+			bus->cr1 = device->cr1;
+		}
+
+		spi_cs(device->cs_pin, 0U);
+		bus->cs_active = device;
+	}
+
+	DMA_Stream_TypeDef *rx = bus->rx_dma.regs;
+	DMA_Stream_TypeDef *tx = bus->tx_dma.regs;
+
+	if (transfer->rx != NULL)
+	{
+		rx->M0AR = (u32) transfer->rx;
+		rx->CR |= DMA_SxCR_MINC;
+	}
+	else
+	{
+		rx->M0AR = (u32) &spi_sink;
+		rx->CR &= ~DMA_SxCR_MINC;
+	}
+	if (transfer->tx != NULL)
+	{
+		tx->M0AR = (u32) transfer->tx;
+		tx->CR |= DMA_SxCR_MINC;
+	}
+	else
+	{
+		tx->M0AR = (u32) &spi_fill;
+		tx->CR &= ~DMA_SxCR_MINC;
+	}
+	rx->NDTR = transfer->len;
+	tx->NDTR = transfer->len;
+
+	// RX first, so that no received byte is missed
+	rx->CR |= DMA_SxCR_EN;
+	tx->CR |= DMA_SxCR_EN;
+}
+
+// Ends the transfer at the head of the queue and starts the next one
+static void spi_complete(spi_Bus *bus, u32 status)
+{
+	spi_Transfer *transfer = bus->head;
+
+	if (status != ERR_NONE)
+	{
+		dma_stop(&bus->rx_dma);
+		dma_stop(&bus->tx_dma);
+		// Drop what the aborted transfer left in the data register
+		(void) bus->regs->DR;
+		(void) bus->regs->SR;
+	}
+	transfer->status = status;
+
+	if (transfer->cs_hold == 0U)
+	{
+		spi_cs(transfer->device->cs_pin, 1U);
+		bus->cs_active = NULL;
+	}
+
+	bus->head = transfer->next;
+	if (bus->head == NULL)
+	{
+		bus->tail = NULL;
+	}
+
+	// Next one on the wire before the bookkeeping
+	spi_start(bus);
+
+	if (transfer->callback != NULL)
+	{
+		// Still busy until its callback has run
+		transfer->next = bus->done;
+		bus->done = transfer;
+		workq_post(&bus->work);
+	}
+	else
+	{
+		transfer->busy = 0U;
+	}
+}
+
+// RX completes last: the transfer is over when its stream is
+static void spi_rx_dma_irq(void *ctx)
+{
+	spi_Bus *bus = ctx;
+
+	u32 flags = dma_take(&bus->rx_dma);
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		spi_complete(bus, ERR_GENERIC);
+	}
+	else if ((flags & DMA_FLAG_TC) != 0U)
+	{
+		(void) dma_take(&bus->tx_dma);
+		spi_complete(bus, ERR_NONE);
+	}
+}
+
+static void spi_tx_dma_irq(void *ctx)
+{
+	spi_Bus *bus = ctx;
+
+	// Only errors are enabled; the RX side completes the transfer
+	if (((dma_take(&bus->tx_dma) & DMA_FLAG_TE) != 0U) && (bus->head != NULL))
+	{
+		spi_complete(bus, ERR_GENERIC);
+	}
+}
+
+static void spi_work(void *arg)
+{
+	spi_Bus *bus = arg;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	spi_Transfer *done = bus->done;
+	bus->done = NULL;
+	__set_PRIMASK(primask);
+
+	// Back to submission order
+	spi_Transfer *list = NULL;
+	while (done != NULL)
+	{
+		spi_Transfer *next = done->next;
+		done->next = list;
+		list = done;
+		done = next;
+	}
+
+	while (list != NULL)
+	{
+		spi_Transfer *next = list->next;
+		list->busy = 0U;
+		list->callback(list->arg, list);
+		list = next;
+	}
+}
+
+static void spi_clock_changed(void *arg, clock_Event event)
+{
+	spi_Bus *bus = arg;
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		bus->hold = 1U;
+		while ((bus->rx_dma.regs->CR & DMA_SxCR_EN) != 0U)
+		{
+		}
+	}
+	else
+	{
+		// Dividers are worked out again on the next use of each device
+		bus->epoch++;
+		bus->cr1 = 0U;
+		if (bus->cs_active != NULL)
+		{
+			spi_cs(bus->cs_active->cs_pin, 1U);
+			bus->cs_active = NULL;
+		}
+		bus->hold = 0U;
+		spi_start(bus);
+	}
+}
+
+u32 spi_bus_init(spi_Bus *bus, u32 instance, const spi_BusConfig *config)
+{
+	if ((bus == NULL) || (config == NULL) || (instance < 1U) || (instance > SPI_INSTANCES))
+	{
+		return ERR_GENERIC;
+	}
+
+	const spi_Hw *hw = &spi_hw[instance - 1U];
+
+	bus->regs = hw->regs;
+	bus->apb2 = hw->apb2;
+	bus->head = NULL;
+	bus->tail = NULL;
+	bus->done = NULL;
+	bus->hold = 0U;
+	bus->cr1 = 0U;
+	bus->epoch = 1U;
+	bus->cs_active = NULL;
+
+	if (workq_item_init(&bus->work, spi_work, bus, config->level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	if (hw->apb2 != 0U)
+	{
+		RCC->APB2ENR |= hw->enable;
+		(void) RCC->APB2ENR;
+	}
+	else
+	{
+		RCC->APB1ENR |= hw->enable;
+		(void) RCC->APB1ENR;
+	}
+
+	pin_af(config->sck_pin, hw->af, GPIO_NOPULL, PIN_PUSH_PULL);
+	pin_af(config->miso_pin, hw->af, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(config->mosi_pin, hw->af, GPIO_NOPULL, PIN_PUSH_PULL);
+
+	bus->regs->CR1 = 0U;
+	bus->regs->CR2 = SPI_CR2_RXDMAEN | SPI_CR2_TXDMAEN;
+
+	if ((dma_stream_init(&bus->rx_dma, hw->dma, hw->rx_stream,
+			spi_rx_dma_irq, bus, config->priority) != ERR_NONE)
+			|| (dma_stream_init(&bus->tx_dma, hw->dma, hw->tx_stream,
+			spi_tx_dma_irq, bus, config->priority) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_Stream_TypeDef *rx = bus->rx_dma.regs;
+	rx->PAR = (u32) &bus->regs->DR;
+	rx->CR = ((u32) hw->channel << DMA_CR_CHSEL_SHIFT)
+			| (SPI_DMA_PL_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_CR_DIR_P2M | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	DMA_Stream_TypeDef *tx = bus->tx_dma.regs;
+	tx->PAR = (u32) &bus->regs->DR;
+	tx->CR = ((u32) hw->channel << DMA_CR_CHSEL_SHIFT)
+			| (SPI_DMA_PL_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_CR_DIR_M2P | DMA_SxCR_TEIE;
+
+	clock_listen(&bus->clock, spi_clock_changed, bus);
+
+	return ERR_NONE;
+}
+
+u32 spi_device_init(spi_Device *device, spi_Bus *bus, u32 cs_pin, u32 max_hz, u32 mode)
+{
+	// Even /256 too fast for it
+	if ((device == NULL) || (bus == NULL) || (max_hz == 0U)
+			|| ((spi_pclk(bus) >> (SPI_BR_MAX + 1U)) > max_hz))
+	{
+		return ERR_GENERIC;
+	}
+
+	device->bus = bus;
+	device->cs_pin = cs_pin;
+	device->max_hz = max_hz;
+	device->mode = mode & (SPI_MODE_3 | SPI_LSB_FIRST);
+	device->cr1 = 0U;
+	device->epoch = 0U;
+
+	spi_cs(cs_pin, 1U);
+	pin_output(cs_pin, PIN_PUSH_PULL);
+
+	return ERR_NONE;
+}
+
+u32 spi_submit(spi_Transfer *transfer)
+{
+	if ((transfer == NULL) || (transfer->device == NULL)
+			|| (transfer->len == 0U) || (transfer->len > 0xFFFFU))
+	{
+		return ERR_GENERIC;
+	}
+
+	spi_Bus *bus = transfer->device->bus;
+
+	transfer->next = NULL;
+	transfer->busy = 1U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (bus->tail != NULL)
+	{
+		bus->tail->next = transfer;
+		bus->tail = transfer;
+	}
+	else
+	{
+		bus->head = transfer;
+		bus->tail = transfer;
+		spi_start(bus);
+	}
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+u32 spi_transfer(spi_Device *device, const u8 *tx, u8 *rx, u32 len)
+{
+	spi_Transfer transfer;
+	transfer.device = device;
+	transfer.tx = tx;
+	transfer.rx = rx;
+	transfer.len = len;
+	transfer.cs_hold = 0U;
+	transfer.callback = NULL;
+	transfer.arg = NULL;
+
+	if (spi_submit(&transfer) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	__disable_irq();
+	while (transfer.busy != 0U)
+	{
+		cpuload_idle();
+
+		__enable_irq();
+		__ISB();
+		__disable_irq();
+	}
+	__enable_irq();
+
+	return transfer.status;
+}
@@ -0,0 +1,148 @@
+/*
+ * stack.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <stack.h>
+
+#include "ktype.h"
+
+typedef struct stack_region
+{
+	u32 *begin;
+	u32 *end;
+	// First word scanned, above the guard if any
+	u32 *floor;
+	// Lowest word found overwritten
+	u32 *high_water;
+	// Next word to check
+	u32 *cursor;
+} stack_Region;
+
+// Main stack; defined in linker script
+extern u32 __carzos_main_stack_limit[];
+extern u32 __carzos_stack_end[];
+
+static stack_Region stack_regions[STACK_MAX];
+static u32 stack_count;
+
+
+static void stack_guard(u32 index, u32 *begin)
+{
+	MPU->RNR = index;
+	MPU->RBAR = (u32) begin;
+	// No access at any privilege, never executable; SIZE is log2(bytes) - 1
+	MPU->RASR = MPU_RASR_XN_Msk
+			| (0U << MPU_RASR_AP_Pos)
+			| ((u32) (__builtin_ctz(STACK_GUARD_SIZE) - 1) << MPU_RASR_SIZE_Pos)
+			| MPU_RASR_ENABLE_Msk;
+
+	// Everything outside the regions keeps the default memory map
+	MPU->CTRL = MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk;
+	SCB->SHCSR |= SCB_SHCSR_MEMFAULTENA_Msk;
+	__DSB();
+	__ISB();
+}
+
+void stack_init(void)
+{
+	stack_register(__carzos_main_stack_limit, __carzos_stack_end, 1U);
+}
+
+u32 stack_register(u32 *begin, u32 *end, u32 guard)
+{
+	if ((stack_count >= STACK_MAX) || (begin >= end))
+	{
+		return STACK_MAX;
+	}
+
+	if ((guard != 0U) && (((u32) begin & (STACK_GUARD_SIZE - 1U)) != 0U))
+	{
+		return STACK_MAX;
+	}
+
+	u32 index = stack_count;
+	stack_Region *region = &stack_regions[index];
+
+	// Leave the live part of the stack we are running on alone
+	u32 *top = end;
+	u32 *sp = (u32 *) __get_MSP();
+	if ((sp >= begin) && (sp < end))
+	{
+		top = sp;
+	}
+
+	for (u32 *p = begin; p < top; p++)
+	{
+		*p = STACK_PAINT;
+	}
+
+	region->begin = begin;
+	region->end = end;
+	region->floor = begin;
+	region->high_water = top;
+
+	if (guard != 0U)
+	{
+		// The guard words cannot be read any more
+		region->floor = begin + (STACK_GUARD_SIZE / sizeof(u32));
+		stack_guard(index, begin);
+	}
+	region->cursor = region->floor;
+
+	stack_count++;
+
+	return index;
+}
+
+void stack_scan(u32 words)
+{
+	for (u32 i = 0U; i < stack_count; i++)
+	{
+		stack_Region *region = &stack_regions[i];
+		u32 budget = words;
+
+		while (budget-- != 0U)
+		{
+			if (region->cursor >= region->high_water)
+			{
+				// Nothing deeper this pass
+				region->cursor = region->floor;
+				break;
+			}
+
+			if (*region->cursor != STACK_PAINT)
+			{
+				region->high_water = region->cursor;
+				region->cursor = region->floor;
+				break;
+			}
+
+			region->cursor++;
+		}
+	}
+}
+
+u32 stack_used(u32 index)
+{
+	if (index >= stack_count)
+	{
+		return 0U;
+	}
+
+	return (u32) stack_regions[index].end - (u32) stack_regions[index].high_water;
+}
+
+u32 stack_size(u32 index)
+{
+	if (index >= stack_count)
+	{
+		return 0U;
+	}
+
+	return (u32) stack_regions[index].end - (u32) stack_regions[index].begin;
+}
@@ -1,10 +1,13 @@
 #include <cortexm/exception_handlers.h>
 #include <timer.h>
+#include <cpuload.h>
+#include <stack.h>
+#include <sections.h>
 
 // ----------------------------------------------------------------------------
 
 #if defined(USE_HAL_DRIVER)
-void HAL_IncTick(void);
+#include "stm32f4xx_hal.h"
 #endif
 
 // Forward declarations.
@@ -15,25 +18,63 @@ void timer_tick (void);
 
 volatile timer_ticks_t timer_delayCount;
 
+volatile timer_ticks_t timer_ticks;
+
 // ----------------------------------------------------------------------------
 
+// Called once, by clock_init(), when the final core clock is set.
 void timer_start (void)
 {
   // Use SysTick as reference for the delay loops.
   SysTick_Config (SystemCoreClock / TIMER_FREQUENCY_HZ);
 }
 
+#if defined(USE_HAL_DRIVER)
+
+// The HAL timebase is the timer_ticks counter. HAL_Init() and
+// HAL_RCC_ClockConfig() call HAL_InitTick() to (re)program the SysTick;
+// it is programmed only by timer_start(), so there is nothing to do here.
+HAL_StatusTypeDef HAL_InitTick (uint32_t TickPriority __attribute__((unused)))
+{
+  return HAL_OK;
+}
+
+void HAL_IncTick (void)
+{
+}
+
+uint32_t HAL_GetTick (void)
+{
+  return timer_ticks;
+}
+
+#endif
+
 void timer_sleep (timer_ticks_t ticks)
 {
   timer_delayCount = ticks;
 
-  // Busy wait until the SysTick decrements the counter to zero.
+  // Sleep until the SysTick decrements the counter to zero. The counter
+  // is checked with interrupts masked, so the last tick cannot slip in
+  // between the check and the WFI.
+  __disable_irq ();
   while (timer_delayCount != 0u)
-    ;
+    {
+      cpuload_idle ();
+
+      // Let the interrupt that woke us run.
+      __enable_irq ();
+      __ISB ();
+      __disable_irq ();
+    }
+  __enable_irq ();
 }
 
-void timer_tick (void)
+void CARZOS_RAMFUNC
+timer_tick (void)
 {
+  timer_ticks++;
+
   // Decrement to zero the counter used by the delay routine.
   if (timer_delayCount != 0u)
     {
@@ -43,12 +84,12 @@ void timer_tick (void)
 
 // ----- SysTick_Handler() ----------------------------------------------------
 
-void SysTick_Handler (void)
+void CARZOS_RAMFUNC
+SysTick_Handler (void)
 {
-#if defined(USE_HAL_DRIVER)
-  HAL_IncTick();
-#endif
   timer_tick ();
+  cpuload_tick ();
+  stack_scan (STACK_SCAN_WORDS);
 }
 
 // ----------------------------------------------------------------------------
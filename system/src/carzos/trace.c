@@ -0,0 +1,319 @@
+/*
+ * trace.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stdarg.h>
+
+#include <dwt.h>
+#include <trace.h>
+#include <workq.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define TRACE_RING_MASK         (TRACE_RING_WORDS - 1U)
+
+// Free running word counts: reserved by the writers, consumed by the drain
+static volatile u32 trace_head;
+static volatile u32 trace_tail;
+static volatile u32 trace_lost;
+
+// Words not written since the drain consumed them are zero
+static u32 trace_ring[TRACE_RING_WORDS];
+
+static workq_Item trace_item;
+static u32 trace_ready;
+
+static void trace_drain(void *arg);
+
+static void trace_lose(void)
+{
+	do
+	{
+	} while (__STREXW(__LDREXW(&trace_lost) + 1U, &trace_lost) != 0U);
+}
+
+u32 trace_init(u32 level)
+{
+	if (workq_item_init(&trace_item, trace_drain, NULL, level) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	trace_ready = 1U;
+
+	return ERR_NONE;
+}
+
+void trace_write(const char *fmt, u32 nargs, ...)
+{
+	if (nargs > TRACE_ARGS_MAX)
+	{
+		nargs = TRACE_ARGS_MAX;
+	}
+	u32 words = TRACE_RECORD_WORDS(nargs);
+
+	// Reserve the words. A writer preempting this one takes the next
+	// ones and makes the STREX fail, so the loop retries, it never blocks.
+	u32 head;
+	do
+	{
+		head = __LDREXW(&trace_head);
+		if ((head + words - trace_tail) > TRACE_RING_WORDS)
+		{
+			__CLREX();
+			trace_lose();
+			return;
+		}
+	} while (__STREXW(head + words, &trace_head) != 0U);
+
+	trace_ring[(head + 1U) & TRACE_RING_MASK] = (u32) fmt;
+	trace_ring[(head + 2U) & TRACE_RING_MASK] = dwt_cycles();
+
+	va_list ap;
+	va_start(ap, nargs);
+	for (u32 i = 0U; i < nargs; i++)
+	{
+		trace_ring[(head + 3U + i) & TRACE_RING_MASK] = va_arg(ap, u32);
+	}
+	va_end(ap);
+
+	// The header last: the drain stops at a record still being written
+	__DMB();
+	trace_ring[head & TRACE_RING_MASK] = TRACE_HEADER_MAGIC | words;
+
+	if (trace_ready != 0U)
+	{
+		workq_post(&trace_item);
+	}
+}
+
+#if defined(TRACE_TEXT)
+
+// A line is put together in pieces this long, to keep the drain's stack
+// small: it runs as an interrupt, on the main stack
+#define TRACE_CHUNK             (32U)
+
+typedef struct trace_out
+{
+	char buf[TRACE_CHUNK];
+	u32 len;
+	u32 lost;                       // the sink did not take a chunk
+} trace_Out;
+
+static void trace_flush(trace_Out *out)
+{
+	if (trace_sink(out->buf, out->len) != out->len)
+	{
+		out->lost = 1U;
+	}
+	out->len = 0U;
+}
+
+static void trace_putc(trace_Out *out, char c)
+{
+	out->buf[out->len++] = c;
+	if (out->len == TRACE_CHUNK)
+	{
+		trace_flush(out);
+	}
+}
+
+// %d %i %u %x %X %o %c %s %p %%, with the '-' and '0' flags and a width;
+// length modifiers are skipped, every argument is a 32 bit word. Non zero
+// when the sink did not take it all.
+static u32 trace_format(const char *fmt, const u32 *args)
+{
+	trace_Out out;
+	out.len = 0U;
+	out.lost = 0U;
+	u32 next = 0U;
+
+	for (const char *f = fmt; *f != '\0'; f++)
+	{
+		if (*f != '%')
+		{
+			trace_putc(&out, *f);
+			continue;
+		}
+
+		u32 left = 0U;
+		char pad = ' ';
+		for (f++; (*f == '-') || (*f == '0'); f++)
+		{
+			if (*f == '-')
+			{
+				left = 1U;
+			}
+			else
+			{
+				pad = '0';
+			}
+		}
+		u32 width = 0U;
+		for (; (*f >= '0') && (*f <= '9'); f++)
+		{
+			width = (width * 10U) + (u32) (*f - '0');
+		}
+		while ((*f == 'l') || (*f == 'h') || (*f == 'z') || (*f == 't') || (*f == 'j'))
+		{
+			f++;
+		}
+		if (*f == '\0')
+		{
+			break;
+		}
+		if (*f == '%')
+		{
+			trace_putc(&out, '%');
+			continue;
+		}
+
+		u32 arg = (next < TRACE_ARGS_MAX) ? args[next] : 0U;
+		next++;
+
+		// The digits, backwards, or the string
+		char digits[12];
+		const char *text = digits;
+		u32 len = 0U;
+		u32 negative = 0U;
+		u32 base = 10U;
+		const char *set = "0123456789abcdef";
+
+		switch (*f)
+		{
+		case 'd':
+		case 'i':
+			if ((s32) arg < 0)
+			{
+				negative = 1U;
+				arg = (u32) -(s32) arg;
+			}
+			break;
+		case 'o':
+			base = 8U;
+			break;
+		case 'X':
+			set = "0123456789ABCDEF";
+			base = 16U;
+			break;
+		case 'x':
+		case 'p':
+			base = 16U;
+			break;
+		case 'c':
+			digits[0] = (char) arg;
+			len = 1U;
+			base = 0U;
+			break;
+		case 's':
+			text = (arg != 0U) ? (const char *) arg : "(null)";
+			while (text[len] != '\0')
+			{
+				len++;
+			}
+			base = 0U;
+			break;
+		default:
+			break;
+		}
+
+		if (base != 0U)
+		{
+			do
+			{
+				digits[len++] = set[arg % base];
+				arg /= base;
+			} while (arg != 0U);
+		}
+
+		u32 total = len + negative;
+		if ((negative != 0U) && (pad == '0'))
+		{
+			trace_putc(&out, '-');
+		}
+		for (u32 i = total; (left == 0U) && (i < width); i++)
+		{
+			trace_putc(&out, pad);
+		}
+		if ((negative != 0U) && (pad != '0'))
+		{
+			trace_putc(&out, '-');
+		}
+		for (u32 i = 0U; i < len; i++)
+		{
+			trace_putc(&out, (base != 0U) ? digits[len - 1U - i] : text[i]);
+		}
+		for (u32 i = total; (left != 0U) && (i < width); i++)
+		{
+			trace_putc(&out, ' ');
+		}
+	}
+
+	if (out.len != 0U)
+	{
+		trace_flush(&out);
+	}
+
+	return out.lost;
+}
+
+#endif // defined(TRACE_TEXT)
+
+static void trace_drain(void *arg)
+{
+	(void) arg;
+
+	u32 record[TRACE_RECORD_WORDS(TRACE_ARGS_MAX)];
+	u32 tail = trace_tail;
+
+	while (tail != trace_head)
+	{
+		u32 header = trace_ring[tail & TRACE_RING_MASK];
+		if ((header & ~0xFFFFU) != TRACE_HEADER_MAGIC)
+		{
+			// Its writer was preempted; it posts again when done
+			break;
+		}
+
+		u32 words = TRACE_HEADER_WORDS(header);
+		for (u32 i = 0U; i < words; i++)
+		{
+			record[i] = trace_ring[(tail + i) & TRACE_RING_MASK];
+			trace_ring[(tail + i) & TRACE_RING_MASK] = 0U;
+		}
+		tail += words;
+		__DMB();
+		trace_tail = tail;
+
+#if defined(TRACE_TEXT)
+		// Unused trailing arguments are ignored by the formatting
+		u32 *a = &record[3];
+		for (u32 i = words - 3U; i < TRACE_ARGS_MAX; i++)
+		{
+			a[i] = 0U;
+		}
+		u32 lost = trace_format((const char *) record[1], a);
+#else
+		u32 bytes = words * sizeof(u32);
+		u32 lost = (trace_sink(record, bytes) != bytes) ? 1U : 0U;
+#endif
+		if (lost != 0U)
+		{
+			trace_lose();
+		}
+	}
+}
+
+u32 trace_dropped(void)
+{
+	return trace_lost;
+}
+
+u32 __attribute__((weak)) trace_sink(const void *buf, u32 len)
+{
+	(void) buf;
+	return len;
+}
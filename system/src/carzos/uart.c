@@ -0,0 +1,511 @@
+/*
+ * uart.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <cpuload.h>
+#include <pin.h>
+#include <timer.h>
+#include <uart.h>
+
+#include "stm32f4xx_hal.h"
+
+#include "ktype.h"
+#include "kmem.h"
+
+#define UART_INSTANCES          (6U)
+#define UART_DMA_PL_HIGH        (2U)
+#define UART_DMA_PL_MEDIUM      (1U)
+
+typedef struct uart_hw
+{
+	USART_TypeDef *regs;
+	IRQn_Type irqn;
+	u32 apb2;
+	u32 enable;
+	u8 af;
+	u8 rx_dma;
+	u8 rx_stream;
+	u8 rx_channel;
+	u8 tx_dma;
+	u8 tx_stream;
+	u8 tx_channel;
+} uart_Hw;
+
+static const uart_Hw uart_hw[UART_INSTANCES] =
+{
+	{ USART1, USART1_IRQn, 1U, RCC_APB2ENR_USART1EN, GPIO_AF7_USART1, 2U, 2U, 4U, 2U, 7U, 4U },
+	{ USART2, USART2_IRQn, 0U, RCC_APB1ENR_USART2EN, GPIO_AF7_USART2, 1U, 5U, 4U, 1U, 6U, 4U },
+	{ USART3, USART3_IRQn, 0U, RCC_APB1ENR_USART3EN, GPIO_AF7_USART3, 1U, 1U, 4U, 1U, 3U, 4U },
+	{ UART4, UART4_IRQn, 0U, RCC_APB1ENR_UART4EN, GPIO_AF8_UART4, 1U, 2U, 4U, 1U, 4U, 4U },
+	{ UART5, UART5_IRQn, 0U, RCC_APB1ENR_UART5EN, GPIO_AF8_UART5, 1U, 0U, 4U, 1U, 7U, 4U },
+	{ USART6, USART6_IRQn, 1U, RCC_APB2ENR_USART6EN, GPIO_AF8_USART6, 2U, 1U, 5U, 2U, 6U, 5U },
+};
+
+
+static void uart_brr(uart_Port *port)
+{
+	// 16x oversampling: BRR is the clock over the baud rate, 4 bits fraction
+	u32 pclk = (port->apb2 != 0U) ? clock_pclk2() : clock_pclk1();
+	port->regs->BRR = (pclk + (port->baud / 2U)) / port->baud;
+}
+
+static void uart_signal(uart_Port *port, u32 events)
+{
+	do
+	{
+	} while (__STREXW(__LDREXW(&port->events) | events, &port->events) != 0U);
+
+	if (port->callback != NULL)
+	{
+		workq_post(&port->work);
+	}
+}
+
+static void uart_work(void *arg)
+{
+	uart_Port *port = arg;
+
+	u32 events;
+	do
+	{
+		events = __LDREXW(&port->events);
+	} while (__STREXW(0U, &port->events) != 0U);
+
+	if (events != 0U)
+	{
+		port->callback(port->arg, events);
+	}
+}
+
+// Accounts for what the RX stream wrote since the last call; from the port
+// interrupts or with them masked. Returns the new bytes.
+static u32 uart_rx_update(uart_Port *port)
+{
+	u32 pos = port->rx_size - port->rx_dma.regs->NDTR;
+	if (pos == port->rx_size)
+	{
+		pos = 0U;
+	}
+
+	// The half and full transfer interrupts make sure that this runs at
+	// least twice a lap, so the distance is not ambiguous
+	u32 delta = (pos + port->rx_size - port->rx_pos) % port->rx_size;
+	port->rx_pos = pos;
+	port->rx_in += delta;
+
+	u32 unread = port->rx_in - port->rx_out;
+	if (unread > port->rx_size)
+	{
+		port->rx_lost += unread - port->rx_size;
+		port->rx_out = port->rx_in - port->rx_size;
+	}
+
+	return delta;
+}
+
+// Starts the buffer at the head of the queue; TX stream stopped, port
+// interrupts masked.
+static void uart_tx_start(uart_Port *port)
+{
+	uart_Buffer *buffer = port->tx_head;
+	if ((buffer == NULL) || (port->tx_hold != 0U))
+	{
+		return;
+	}
+
+	DMA_Stream_TypeDef *stream = port->tx_dma.regs;
+	stream->M0AR = (u32) buffer->data;
+	stream->NDTR = buffer->len;
+	port->regs->SR = ~USART_SR_TC;
+	stream->CR |= DMA_SxCR_EN;
+}
+
+static void uart_irq(void *ctx)
+{
+	uart_Port *port = ctx;
+	u32 events = 0U;
+
+	// Reading SR then DR clears IDLE and the error flags
+	u32 sr = port->regs->SR;
+	if ((sr & (USART_SR_IDLE | USART_SR_ORE | USART_SR_FE | USART_SR_NE)) != 0U)
+	{
+		(void) port->regs->DR;
+	}
+
+	if ((sr & (USART_SR_ORE | USART_SR_FE | USART_SR_NE)) != 0U)
+	{
+		port->errors++;
+		events |= UART_EVENT_ERROR;
+	}
+
+	if (uart_rx_update(port) != 0U)
+	{
+		events |= UART_EVENT_RX;
+	}
+
+	if ((sr & USART_SR_IDLE) != 0U)
+	{
+		port->rx_frame_end = port->rx_in;
+		events |= UART_EVENT_FRAME;
+	}
+
+	if (events != 0U)
+	{
+		uart_signal(port, events);
+	}
+}
+
+static void uart_rx_dma_irq(void *ctx)
+{
+	uart_Port *port = ctx;
+	u32 events = 0U;
+
+	u32 flags = dma_take(&port->rx_dma);
+
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		// The stream stopped itself; carry on
+		port->errors++;
+		events |= UART_EVENT_ERROR;
+		port->rx_dma.regs->CR |= DMA_SxCR_EN;
+	}
+
+	if (uart_rx_update(port) != 0U)
+	{
+		events |= UART_EVENT_RX;
+	}
+
+	if (events != 0U)
+	{
+		uart_signal(port, events);
+	}
+}
+
+static void uart_tx_dma_irq(void *ctx)
+{
+	uart_Port *port = ctx;
+
+	u32 flags = dma_take(&port->tx_dma);
+	if ((flags & (DMA_FLAG_TC | DMA_FLAG_TE)) == 0U)
+	{
+		return;
+	}
+
+	uart_Buffer *buffer = port->tx_head;
+	port->tx_head = buffer->next;
+	if (port->tx_head == NULL)
+	{
+		port->tx_tail = NULL;
+	}
+	buffer->busy = 0U;
+
+	// Next one out before anything else
+	uart_tx_start(port);
+
+	u32 events = UART_EVENT_TX;
+	if ((flags & DMA_FLAG_TE) != 0U)
+	{
+		port->errors++;
+		events |= UART_EVENT_ERROR;
+	}
+	uart_signal(port, events);
+}
+
+// Lets the buffer in flight finish before the clock changes, and sets the
+// baud rate again after.
+static void uart_clock_changed(void *arg, clock_Event event)
+{
+	uart_Port *port = arg;
+
+	if (event == CLOCK_EVENT_PRE)
+	{
+		port->tx_hold = 1U;
+		while ((port->tx_dma.regs->CR & DMA_SxCR_EN) != 0U)
+		{
+		}
+		while ((port->regs->SR & USART_SR_TC) == 0U)
+		{
+		}
+	}
+	else
+	{
+		uart_brr(port);
+		port->tx_hold = 0U;
+		uart_tx_start(port);
+	}
+}
+
+u32 uart_init(uart_Port *port, u32 instance, const uart_Config *config)
+{
+	if ((port == NULL) || (config == NULL) || (instance < 1U) || (instance > UART_INSTANCES)
+			|| (config->baud == 0U) || (config->rx_buf == NULL)
+			|| (config->rx_size == 0U) || (config->rx_size > 0xFFFFU))
+	{
+		return ERR_GENERIC;
+	}
+
+	const uart_Hw *hw = &uart_hw[instance - 1U];
+
+	port->regs = hw->regs;
+	port->baud = config->baud;
+	port->apb2 = hw->apb2;
+	port->rx_buf = config->rx_buf;
+	port->rx_size = config->rx_size;
+	port->rx_pos = 0U;
+	port->rx_in = 0U;
+	port->rx_out = 0U;
+	port->rx_frame_end = 0U;
+	port->rx_lost = 0U;
+	port->errors = 0U;
+	port->tx_head = NULL;
+	port->tx_tail = NULL;
+	port->tx_hold = 0U;
+	port->events = 0U;
+	port->callback = config->callback;
+	port->arg = config->arg;
+
+	if (port->callback != NULL)
+	{
+		if (workq_item_init(&port->work, uart_work, port, config->level) != ERR_NONE)
+		{
+			return ERR_GENERIC;
+		}
+	}
+
+	if (hw->apb2 != 0U)
+	{
+		RCC->APB2ENR |= hw->enable;
+		(void) RCC->APB2ENR;
+	}
+	else
+	{
+		RCC->APB1ENR |= hw->enable;
+		(void) RCC->APB1ENR;
+	}
+
+	pin_af(config->tx_pin, hw->af, GPIO_PULLUP, PIN_PUSH_PULL);
+	pin_af(config->rx_pin, hw->af, GPIO_PULLUP, PIN_PUSH_PULL);
+
+	USART_TypeDef *regs = port->regs;
+	regs->CR1 = 0U;
+	regs->CR2 = 0U;
+	regs->CR3 = USART_CR3_DMAR | USART_CR3_DMAT | USART_CR3_EIE;
+	uart_brr(port);
+
+	if ((dma_stream_init(&port->rx_dma, hw->rx_dma, hw->rx_stream,
+			uart_rx_dma_irq, port, config->priority) != ERR_NONE)
+			|| (dma_stream_init(&port->tx_dma, hw->tx_dma, hw->tx_stream,
+			uart_tx_dma_irq, port, config->priority) != ERR_NONE))
+	{
+		return ERR_GENERIC;
+	}
+
+	DMA_Stream_TypeDef *rx = port->rx_dma.regs;
+	rx->PAR = (u32) &regs->DR;
+	rx->M0AR = (u32) port->rx_buf;
+	rx->NDTR = port->rx_size;
+	rx->CR = ((u32) hw->rx_channel << DMA_CR_CHSEL_SHIFT)
+			| (UART_DMA_PL_HIGH << DMA_CR_PL_SHIFT)
+			| DMA_SxCR_MINC | DMA_SxCR_CIRC | DMA_CR_DIR_P2M
+			| DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+	rx->CR |= DMA_SxCR_EN;
+
+	DMA_Stream_TypeDef *tx = port->tx_dma.regs;
+	tx->PAR = (u32) &regs->DR;
+	tx->CR = ((u32) hw->tx_channel << DMA_CR_CHSEL_SHIFT)
+			| (UART_DMA_PL_MEDIUM << DMA_CR_PL_SHIFT)
+			| DMA_SxCR_MINC | DMA_CR_DIR_M2P
+			| DMA_SxCR_TCIE | DMA_SxCR_TEIE;
+
+	if (irq_attach(hw->irqn, uart_irq, port) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+	NVIC_SetPriority(hw->irqn, config->priority);
+	NVIC_EnableIRQ(hw->irqn);
+
+	clock_listen(&port->clock, uart_clock_changed, port);
+
+	regs->CR1 = USART_CR1_UE | USART_CR1_TE | USART_CR1_RE | USART_CR1_IDLEIE;
+
+	return ERR_NONE;
+}
+
+u32 uart_available(uart_Port *port)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	uart_rx_update(port);
+	u32 n = port->rx_in - port->rx_out;
+	__set_PRIMASK(primask);
+
+	return n;
+}
+
+u32 uart_read_some(uart_Port *port, u8 *buf, u32 len)
+{
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+	uart_rx_update(port);
+	u32 start = port->rx_out;
+	u32 n = port->rx_in - start;
+	__set_PRIMASK(primask);
+
+	if (n > len)
+	{
+		n = len;
+	}
+
+	// At most two pieces, before and after the end of the ring
+	u32 at = start % port->rx_size;
+	u32 first = port->rx_size - at;
+	if (first > n)
+	{
+		first = n;
+	}
+	for (u32 i = 0U; i < first; i++)
+	{
+		buf[i] = port->rx_buf[at + i];
+	}
+	for (u32 i = first; i < n; i++)
+	{
+		buf[i] = port->rx_buf[i - first];
+	}
+
+	// The DMA may have come round and written over the start of what was
+	// copied; uart_rx_update() then moves rx_out past it (counted as
+	// lost). Only the bytes after that are kept.
+	primask = __get_PRIMASK();
+	__disable_irq();
+	uart_rx_update(port);
+	u32 drop = port->rx_out - start;
+	if (drop < n)
+	{
+		port->rx_out = start + n;
+	}
+	__set_PRIMASK(primask);
+
+	if (drop >= n)
+	{
+		return 0U;
+	}
+	if (drop != 0U)
+	{
+		n -= drop;
+		for (u32 i = 0U; i < n; i++)
+		{
+			buf[i] = buf[drop + i];
+		}
+	}
+
+	return n;
+}
+
+u32 uart_read(uart_Port *port, u8 *buf, u32 len, u32 timeout_ms)
+{
+	u32 start = timer_ticks;
+	u32 got = 0U;
+
+	while (1)
+	{
+		got += uart_read_some(port, &buf[got], len - got);
+
+		// Done when full, or when read up to where the line went idle
+		if ((got == len)
+				|| ((got != 0U) && (port->rx_out == port->rx_frame_end)))
+		{
+			break;
+		}
+
+		if ((timeout_ms != UART_FOREVER) && ((timer_ticks - start) >= timeout_ms))
+		{
+			break;
+		}
+
+		// The RX interrupts, or the tick, wake us
+		__disable_irq();
+		if (uart_available(port) == 0U)
+		{
+			cpuload_idle();
+		}
+		__enable_irq();
+		__ISB();
+	}
+
+	return got;
+}
+
+u32 uart_write_async(uart_Port *port, uart_Buffer *buffer)
+{
+	if ((buffer == NULL) || (buffer->len > 0xFFFFU))
+	{
+		return ERR_GENERIC;
+	}
+
+	buffer->next = NULL;
+	if (buffer->len == 0U)
+	{
+		buffer->busy = 0U;
+		return ERR_NONE;
+	}
+	buffer->busy = 1U;
+
+	u32 primask = __get_PRIMASK();
+	__disable_irq();
+
+	if (port->tx_tail != NULL)
+	{
+		port->tx_tail->next = buffer;
+		port->tx_tail = buffer;
+	}
+	else
+	{
+		port->tx_head = buffer;
+		port->tx_tail = buffer;
+		uart_tx_start(port);
+	}
+
+	__set_PRIMASK(primask);
+
+	return ERR_NONE;
+}
+
+u32 uart_write(uart_Port *port, const u8 *data, u32 len)
+{
+	uart_Buffer buffer;
+	buffer.data = data;
+	buffer.len = len;
+
+	if (uart_write_async(port, &buffer) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	__disable_irq();
+	while (buffer.busy != 0U)
+	{
+		cpuload_idle();
+
+		__enable_irq();
+		__ISB();
+		__disable_irq();
+	}
+	__enable_irq();
+
+	return ERR_NONE;
+}
+
+u32 uart_lost(const uart_Port *port)
+{
+	return port->rx_lost;
+}
+
+u32 uart_errors(const uart_Port *port)
+{
+	return port->errors;
+}
@@ -0,0 +1,130 @@
+/*
+ * workq.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+#include <stddef.h>
+
+#include <cpuload.h>
+#include <irq.h>
+#include <sections.h>
+#include <workq.h>
+
+#include "ktype.h"
+#include "kmem.h"
+
+typedef struct workq_level
+{
+	// LIFO of posted items, pushed by workq_post() and taken by the drain
+	workq_Item *volatile head;
+	IRQn_Type irqn;
+} workq_Level;
+
+// Hit by every post and drain, so kept in CCM RAM
+static workq_Level workq_levels[WORKQ_LEVELS] CARZOS_CCMRAM =
+{
+	{ NULL, WORKQ_LEVEL0_IRQn },
+	{ NULL, WORKQ_LEVEL1_IRQn },
+	{ NULL, WORKQ_LEVEL2_IRQn },
+};
+
+static void workq_drain(void *ctx);
+
+u32 workq_init(u32 level, u32 priority)
+{
+	if (level >= WORKQ_LEVELS)
+	{
+		return ERR_GENERIC;
+	}
+
+	IRQn_Type irqn = workq_levels[level].irqn;
+
+	if (irq_attach(irqn, workq_drain, &workq_levels[level]) != ERR_NONE)
+	{
+		return ERR_GENERIC;
+	}
+
+	NVIC_SetPriority(irqn, priority);
+	NVIC_EnableIRQ(irqn);
+
+	return ERR_NONE;
+}
+
+u32 workq_item_init(workq_Item *item, workq_Fn fn, void *arg, u32 level)
+{
+	if ((item == NULL) || (fn == NULL) || (level >= WORKQ_LEVELS))
+	{
+		return ERR_GENERIC;
+	}
+
+	item->fn = fn;
+	item->arg = arg;
+	item->next = NULL;
+	item->pending = 0U;
+	item->level = level;
+
+	return ERR_NONE;
+}
+
+CARZOS_RAMFUNC u32 workq_post(workq_Item *item)
+{
+	// Claim the item. If it is already pending the work will run anyway,
+	// so the post is coalesced into that run.
+	do
+	{
+		if (__LDREXW(&item->pending) != 0U)
+		{
+			__CLREX();
+			return ERR_NONE;
+		}
+	} while (__STREXW(1U, &item->pending) != 0U);
+
+	// Push onto the level. A preempting post only makes the STREX fail
+	// and the loop retry, it never blocks.
+	workq_Level *level = &workq_levels[item->level];
+	do
+	{
+		item->next = (workq_Item *) __LDREXW((volatile u32 *) &level->head);
+	} while (__STREXW((u32) item, (volatile u32 *) &level->head) != 0U);
+
+	NVIC_SetPendingIRQ(level->irqn);
+
+	return ERR_NONE;
+}
+
+CARZOS_RAMFUNC static void workq_drain(void *ctx)
+{
+	workq_Level *level = (workq_Level *) ctx;
+	u32 interrupted = cpuload_switch(CPULOAD_CTX_WORKQ(level - workq_levels));
+
+	// Take the whole list in one go, new posts start a fresh one
+	workq_Item *list;
+	do
+	{
+		list = (workq_Item *) __LDREXW((volatile u32 *) &level->head);
+	} while (__STREXW(0U, (volatile u32 *) &level->head) != 0U);
+
+	// Reverse into posting order
+	workq_Item *fifo = NULL;
+	while (list != NULL)
+	{
+		workq_Item *next = list->next;
+		list->next = fifo;
+		fifo = list;
+		list = next;
+	}
+
+	while (fifo != NULL)
+	{
+		workq_Item *item = fifo;
+		fifo = item->next;
+
+		// Release before running, a post from now on must run it again
+		item->pending = 0U;
+		item->fn(item->arg);
+	}
+
+	cpuload_switch(interrupted);
+}
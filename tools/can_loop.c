@@ -0,0 +1,433 @@
+/*
+ * can_loop.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for can.c: the can.h interface on Linux, with the
+// instances on one simulated bus, so that code using it can be checked
+// without a board.
+//
+// Nothing moves on its own: can_loop_bus() plays the bus, sending the
+// queued frames of all instances in arbitration order (the lowest TIR
+// value first, as on the wire) until none is left, and returns how many
+// went. A frame reaches every other initialised instance in
+// CAN_BUS_NORMAL, and only its own instance in CAN_BUS_LOOPBACK, as
+// with LBKM and SILM on the target. A frame nobody else is there to
+// acknowledge stays queued, as it would be retried on the target.
+//
+// The filters take the same room in the banks as in the hardware, so
+// can_filter_add() fails at the same point, and match the same frames:
+// exact IDs take data frames only. Receiving rings and overruns work as
+// in the driver; the callbacks run from can_loop_bus() after the frames
+// are in.
+//
+//   $ cc -I system/include/carzos -DCAN_LOOP_DEMO -o can_demo tools/can_loop.c
+//   $ ./can_demo
+
+#include <stdio.h>
+#include <string.h>
+
+#include <can.h>
+
+#define CAN_LOOP_STD_LIST       (0U)
+#define CAN_LOOP_STD_MASK       (1U)
+#define CAN_LOOP_EXT_LIST       (2U)
+#define CAN_LOOP_EXT_MASK       (3U)
+
+typedef struct can_loop_bank
+{
+  uint32_t kind;
+  uint32_t fifo;
+  uint32_t used;
+  uint32_t id[4];
+  uint32_t mask[4];
+} can_loop_Bank;
+
+typedef struct can_loop_port
+{
+  uint32_t ready;
+  uint32_t mode;
+  can_Frame *ring;
+  uint32_t ring_mask;
+  uint32_t head;
+  uint32_t tail;
+  uint32_t overruns;
+  uint32_t received;
+
+  // Sorted by falling key, the next to send last
+  can_Frame txq[CAN_TX_QUEUE];
+  uint32_t txq_key[CAN_TX_QUEUE];
+  uint32_t txq_len;
+
+  can_loop_Bank banks[CAN_BANKS];
+  uint32_t nbanks;
+
+  can_Callback callback;
+  void *arg;
+} can_loop_Port;
+
+static can_loop_Port can_loop_ports[CAN_INSTANCES];
+
+static const uint32_t can_loop_slots[4] = { 4U, 2U, 2U, 1U };
+
+// Not in can.h: only host tests drive the bus
+uint32_t can_loop_bus(void);
+
+
+static can_loop_Port *can_loop_port(uint32_t instance)
+{
+  if ((instance < 1U) || (instance > CAN_INSTANCES)
+      || (can_loop_ports[instance - 1U].ready == 0U))
+    {
+      return NULL;
+    }
+  return &can_loop_ports[instance - 1U];
+}
+
+// The TIR value of the frame: the lower wins the arbitration
+static uint32_t can_loop_key(const can_Frame *frame)
+{
+  uint32_t rtr = (frame->rtr != 0U) ? 0x2U : 0U;
+
+  if ((frame->id & CAN_EXT_ID) != 0U)
+    {
+      return ((frame->id & CAN_EXT_ID_MAX) << 3) | 0x4U | rtr;
+    }
+  return (frame->id << 21) | rtr;
+}
+
+uint32_t can_init(uint32_t instance, const can_Config *config)
+{
+  if ((instance < 1U) || (instance > CAN_INSTANCES) || (config == NULL)
+      || (config->ring == NULL) || (config->ring_len == 0U)
+      || ((config->ring_len & (config->ring_len - 1U)) != 0U)
+      || (config->bitrate == 0U) || (config->mode > CAN_BUS_LOOPBACK))
+    {
+      return 1U;
+    }
+
+  can_loop_Port *port = &can_loop_ports[instance - 1U];
+  memset(port, 0, sizeof(*port));
+  port->mode = config->mode;
+  port->ring = config->ring;
+  port->ring_mask = config->ring_len - 1U;
+  port->callback = config->callback;
+  port->arg = config->arg;
+  port->ready = 1U;
+
+  return 0U;
+}
+
+uint32_t can_filter_add(uint32_t instance, uint32_t id, uint32_t mask,
+                        uint32_t fifo)
+{
+  can_loop_Port *port = can_loop_port(instance);
+  uint32_t ext = id & CAN_EXT_ID;
+  uint32_t max = (ext != 0U) ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX;
+  uint32_t raw = id & ~CAN_EXT_ID;
+
+  if ((port == NULL) || (raw > max) || (fifo > 1U))
+    {
+      return 1U;
+    }
+  mask &= max;
+
+  uint32_t kind = (ext != 0U) ? CAN_LOOP_EXT_LIST : CAN_LOOP_STD_LIST;
+  if (mask != max)
+    {
+      kind++;
+    }
+
+  uint32_t index = 0U;
+  while ((index < port->nbanks)
+         && ((port->banks[index].kind != kind)
+             || (port->banks[index].fifo != fifo)
+             || (port->banks[index].used >= can_loop_slots[kind])))
+    {
+      index++;
+    }
+
+  can_loop_Bank *bank = &port->banks[index];
+  if (index == port->nbanks)
+    {
+      if (port->nbanks == CAN_BANKS)
+        {
+          return 1U;
+        }
+      port->nbanks++;
+      bank->kind = kind;
+      bank->fifo = fifo;
+      bank->used = 0U;
+    }
+
+  bank->id[bank->used] = id;
+  bank->mask[bank->used] = mask;
+  bank->used++;
+
+  return 0U;
+}
+
+static int can_loop_accepts(const can_loop_Port *port, const can_Frame *frame)
+{
+  if (port->nbanks == 0U)
+    {
+      return 1;
+    }
+
+  uint32_t ext = frame->id & CAN_EXT_ID;
+  for (uint32_t b = 0U; b < port->nbanks; b++)
+    {
+      const can_loop_Bank *bank = &port->banks[b];
+      uint32_t list = ((bank->kind == CAN_LOOP_STD_LIST)
+                       || (bank->kind == CAN_LOOP_EXT_LIST));
+
+      for (uint32_t i = 0U; i < bank->used; i++)
+        {
+          if (((bank->id[i] & CAN_EXT_ID) != ext)
+              || (list && (frame->rtr != 0U)))
+            {
+              continue;
+            }
+          if (((bank->id[i] ^ frame->id) & bank->mask[i]) == 0U)
+            {
+              return 1;
+            }
+        }
+    }
+  return 0;
+}
+
+static void can_loop_deliver(can_loop_Port *port, const can_Frame *frame)
+{
+  if (!can_loop_accepts(port, frame))
+    {
+      return;
+    }
+  if ((port->head - port->tail) > port->ring_mask)
+    {
+      port->overruns++;
+      return;
+    }
+  port->ring[port->head & port->ring_mask] = *frame;
+  port->head++;
+  port->received = 1U;
+}
+
+uint32_t can_send(uint32_t instance, const can_Frame *frame)
+{
+  can_loop_Port *port = can_loop_port(instance);
+
+  if ((port == NULL) || (frame == NULL) || (frame->len > 8U)
+      || ((frame->id & ~CAN_EXT_ID)
+          > (((frame->id & CAN_EXT_ID) != 0U)
+             ? CAN_EXT_ID_MAX : CAN_STD_ID_MAX))
+      || (port->txq_len >= CAN_TX_QUEUE))
+    {
+      return 1U;
+    }
+
+  // Equal keys keep their order
+  uint32_t key = can_loop_key(frame);
+  uint32_t i = port->txq_len;
+  while ((i > 0U) && (port->txq_key[i - 1U] <= key))
+    {
+      port->txq[i] = port->txq[i - 1U];
+      port->txq_key[i] = port->txq_key[i - 1U];
+      i--;
+    }
+  port->txq[i] = *frame;
+  port->txq_key[i] = key;
+  port->txq_len++;
+
+  return 0U;
+}
+
+uint32_t can_receive(uint32_t instance, can_Frame *frame)
+{
+  can_loop_Port *port = can_loop_port(instance);
+
+  if ((port == NULL) || (frame == NULL) || (port->tail == port->head))
+    {
+      return 1U;
+    }
+  *frame = port->ring[port->tail & port->ring_mask];
+  port->tail++;
+
+  return 0U;
+}
+
+uint32_t can_overruns(uint32_t instance)
+{
+  can_loop_Port *port = can_loop_port(instance);
+  return (port != NULL) ? port->overruns : 0U;
+}
+
+// Whether anyone acknowledges what 'sender' sends
+static int can_loop_heard(uint32_t sender)
+{
+  if (can_loop_ports[sender].mode == CAN_BUS_LOOPBACK)
+    {
+      return 1;
+    }
+  for (uint32_t n = 0U; n < CAN_INSTANCES; n++)
+    {
+      if ((n != sender) && (can_loop_ports[n].ready != 0U)
+          && (can_loop_ports[n].mode == CAN_BUS_NORMAL))
+        {
+          return 1;
+        }
+    }
+  return 0;
+}
+
+uint32_t can_loop_bus(void)
+{
+  uint32_t sent = 0U;
+
+  for (;;)
+    {
+      // Arbitration between the heads of the queues
+      uint32_t winner = CAN_INSTANCES;
+      for (uint32_t n = 0U; n < CAN_INSTANCES; n++)
+        {
+          can_loop_Port *port = &can_loop_ports[n];
+          if ((port->ready == 0U) || (port->txq_len == 0U)
+              || !can_loop_heard(n))
+            {
+              continue;
+            }
+          if ((winner == CAN_INSTANCES)
+              || (port->txq_key[port->txq_len - 1U]
+                  < can_loop_ports[winner].txq_key[can_loop_ports[winner].txq_len - 1U]))
+            {
+              winner = n;
+            }
+        }
+      if (winner == CAN_INSTANCES)
+        {
+          break;
+        }
+
+      can_loop_Port *tx = &can_loop_ports[winner];
+      tx->txq_len--;
+      const can_Frame *frame = &tx->txq[tx->txq_len];
+
+      if (tx->mode == CAN_BUS_LOOPBACK)
+        {
+          can_loop_deliver(tx, frame);
+        }
+      else
+        {
+          for (uint32_t n = 0U; n < CAN_INSTANCES; n++)
+            {
+              can_loop_Port *rx = &can_loop_ports[n];
+              if ((n != winner) && (rx->ready != 0U)
+                  && (rx->mode == CAN_BUS_NORMAL))
+                {
+                  can_loop_deliver(rx, frame);
+                }
+            }
+        }
+      sent++;
+    }
+
+  for (uint32_t n = 0U; n < CAN_INSTANCES; n++)
+    {
+      can_loop_Port *port = &can_loop_ports[n];
+      if (port->received != 0U)
+        {
+          port->received = 0U;
+          if (port->callback != NULL)
+            {
+              port->callback(port->arg, n + 1U);
+            }
+        }
+    }
+
+  return sent;
+}
+
+#if defined(CAN_LOOP_DEMO)
+
+static void can_loop_show(void *arg, uint32_t instance)
+{
+  can_Frame frame;
+
+  (void) arg;
+  while (can_receive(instance, &frame) == 0U)
+    {
+      printf("can%u: %s%08X%s [%u]", instance,
+             ((frame.id & CAN_EXT_ID) != 0U) ? "x" : " ",
+             frame.id & ~CAN_EXT_ID, (frame.rtr != 0U) ? " rtr" : "    ",
+             frame.len);
+      for (uint32_t i = 0U; i < frame.len; i++)
+        {
+          printf(" %02X", frame.data[i]);
+        }
+      printf("\n");
+    }
+}
+
+int main(void)
+{
+  static can_Frame ring1[8];
+  static can_Frame ring2[4];
+
+  can_Config config =
+    {
+      .mode = CAN_BUS_NORMAL,
+      .bitrate = 500000U,
+      .ring = ring1,
+      .ring_len = 8U,
+      .callback = can_loop_show,
+    };
+  can_init(1U, &config);
+  config.ring = ring2;
+  config.ring_len = 4U;
+  can_init(2U, &config);
+
+  // CAN2 takes 0x100 to 0x10F, 0x200 and one extended ID
+  can_filter_add(2U, 0x100U, 0x7F0U, 0U);
+  can_filter_add(2U, 0x200U, CAN_STD_ID_MAX, 1U);
+  can_filter_add(2U, CAN_EXT_ID | 0x18DAF110U, CAN_EXT_ID_MAX, 0U);
+
+  // Queued low priority first; they go out by ID. The ring of CAN2 holds
+  // four, so the extended frame, last by priority, is an overrun.
+  static const uint32_t ids[] =
+    {
+      0x300U, 0x10FU, CAN_EXT_ID | 0x18DAF110U, 0x200U, 0x101U, 0x100U,
+    };
+  for (uint32_t i = 0U; i < (sizeof(ids) / sizeof(ids[0])); i++)
+    {
+      can_Frame frame = { .id = ids[i], .len = 2U, .data = { 0xCA, (uint8_t) i } };
+      can_send(1U, &frame);
+    }
+  can_Frame remote = { .id = 0x200U, .rtr = 1U };
+  can_send(1U, &remote);
+
+  printf("%u frames on the bus\n", can_loop_bus());
+  printf("can2: %u overruns\n", can_overruns(2U));
+
+  // Loopback: CAN1 hears itself, CAN2 nothing
+  config.mode = CAN_BUS_LOOPBACK;
+  config.ring = ring1;
+  config.ring_len = 8U;
+  can_init(1U, &config);
+  can_Frame self = { .id = 0x7FFU, .len = 1U, .data = { 0x55 } };
+  can_send(1U, &self);
+  printf("%u frames on the bus\n", can_loop_bus());
+
+  // 14 banks of 4 exact IDs, then no more room
+  uint32_t added = 0U;
+  while (can_filter_add(1U, 0x400U + added, CAN_STD_ID_MAX, 0U) == 0U)
+    {
+      added++;
+    }
+  printf("can1: %u exact standard filters fit\n", added);
+
+  return 0;
+}
+
+#endif // defined(CAN_LOOP_DEMO)
@@ -0,0 +1,188 @@
+#!/usr/bin/env python3
+#
+# crashdump.py
+#
+#  Created on: Oct 19, 2026
+#      Author: ci
+#
+# Decodes the fault_Record left in .noinit by fault.c, against the ELF
+# that was running.
+#
+# The dump is a raw memory image read with the debugger, either of the
+# record alone or of the whole SRAM1 (the record is then found through the
+# fault_record symbol):
+#
+#   (gdb) dump binary memory ram.bin 0x20000000 0x2001C000
+#   $ tools/crashdump.py firmware.elf ram.bin --base 0x20000000
+#
+#   > dump_image fault.bin <address of fault_record> 116     (OpenOCD)
+#   $ tools/crashdump.py firmware.elf fault.bin
+#
+# Addresses are resolved with arm-none-eabi-addr2line; set CROSS to use
+# another toolchain prefix.
+
+import argparse
+import os
+import struct
+import subprocess
+import sys
+
+FAULT_MAGIC = 0x46415554
+FAULT_WALK_DEPTH = 8
+
+# fault_Record, see fault.h
+FIELDS = ["magic", "count", "type",
+          "r0", "r1", "r2", "r3", "r12", "lr", "pc", "psr",
+          "exc_return", "sp", "cfsr", "hfsr", "mmfar", "bfar",
+          "context", "ticks", "depth"]
+RECORD_WORDS = len(FIELDS) + FAULT_WALK_DEPTH + 1
+
+TYPES = {3: "HardFault", 4: "MemManage", 5: "BusFault", 6: "UsageFault"}
+
+CFSR_BITS = [
+    (0, "IACCVIOL", "instruction access violation"),
+    (1, "DACCVIOL", "data access violation"),
+    (3, "MUNSTKERR", "MemManage fault on unstacking"),
+    (4, "MSTKERR", "MemManage fault on stacking (stack overflow?)"),
+    (5, "MLSPERR", "MemManage fault on FP lazy state preservation"),
+    (7, "MMARVALID", "MMFAR holds the address"),
+    (8, "IBUSERR", "instruction bus error"),
+    (9, "PRECISERR", "precise data bus error"),
+    (10, "IMPRECISERR", "imprecise data bus error"),
+    (11, "UNSTKERR", "BusFault on unstacking"),
+    (12, "STKERR", "BusFault on stacking"),
+    (13, "LSPERR", "BusFault on FP lazy state preservation"),
+    (15, "BFARVALID", "BFAR holds the address"),
+    (16, "UNDEFINSTR", "undefined instruction"),
+    (17, "INVSTATE", "invalid state (Thumb bit clear?)"),
+    (18, "INVPC", "invalid EXC_RETURN on PC load"),
+    (19, "NOCP", "no coprocessor (FPU off?)"),
+    (24, "UNALIGNED", "unaligned access"),
+    (25, "DIVBYZERO", "divide by zero"),
+]
+
+HFSR_BITS = [
+    (1, "VECTTBL", "vector table read fault"),
+    (30, "FORCED", "escalated from a configurable fault"),
+    (31, "DEBUGEVT", "debug event"),
+]
+
+
+def tool(name):
+    return os.environ.get("CROSS", "arm-none-eabi-") + name
+
+
+def symbol_address(elf, name):
+    out = subprocess.run([tool("nm"), elf], check=True,
+                         capture_output=True, text=True).stdout
+    for line in out.splitlines():
+        parts = line.split()
+        if len(parts) == 3 and parts[2] == name:
+            return int(parts[0], 16)
+    return None
+
+
+def addr2line(elf, addresses):
+    if not addresses:
+        return {}
+    args = [tool("addr2line"), "-f", "-C", "-p", "-e", elf]
+    args += ["0x%08x" % (a & ~1) for a in addresses]
+    try:
+        out = subprocess.run(args, check=True,
+                             capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as e:
+        print("warning: no symbols (%s)" % e)
+        return {}
+    return dict(zip(addresses, out.splitlines()))
+
+
+def bits(value, table):
+    return [(name, text) for bit, name, text in table if value & (1 << bit)]
+
+
+def context_name(context):
+    if context == 0:
+        return "main"
+    return "workq level %d" % (context - 1)
+
+
+def decode(elf, data):
+    words = struct.unpack("<%dI" % RECORD_WORDS, data[:RECORD_WORDS * 4])
+    record = dict(zip(FIELDS, words))
+    walk = list(words[len(FIELDS):len(FIELDS) + FAULT_WALK_DEPTH])
+    check = words[-1]
+
+    if record["magic"] != FAULT_MAGIC:
+        sys.exit("no fault record (magic 0x%08x)" % record["magic"])
+    if (~sum(words[:-1])) & 0xFFFFFFFF != check:
+        print("warning: checksum mismatch, the record may be partial")
+
+    walk = walk[:min(record["depth"], FAULT_WALK_DEPTH)]
+    where = addr2line(elf, [record["pc"], record["lr"]] + walk)
+
+    print("%s (fault #%d in a row), %d ms after boot"
+          % (TYPES.get(record["type"], "type %d" % record["type"]),
+             record["count"], record["ticks"]))
+
+    ipsr = record["psr"] & 0x1FF
+    if ipsr == 0:
+        running = context_name(record["context"])
+    elif ipsr >= 16:
+        running = "IRQ %d, over %s" % (ipsr - 16, context_name(record["context"]))
+    else:
+        running = "exception %d" % ipsr
+    print("in %s" % running)
+    print()
+
+    print("PC   0x%08x  %s" % (record["pc"], where.get(record["pc"], "")))
+    print("LR   0x%08x  %s" % (record["lr"], where.get(record["lr"], "")))
+    for name in ["r0", "r1", "r2", "r3", "r12", "psr", "sp", "exc_return"]:
+        print("%-4s 0x%08x" % (name.upper() if name != "exc_return" else "EXC",
+                               record[name]))
+    print()
+
+    cfsr = record["cfsr"]
+    print("CFSR 0x%08x" % cfsr)
+    for name, text in bits(cfsr, CFSR_BITS):
+        print("  %-11s %s" % (name, text))
+    if cfsr & (1 << 7):
+        print("  MMFAR 0x%08x" % record["mmfar"])
+    if cfsr & (1 << 15):
+        print("  BFAR  0x%08x" % record["bfar"])
+    print("HFSR 0x%08x" % record["hfsr"])
+    for name, text in bits(record["hfsr"], HFSR_BITS):
+        print("  %-11s %s" % (name, text))
+    print()
+
+    print("Stack walk (innermost first):")
+    for address in walk:
+        print("  0x%08x  %s" % (address, where.get(address, "")))
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Decode a carzos fault record against the ELF.")
+    parser.add_argument("elf")
+    parser.add_argument("dump", help="raw memory image")
+    parser.add_argument("--base", type=lambda s: int(s, 0),
+                        help="address of the first byte of a RAM image;"
+                        " without it the dump is the record alone")
+    args = parser.parse_args()
+
+    with open(args.dump, "rb") as f:
+        data = f.read()
+
+    if args.base is not None:
+        address = symbol_address(args.elf, "fault_record")
+        if address is None:
+            sys.exit("fault_record not found in %s" % args.elf)
+        data = data[address - args.base:]
+
+    if len(data) < RECORD_WORDS * 4:
+        sys.exit("dump too short")
+
+    decode(args.elf, data)
+
+
+if __name__ == "__main__":
+    main()
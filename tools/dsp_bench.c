@@ -0,0 +1,621 @@
+/*
+ * dsp_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Checks and times the dsp.h kernels against scalar references.
+//
+// Each kernel runs on the same pseudo random signal as the plain C code
+// it replaces: FIR filters and biquads on a delay line one sample at a
+// time, the FFT as a scalar radix-2 (q15) or a direct DFT (f32), moving
+// averages summing the whole window. The fixed point kernels must match
+// bit for bit; the f32 ones within a tolerance, as the compiler may fuse
+// or reorder float operations differently in the two. The filters run in
+// blocks, so the state carried across calls is checked too.
+//
+// On the host the SIMD instructions are C stand-ins, so only the results
+// mean something there; the times are nanoseconds.
+//
+//   $ cc -O2 -I system/include/carzos -o dsp_bench tools/dsp_bench.c system/src/carzos/dsp.c
+//   $ ./dsp_bench
+//
+// On the target add this file to the build and call dsp_bench() once
+// trace_init() has run; the times are DWT cycles and the report goes out
+// through trace_printf().
+
+#if !defined(__arm__)
+#define _POSIX_C_SOURCE 199309L
+#endif
+
+#include <stdint.h>
+#include <string.h>
+
+#include <dsp.h>
+
+#if defined(__arm__)
+
+#include <dwt.h>
+#include <trace.h>
+
+#define BENCH_PRINTF(...)       trace_printf(__VA_ARGS__)
+
+static uint32_t bench_now(void)
+{
+  return dwt_cycles();
+}
+
+#else
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_PRINTF(...)       printf(__VA_ARGS__)
+
+static uint32_t bench_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) (((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec);
+}
+
+#endif // __arm__
+
+#define BENCH_SAMPLES           (1024U)
+#define BENCH_BLOCK             (128U)
+#define BENCH_TAPS              (31U)
+#define BENCH_STAGES            (3U)
+#define BENCH_FFT               (256U)
+#define BENCH_AVG_SHIFT         (5U)
+#define BENCH_AVG_LEN           (24U)
+
+// f32 tolerance, relative to the largest reference output
+#define BENCH_F32_TOL           (1e-5f)
+
+extern uint32_t dsp_bench(void);
+
+static int16_t bench_in_q15[BENCH_SAMPLES];
+static int16_t bench_in2_q15[BENCH_SAMPLES];
+static int32_t bench_in_q31[BENCH_SAMPLES];
+static float bench_in_f32[BENCH_SAMPLES];
+
+static int16_t bench_ref_q15[BENCH_SAMPLES];
+static int16_t bench_out_q15[BENCH_SAMPLES];
+static int32_t bench_ref_q31[BENCH_SAMPLES];
+static int32_t bench_out_q31[BENCH_SAMPLES];
+static float bench_ref_f32[BENCH_SAMPLES];
+static float bench_out_f32[BENCH_SAMPLES];
+
+static int16_t bench_state_q15[BENCH_TAPS - 1U + BENCH_BLOCK];
+static int32_t bench_state_q31[BENCH_TAPS - 1U + BENCH_BLOCK];
+static float bench_state_f32[BENCH_TAPS - 1U + BENCH_BLOCK];
+
+static int16_t bench_fir_q15[BENCH_TAPS];
+static int32_t bench_fir_q31[BENCH_TAPS];
+static float bench_fir_f32[BENCH_TAPS];
+
+// Second order low passes; q15 stages padded to 6, scaled down by 2
+static const int16_t bench_iir_q15[6U * BENCH_STAGES] =
+{
+  1024, 0, 2048, 1024, 18000, -8000,
+  2000, 0, 4000, 2000, 14000, -6000,
+  3000, 0, 6000, 3000, 10000, -4000,
+};
+static int32_t bench_iir_q31[5U * BENCH_STAGES];
+static float bench_iir_f32[5U * BENCH_STAGES];
+
+static uint32_t bench_twiddle_q15[BENCH_FFT / 2U];
+static float bench_twiddle_f32[BENCH_FFT];
+static int16_t bench_window_q15[1U << BENCH_AVG_SHIFT];
+static float bench_window_f32[BENCH_AVG_LEN];
+
+static uint32_t bench_failed;
+
+
+static uint32_t bench_seed = 0x2545F491U;
+
+static int32_t bench_random(void)
+{
+  bench_seed = (bench_seed * 1664525U) + 1013904223U;
+  return (int32_t) bench_seed;
+}
+
+static int16_t bench_sat_q15(int64_t value)
+{
+  return (int16_t) ((value > INT16_MAX) ? INT16_MAX : ((value < INT16_MIN) ? INT16_MIN : value));
+}
+
+static int32_t bench_sat_q31(int64_t value)
+{
+  return (int32_t) ((value > INT32_MAX) ? INT32_MAX : ((value < INT32_MIN) ? INT32_MIN : value));
+}
+
+static float bench_abs(float x)
+{
+  return (x < 0.0f) ? -x : x;
+}
+
+static void bench_report(const char *name, uint32_t ref, uint32_t opt, uint32_t ok)
+{
+  uint32_t speedup = (opt != 0U) ? (uint32_t) (((uint64_t) ref * 100U) / opt) : 0U;
+
+  BENCH_PRINTF("%-14s %9u %9u  x%u.%02u  %s\n", name, (unsigned) ref, (unsigned) opt,
+      (unsigned) (speedup / 100U), (unsigned) (speedup % 100U), ok ? "ok" : "MISMATCH");
+  if (!ok)
+    {
+      bench_failed++;
+    }
+}
+
+static uint32_t bench_same(const void *a, const void *b, uint32_t len)
+{
+  return (memcmp(a, b, len) == 0) ? 1U : 0U;
+}
+
+static uint32_t bench_close(const float *ref, const float *out, uint32_t n)
+{
+  float max = 0.0f;
+  float err = 0.0f;
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      if (bench_abs(ref[i]) > max)
+        {
+          max = bench_abs(ref[i]);
+        }
+      if (bench_abs(ref[i] - out[i]) > err)
+        {
+          err = bench_abs(ref[i] - out[i]);
+        }
+    }
+  return (err <= (max * BENCH_F32_TOL)) ? 1U : 0U;
+}
+
+// ----------------------------------------------------------------------------
+
+// References: the scalar code, one sample at a time
+
+static void ref_fir_q15(const int16_t *coeffs, uint32_t taps, const int16_t *in, int16_t *out,
+    uint32_t n)
+{
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      int64_t acc = 0;
+      for (uint32_t k = 0U; k < taps; k++)
+        {
+          int32_t t = (int32_t) i - (int32_t) (taps - 1U) + (int32_t) k;
+          if (t >= 0)
+            {
+              acc += (int32_t) coeffs[k] * in[t];
+            }
+        }
+      out[i] = bench_sat_q15(acc >> 15);
+    }
+}
+
+static void ref_fir_q31(const int32_t *coeffs, uint32_t taps, const int32_t *in, int32_t *out,
+    uint32_t n)
+{
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      int64_t acc = 0;
+      for (uint32_t k = 0U; k < taps; k++)
+        {
+          int32_t t = (int32_t) i - (int32_t) (taps - 1U) + (int32_t) k;
+          if (t >= 0)
+            {
+              acc += (int64_t) coeffs[k] * in[t];
+            }
+        }
+      out[i] = bench_sat_q31(acc >> 31);
+    }
+}
+
+static void ref_fir_f32(const float *coeffs, uint32_t taps, const float *in, float *out,
+    uint32_t n)
+{
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      float acc = 0.0f;
+      for (uint32_t k = 0U; k < taps; k++)
+        {
+          int32_t t = (int32_t) i - (int32_t) (taps - 1U) + (int32_t) k;
+          acc += coeffs[k] * ((t >= 0) ? in[t] : 0.0f);
+        }
+      out[i] = acc;
+    }
+}
+
+static void ref_biquad_q15(const int16_t *coeffs, uint32_t stages, uint32_t shift,
+    const int16_t *in, int16_t *out, uint32_t n)
+{
+  memcpy(out, in, n * sizeof(int16_t));
+  for (uint32_t s = 0U; s < stages; s++, coeffs += 6U)
+    {
+      int32_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+      for (uint32_t i = 0U; i < n; i++)
+        {
+          int32_t x = out[i];
+          int64_t acc = (int64_t) coeffs[0] * x + (int64_t) coeffs[2] * x1
+              + (int64_t) coeffs[3] * x2 + (int64_t) coeffs[4] * y1
+              + (int64_t) coeffs[5] * y2;
+          int32_t y = bench_sat_q15(acc >> (15U - shift));
+          x2 = x1;
+          x1 = x;
+          y2 = y1;
+          y1 = y;
+          out[i] = (int16_t) y;
+        }
+    }
+}
+
+static void ref_biquad_q31(const int32_t *coeffs, uint32_t stages, uint32_t shift,
+    const int32_t *in, int32_t *out, uint32_t n)
+{
+  memcpy(out, in, n * sizeof(int32_t));
+  for (uint32_t s = 0U; s < stages; s++, coeffs += 5U)
+    {
+      int32_t x1 = 0, x2 = 0, y1 = 0, y2 = 0;
+      for (uint32_t i = 0U; i < n; i++)
+        {
+          int32_t x = out[i];
+          int64_t acc = (int64_t) coeffs[0] * x + (int64_t) coeffs[1] * x1
+              + (int64_t) coeffs[2] * x2 + (int64_t) coeffs[3] * y1
+              + (int64_t) coeffs[4] * y2;
+          int32_t y = bench_sat_q31(acc >> (31U - shift));
+          x2 = x1;
+          x1 = x;
+          y2 = y1;
+          y1 = y;
+          out[i] = y;
+        }
+    }
+}
+
+static void ref_biquad_f32(const float *coeffs, uint32_t stages, const float *in, float *out,
+    uint32_t n)
+{
+  memcpy(out, in, n * sizeof(float));
+  for (uint32_t s = 0U; s < stages; s++, coeffs += 5U)
+    {
+      float x1 = 0.0f, x2 = 0.0f, y1 = 0.0f, y2 = 0.0f;
+      for (uint32_t i = 0U; i < n; i++)
+        {
+          float x = out[i];
+          float y = coeffs[0] * x + coeffs[1] * x1 + coeffs[2] * x2 + coeffs[3] * y1
+              + coeffs[4] * y2;
+          x2 = x1;
+          x1 = x;
+          y2 = y1;
+          y1 = y;
+          out[i] = y;
+        }
+    }
+}
+
+// Radix-2 DIF on separate integers, the same twiddles and roundings
+static void ref_fft_q15(const dsp_FftQ15 *fft, int16_t *buf)
+{
+  uint32_t n = fft->n;
+
+  for (uint32_t span = n / 2U, step = 1U; span > 0U; span >>= 1, step <<= 1)
+    {
+      for (uint32_t j = 0U; j < span; j++)
+        {
+          int32_t c = (int16_t) (fft->twiddle[j * step] & 0xFFFFU);
+          int32_t s = (int16_t) (fft->twiddle[j * step] >> 16);
+
+          for (uint32_t i = j; i < n; i += 2U * span)
+            {
+              int16_t *a = &buf[2U * i];
+              int16_t *b = &buf[2U * (i + span)];
+              int32_t dr = (a[0] - b[0]) >> 1;
+              int32_t di = (a[1] - b[1]) >> 1;
+
+              a[0] = (int16_t) ((a[0] + b[0]) >> 1);
+              a[1] = (int16_t) ((a[1] + b[1]) >> 1);
+              b[0] = bench_sat_q15((dr * c + di * s) >> 15);
+              b[1] = bench_sat_q15((di * c - dr * s) >> 15);
+            }
+        }
+    }
+
+  for (uint32_t i = 0U, j = 0U; i < n; i++)
+    {
+      if (i < j)
+        {
+          int16_t tr = buf[2U * i], ti = buf[2U * i + 1U];
+          buf[2U * i] = buf[2U * j];
+          buf[2U * i + 1U] = buf[2U * j + 1U];
+          buf[2U * j] = tr;
+          buf[2U * j + 1U] = ti;
+        }
+      uint32_t bit = n >> 1;
+      while ((j & bit) != 0U)
+        {
+          j ^= bit;
+          bit >>= 1;
+        }
+      j |= bit;
+    }
+}
+
+// Direct DFT; the powers of w past n / 2 are the negated first half
+static void ref_dft_f32(const dsp_FftF32 *fft, const float *in, float *out)
+{
+  uint32_t n = fft->n;
+
+  for (uint32_t k = 0U; k < n; k++)
+    {
+      float re = 0.0f;
+      float im = 0.0f;
+      for (uint32_t t = 0U; t < n; t++)
+        {
+          uint32_t e = (k * t) % n;
+          float sign = (e < (n / 2U)) ? 1.0f : -1.0f;
+          e %= n / 2U;
+          float c = sign * fft->twiddle[2U * e];
+          float s = sign * fft->twiddle[2U * e + 1U];
+          re += in[2U * t] * c + in[2U * t + 1U] * s;
+          im += in[2U * t + 1U] * c - in[2U * t] * s;
+        }
+      out[2U * k] = re;
+      out[2U * k + 1U] = im;
+    }
+}
+
+static void ref_average_q15(uint32_t shift, const int16_t *in, int16_t *out, uint32_t n)
+{
+  uint32_t len = 1U << shift;
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      int32_t sum = 0;
+      for (uint32_t k = 0U; (k < len) && (k <= i); k++)
+        {
+          sum += in[i - k];
+        }
+      out[i] = (int16_t) (sum >> shift);
+    }
+}
+
+static void ref_average_f32(uint32_t len, const float *in, float *out, uint32_t n)
+{
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      float sum = 0.0f;
+      for (uint32_t k = 0U; (k < len) && (k <= i); k++)
+        {
+          sum += in[i - k];
+        }
+      out[i] = sum / (float) len;
+    }
+}
+
+static void ref_add_q15(const int16_t *a, const int16_t *b, int16_t *out, uint32_t n)
+{
+  for (uint32_t i = 0U; i < n; i++)
+    {
+      out[i] = bench_sat_q15((int32_t) a[i] + b[i]);
+    }
+}
+
+// ----------------------------------------------------------------------------
+
+static void bench_setup(void)
+{
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i++)
+    {
+      bench_in_q15[i] = (int16_t) (bench_random() >> 16);
+      bench_in2_q15[i] = (int16_t) (bench_random() >> 16);
+      // log2(taps) bits of headroom
+      bench_in_q31[i] = bench_random() >> 5;
+      bench_in_f32[i] = (float) bench_in_q15[i] / 32768.0f;
+    }
+
+  // A windowed sinc-ish low pass, any will do
+  for (uint32_t k = 0U; k < BENCH_TAPS; k++)
+    {
+      int32_t d = (int32_t) k - (int32_t) (BENCH_TAPS / 2U);
+      int32_t c = 2400 - (d * d * 9);
+      bench_fir_q15[k] = (int16_t) c;
+      bench_fir_q31[k] = c << 16;
+      bench_fir_f32[k] = (float) c / 32768.0f;
+    }
+
+  for (uint32_t s = 0U; s < BENCH_STAGES; s++)
+    {
+      const int16_t *c = &bench_iir_q15[6U * s];
+      int32_t q15[5] = { c[0], c[2], c[3], c[4], c[5] };
+      for (uint32_t k = 0U; k < 5U; k++)
+        {
+          bench_iir_q31[5U * s + k] = q15[k] << 16;
+          bench_iir_f32[5U * s + k] = (float) q15[k] / 16384.0f;
+        }
+    }
+}
+
+static void bench_fir(void)
+{
+  uint32_t t0, ref, opt;
+
+  dsp_FirQ15 fir_q15;
+  dsp_fir_q15_init(&fir_q15, bench_fir_q15, BENCH_TAPS, bench_state_q15, BENCH_BLOCK);
+  t0 = bench_now();
+  ref_fir_q15(bench_fir_q15, BENCH_TAPS, bench_in_q15, bench_ref_q15, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_fir_q15(&fir_q15, &bench_in_q15[i], &bench_out_q15[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("fir_q15", ref, opt,
+      bench_same(bench_ref_q15, bench_out_q15, sizeof(bench_out_q15)));
+
+  dsp_FirQ31 fir_q31;
+  dsp_fir_q31_init(&fir_q31, bench_fir_q31, BENCH_TAPS, bench_state_q31, BENCH_BLOCK);
+  t0 = bench_now();
+  ref_fir_q31(bench_fir_q31, BENCH_TAPS, bench_in_q31, bench_ref_q31, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_fir_q31(&fir_q31, &bench_in_q31[i], &bench_out_q31[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("fir_q31", ref, opt,
+      bench_same(bench_ref_q31, bench_out_q31, sizeof(bench_out_q31)));
+
+  dsp_FirF32 fir_f32;
+  dsp_fir_f32_init(&fir_f32, bench_fir_f32, BENCH_TAPS, bench_state_f32, BENCH_BLOCK);
+  t0 = bench_now();
+  ref_fir_f32(bench_fir_f32, BENCH_TAPS, bench_in_f32, bench_ref_f32, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_fir_f32(&fir_f32, &bench_in_f32[i], &bench_out_f32[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("fir_f32", ref, opt, bench_close(bench_ref_f32, bench_out_f32, BENCH_SAMPLES));
+}
+
+static void bench_biquad(void)
+{
+  uint32_t t0, ref, opt;
+  int16_t state_q15[4U * BENCH_STAGES];
+  int32_t state_q31[4U * BENCH_STAGES];
+  float state_f32[2U * BENCH_STAGES];
+
+  dsp_BiquadQ15 iir_q15;
+  dsp_biquad_q15_init(&iir_q15, bench_iir_q15, BENCH_STAGES, state_q15, 1U);
+  t0 = bench_now();
+  ref_biquad_q15(bench_iir_q15, BENCH_STAGES, 1U, bench_in_q15, bench_ref_q15, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_biquad_q15(&iir_q15, &bench_in_q15[i], &bench_out_q15[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("biquad_q15", ref, opt,
+      bench_same(bench_ref_q15, bench_out_q15, sizeof(bench_out_q15)));
+
+  dsp_BiquadQ31 iir_q31;
+  dsp_biquad_q31_init(&iir_q31, bench_iir_q31, BENCH_STAGES, state_q31, 1U);
+  t0 = bench_now();
+  ref_biquad_q31(bench_iir_q31, BENCH_STAGES, 1U, bench_in_q31, bench_ref_q31, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_biquad_q31(&iir_q31, &bench_in_q31[i], &bench_out_q31[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("biquad_q31", ref, opt,
+      bench_same(bench_ref_q31, bench_out_q31, sizeof(bench_out_q31)));
+
+  dsp_BiquadF32 iir_f32;
+  dsp_biquad_f32_init(&iir_f32, bench_iir_f32, BENCH_STAGES, state_f32);
+  t0 = bench_now();
+  ref_biquad_f32(bench_iir_f32, BENCH_STAGES, bench_in_f32, bench_ref_f32, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  for (uint32_t i = 0U; i < BENCH_SAMPLES; i += BENCH_BLOCK)
+    {
+      dsp_biquad_f32(&iir_f32, &bench_in_f32[i], &bench_out_f32[i], BENCH_BLOCK);
+    }
+  opt = bench_now() - t0;
+  bench_report("biquad_f32", ref, opt,
+      bench_close(bench_ref_f32, bench_out_f32, BENCH_SAMPLES));
+}
+
+static void bench_fft(void)
+{
+  uint32_t t0, ref, opt;
+
+  dsp_FftQ15 fft_q15;
+  dsp_fft_q15_init(&fft_q15, BENCH_FFT, bench_twiddle_q15);
+  memcpy(bench_ref_q15, bench_in_q15, 2U * BENCH_FFT * sizeof(int16_t));
+  memcpy(bench_out_q15, bench_in_q15, 2U * BENCH_FFT * sizeof(int16_t));
+  t0 = bench_now();
+  ref_fft_q15(&fft_q15, bench_ref_q15);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  dsp_fft_q15(&fft_q15, bench_out_q15);
+  opt = bench_now() - t0;
+  bench_report("fft_q15", ref, opt,
+      bench_same(bench_ref_q15, bench_out_q15, 2U * BENCH_FFT * sizeof(int16_t)));
+
+  dsp_FftF32 fft_f32;
+  dsp_fft_f32_init(&fft_f32, BENCH_FFT, bench_twiddle_f32);
+  memcpy(bench_out_f32, bench_in_f32, 2U * BENCH_FFT * sizeof(float));
+  t0 = bench_now();
+  ref_dft_f32(&fft_f32, bench_in_f32, bench_ref_f32);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  dsp_fft_f32(&fft_f32, bench_out_f32);
+  opt = bench_now() - t0;
+  bench_report("fft_f32 (dft)", ref, opt,
+      bench_close(bench_ref_f32, bench_out_f32, 2U * BENCH_FFT));
+}
+
+static void bench_misc(void)
+{
+  uint32_t t0, ref, opt;
+
+  dsp_AverageQ15 avg_q15;
+  dsp_average_q15_init(&avg_q15, bench_window_q15, BENCH_AVG_SHIFT);
+  t0 = bench_now();
+  ref_average_q15(BENCH_AVG_SHIFT, bench_in_q15, bench_ref_q15, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  dsp_average_q15(&avg_q15, bench_in_q15, bench_out_q15, BENCH_SAMPLES);
+  opt = bench_now() - t0;
+  bench_report("average_q15", ref, opt,
+      bench_same(bench_ref_q15, bench_out_q15, sizeof(bench_out_q15)));
+
+  dsp_AverageF32 avg_f32;
+  dsp_average_f32_init(&avg_f32, bench_window_f32, BENCH_AVG_LEN);
+  t0 = bench_now();
+  ref_average_f32(BENCH_AVG_LEN, bench_in_f32, bench_ref_f32, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  dsp_average_f32(&avg_f32, bench_in_f32, bench_out_f32, BENCH_SAMPLES);
+  opt = bench_now() - t0;
+  bench_report("average_f32", ref, opt,
+      bench_close(bench_ref_f32, bench_out_f32, BENCH_SAMPLES));
+
+  t0 = bench_now();
+  ref_add_q15(bench_in_q15, bench_in2_q15, bench_ref_q15, BENCH_SAMPLES);
+  ref = bench_now() - t0;
+  t0 = bench_now();
+  dsp_add_q15(bench_in_q15, bench_in2_q15, bench_out_q15, BENCH_SAMPLES);
+  opt = bench_now() - t0;
+  bench_report("add_q15", ref, opt,
+      bench_same(bench_ref_q15, bench_out_q15, sizeof(bench_out_q15)));
+}
+
+// Runs every check; returns the number of mismatches.
+uint32_t dsp_bench(void)
+{
+  bench_failed = 0U;
+  bench_setup();
+
+  BENCH_PRINTF("%-14s %9s %9s  speedup\n", "kernel", "ref", "dsp");
+  bench_fir();
+  bench_biquad();
+  bench_fft();
+  bench_misc();
+
+  return bench_failed;
+}
+
+#if !defined(__arm__)
+
+int main(void)
+{
+  return (dsp_bench() == 0U) ? 0 : 1;
+}
+
+#endif // __arm__
@@ -0,0 +1,703 @@
+/*
+ * eth_tap.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for eth.c: the eth.h interface on Linux, over a TAP
+// device, so that net.c and the code on it run on a PC against a real
+// network stack, or over pcap files, to replay traffic and time the
+// stack frame by frame.
+//
+// TAP: the device is $ETH_TAP ("carzos0" by default) and needs
+// CAP_NET_ADMIN, or to be made beforehand for the user:
+//
+//   # ip tuntap add dev carzos0 mode tap user $USER
+//   # ip addr add 192.168.7.1/24 dev carzos0 && ip link set carzos0 up
+//
+// pcap: when $ETH_PCAP_IN is set, the frames are read from that file
+// rather than the device, and the frames sent go to $ETH_PCAP_OUT (if
+// set), Ethernet link type both.
+//
+// As on the target the frames come in pool buffers, 'data' 2 bytes in;
+// a frame finds the pool empty and is dropped like with the driver. The
+// MAC offloads are done here: the checksums of the frames sent are
+// filled in, and received IPv4 frames with a bad one are dropped, the
+// others marked PKT_CSUM_OK. The TX ring is ETH_TX_RING buffers long too,
+// so eth_send() fails when the real one would.
+//
+// Nothing moves on its own: eth_tap_poll() hands the frames sent back
+// to tx_done, then waits up to 'timeout_ms' for frames and passes up to
+// ETH_RX_RING of them to rx, a batch as from the work item; it returns
+// how many, or -1 when the pcap input has run out.
+//
+//   $ cc -I system/include/carzos -I system/src/carzos -DETH_TAP_DEMO -o net_demo
+//         tools/eth_tap.c system/src/carzos/net.c system/src/carzos/pkt.c
+//   $ ./net_demo
+//
+// The demo is 192.168.7.2, with UDP and TCP echo on port 7 and a TCP
+// chargen on port 19 to measure throughput (nc 192.168.7.2 19 | pv >
+// /dev/null). With pcap files it reports the time per frame.
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/if.h>
+#include <linux/if_tun.h>
+
+#include <eth.h>
+
+#define ETH_TAP_FRAME_MIN       (60U)
+#define ETH_TAP_RX_OFFSET       (2U)
+
+#define ETH_TAP_PCAP_MAGIC      (0xA1B2C3D4U)
+#define ETH_TAP_PCAP_ETHERNET   (1U)
+
+typedef struct eth_tap_pcap_header
+{
+  uint32_t magic;
+  uint16_t major;
+  uint16_t minor;
+  int32_t zone;
+  uint32_t sigfigs;
+  uint32_t snaplen;
+  uint32_t linktype;
+} eth_tap_PcapHeader;
+
+typedef struct eth_tap_pcap_record
+{
+  uint32_t sec;
+  uint32_t usec;
+  uint32_t incl_len;
+  uint32_t orig_len;
+} eth_tap_PcapRecord;
+
+typedef struct eth_tap_port
+{
+  eth_Config config;
+  int fd;
+  FILE *pcap_in;
+  FILE *pcap_out;
+
+  // Chains sent, not yet handed back
+  pkt_Buf *sent[ETH_TX_RING];
+  uint32_t sent_head;
+  uint32_t sent_count;
+  uint32_t tx_used;
+
+  eth_Stats stats;
+} eth_tap_Port;
+
+static eth_tap_Port eth_tap;
+
+static uint32_t eth_tap_get16(const uint8_t *p)
+{
+  return ((uint32_t) p[0] << 8) | p[1];
+}
+
+static uint32_t eth_tap_sum(const uint8_t *p, uint32_t len, uint32_t sum)
+{
+  for (; len > 1U; len -= 2U, p += 2)
+    {
+      sum += eth_tap_get16(p);
+    }
+  if (len != 0U)
+    {
+      sum += (uint32_t) p[0] << 8;
+    }
+  while ((sum >> 16) != 0U)
+    {
+      sum = (sum & 0xFFFFU) + (sum >> 16);
+    }
+  return sum;
+}
+
+// The checksums of an IPv4 frame: filled in when 'fill', else checked.
+// 0 when a checked one is wrong.
+static uint32_t eth_tap_csum(uint8_t *frame, uint32_t len, uint32_t fill)
+{
+  if ((len < 34U) || (eth_tap_get16(frame + 12) != 0x0800U))
+    {
+      return 1U;
+    }
+
+  uint8_t *ip = frame + 14;
+  uint32_t ihl = (uint32_t) (ip[0] & 0x0FU) * 4U;
+  uint32_t total = eth_tap_get16(ip + 2);
+  if ((ihl < 20U) || (total < ihl) || ((14U + total) > len))
+    {
+      return 1U;
+    }
+
+  if (fill != 0U)
+    {
+      ip[10] = 0U;
+      ip[11] = 0U;
+      uint32_t sum = ~eth_tap_sum(ip, ihl, 0U) & 0xFFFFU;
+      ip[10] = (uint8_t) (sum >> 8);
+      ip[11] = (uint8_t) sum;
+    }
+  else if (eth_tap_sum(ip, ihl, 0U) != 0xFFFFU)
+    {
+      return 0U;
+    }
+
+  // Fragments go as they are
+  if ((eth_tap_get16(ip + 6) & 0x3FFFU) != 0U)
+    {
+      return 1U;
+    }
+
+  uint8_t *p = ip + ihl;
+  uint32_t plen = total - ihl;
+  uint32_t field;
+  uint32_t sum = 0U;
+  switch (ip[9])
+    {
+    case 1U:
+      field = 2U;
+      break;
+    case 6U:
+      field = 16U;
+      sum = eth_tap_sum(ip + 12, 8U, 6U + plen);
+      break;
+    case 17U:
+      field = 6U;
+      sum = eth_tap_sum(ip + 12, 8U, 17U + plen);
+      if ((fill == 0U) && (plen >= 8U) && (eth_tap_get16(p + 6) == 0U))
+        {
+          return 1U;
+        }
+      break;
+    default:
+      return 1U;
+    }
+  if (plen < (field + 2U))
+    {
+      return 1U;
+    }
+
+  if (fill == 0U)
+    {
+      return (eth_tap_sum(p, plen, sum) == 0xFFFFU) ? 1U : 0U;
+    }
+
+  p[field] = 0U;
+  p[field + 1U] = 0U;
+  sum = ~eth_tap_sum(p, plen, sum) & 0xFFFFU;
+  if ((sum == 0U) && (ip[9] == 17U))
+    {
+      sum = 0xFFFFU;
+    }
+  p[field] = (uint8_t) (sum >> 8);
+  p[field + 1U] = (uint8_t) sum;
+  return 1U;
+}
+
+static uint32_t eth_tap_open_pcap(const char *in)
+{
+  eth_tap_PcapHeader header;
+
+  eth_tap.pcap_in = fopen(in, "rb");
+  if ((eth_tap.pcap_in == NULL)
+      || (fread(&header, sizeof(header), 1U, eth_tap.pcap_in) != 1U)
+      || (header.magic != ETH_TAP_PCAP_MAGIC)
+      || (header.linktype != ETH_TAP_PCAP_ETHERNET))
+    {
+      fprintf(stderr, "eth_tap: %s: not an Ethernet pcap file\n", in);
+      return 1U;
+    }
+
+  const char *out = getenv("ETH_PCAP_OUT");
+  if (out != NULL)
+    {
+      eth_tap.pcap_out = fopen(out, "wb");
+      if (eth_tap.pcap_out == NULL)
+        {
+          perror(out);
+          return 1U;
+        }
+      memset(&header, 0, sizeof(header));
+      header.magic = ETH_TAP_PCAP_MAGIC;
+      header.major = 2U;
+      header.minor = 4U;
+      header.snaplen = 65535U;
+      header.linktype = ETH_TAP_PCAP_ETHERNET;
+      fwrite(&header, sizeof(header), 1U, eth_tap.pcap_out);
+    }
+  return 0U;
+}
+
+static uint32_t eth_tap_open_tap(void)
+{
+  struct ifreq ifr;
+  const char *name = getenv("ETH_TAP");
+
+  eth_tap.fd = open("/dev/net/tun", O_RDWR | O_NONBLOCK);
+  if (eth_tap.fd < 0)
+    {
+      perror("/dev/net/tun");
+      return 1U;
+    }
+
+  memset(&ifr, 0, sizeof(ifr));
+  ifr.ifr_flags = IFF_TAP | IFF_NO_PI;
+  strncpy(ifr.ifr_name, (name != NULL) ? name : "carzos0", IFNAMSIZ - 1);
+  if (ioctl(eth_tap.fd, TUNSETIFF, &ifr) < 0)
+    {
+      perror(ifr.ifr_name);
+      close(eth_tap.fd);
+      eth_tap.fd = -1;
+      return 1U;
+    }
+  return 0U;
+}
+
+uint32_t eth_init(const eth_Config *config)
+{
+  if ((config == NULL) || (config->pool == NULL) || (config->rx == NULL)
+      || (config->pool->size < ETH_POOL_BUF_MIN))
+    {
+      return 1U;
+    }
+
+  memset(&eth_tap, 0, sizeof(eth_tap));
+  eth_tap.config = *config;
+  eth_tap.fd = -1;
+
+  const char *in = getenv("ETH_PCAP_IN");
+  return (in != NULL) ? eth_tap_open_pcap(in) : eth_tap_open_tap();
+}
+
+uint32_t eth_send(pkt_Buf *chain)
+{
+  uint8_t frame[ETH_FRAME_MAX];
+  uint32_t len = 0U;
+  uint32_t bufs = 0U;
+
+  for (pkt_Buf *b = chain; b != NULL; b = b->next)
+    {
+      if ((len + b->len) > ETH_FRAME_MAX)
+        {
+          return 1U;
+        }
+      memcpy(frame + len, b->data, b->len);
+      len += b->len;
+      bufs++;
+    }
+  if ((len < 14U) || ((eth_tap.tx_used + bufs) > ETH_TX_RING))
+    {
+      return 1U;
+    }
+
+  if (len < ETH_TAP_FRAME_MIN)
+    {
+      memset(frame + len, 0, ETH_TAP_FRAME_MIN - len);
+      len = ETH_TAP_FRAME_MIN;
+    }
+  (void) eth_tap_csum(frame, len, 1U);
+
+  if (eth_tap.fd >= 0)
+    {
+      if (write(eth_tap.fd, frame, len) != (ssize_t) len)
+        {
+          eth_tap.stats.tx_errors++;
+        }
+    }
+  else if (eth_tap.pcap_out != NULL)
+    {
+      eth_tap_PcapRecord record = { 0U, 0U, len, len };
+      fwrite(&record, sizeof(record), 1U, eth_tap.pcap_out);
+      fwrite(frame, len, 1U, eth_tap.pcap_out);
+    }
+  eth_tap.stats.tx_frames++;
+
+  eth_tap.tx_used += bufs;
+  eth_tap.sent[(eth_tap.sent_head + eth_tap.sent_count) % ETH_TX_RING] = chain;
+  eth_tap.sent_count++;
+  return 0U;
+}
+
+uint32_t eth_link(void)
+{
+  return ETH_LINK_100_FULL;
+}
+
+void eth_stats(eth_Stats *stats)
+{
+  *stats = eth_tap.stats;
+}
+
+// One frame into 'frame', 0 for none yet, -1 for no more
+static int eth_tap_read(uint8_t *frame, uint32_t size)
+{
+  if (eth_tap.pcap_in == NULL)
+    {
+      ssize_t n = read(eth_tap.fd, frame, size);
+      return (n > 0) ? (int) n : 0;
+    }
+
+  eth_tap_PcapRecord record;
+  if (fread(&record, sizeof(record), 1U, eth_tap.pcap_in) != 1U)
+    {
+      return -1;
+    }
+  if (record.incl_len > size)
+    {
+      fseek(eth_tap.pcap_in, record.incl_len, SEEK_CUR);
+      eth_tap.stats.rx_errors++;
+      return 0;
+    }
+  if (fread(frame, record.incl_len, 1U, eth_tap.pcap_in) != 1U)
+    {
+      return -1;
+    }
+  return (int) record.incl_len;
+}
+
+int eth_tap_poll(uint32_t timeout_ms)
+{
+  while (eth_tap.sent_count != 0U)
+    {
+      pkt_Buf *chain = eth_tap.sent[eth_tap.sent_head];
+      eth_tap.sent_head = (eth_tap.sent_head + 1U) % ETH_TX_RING;
+      eth_tap.sent_count--;
+      for (pkt_Buf *b = chain; b != NULL; b = b->next)
+        {
+          eth_tap.tx_used--;
+        }
+      if (eth_tap.config.tx_done != NULL)
+        {
+          eth_tap.config.tx_done(eth_tap.config.arg, chain);
+        }
+      else
+        {
+          pkt_free(chain);
+        }
+    }
+
+  if (eth_tap.pcap_in == NULL)
+    {
+      struct pollfd pfd = { eth_tap.fd, POLLIN, 0 };
+      if (poll(&pfd, 1, (int) timeout_ms) <= 0)
+        {
+          return 0;
+        }
+    }
+
+  int frames = 0;
+  while (frames < (int) ETH_RX_RING)
+    {
+      uint8_t frame[ETH_FRAME_MAX + 4U];
+      int len = eth_tap_read(frame, sizeof(frame));
+      if (len < 0)
+        {
+          return (frames != 0) ? frames : -1;
+        }
+      if (len == 0)
+        {
+          if (eth_tap.pcap_in == NULL)
+            {
+              break;
+            }
+          continue;
+        }
+
+      if (eth_tap_csum(frame, (uint32_t) len, 0U) == 0U)
+        {
+          eth_tap.stats.rx_errors++;
+          continue;
+        }
+
+      pkt_Buf *buf = pkt_alloc(eth_tap.config.pool);
+      if (buf == NULL)
+        {
+          eth_tap.stats.rx_dropped++;
+          continue;
+        }
+      buf->data = buf->mem + ETH_TAP_RX_OFFSET;
+      buf->len = (uint16_t) len;
+      memcpy(buf->data, frame, (uint32_t) len);
+      if ((len >= 14) && (eth_tap_get16(frame + 12) == 0x0800U))
+        {
+          buf->flags |= PKT_CSUM_OK;
+        }
+
+      eth_tap.stats.rx_frames++;
+      frames++;
+      eth_tap.config.rx(eth_tap.config.arg, buf);
+    }
+  return frames;
+}
+
+#if defined(ETH_TAP_DEMO)
+
+#include <time.h>
+
+#include <net.h>
+
+#define ETH_TAP_POOL_COUNT      (256U)
+#define ETH_TAP_POOL_SIZE       (1536U)
+#define ETH_TAP_ECHO            (7U)
+#define ETH_TAP_CHARGEN         (19U)
+
+typedef struct eth_tap_conn
+{
+  net_Tcp *tcp;
+  // Received data not echoed yet, for want of send queue
+  pkt_Buf *pending;
+} eth_tap_Conn;
+
+static uint8_t eth_tap_pool_mem[PKT_POOL_BYTES (ETH_TAP_POOL_COUNT, ETH_TAP_POOL_SIZE)]
+  __attribute__ ((aligned (4)));
+static pkt_Pool eth_tap_pool;
+static net_Udp eth_tap_udp_echo;
+static eth_tap_Conn eth_tap_conns[NET_TCP_CONNS];
+static uint64_t eth_tap_chargen_bytes;
+
+static uint32_t eth_tap_now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t) ((ts.tv_sec * 1000U) + (ts.tv_nsec / 1000000));
+}
+
+static void eth_tap_udp(void *arg, pkt_Buf *data, uint32_t ip, uint16_t port)
+{
+  // Back in the buffer it came in
+  net_udp_send(arg, ip, port, data);
+}
+
+static eth_tap_Conn *eth_tap_conn_new(net_Tcp *tcp)
+{
+  for (uint32_t i = 0U; i < NET_TCP_CONNS; i++)
+    {
+      if (eth_tap_conns[i].tcp == NULL)
+        {
+          eth_tap_conns[i].tcp = tcp;
+          eth_tap_conns[i].pending = NULL;
+          return &eth_tap_conns[i];
+        }
+    }
+  return NULL;
+}
+
+// Echoes what it can of the data held; the window stays shut on the rest
+static void eth_tap_echo_flush(eth_tap_Conn *conn)
+{
+  while (conn->pending != NULL)
+    {
+      pkt_Buf *in = conn->pending;
+      pkt_Buf *out = net_alloc();
+      if (out == NULL)
+        {
+          return;
+        }
+      uint32_t len = net_tcp_mss(conn->tcp);
+      if (len > in->len)
+        {
+          len = in->len;
+        }
+      memcpy(out->data, in->data, len);
+      out->len = (uint16_t) len;
+      if (net_tcp_send(conn->tcp, out) != 0U)
+        {
+          pkt_free(out);
+          return;
+        }
+
+      in->data += len;
+      in->len = (uint16_t) (in->len - len);
+      net_tcp_recved(conn->tcp, len);
+      if (in->len == 0U)
+        {
+          conn->pending = in->link;
+          in->link = NULL;
+          pkt_free(in);
+        }
+    }
+}
+
+static void eth_tap_echo_recv(void *arg, net_Tcp *tcp, pkt_Buf *data)
+{
+  eth_tap_Conn *conn = arg;
+  pkt_Buf **tail = &conn->pending;
+
+  (void) tcp;
+  while (*tail != NULL)
+    {
+      tail = &(*tail)->link;
+    }
+  data->link = NULL;
+  *tail = data;
+  eth_tap_echo_flush(conn);
+}
+
+static void eth_tap_chargen_fill(net_Tcp *tcp)
+{
+  static uint32_t column;
+
+  for (;;)
+    {
+      pkt_Buf *out = net_alloc();
+      if (out == NULL)
+        {
+          return;
+        }
+      uint32_t len = net_tcp_mss(tcp);
+      for (uint32_t i = 0U; i < len; i++)
+        {
+          out->data[i] = (uint8_t) (' ' + ((column + i) % 95U));
+        }
+      out->len = (uint16_t) len;
+      if (net_tcp_send(tcp, out) != 0U)
+        {
+          pkt_free(out);
+          return;
+        }
+      column += len;
+      eth_tap_chargen_bytes += len;
+    }
+}
+
+// Accepted connections start with the listener's arg, NULL
+static eth_tap_Conn *eth_tap_tcp_event(eth_tap_Conn *conn, net_Tcp *tcp, uint32_t event)
+{
+  switch (event)
+    {
+    case NET_TCP_CONNECTED:
+      conn = eth_tap_conn_new(tcp);
+      if (conn == NULL)
+        {
+          net_tcp_abort(tcp);
+          return NULL;
+        }
+      net_tcp_set_arg(tcp, conn);
+      return conn;
+    case NET_TCP_SENT:
+      return conn;
+    case NET_TCP_PEER_CLOSED:
+      net_tcp_close(tcp);
+      return NULL;
+    default:
+      if (conn != NULL)
+        {
+          while (conn->pending != NULL)
+            {
+              pkt_Buf *in = conn->pending;
+              conn->pending = in->link;
+              pkt_free(in);
+            }
+          conn->tcp = NULL;
+          conn->pending = NULL;
+        }
+      return NULL;
+    }
+}
+
+static void eth_tap_echo_event(void *arg, net_Tcp *tcp, uint32_t event)
+{
+  eth_tap_Conn *conn = eth_tap_tcp_event(arg, tcp, event);
+  if (conn != NULL)
+    {
+      eth_tap_echo_flush(conn);
+    }
+}
+
+static void eth_tap_chargen_event(void *arg, net_Tcp *tcp, uint32_t event)
+{
+  if (eth_tap_tcp_event(arg, tcp, event) != NULL)
+    {
+      eth_tap_chargen_fill(tcp);
+    }
+}
+
+static void eth_tap_chargen_recv(void *arg, net_Tcp *tcp, pkt_Buf *data)
+{
+  (void) arg;
+  net_tcp_recved(tcp, data->len);
+  pkt_free(data);
+}
+
+static const net_TcpHandler eth_tap_echo =
+  { eth_tap_echo_recv, eth_tap_echo_event };
+static const net_TcpHandler eth_tap_chargen =
+  { eth_tap_chargen_recv, eth_tap_chargen_event };
+
+int main(void)
+{
+  net_Config config =
+    {
+      .mac = { 0x02U, 0x00U, 0x00U, 0x00U, 0x00U, 0x02U },
+      .ip = NET_IP (192, 168, 7, 2),
+      .netmask = NET_IP (255, 255, 255, 0),
+      .gateway = NET_IP (192, 168, 7, 1),
+      .pool = &eth_tap_pool,
+      .phy = ETH_PHY_ANY,
+    };
+
+  pkt_pool_init(&eth_tap_pool, eth_tap_pool_mem, ETH_TAP_POOL_COUNT, ETH_TAP_POOL_SIZE);
+  if (net_init(&config) != 0U)
+    {
+      return 1;
+    }
+  net_udp_bind(&eth_tap_udp_echo, ETH_TAP_ECHO, eth_tap_udp, &eth_tap_udp_echo);
+  net_tcp_listen(ETH_TAP_ECHO, &eth_tap_echo, NULL);
+  net_tcp_listen(ETH_TAP_CHARGEN, &eth_tap_chargen, NULL);
+
+  uint32_t pcap = (getenv("ETH_PCAP_IN") != NULL) ? 1U : 0U;
+  uint32_t tick = eth_tap_now();
+  uint32_t report = tick;
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  for (;;)
+    {
+      if (eth_tap_poll(NET_TIMER_MS / 10U) < 0)
+        {
+          break;
+        }
+
+      uint32_t now = eth_tap_now();
+      if ((now - tick) >= NET_TIMER_MS)
+        {
+          tick = now;
+          net_timer(now);
+        }
+      if ((pcap == 0U) && ((now - report) >= 1000U))
+        {
+          net_Stats stats;
+          net_stats(&stats);
+          printf("ip in %u out %u dropped %u arp misses %u retransmits %u chargen %llu kB\n",
+                 stats.ip_in, stats.ip_out, stats.dropped, stats.arp_misses,
+                 stats.tcp_retransmits, (unsigned long long) (eth_tap_chargen_bytes / 1024U));
+          report = now;
+        }
+    }
+
+  // pcap: what is left to send goes out, then the timing
+  (void) eth_tap_poll(0U);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  eth_Stats eth;
+  net_Stats stats;
+  eth_stats(&eth);
+  net_stats(&stats);
+  double ns = ((double) (end.tv_sec - start.tv_sec) * 1e9) + (double) (end.tv_nsec - start.tv_nsec);
+  printf("%u frames in, %u out, %u dropped, %.0f ns per frame in\n", eth.rx_frames,
+         eth.tx_frames, stats.dropped, (eth.rx_frames != 0U) ? (ns / eth.rx_frames) : 0.0);
+  if (eth_tap.pcap_out != NULL)
+    {
+      fclose(eth_tap.pcap_out);
+    }
+  return 0;
+}
+
+#endif // defined(ETH_TAP_DEMO)
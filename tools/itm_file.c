@@ -0,0 +1,267 @@
+/*
+ * itm_file.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for itm.c: the itm.h interface on Linux, writing to a
+// file the SWO byte stream the ITM would send, so that code using it and
+// tools/swodump.py can be checked without a board.
+//
+// The packets are the ones of the hardware: a sync packet at init, one
+// instrumentation packet per write, and a local timestamp packet (cycles
+// of a ITM_FILE_HZ core clock since the previous one) after each. The
+// ITM FIFO is modelled too: it holds ITM_FILE_FIFO bytes and the line
+// empties it at swo_hz / 10 bytes per second (8N1 framing), so writing
+// faster than the line drops values as on the target.
+//
+// The output file is $ITM_FILE, itm.swo by default.
+//
+//   $ cc -I system/include/carzos -DITM_FILE_DEMO -o itm_demo tools/itm_file.c
+//   $ ./itm_demo && tools/swodump.py itm.swo
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <itm.h>
+
+#define ITM_FILE_HZ             (168000000ULL)
+#define ITM_FILE_FIFO           (10U)
+
+static FILE *itm_file;
+static uint32_t itm_ports;
+static uint32_t itm_swo_hz;
+static uint32_t itm_drops[ITM_PORTS];
+
+static uint64_t itm_line_ns_per_byte;
+static uint64_t itm_fifo_free_at;         // ns when the FIFO is empty again
+static uint64_t itm_last_cycles;
+
+
+static uint64_t itm_now_ns(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ((uint64_t) ts.tv_sec * 1000000000ULL) + (uint64_t) ts.tv_nsec;
+}
+
+static uint64_t itm_cycles(void)
+{
+  return (itm_now_ns() * ITM_FILE_HZ) / 1000000000ULL;
+}
+
+// Takes 'len' bytes in the FIFO, or none when they do not fit
+static int itm_fifo_take(uint32_t len)
+{
+  uint64_t now = itm_now_ns();
+  if (itm_fifo_free_at < now)
+    {
+      itm_fifo_free_at = now;
+    }
+
+  uint64_t queued = (itm_fifo_free_at - now) / itm_line_ns_per_byte;
+  if ((queued + len) > ITM_FILE_FIFO)
+    {
+      return 0;
+    }
+
+  itm_fifo_free_at += len * itm_line_ns_per_byte;
+  return 1;
+}
+
+static void itm_timestamp(void)
+{
+  uint64_t now = itm_cycles();
+  uint64_t delta = now - itm_last_cycles;
+  itm_last_cycles = now;
+
+  if (delta == 0U)
+    {
+      return;
+    }
+  if (delta > 0x0FFFFFFFULL)
+    {
+      delta = 0x0FFFFFFFULL;
+    }
+
+  // Format 1, TC = 0 (in sync): up to four 7 bit groups, LSB first
+  fputc(0xC0, itm_file);
+  do
+    {
+      uint8_t byte = delta & 0x7FU;
+      delta >>= 7;
+      fputc((delta != 0U) ? (byte | 0x80U) : byte, itm_file);
+    }
+  while (delta != 0U);
+}
+
+static uint32_t itm_packet(uint32_t port, uint32_t value, uint32_t size)
+{
+  if ((itm_file == NULL) || (port >= ITM_PORTS)
+      || ((itm_ports & (1U << port)) == 0U))
+    {
+      return 0U;
+    }
+
+  if (!itm_fifo_take(1U + size))
+    {
+      itm_drops[port]++;
+      return 0U;
+    }
+
+  fputc((int) ((port << 3) | ((size == 4U) ? 3U : size)), itm_file);
+  for (uint32_t i = 0U; i < size; i++)
+    {
+      fputc((int) ((value >> (8U * i)) & 0xFFU), itm_file);
+    }
+  itm_timestamp();
+
+  return 1U;
+}
+
+uint32_t itm_init(uint32_t swo_hz, uint32_t ports)
+{
+  if (swo_hz == 0U)
+    {
+      return 1U;
+    }
+
+  const char *path = getenv("ITM_FILE");
+  if (itm_file != NULL)
+    {
+      fclose(itm_file);
+    }
+  itm_file = fopen((path != NULL) ? path : "itm.swo", "wb");
+  if (itm_file == NULL)
+    {
+      return 1U;
+    }
+
+  itm_ports = ports;
+  itm_swo_hz = swo_hz;
+  itm_line_ns_per_byte = (10ULL * 1000000000ULL) / swo_hz;
+  if (itm_line_ns_per_byte == 0U)
+    {
+      itm_line_ns_per_byte = 1U;
+    }
+  itm_fifo_free_at = 0U;
+  itm_last_cycles = itm_cycles();
+  for (uint32_t i = 0U; i < ITM_PORTS; i++)
+    {
+      itm_drops[i] = 0U;
+    }
+
+  // Sync packet: at least 47 zero bits and a one
+  static const uint8_t sync[] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x80 };
+  fwrite(sync, sizeof(sync), 1U, itm_file);
+
+  return 0U;
+}
+
+uint32_t itm_write8(uint32_t port, uint8_t value)
+{
+  return itm_packet(port, value, 1U);
+}
+
+uint32_t itm_write16(uint32_t port, uint16_t value)
+{
+  return itm_packet(port, value, 2U);
+}
+
+uint32_t itm_write32(uint32_t port, uint32_t value)
+{
+  return itm_packet(port, value, 4U);
+}
+
+uint32_t itm_write(uint32_t port, const void *buf, uint32_t len)
+{
+  const uint8_t *p = buf;
+  uint32_t sent = 0U;
+
+  for (; (len - sent) >= 4U; sent += 4U)
+    {
+      uint32_t word = (uint32_t) p[sent]
+          | ((uint32_t) p[sent + 1U] << 8)
+          | ((uint32_t) p[sent + 2U] << 16)
+          | ((uint32_t) p[sent + 3U] << 24);
+      if (itm_write32(port, word) == 0U)
+        {
+          return sent;
+        }
+    }
+
+  for (; sent < len; sent++)
+    {
+      if (itm_write8(port, p[sent]) == 0U)
+        {
+          return sent;
+        }
+    }
+
+  return sent;
+}
+
+uint32_t itm_stamp(uint32_t port)
+{
+  return itm_write32(port, (uint32_t) itm_cycles());
+}
+
+uint32_t itm_swo_rate(void)
+{
+  // As the divider on a core at ITM_FILE_HZ makes it
+  if (itm_swo_hz == 0U)
+    {
+      return 0U;
+    }
+  uint64_t div = ITM_FILE_HZ / itm_swo_hz;
+  return (uint32_t) (ITM_FILE_HZ / ((div == 0U) ? 1U : div));
+}
+
+uint32_t itm_dropped(uint32_t port)
+{
+  return (port < ITM_PORTS) ? itm_drops[port] : 0U;
+}
+
+#if defined(ITM_FILE_DEMO)
+
+int main(void)
+{
+  static const char hello[] = "hello from port 0\n";
+
+  itm_init(ITM_SWO_HZ, 0x7U);
+
+  struct timespec gap = { 0, 50000 };
+
+  // Paced to the line: nothing is lost
+  for (uint32_t i = 0U; i < (sizeof(hello) - 1U); i++)
+    {
+      itm_write8(0U, (uint8_t) hello[i]);
+      nanosleep(&gap, NULL);
+    }
+  for (uint32_t i = 0U; i < 4U; i++)
+    {
+      itm_write16(1U, (uint16_t) (i * 1000U));
+      itm_stamp(2U);
+      nanosleep(&gap, NULL);
+    }
+
+  // A burst faster than the line: most of it is dropped
+  for (uint32_t i = 0U; i < 100U; i++)
+    {
+      itm_write32(1U, i);
+    }
+
+  for (uint32_t port = 0U; port < 3U; port++)
+    {
+      printf("port %u: %u dropped\n", port, itm_dropped(port));
+    }
+
+  fclose(itm_file);
+  return 0;
+}
+
+#endif // defined(ITM_FILE_DEMO)
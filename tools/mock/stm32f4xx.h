@@ -0,0 +1,128 @@
+/*
+ * stm32f4xx.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for the device header, for the driver tests under tools/:
+// the registers the drivers touch, in memory the test owns, with the bit
+// values of stm32f407xx.h. Only what spi.c needs so far.
+//
+// SPI CR1 and GPIO BSRR are logs: the register names are macros that take
+// the next slot from mock_write(), so every write lands in a slot of its
+// own and the test can replay them in order. A slot nobody wrote holds
+// MOCK_UNWRITTEN.
+
+#ifndef MOCK_STM32F4XX_H_
+#define MOCK_STM32F4XX_H_
+
+#include <stdint.h>
+
+#define MOCK_LOG                        (64U)
+#define MOCK_UNWRITTEN                  (0xFFFFFFFFU)
+
+extern uint32_t mock_write(void);
+
+typedef enum
+{
+  OTG_HS_EP1_OUT_IRQn = 74,
+  OTG_HS_EP1_IN_IRQn = 75,
+  DCMI_IRQn = 78,
+  FPU_IRQn = 81,
+} IRQn_Type;
+
+typedef struct
+{
+  volatile uint32_t cr1_log[MOCK_LOG];
+  volatile uint32_t CR2;
+  volatile uint32_t SR;
+  volatile uint32_t DR;
+} SPI_TypeDef;
+
+#define CR1                             cr1_log[mock_write()]
+
+typedef struct
+{
+  volatile uint32_t bsrr_log[MOCK_LOG];
+} GPIO_TypeDef;
+
+#define BSRR                            bsrr_log[mock_write()]
+
+typedef struct
+{
+  volatile uint32_t CR;
+  volatile uint32_t NDTR;
+  volatile uint32_t PAR;
+  volatile uint32_t M0AR;
+  volatile uint32_t M1AR;
+  volatile uint32_t FCR;
+} DMA_Stream_TypeDef;
+
+typedef struct
+{
+  volatile uint32_t APB1ENR;
+  volatile uint32_t APB2ENR;
+} RCC_TypeDef;
+
+extern SPI_TypeDef mock_spi[3];
+extern GPIO_TypeDef mock_gpio[9];
+extern RCC_TypeDef mock_rcc;
+
+#define SPI1                            (&mock_spi[0])
+#define SPI2                            (&mock_spi[1])
+#define SPI3                            (&mock_spi[2])
+#define RCC                             (&mock_rcc)
+#define GPIOA_BASE                      ((uintptr_t) &mock_gpio[0])
+#define GPIOB_BASE                      ((uintptr_t) &mock_gpio[1])
+
+#define RCC_APB1ENR_SPI2EN              (0x00004000U)
+#define RCC_APB1ENR_SPI3EN              (0x00008000U)
+#define RCC_APB2ENR_SPI1EN              (0x00001000U)
+
+#define SPI_CR1_CPHA                    (0x00000001U)
+#define SPI_CR1_CPOL                    (0x00000002U)
+#define SPI_CR1_MSTR                    (0x00000004U)
+#define SPI_CR1_SPE                     (0x00000040U)
+#define SPI_CR1_LSBFIRST                (0x00000080U)
+#define SPI_CR1_SSI                     (0x00000100U)
+#define SPI_CR1_SSM                     (0x00000200U)
+#define SPI_CR2_RXDMAEN                 (0x00000001U)
+#define SPI_CR2_TXDMAEN                 (0x00000002U)
+
+#define DMA_SxCR_EN                     (0x00000001U)
+#define DMA_SxCR_TEIE                   (0x00000004U)
+#define DMA_SxCR_TCIE                   (0x00000010U)
+#define DMA_SxCR_DIR_0                  (0x00000040U)
+#define DMA_SxCR_DIR_1                  (0x00000080U)
+#define DMA_SxCR_MINC                   (0x00000400U)
+
+// Interrupts are only ever taken when the test delivers them, so the mask
+// is just remembered
+extern uint32_t mock_primask;
+
+static inline uint32_t __get_PRIMASK(void)
+{
+  return mock_primask;
+}
+
+static inline void __set_PRIMASK(uint32_t primask)
+{
+  mock_primask = primask;
+}
+
+static inline void __disable_irq(void)
+{
+  mock_primask = 1U;
+}
+
+static inline void __enable_irq(void)
+{
+  mock_primask = 0U;
+}
+
+static inline void __ISB(void)
+{
+}
+
+#endif // MOCK_STM32F4XX_H_
@@ -0,0 +1,22 @@
+/*
+ * stm32f4xx_hal.h
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for the HAL header: the few HAL constants the drivers use.
+
+#ifndef MOCK_STM32F4XX_HAL_H_
+#define MOCK_STM32F4XX_HAL_H_
+
+#include "stm32f4xx.h"
+
+#define GPIO_NOPULL                     (0x00000000U)
+#define GPIO_PULLUP                     (0x00000001U)
+
+#define GPIO_AF5_SPI1                   ((uint8_t) 0x05U)
+#define GPIO_AF5_SPI2                   ((uint8_t) 0x05U)
+#define GPIO_AF6_SPI3                   ((uint8_t) 0x06U)
+
+#endif // MOCK_STM32F4XX_HAL_H_
@@ -0,0 +1,154 @@
+/*
+ * ramfunc_bench.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Times the functions that CARZOS_RAMFUNC moves to SRAM1, in cycles per
+// call, to tell whether they are worth the RAM.
+//
+// Each function is called RAMFUNC_BENCH_CALLS times with the interrupts
+// masked, each call timed on its own with the DWT cycle counter, less the
+// cost of reading it. The report gives the first call (ART cache cold
+// for flash code), the least and the mean, and where the code is, flash
+// or RAM, from its address.
+//
+//   SysTick_Handler  the whole tick: timer, cpuload, stack scan (the
+//                    calls advance timer_ticks by RAMFUNC_BENCH_CALLS)
+//   workq_post       a post of a fresh item to 'level', which then runs
+//                    them all (they do nothing) once the bench unmasks
+//   kmem_alloc/free  a 64 byte block and back, on the kernel heap
+//
+// Target only. Build the firmware twice, as is and with
+// CARZOS_RAMFUNC_FLASH defined (sections.h), add this file to both, and
+// call ramfunc_bench() once trace_init() and kmem_init() have run; the
+// report goes out through trace_printf(). It returns non zero when
+// 'level' is not set up.
+
+#if defined(__arm__)
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <cortexm/exception_handlers.h>
+#include <dwt.h>
+#include <trace.h>
+#include <workq.h>
+
+#define RAMFUNC_BENCH_CALLS     (32U)
+#define RAMFUNC_BENCH_ALLOC     (64U)
+
+extern uint32_t ramfunc_bench(uint32_t level);
+
+// Not in a header
+extern void *kmem_alloc(uint32_t size);
+extern uint32_t kmem_free(void *p);
+
+typedef struct ramfunc_bench_result
+{
+  uint32_t first;
+  uint32_t min;
+  uint32_t total;
+} ramfunc_bench_Result;
+
+static workq_Item ramfunc_bench_items[RAMFUNC_BENCH_CALLS];
+
+
+static void ramfunc_bench_nothing(void *arg)
+{
+  (void) arg;
+}
+
+static void ramfunc_bench_add(ramfunc_bench_Result *result, uint32_t n, uint32_t cycles)
+{
+  if (n == 0U)
+    {
+      result->first = cycles;
+      result->min = cycles;
+      result->total = 0U;
+    }
+  else if (cycles < result->min)
+    {
+      result->min = cycles;
+    }
+  result->total += cycles;
+}
+
+static void ramfunc_bench_report(const char *name, const void *code,
+                                 const ramfunc_bench_Result *result)
+{
+  // SRAM1 and SRAM2 from 0x20000000; flash, and its alias at 0, below
+  const char *where = (((uintptr_t) code >> 28) == 0x2U) ? "ram" : "flash";
+
+  trace_printf("%-16s %-5s %6u %6u %6u\n", name, where, result->first,
+               result->min, result->total / RAMFUNC_BENCH_CALLS);
+}
+
+uint32_t ramfunc_bench(uint32_t level)
+{
+  ramfunc_bench_Result tick;
+  ramfunc_bench_Result post;
+  ramfunc_bench_Result alloc;
+  ramfunc_bench_Result release;
+
+  dwt_init();
+
+  // The level must have been set up with workq_init()
+  for (uint32_t i = 0U; i < RAMFUNC_BENCH_CALLS; i++)
+    {
+      if (workq_item_init(&ramfunc_bench_items[i], ramfunc_bench_nothing, NULL, level) != 0U)
+        {
+          return 1U;
+        }
+    }
+
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+
+  // The cost of the two reads around each call
+  uint32_t overhead = UINT32_MAX;
+  for (uint32_t i = 0U; i < RAMFUNC_BENCH_CALLS; i++)
+    {
+      uint32_t start = dwt_cycles();
+      uint32_t cycles = dwt_cycles() - start;
+      overhead = (cycles < overhead) ? cycles : overhead;
+    }
+
+  for (uint32_t i = 0U; i < RAMFUNC_BENCH_CALLS; i++)
+    {
+      uint32_t start = dwt_cycles();
+      SysTick_Handler();
+      ramfunc_bench_add(&tick, i, (dwt_cycles() - start) - overhead);
+    }
+
+  for (uint32_t i = 0U; i < RAMFUNC_BENCH_CALLS; i++)
+    {
+      uint32_t start = dwt_cycles();
+      workq_post(&ramfunc_bench_items[i]);
+      ramfunc_bench_add(&post, i, (dwt_cycles() - start) - overhead);
+    }
+
+  for (uint32_t i = 0U; i < RAMFUNC_BENCH_CALLS; i++)
+    {
+      uint32_t start = dwt_cycles();
+      void *p = kmem_alloc(RAMFUNC_BENCH_ALLOC);
+      ramfunc_bench_add(&alloc, i, (dwt_cycles() - start) - overhead);
+
+      start = dwt_cycles();
+      kmem_free(p);
+      ramfunc_bench_add(&release, i, (dwt_cycles() - start) - overhead);
+    }
+
+  __set_PRIMASK(primask);
+
+  trace_printf("%-16s %-5s %6s %6s %6s\n", "cycles", "code", "first", "min", "mean");
+  ramfunc_bench_report("SysTick_Handler", (const void *) SysTick_Handler, &tick);
+  ramfunc_bench_report("workq_post", (const void *) workq_post, &post);
+  ramfunc_bench_report("kmem_alloc", (const void *) kmem_alloc, &alloc);
+  ramfunc_bench_report("kmem_free", (const void *) kmem_free, &release);
+
+  return 0U;
+}
+
+#endif // defined(__arm__)
@@ -0,0 +1,377 @@
+/*
+ * sdcard_file.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host stand-in for sdcard.c: the sdcard.h interface over an image file,
+// so that file systems and loggers on the block device run on a PC and
+// their images can be looked at with the host tools (mkfs, fsck, mount
+// -o loop).
+//
+// The image is $SDCARD_IMAGE ("sdcard.img" by default); it is made, 64
+// MiB of zeros, when there is none, and its size is the card's, rounded
+// down to whole sectors.
+//
+// Requests queue as with the driver and, when the config asks for it,
+// are merged by the same rules: next in the queue, same direction,
+// adjacent sectors, SDCARD_RUN_MAX sectors at most, so the statistics
+// tell what the card would have seen. Nothing moves on its own: sdcard_file_poll() runs the queue,
+// one pread() or pwrite() per request, then calls the callbacks in
+// submission order, and returns how many requests it completed.
+// sdcard_transfer() polls until its request is done.
+//
+//   $ cc -I system/include/carzos -DSDCARD_FILE_DEMO -o sdcard_demo tools/sdcard_file.c
+//   $ ./sdcard_demo
+
+#define _DEFAULT_SOURCE
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <sdcard.h>
+
+#define SDCARD_FILE_DEFAULT     "sdcard.img"
+#define SDCARD_FILE_NEW_SIZE    (64UL * 1024UL * 1024UL)
+
+typedef struct sdcard_file_card
+{
+  int fd;
+  uint32_t sectors;
+  uint32_t hz;
+  uint32_t merge;
+
+  sdcard_Request *head;
+  sdcard_Request *tail;
+
+  sdcard_Stats stats;
+} sdcard_file_Card;
+
+static sdcard_file_Card sdcard_file = { .fd = -1 };
+
+// Not in sdcard.h: on the target the interrupts do it
+uint32_t sdcard_file_poll(void);
+
+
+uint32_t sdcard_init(const sdcard_Config *config)
+{
+  if (config == NULL)
+    {
+      return 1U;
+    }
+
+  const char *path = getenv("SDCARD_IMAGE");
+  if (path == NULL)
+    {
+      path = SDCARD_FILE_DEFAULT;
+    }
+
+  if (sdcard_file.fd >= 0)
+    {
+      close(sdcard_file.fd);
+    }
+  memset(&sdcard_file, 0, sizeof(sdcard_file));
+  sdcard_file.fd = open(path, O_RDWR | O_CREAT, 0644);
+  if (sdcard_file.fd < 0)
+    {
+      perror(path);
+      return 1U;
+    }
+
+  struct stat st;
+  if (fstat(sdcard_file.fd, &st) != 0)
+    {
+      perror(path);
+      return 1U;
+    }
+  if (st.st_size < (off_t) SDCARD_SECTOR)
+    {
+      if (ftruncate(sdcard_file.fd, (off_t) SDCARD_FILE_NEW_SIZE) != 0)
+        {
+          perror(path);
+          return 1U;
+        }
+      st.st_size = (off_t) SDCARD_FILE_NEW_SIZE;
+    }
+  sdcard_file.sectors = (uint32_t) (st.st_size / SDCARD_SECTOR);
+
+  sdcard_file.merge = config->merge;
+
+  // A high speed card, unless max_hz says otherwise
+  sdcard_file.hz = 50000000U;
+  if ((config->max_hz != 0U) && (config->max_hz < sdcard_file.hz))
+    {
+      sdcard_file.hz = config->max_hz;
+    }
+
+  return 0U;
+}
+
+uint32_t sdcard_submit(sdcard_Request *request)
+{
+  if ((request == NULL) || (sdcard_file.fd < 0) || (request->buf == NULL)
+      || (((uintptr_t) request->buf & 3U) != 0U)
+      || (request->count == 0U) || (request->count > SDCARD_RUN_MAX)
+      || (request->sector >= sdcard_file.sectors)
+      || (request->count > (sdcard_file.sectors - request->sector))
+      || (request->write > SDCARD_WRITE))
+    {
+      return 1U;
+    }
+
+  request->next = NULL;
+  request->busy = 1U;
+  request->tries = 0U;
+
+  sdcard_file.stats.requests++;
+  if (sdcard_file.tail != NULL)
+    {
+      sdcard_file.tail->next = request;
+    }
+  else
+    {
+      sdcard_file.head = request;
+    }
+  sdcard_file.tail = request;
+
+  return 0U;
+}
+
+static uint32_t sdcard_file_io(const sdcard_Request *request)
+{
+  size_t len = (size_t) request->count * SDCARD_SECTOR;
+  off_t offset = (off_t) request->sector * SDCARD_SECTOR;
+  ssize_t done;
+
+  if (request->write != 0U)
+    {
+      done = pwrite(sdcard_file.fd, request->buf, len, offset);
+    }
+  else
+    {
+      done = pread(sdcard_file.fd, request->buf, len, offset);
+    }
+  return (done == (ssize_t) len) ? 0U : 1U;
+}
+
+uint32_t sdcard_file_poll(void)
+{
+  sdcard_Request *done = NULL;
+  sdcard_Request *done_tail = NULL;
+  uint32_t completed = 0U;
+
+  while (sdcard_file.head != NULL)
+    {
+      // One command: the run the driver would merge
+      sdcard_Request *first = sdcard_file.head;
+      uint32_t count = 1U;
+      uint32_t sectors = first->count;
+      for (sdcard_Request *r = first->next; (r != NULL) && (sdcard_file.merge != 0U); r = r->next)
+        {
+          if ((r->write != first->write) || (r->sector != (first->sector + sectors))
+              || ((sectors + r->count) > SDCARD_RUN_MAX))
+            {
+              break;
+            }
+          sectors += r->count;
+          count++;
+        }
+      sdcard_file.stats.commands++;
+      sdcard_file.stats.merged += count - 1U;
+
+      for (uint32_t i = 0U; i < count; i++)
+        {
+          sdcard_Request *request = sdcard_file.head;
+          sdcard_file.head = request->next;
+
+          request->status = sdcard_file_io(request);
+          if (request->status != 0U)
+            {
+              sdcard_file.stats.errors++;
+            }
+          else if (request->write != 0U)
+            {
+              sdcard_file.stats.sectors_written += request->count;
+            }
+          else
+            {
+              sdcard_file.stats.sectors_read += request->count;
+            }
+
+          request->next = NULL;
+          if (done_tail != NULL)
+            {
+              done_tail->next = request;
+            }
+          else
+            {
+              done = request;
+            }
+          done_tail = request;
+        }
+    }
+  sdcard_file.tail = NULL;
+
+  // Callbacks may submit again; that goes to the next poll
+  while (done != NULL)
+    {
+      sdcard_Request *next = done->next;
+      done->busy = 0U;
+      if (done->callback != NULL)
+        {
+          done->callback(done->arg, done);
+        }
+      done = next;
+      completed++;
+    }
+
+  return completed;
+}
+
+uint32_t sdcard_transfer(uint32_t sector, uint32_t count, uint8_t *buf, uint32_t write)
+{
+  sdcard_Request request =
+    {
+      .sector = sector,
+      .count = count,
+      .buf = buf,
+      .write = write,
+    };
+
+  if (sdcard_submit(&request) != 0U)
+    {
+      return 1U;
+    }
+  while (request.busy != 0U)
+    {
+      sdcard_file_poll();
+    }
+  return request.status;
+}
+
+uint32_t sdcard_watchdog(uint32_t timeout_ms)
+{
+  (void) timeout_ms;
+  return 0U;
+}
+
+void sdcard_info(sdcard_Info *info)
+{
+  info->sectors = sdcard_file.sectors;
+  info->hz = sdcard_file.hz;
+  info->bus_width = 4U;
+  info->high_capacity = 1U;
+  info->high_speed = (sdcard_file.hz > 25000000U) ? 1U : 0U;
+  info->cmd23 = 1U;
+}
+
+void sdcard_stats(sdcard_Stats *stats)
+{
+  *stats = sdcard_file.stats;
+}
+
+#if defined(SDCARD_FILE_DEMO)
+
+#define SDCARD_FILE_DEMO_PIECES (16U)
+#define SDCARD_FILE_DEMO_PIECE  (8U)    // sectors, 4 KiB
+
+static uint32_t sdcard_file_demo_done;
+
+static void sdcard_file_demo_callback(void *arg, sdcard_Request *request)
+{
+  (void) arg;
+  if (request->status != 0U)
+    {
+      printf("sector %u: failed\n", request->sector);
+    }
+  sdcard_file_demo_done++;
+}
+
+static void sdcard_file_demo_stats(const char *what)
+{
+  sdcard_Stats stats;
+  sdcard_stats(&stats);
+  printf("%-6s %3u requests %3u commands %3u merged %5u read %5u written %u errors\n",
+         what, stats.requests, stats.commands, stats.merged, stats.sectors_read,
+         stats.sectors_written, stats.errors);
+}
+
+int main(void)
+{
+  static uint32_t data[SDCARD_FILE_DEMO_PIECES * SDCARD_FILE_DEMO_PIECE * SDCARD_SECTOR / 4U];
+  static uint32_t back[sizeof(data) / 4U];
+  static sdcard_Request requests[SDCARD_FILE_DEMO_PIECES];
+
+  sdcard_Config config = { .max_hz = 0U, .merge = 1U };
+  if (sdcard_init(&config) != 0U)
+    {
+      return 1;
+    }
+
+  sdcard_Info info;
+  sdcard_info(&info);
+  printf("%u sectors (%u MiB), %u bit bus at %u MHz\n", info.sectors,
+         info.sectors / 2048U, info.bus_width, info.hz / 1000000U);
+
+  for (uint32_t i = 0U; i < (sizeof(data) / 4U); i++)
+    {
+      data[i] = (i * 2654435761U) ^ 0x5DC0A2D5U;
+    }
+
+  // Sequential 4 KiB writes, queued together: one command. Sector 1000
+  // on, so that a partition table at 0 is left alone.
+  uint8_t *bytes = (uint8_t *) data;
+  for (uint32_t i = 0U; i < SDCARD_FILE_DEMO_PIECES; i++)
+    {
+      requests[i] = (sdcard_Request)
+        {
+          .sector = 1000U + (i * SDCARD_FILE_DEMO_PIECE),
+          .count = SDCARD_FILE_DEMO_PIECE,
+          .buf = bytes + (i * SDCARD_FILE_DEMO_PIECE * SDCARD_SECTOR),
+          .write = SDCARD_WRITE,
+          .callback = sdcard_file_demo_callback,
+        };
+      sdcard_submit(&requests[i]);
+    }
+  sdcard_file_poll();
+  sdcard_file_demo_stats("write");
+
+  // Read back in other pieces, 2 KiB, last first: adjacent sectors but
+  // not in queue order, so no merging
+  uint8_t *into = (uint8_t *) back;
+  uint32_t pieces = (SDCARD_FILE_DEMO_PIECES * SDCARD_FILE_DEMO_PIECE) / 4U;
+  static sdcard_Request reads[(SDCARD_FILE_DEMO_PIECES * SDCARD_FILE_DEMO_PIECE) / 4U];
+  for (uint32_t i = pieces; i > 0U; i--)
+    {
+      reads[i - 1U] = (sdcard_Request)
+        {
+          .sector = 1000U + ((i - 1U) * 4U),
+          .count = 4U,
+          .buf = into + ((i - 1U) * 4U * SDCARD_SECTOR),
+          .write = SDCARD_READ,
+          .callback = sdcard_file_demo_callback,
+        };
+      sdcard_submit(&reads[i - 1U]);
+    }
+  sdcard_file_poll();
+  sdcard_file_demo_stats("read");
+  uint32_t same = (memcmp(data, back, sizeof(data)) == 0) ? 1U : 0U;
+
+  // Again in one blocking read
+  memset(back, 0, sizeof(back));
+  sdcard_transfer(1000U, SDCARD_FILE_DEMO_PIECES * SDCARD_FILE_DEMO_PIECE, into, SDCARD_READ);
+  sdcard_file_demo_stats("read");
+  same &= (memcmp(data, back, sizeof(data)) == 0) ? 1U : 0U;
+
+  printf("%u callbacks, data %s\n", sdcard_file_demo_done,
+         (same != 0U) ? "matches" : "DIFFERS");
+  return 0;
+}
+
+#endif // defined(SDCARD_FILE_DEMO)
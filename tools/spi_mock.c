@@ -0,0 +1,484 @@
+/*
+ * spi_mock.c
+ *
+ *  Created on: Oct 19, 2026
+ *      Author: ci
+ */
+
+// Host test of the SPI bus manager: spi.c as it is, built against a mock
+// SPI1, its two DMA streams and the GPIO ports, printing what the queue
+// puts on the wire.
+//
+// tools/mock stands in for the device headers. Every write of SPI CR1 and
+// of a GPIO BSRR is logged in order (see tools/mock/stm32f4xx.h), so the
+// chip select edges and the settings written between two transfers are
+// known exactly. The bus moves when the test runs it: a transfer takes its
+// length in SCK periods at the divider in CR1, the device on the far end
+// answers each byte with its complement, then the RX stream's handler is
+// called as the NVIC would, and the work items posted run after it.
+// Interrupt latency is not modelled: a transfer that the completion
+// interrupt starts follows the last one without a gap.
+//
+// It checks that
+//   - a device slower than the bus clock over 256 is refused,
+//   - the data comes back, through queued and blocking transfers,
+//   - CR1 is written only when the next transfer is for another device,
+//     and once more after a clock change, with the new divider,
+//   - a transfer with cs_hold keeps its chip select low into the next,
+//   - every queued transfer is started from the completion interrupt,
+// and returns non zero when one of them fails.
+//
+// The DMA address registers are 32 bit, so the buffers must be below
+// 4 GiB: build without PIE, and keep them static.
+//
+//   $ cc -no-pie -Wno-pointer-to-int-cast -I tools/mock -I system/include/carzos -o spi_mock tools/spi_mock.c
+//   $ ./spi_mock
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../system/src/carzos/spi.c"
+
+#define SPI_MOCK_PCLK1          (42000000U)
+#define SPI_MOCK_PORTS          (9U)
+#define SPI_MOCK_ITEMS          (8U)
+
+typedef struct spi_mock_stream
+{
+  DMA_Stream_TypeDef regs;
+  volatile uint32_t isr;
+  volatile uint32_t ifcr;
+  irq_Handler handler;
+  void *ctx;
+} spi_mock_Stream;
+
+SPI_TypeDef mock_spi[3];
+GPIO_TypeDef mock_gpio[SPI_MOCK_PORTS];
+RCC_TypeDef mock_rcc;
+uint32_t mock_primask;
+
+static uint32_t spi_mock_pclk2 = 84000000U;
+static clock_Listener *spi_mock_listeners;
+
+static spi_mock_Stream spi_mock_dma[2][8];
+static workq_Item *spi_mock_items[SPI_MOCK_ITEMS];
+static uint32_t spi_mock_pending;
+
+// The register log: slots handed out, slots replayed
+static uint32_t spi_mock_written;
+static uint32_t spi_mock_seen;
+
+// What the hardware holds
+static uint32_t spi_mock_cr1;
+static uint32_t spi_mock_odr[SPI_MOCK_PORTS];
+
+static double spi_mock_us;
+static uint32_t spi_mock_quiet;
+static uint32_t spi_mock_from_irq;
+
+static uint32_t spi_mock_transfers;
+static uint32_t spi_mock_chained;
+static uint32_t spi_mock_cr1_writes;
+static uint32_t spi_mock_cs_edges;
+static uint32_t spi_mock_failed;
+
+
+// ----- Mocked kernel interfaces ---------------------------------------------
+
+uint32_t mock_write(void)
+{
+  return spi_mock_written++ % MOCK_LOG;
+}
+
+uint32_t clock_pclk1(void)
+{
+  return SPI_MOCK_PCLK1;
+}
+
+uint32_t clock_pclk2(void)
+{
+  return spi_mock_pclk2;
+}
+
+void clock_listen(clock_Listener *listener, clock_Callback fn, void *arg)
+{
+  listener->fn = fn;
+  listener->arg = arg;
+  listener->next = spi_mock_listeners;
+  spi_mock_listeners = listener;
+}
+
+void pin_af(uint32_t pin, uint32_t af, uint32_t pull, uint32_t type)
+{
+  (void) pin;
+  (void) af;
+  (void) pull;
+  (void) type;
+}
+
+void pin_output(uint32_t pin, uint32_t type)
+{
+  (void) pin;
+  (void) type;
+}
+
+uint32_t dma_stream_init(dma_Stream *stream, uint32_t controller, uint32_t index,
+                         irq_Handler handler, void *ctx, uint32_t priority)
+{
+  (void) priority;
+
+  if ((controller < 1U) || (controller > 2U) || (index > 7U))
+    {
+      return 1U;
+    }
+
+  spi_mock_Stream *mock = &spi_mock_dma[controller - 1U][index];
+  memset(mock, 0, sizeof(*mock));
+  mock->handler = handler;
+  mock->ctx = ctx;
+
+  stream->regs = &mock->regs;
+  stream->isr = &mock->isr;
+  stream->ifcr = &mock->ifcr;
+  stream->shift = 0U;
+  stream->irqn = DCMI_IRQn;
+  return 0U;
+}
+
+void dma_stop(const dma_Stream *stream)
+{
+  stream->regs->CR &= ~DMA_SxCR_EN;
+  *stream->isr = 0U;
+}
+
+uint32_t workq_item_init(workq_Item *item, workq_Fn fn, void *arg, uint32_t level)
+{
+  item->fn = fn;
+  item->arg = arg;
+  item->next = NULL;
+  item->pending = 0U;
+  item->level = level;
+  return 0U;
+}
+
+uint32_t workq_post(workq_Item *item)
+{
+  if (item->pending == 0U)
+    {
+      if (spi_mock_pending == SPI_MOCK_ITEMS)
+        {
+          return 1U;
+        }
+      item->pending = 1U;
+      spi_mock_items[spi_mock_pending++] = item;
+    }
+  return 0U;
+}
+
+static uint32_t spi_mock_step(void);
+
+// spi_transfer() waits here
+void cpuload_idle(void)
+{
+  if (spi_mock_step() == 0U)
+    {
+      printf("spi_transfer() waits for a bus that does not move\n");
+      exit(1);
+    }
+}
+
+
+// ----- The hardware ---------------------------------------------------------
+
+static void spi_mock_check(uint32_t ok, const char *what)
+{
+  if (ok == 0U)
+    {
+      printf("  FAILED: %s\n", what);
+      spi_mock_failed++;
+    }
+}
+
+static uint32_t spi_mock_sck(uint32_t cr1)
+{
+  return spi_mock_pclk2 >> (((cr1 >> SPI_CR1_BR_SHIFT) & SPI_BR_MAX) + 1U);
+}
+
+// Replays the register writes since the last call
+static void spi_mock_replay(void)
+{
+  for (; spi_mock_seen != spi_mock_written; spi_mock_seen++)
+    {
+      uint32_t slot = spi_mock_seen % MOCK_LOG;
+
+      uint32_t value = mock_spi[0].cr1_log[slot];
+      if (value != MOCK_UNWRITTEN)
+        {
+          mock_spi[0].cr1_log[slot] = MOCK_UNWRITTEN;
+          spi_mock_cr1 = value;
+          spi_mock_cr1_writes++;
+          if (spi_mock_quiet == 0U)
+            {
+              printf("%9.3f us  CR1 0x%04x  mode %u, SCK %u kHz%s\n", spi_mock_us, value,
+                     value & SPI_MODE_3, spi_mock_sck(value) / 1000U,
+                     ((value & SPI_CR1_SPE) != 0U) ? "" : ", disabled");
+            }
+          continue;
+        }
+
+      for (uint32_t port = 0U; port < SPI_MOCK_PORTS; port++)
+        {
+          value = mock_gpio[port].bsrr_log[slot];
+          if (value == MOCK_UNWRITTEN)
+            {
+              continue;
+            }
+          mock_gpio[port].bsrr_log[slot] = MOCK_UNWRITTEN;
+
+          for (uint32_t n = 0U; n < 16U; n++)
+            {
+              const char *edge = NULL;
+              if ((value & (1U << n)) != 0U)
+                {
+                  spi_mock_odr[port] |= 1U << n;
+                  edge = "high";
+                }
+              else if ((value & (1U << (n + 16U))) != 0U)
+                {
+                  spi_mock_odr[port] &= ~(1U << n);
+                  edge = "low";
+                }
+              if ((edge != NULL) && (spi_mock_quiet == 0U))
+                {
+                  spi_mock_cs_edges++;
+                  printf("%9.3f us  CS P%c%u %s\n", spi_mock_us, 'A' + port, n, edge);
+                }
+            }
+          break;
+        }
+    }
+}
+
+static void spi_mock_work(void)
+{
+  for (uint32_t i = 0U; i < spi_mock_pending; i++)
+    {
+      workq_Item *item = spi_mock_items[i];
+      item->pending = 0U;
+      item->fn(item->arg);
+    }
+  spi_mock_pending = 0U;
+}
+
+// Runs one transfer of SPI1 to its end; zero when the streams are idle
+static uint32_t spi_mock_step(void)
+{
+  spi_mock_Stream *rx = &spi_mock_dma[1][0];
+  spi_mock_Stream *tx = &spi_mock_dma[1][3];
+
+  spi_mock_replay();
+  if (((rx->regs.CR & DMA_SxCR_EN) == 0U) || ((tx->regs.CR & DMA_SxCR_EN) == 0U))
+    {
+      spi_mock_check(((rx->regs.CR | tx->regs.CR) & DMA_SxCR_EN) == 0U,
+                     "one stream enabled without the other");
+      return 0U;
+    }
+
+  // The chip select low, one and only one
+  char selected[8] = "none";
+  uint32_t low = 0U;
+  for (uint32_t port = 0U; port < SPI_MOCK_PORTS; port++)
+    {
+      for (uint32_t n = 0U; n < 16U; n++)
+        {
+          if ((spi_mock_odr[port] & (1U << n)) == 0U)
+            {
+              snprintf(selected, sizeof(selected), "P%c%u", 'A' + port, n);
+              low++;
+            }
+        }
+    }
+  spi_mock_check(low == 1U, "one chip select low");
+  spi_mock_check((spi_mock_cr1 & SPI_CR1_SPE) != 0U, "SPI enabled");
+  spi_mock_check(rx->regs.NDTR == tx->regs.NDTR, "RX and TX of the same length");
+
+  uint32_t len = tx->regs.NDTR;
+  uint32_t sck = spi_mock_sck(spi_mock_cr1);
+  printf("%9.3f us  start %5u bytes, %s, SCK %u kHz, from %s\n", spi_mock_us, len,
+         selected, sck / 1000U, (spi_mock_from_irq != 0U) ? "the interrupt" : "main");
+  spi_mock_transfers++;
+  spi_mock_chained += spi_mock_from_irq;
+
+  const uint8_t *src = (const uint8_t *) (uintptr_t) tx->regs.M0AR;
+  uint8_t *dst = (uint8_t *) (uintptr_t) rx->regs.M0AR;
+  for (uint32_t i = 0U; i < len; i++)
+    {
+      uint8_t byte = src[((tx->regs.CR & DMA_SxCR_MINC) != 0U) ? i : 0U];
+      dst[((rx->regs.CR & DMA_SxCR_MINC) != 0U) ? i : 0U] = (uint8_t) ~byte;
+    }
+  spi_mock_us += (len * 8.0 * 1e6) / sck;
+
+  tx->regs.NDTR = 0U;
+  rx->regs.NDTR = 0U;
+  tx->regs.CR &= ~DMA_SxCR_EN;
+  rx->regs.CR &= ~DMA_SxCR_EN;
+  tx->isr |= DMA_FLAG_TC | DMA_FLAG_HT;
+  rx->isr |= DMA_FLAG_TC | DMA_FLAG_HT;
+  printf("%9.3f us  end\n", spi_mock_us);
+
+  // The completion interrupt
+  uint32_t primask = mock_primask;
+  mock_primask = 1U;
+  rx->handler(rx->ctx);
+  mock_primask = primask;
+  rx->isr &= ~rx->ifcr;
+  tx->isr &= ~tx->ifcr;
+  rx->ifcr = 0U;
+  tx->ifcr = 0U;
+
+  spi_mock_replay();
+  spi_mock_from_irq = ((rx->regs.CR & DMA_SxCR_EN) != 0U) ? 1U : 0U;
+
+  spi_mock_work();
+  return 1U;
+}
+
+static void spi_mock_run(void)
+{
+  while (spi_mock_step() != 0U)
+    {
+    }
+}
+
+static void spi_mock_clock(uint32_t pclk2)
+{
+  printf("%9.3f us  clock: PCLK2 %u MHz\n", spi_mock_us, pclk2 / 1000000U);
+  for (clock_Listener *l = spi_mock_listeners; l != NULL; l = l->next)
+    {
+      l->fn(l->arg, CLOCK_EVENT_PRE);
+    }
+  spi_mock_pclk2 = pclk2;
+  for (clock_Listener *l = spi_mock_listeners; l != NULL; l = l->next)
+    {
+      l->fn(l->arg, CLOCK_EVENT_POST);
+    }
+}
+
+
+// ----- The test -------------------------------------------------------------
+
+static uint32_t spi_mock_callbacks;
+
+static void spi_mock_callback(void *arg, spi_Transfer *transfer)
+{
+  (void) arg;
+  spi_mock_check(transfer->status == 0U, "transfer status");
+  spi_mock_callbacks++;
+}
+
+static uint32_t spi_mock_answer(const uint8_t *tx, const uint8_t *rx, uint32_t len)
+{
+  for (uint32_t i = 0U; i < len; i++)
+    {
+      uint8_t answer = (uint8_t) ~((tx != NULL) ? tx[i] : 0xFFU);
+      if (rx[i] != answer)
+        {
+          return 0U;
+        }
+    }
+  return 1U;
+}
+
+int main(void)
+{
+  static spi_Bus bus;
+  static spi_Device flash;
+  static spi_Device sensor;
+  static spi_Transfer queue[5];
+
+  static const uint8_t command[4] = { 0x0BU, 0x00U, 0x10U, 0x00U };
+  static uint8_t status[4];
+  static uint8_t page[16];
+  static const uint8_t reg[2] = { 0x8FU, 0x00U };
+  static uint8_t first[2];
+  static uint8_t second[2];
+  static uint8_t more[8];
+
+  memset(mock_spi, 0xFF, sizeof(mock_spi));
+  memset(mock_gpio, 0xFF, sizeof(mock_gpio));
+  for (uint32_t port = 0U; port < SPI_MOCK_PORTS; port++)
+    {
+      spi_mock_odr[port] = 0xFFFFU;
+    }
+
+  spi_BusConfig config =
+    {
+      .sck_pin = PIN('A', 5),
+      .miso_pin = PIN('A', 6),
+      .mosi_pin = PIN('A', 7),
+      .priority = 5U,
+      .level = 1U,
+    };
+  spi_mock_check(spi_bus_init(&bus, 1U, &config) == 0U, "spi_bus_init");
+  spi_mock_check(spi_device_init(&flash, &bus, PIN('A', 4), 21000000U, SPI_MODE_0) == 0U,
+                 "spi_device_init");
+  spi_mock_check(spi_device_init(&sensor, &bus, PIN('B', 12), 1000000U, SPI_MODE_3) == 0U,
+                 "spi_device_init");
+  spi_Device slow;
+  spi_mock_check(spi_device_init(&slow, &bus, PIN('C', 0), 100000U, SPI_MODE_0) != 0U,
+                 "spi_device_init refuses a device slower than PCLK2 / 256");
+  spi_mock_quiet = 1U;
+  spi_mock_replay();
+  spi_mock_quiet = 0U;
+  spi_mock_cr1_writes = 0U;
+
+  // A flash read (command with cs_hold, then the data), two sensor
+  // registers, flash again: all queued before the bus moves
+  printf("queued: flash, flash, sensor, sensor, flash\n");
+  queue[0] = (spi_Transfer) { .device = &flash, .tx = command, .rx = status, .len = 4U,
+                              .cs_hold = 1U, .callback = spi_mock_callback };
+  queue[1] = (spi_Transfer) { .device = &flash, .rx = page, .len = 16U,
+                              .callback = spi_mock_callback };
+  queue[2] = (spi_Transfer) { .device = &sensor, .tx = reg, .rx = first, .len = 2U,
+                              .callback = spi_mock_callback };
+  queue[3] = (spi_Transfer) { .device = &sensor, .tx = reg, .rx = second, .len = 2U,
+                              .callback = spi_mock_callback };
+  queue[4] = (spi_Transfer) { .device = &flash, .rx = more, .len = 8U,
+                              .callback = spi_mock_callback };
+  for (uint32_t i = 0U; i < 5U; i++)
+    {
+      spi_mock_check(spi_submit(&queue[i]) == 0U, "spi_submit");
+    }
+  spi_mock_run();
+
+  spi_mock_check(spi_mock_callbacks == 5U, "five callbacks");
+  spi_mock_check(spi_mock_chained == 4U, "four transfers started from the interrupt");
+  spi_mock_check(spi_mock_cr1_writes == 6U, "CR1 set three times, two writes each");
+  spi_mock_check(spi_mock_cs_edges == 8U, "no chip select edge between command and data");
+  spi_mock_check(spi_mock_answer(command, status, 4U) && spi_mock_answer(NULL, page, 16U)
+                 && spi_mock_answer(reg, first, 2U) && spi_mock_answer(reg, second, 2U)
+                 && spi_mock_answer(NULL, more, 8U), "data");
+  uint32_t before = (bus.cr1 >> SPI_CR1_BR_SHIFT) & SPI_BR_MAX;
+
+  // Half the clock: the flash divider is worked out again on its next use
+  printf("\n");
+  spi_mock_cr1_writes = 0U;
+  spi_mock_clock(42000000U);
+  spi_mock_check(spi_submit(&queue[4]) == 0U, "spi_submit");
+  spi_mock_run();
+  spi_mock_check(spi_mock_cr1_writes == 2U, "CR1 set again after the clock change");
+  spi_mock_check(((bus.cr1 >> SPI_CR1_BR_SHIFT) & SPI_BR_MAX) == (before - 1U),
+                 "divider halved");
+
+  // Blocking, from main
+  printf("\nspi_transfer(): sensor\n");
+  memset(first, 0, sizeof(first));
+  spi_mock_check(spi_transfer(&sensor, reg, first, 2U) == 0U, "spi_transfer");
+  spi_mock_check(spi_mock_answer(reg, first, 2U), "data");
+
+  printf("\n%u transfers, %u started from the completion interrupt, %s\n",
+         spi_mock_transfers, spi_mock_chained,
+         (spi_mock_failed == 0U) ? "all checks passed" : "CHECKS FAILED");
+  return (spi_mock_failed == 0U) ? 0 : 1;
+}
@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+#
+# swodump.py
+#
+#  Created on: Oct 19, 2026
+#      Author: ci
+#
+# Decodes a SWO byte stream (ITM packets, NRZ capture, formatter off) into
+# events, see itm.h. The stream comes from a probe (e.g. OpenOCD
+# "tpiu config internal swo.bin uart off 168000000 2000000") or from the
+# host stand-in tools/itm_file.c.
+#
+#   $ tools/swodump.py swo.bin                # all events
+#   $ tools/swodump.py swo.bin --text 0       # port 0 as a text console
+#   $ tools/swodump.py swo.bin --hz 168000000 # times in seconds
+#
+# Local timestamps are added up from the start of the capture; the time of
+# an event is taken from the timestamp packet that follows it.
+
+import argparse
+import sys
+
+
+class Decoder:
+    """ITM/DWT packet parser; feed() bytes, events come out of emit()."""
+
+    def __init__(self, emit):
+        self.emit = emit
+        self.time = 0
+        self.pending = []
+        self.zeros = 0
+        self.state = self.header
+        self.need = 0
+        self.payload = []
+        self.kind = None
+
+    def feed(self, data):
+        for b in data:
+            self.state(b)
+
+    def flush(self):
+        for event in self.pending:
+            self.emit(self.time, *event)
+        self.pending = []
+
+    def event(self, *event):
+        self.pending.append(event)
+
+    # Header byte
+    def header(self, b):
+        if b == 0x00:
+            self.zeros += 1
+            return
+        if self.zeros > 0:
+            if b == 0x80 and self.zeros >= 5:
+                self.flush()
+                self.event("sync")
+                self.zeros = 0
+                return
+            self.zeros = 0
+
+        if b == 0x70:
+            self.event("overflow")
+        elif (b & 0x03) != 0:
+            # Source packet: software (instrumentation) or hardware (DWT)
+            size = {1: 1, 2: 2, 3: 4}[b & 0x03]
+            self.kind = ("hw" if b & 0x04 else "port", b >> 3, size)
+            self.need = size
+            self.payload = []
+            self.state = self.source
+        elif (b & 0x0F) == 0x00:
+            if b & 0x80:
+                # Local timestamp format 1, continuation bytes follow
+                self.kind = ("lts", (b >> 4) & 0x03)
+                self.payload = []
+                self.state = self.continuation
+            else:
+                # Local timestamp format 2, the value is in the header
+                self.timestamp((b >> 4) & 0x07)
+        elif b in (0x94, 0xB4) or (b & 0x0B) == 0x08:
+            # Global timestamps and extension packets: skipped
+            self.kind = ("skip",)
+            self.payload = []
+            self.state = self.continuation if b & 0x80 else self.header
+        else:
+            self.event("unknown", b)
+
+    def source(self, b):
+        self.payload.append(b)
+        if len(self.payload) < self.need:
+            return
+        value = 0
+        for i, byte in enumerate(self.payload):
+            value |= byte << (8 * i)
+        source, port, size = self.kind
+        self.event(source, port, value, size)
+        self.state = self.header
+
+    def continuation(self, b):
+        self.payload.append(b)
+        if (b & 0x80) and len(self.payload) < 4:
+            return
+        if self.kind[0] == "lts":
+            value = 0
+            for i, byte in enumerate(self.payload):
+                value |= (byte & 0x7F) << (7 * i)
+            self.timestamp(value)
+        self.state = self.header
+
+    def timestamp(self, delta):
+        self.time += delta
+        self.flush()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode an ITM/SWO stream.")
+    parser.add_argument("swo", help="SWO capture, - for stdin")
+    parser.add_argument("--text", type=int, action="append", default=[],
+                        metavar="PORT", help="print this port as text")
+    parser.add_argument("--hz", type=float,
+                        help="core clock, to print times instead of cycles")
+    args = parser.parse_args()
+
+    def stamp(time):
+        return ("%12.6f" % (time / args.hz)) if args.hz else ("%12u" % time)
+
+    def emit(time, kind, *rest):
+        if kind == "port" and rest[0] in args.text:
+            sys.stdout.write("".join(chr((rest[1] >> (8 * i)) & 0xFF)
+                                     for i in range(rest[2])))
+        elif kind in ("port", "hw"):
+            port, value, size = rest
+            print("%s  %-4s %2u  0x%0*x" % (stamp(time), kind, port,
+                                              2 * size, value))
+        elif kind == "unknown":
+            print("%s  unknown header 0x%02x" % (stamp(time), rest[0]))
+        elif not args.text:
+            print("%s  %s" % (stamp(time), kind))
+
+    stream = sys.stdin.buffer if args.swo == "-" else open(args.swo, "rb")
+    decoder = Decoder(emit)
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            break
+        decoder.feed(chunk)
+    decoder.flush()
+
+
+if __name__ == "__main__":
+    main()
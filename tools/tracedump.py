@@ -0,0 +1,139 @@
+#!/usr/bin/env python3
+#
+# tracedump.py
+#
+#  Created on: Oct 19, 2026
+#      Author: ci
+#
+# Formats the binary trace (see trace.h; the default, without TRACE_TEXT),
+# taking the format strings from the ELF.
+#
+# Each record is little endian 32 bit words: header (0x5452 << 16 | number
+# of words), address of the format string, DWT cycle count, arguments.
+#
+#   $ tools/tracedump.py firmware.elf trace.bin --hz 168000000
+#   $ cat /dev/ttyUSB0 | tools/tracedump.py firmware.elf -
+#
+# Only the standard library is used; the ELF is read directly.
+
+import argparse
+import re
+import struct
+import sys
+
+TRACE_HEADER_MAGIC = 0x5452
+TRACE_ARGS_MAX = 8
+
+SHT_NOBITS = 8
+
+CONVERSION = re.compile(
+    r"%([-+ #0]*)(\*|\d+)?(?:\.(\d+))?(hh|h|ll|l|z|t|j)?([diouxXcsp%])")
+
+
+class Elf:
+    """The loaded sections of a 32 bit little endian ELF, by address."""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF" or self.data[4] != 1 or self.data[5] != 1:
+            sys.exit("%s: not a 32 bit little endian ELF" % path)
+
+        shoff, = struct.unpack_from("<I", self.data, 0x20)
+        shentsize, shnum = struct.unpack_from("<HH", self.data, 0x2E)
+
+        self.sections = []
+        for i in range(shnum):
+            (name, stype, flags, addr, offset, size) = struct.unpack_from(
+                "<IIIIII", self.data, shoff + i * shentsize)
+            if addr != 0 and size != 0 and stype != SHT_NOBITS:
+                self.sections.append((addr, offset, size))
+
+    def string(self, address):
+        for addr, offset, size in self.sections:
+            if addr <= address < addr + size:
+                start = offset + address - addr
+                end = self.data.find(b"\0", start, offset + size)
+                if end < 0:
+                    return None
+                return self.data[start:end].decode("latin-1")
+        return None
+
+
+def format_record(elf, fmt, args):
+    args = list(args)
+
+    def convert(match):
+        flags, width, precision, _, conv = match.groups()
+        if conv == "%":
+            return "%"
+        value = args.pop(0) if args else 0
+        spec = "%" + (flags or "") + (width if width and width != "*" else "")
+        if precision is not None:
+            spec += "." + precision
+        if conv in "di":
+            return (spec + "d") % (value - (1 << 32) if value & 0x80000000 else value)
+        if conv in "ouxX":
+            return (spec + ("d" if conv == "u" else conv)) % value
+        if conv == "c":
+            return (spec + "c") % chr(value & 0xFF)
+        if conv == "p":
+            return (spec + "s") % ("0x%08x" % value)
+        s = elf.string(value)
+        return (spec + "s") % (s if s is not None else "<0x%08x>" % value)
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def records(stream):
+    buf = b""
+    while True:
+        chunk = stream.read(4096)
+        if not chunk:
+            return
+        buf += chunk
+        while len(buf) >= 12:
+            header, = struct.unpack_from("<I", buf, 0)
+            words = header & 0xFF
+            if (header >> 16) != TRACE_HEADER_MAGIC or not 3 <= words <= 3 + TRACE_ARGS_MAX:
+                # Out of step, e.g. the capture started mid record
+                buf = buf[1:]
+                continue
+            if len(buf) < words * 4:
+                break
+            yield struct.unpack_from("<%dI" % words, buf, 0)
+            buf = buf[words * 4:]
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Format a carzos binary trace against the ELF.")
+    parser.add_argument("elf")
+    parser.add_argument("trace", help="binary trace, - for stdin")
+    parser.add_argument("--hz", type=float,
+                        help="core clock, to print times instead of cycles")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    stream = sys.stdin.buffer if args.trace == "-" else open(args.trace, "rb")
+
+    first = None
+    for record in records(stream):
+        fmt = elf.string(record[1])
+        if fmt is None:
+            print("?? unknown format 0x%08x" % record[1])
+            continue
+
+        cycles = record[2]
+        if first is None:
+            first = cycles
+        delta = (cycles - first) & 0xFFFFFFFF
+        stamp = ("%12.6f" % (delta / args.hz)) if args.hz else ("%10u" % delta)
+
+        sys.stdout.write("%s  %s" % (stamp, format_record(elf, fmt, record[3:])))
+        if not fmt.endswith("\n"):
+            sys.stdout.write("\n")
+
+
+if __name__ == "__main__":
+    main()